@@ -240,6 +240,8 @@ SOURCES += src\protobuf\google\protobuf\any.cc \
     src\asyncrpcqueue.cpp \
     src\base58.cpp \
     src\bech32.cpp \
+    src\blockencodings.cpp \
+    src\blockfilewriter.cpp \
     src\bloom.cpp \
     src\chain.cpp \
     src\chainparamsbase.cpp \
@@ -430,6 +432,7 @@ SOURCES += src\protobuf\google\protobuf\any.cc \
     src\sendalert.cpp \
     src\support\cleanse.cpp \
     src\support\pagelocker.cpp \
+    src\support\pool.cpp \
     src\sync.cpp \
     src\sys\time.cpp \
     src\threadinterrupt.cpp \
@@ -498,6 +501,7 @@ SOURCES += src\protobuf\google\protobuf\any.cc \
     src\paymentdisclosuredb.cpp \
     src\script\cc.cpp \
     src\wallet\asyncrpcoperation_mergetoaddress.cpp \
+    src\wallet\asyncrpcoperation_rescan.cpp \
     src\wallet\asyncrpcoperation_shieldcoinbase.cpp \
     src\wallet\rpcdisclosure.cpp \
     src\cryptoconditions\src\cryptoconditions.cpp \
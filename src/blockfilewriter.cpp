@@ -0,0 +1,259 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "blockfilewriter.h"
+
+#include "main.h"
+#include "util.h"
+
+#include <boost/bind.hpp>
+
+/** Most files kept open between batches. */
+static const size_t MAX_OPEN_FILES = 8;
+
+CBlockFileWriter blockFileWriter;
+
+CBlockFileWriter::CBlockFileWriter() : nQueuedBytes(0), nSeq(0), nDoneSeq(0), fFailed(false), fStop(false), pthread(NULL)
+{
+}
+
+CBlockFileWriter::~CBlockFileWriter()
+{
+    Stop();
+    boost::mutex::scoped_lock lockFiles(csFiles);
+    CloseFiles();
+}
+
+void CBlockFileWriter::Start()
+{
+    boost::mutex::scoped_lock lock(cs);
+    if (pthread)
+        return;
+    fStop = false;
+    pthread = new boost::thread(boost::bind(&CBlockFileWriter::ThreadWrite, this));
+}
+
+void CBlockFileWriter::Stop()
+{
+    boost::thread* pthreadStop;
+    {
+        boost::mutex::scoped_lock lock(cs);
+        if (!pthread)
+            return;
+        fStop = true;
+        pthreadStop = pthread;
+    }
+    condWork.notify_all();
+    pthreadStop->join();
+    delete pthreadStop;
+    {
+        boost::mutex::scoped_lock lock(cs);
+        pthread = NULL;
+    }
+}
+
+bool CBlockFileWriter::Submit(Op& op, bool fWait)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (fFailed)
+        return false;
+    if (!pthread) {
+        lock.unlock();
+        std::deque<Op> ops(1, op);
+        Process(ops);
+        lock.lock();
+        return !fFailed;
+    }
+
+    if (op.type == OP_WRITE) {
+        while (nQueuedBytes > MAX_BLOCK_WRITE_QUEUE_BYTES && !fFailed)
+            condDone.wait(lock);
+        mapPending[std::make_pair(FileKey(op.fUndo, op.pos.nFile), op.pos.nPos + RECORD_HEADER_SIZE)] = op.data;
+        nQueuedBytes += op.data->size();
+    }
+    op.nSeq = ++nSeq;
+    mapLastSeq[FileKey(op.fUndo, op.pos.nFile)] = op.nSeq;
+    queue.push_back(op);
+    condWork.notify_one();
+
+    while (fWait && nDoneSeq < op.nSeq && !fFailed)
+        condDone.wait(lock);
+    return !fFailed;
+}
+
+bool CBlockFileWriter::Write(bool fUndo, const CDiskBlockPos& pos, CSerializeData& vData)
+{
+    std::shared_ptr<CSerializeData> data = std::make_shared<CSerializeData>();
+    data->swap(vData);
+    Op op = {OP_WRITE, fUndo, pos, (unsigned int)data->size(), 0, false, data, 0};
+    return Submit(op, false);
+}
+
+bool CBlockFileWriter::Allocate(bool fUndo, const CDiskBlockPos& pos, unsigned int nLength)
+{
+    Op op = {OP_ALLOCATE, fUndo, pos, nLength, 0, false, std::shared_ptr<const CSerializeData>(), 0};
+    return Submit(op, false);
+}
+
+bool CBlockFileWriter::Sync(int nFile, bool fFinalize, unsigned int nBlockSize, unsigned int nUndoSize)
+{
+    Op op = {OP_SYNC, false, CDiskBlockPos(nFile, 0), nBlockSize, nUndoSize, fFinalize, std::shared_ptr<const CSerializeData>(), 0};
+    return Submit(op, true);
+}
+
+std::shared_ptr<const CSerializeData> CBlockFileWriter::GetPending(bool fUndo, const CDiskBlockPos& pos)
+{
+    boost::mutex::scoped_lock lock(cs);
+    std::map<std::pair<FileKey, unsigned int>, std::shared_ptr<const CSerializeData> >::iterator it = mapPending.find(std::make_pair(FileKey(fUndo, pos.nFile), pos.nPos));
+    if (it == mapPending.end())
+        return std::shared_ptr<const CSerializeData>();
+    return it->second;
+}
+
+void CBlockFileWriter::WaitForFile(bool fUndo, int nFile)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    std::map<FileKey, uint64_t>::iterator it = mapLastSeq.find(FileKey(fUndo, nFile));
+    if (it == mapLastSeq.end())
+        return;
+    uint64_t nSeqWait = it->second;
+    while (nDoneSeq < nSeqWait && !fFailed)
+        condDone.wait(lock);
+}
+
+FILE* CBlockFileWriter::GetFile(const FileKey& key)
+{
+    std::map<FileKey, FILE*>::iterator it = mapFiles.find(key);
+    if (it != mapFiles.end())
+        return it->second;
+    if (mapFiles.size() >= MAX_OPEN_FILES)
+        CloseFiles();
+    CDiskBlockPos pos(key.second, 0);
+    FILE* file = key.first ? OpenUndoFile(pos) : OpenBlockFile(pos);
+    if (file)
+        mapFiles[key] = file;
+    return file;
+}
+
+void CBlockFileWriter::CloseFiles()
+{
+    for (std::map<FileKey, FILE*>::iterator it = mapFiles.begin(); it != mapFiles.end(); it++)
+        fclose(it->second);
+    mapFiles.clear();
+}
+
+bool CBlockFileWriter::ProcessOp(const Op& op)
+{
+    FileKey key(op.fUndo, op.pos.nFile);
+    const char* prefix = op.fUndo ? "rev" : "blk";
+    switch (op.type) {
+    case OP_WRITE: {
+        FILE* file = GetFile(key);
+        if (!file)
+            return error("%s: cannot open %s%05u.dat", __func__, prefix, op.pos.nFile);
+        if (fseek(file, op.pos.nPos, SEEK_SET) || fwrite(&(*op.data)[0], 1, op.data->size(), file) != op.data->size())
+            return error("%s: cannot write %u bytes at %u of %s%05u.dat", __func__, op.data->size(), op.pos.nPos, prefix, op.pos.nFile);
+        setUnsynced.insert(key);
+        break;
+    }
+    case OP_ALLOCATE: {
+        FILE* file = GetFile(key);
+        if (!file)
+            return error("%s: cannot open %s%05u.dat", __func__, prefix, op.pos.nFile);
+        LogPrintf("Pre-allocating up to position 0x%x in %s%05u.dat\n", op.pos.nPos + op.nLength, prefix, op.pos.nFile);
+        AllocateFileRange(file, op.pos.nPos, op.nLength);
+        setUnsynced.insert(key);
+        break;
+    }
+    case OP_SYNC: {
+        if (op.fFinalize) {
+            FILE* file = GetFile(FileKey(false, op.pos.nFile));
+            if (file && (fflush(file) || !TruncateFile(file, op.nLength)))
+                LogPrintf("%s: cannot truncate blk%05u.dat\n", __func__, op.pos.nFile);
+            file = GetFile(FileKey(true, op.pos.nFile));
+            if (file && (fflush(file) || !TruncateFile(file, op.nUndoSize)))
+                LogPrintf("%s: cannot truncate rev%05u.dat\n", __func__, op.pos.nFile);
+        }
+        // One fsync per file written since the last sync, however many records it took.
+        setUnsynced.insert(FileKey(false, op.pos.nFile));
+        setUnsynced.insert(FileKey(true, op.pos.nFile));
+        for (std::set<FileKey>::iterator it = setUnsynced.begin(); it != setUnsynced.end(); it++) {
+            FILE* file = GetFile(*it);
+            if (file)
+                FileCommit(file);
+        }
+        setUnsynced.clear();
+        CloseFiles();
+        break;
+    }
+    }
+    return true;
+}
+
+void CBlockFileWriter::Process(std::deque<Op>& ops)
+{
+    bool fOk = true;
+    {
+        boost::mutex::scoped_lock lockFiles(csFiles);
+        for (std::deque<Op>::iterator it = ops.begin(); it != ops.end() && fOk; it++)
+            fOk = ProcessOp(*it);
+        // Make the batch visible to readers opening the files themselves.
+        for (std::map<FileKey, FILE*>::iterator it = mapFiles.begin(); it != mapFiles.end(); it++)
+            fflush(it->second);
+    }
+    if (!fOk) {
+        boost::mutex::scoped_lock lock(cs);
+        fFailed = true;
+    }
+}
+
+void CBlockFileWriter::ThreadWrite()
+{
+    RenameThread("zcash-blkwrite");
+    while (true) {
+        std::deque<Op> ops;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (queue.empty() && !fStop)
+                condWork.wait(lock);
+            if (queue.empty())
+                break;
+            ops.swap(queue);
+        }
+
+        Process(ops);
+
+        {
+            boost::mutex::scoped_lock lock(cs);
+            for (std::deque<Op>::const_iterator it = ops.begin(); it != ops.end(); it++) {
+                if (it->type != OP_WRITE)
+                    continue;
+                std::map<std::pair<FileKey, unsigned int>, std::shared_ptr<const CSerializeData> >::iterator itPending =
+                    mapPending.find(std::make_pair(FileKey(it->fUndo, it->pos.nFile), it->pos.nPos + RECORD_HEADER_SIZE));
+                if (itPending != mapPending.end() && itPending->second == it->data)
+                    mapPending.erase(itPending);
+                nQueuedBytes -= it->data->size();
+            }
+            nDoneSeq = ops.back().nSeq;
+            for (std::map<FileKey, uint64_t>::iterator it = mapLastSeq.begin(); it != mapLastSeq.end(); ) {
+                if (it->second <= nDoneSeq)
+                    mapLastSeq.erase(it++);
+                else
+                    it++;
+            }
+        }
+        condDone.notify_all();
+    }
+}
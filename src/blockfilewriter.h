@@ -0,0 +1,128 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef BITCOIN_BLOCKFILEWRITER_H
+#define BITCOIN_BLOCKFILEWRITER_H
+
+#include "chain.h"
+#include "support/allocators/zeroafterfree.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/** Most bytes of block and undo records waiting to be written before writers have to wait. */
+static const size_t MAX_BLOCK_WRITE_QUEUE_BYTES = 64 * 1024 * 1024;
+
+/**
+ * Writes block and undo records to the blk and rev files on a thread of its
+ * own. Positions are still reserved synchronously by FindBlockPos and
+ * FindUndoPos; only the file I/O is deferred. Records are written in the
+ * order they were queued, each batch is flushed to the OS once, and files are
+ * only fsync'ed at Sync, which is where callers wait for the disk.
+ *
+ * Until a queued record is written, GetPending returns it so it can be read
+ * without touching the disk; opening a file for reading waits for its
+ * pending records with WaitForFile.
+ *
+ * When the thread is not running, every request is carried out directly.
+ */
+class CBlockFileWriter
+{
+public:
+    CBlockFileWriter();
+    ~CBlockFileWriter();
+
+    void Start();
+    //! Write out everything queued and stop the thread.
+    void Stop();
+
+    /**
+     * Queue a record for the blk (fUndo false) or rev file, to be written at
+     * pos. The record starts with the network magic and its size, and vData
+     * is swapped out. Waits while too much is queued already.
+     */
+    bool Write(bool fUndo, const CDiskBlockPos& pos, CSerializeData& vData);
+    //! Queue preallocation of nLength bytes from pos.
+    bool Allocate(bool fUndo, const CDiskBlockPos& pos, unsigned int nLength);
+    /**
+     * Write out everything queued, then fsync every file written since the
+     * last Sync. With fFinalize, the blk and rev files of nFile are first
+     * truncated to nBlockSize and nUndoSize.
+     */
+    bool Sync(int nFile, bool fFinalize, unsigned int nBlockSize, unsigned int nUndoSize);
+
+    /**
+     * The record whose data starts at pos, if it is not written yet. The data
+     * starts at offset RECORD_HEADER_SIZE of the returned buffer.
+     */
+    std::shared_ptr<const CSerializeData> GetPending(bool fUndo, const CDiskBlockPos& pos);
+    //! Wait until the records queued so far for a file are written.
+    void WaitForFile(bool fUndo, int nFile);
+
+    //! Network magic and record size in front of each record.
+    static const unsigned int RECORD_HEADER_SIZE = 8;
+
+private:
+    enum OpType { OP_WRITE, OP_ALLOCATE, OP_SYNC };
+    struct Op {
+        OpType type;
+        bool fUndo;
+        CDiskBlockPos pos;
+        unsigned int nLength;       //! Bytes to allocate, or the blk file size to truncate to
+        unsigned int nUndoSize;
+        bool fFinalize;
+        std::shared_ptr<const CSerializeData> data;
+        uint64_t nSeq;
+    };
+    typedef std::pair<bool, int> FileKey;
+
+    boost::mutex cs;
+    boost::condition_variable condWork;
+    boost::condition_variable condDone;
+    std::deque<Op> queue;
+    std::map<std::pair<FileKey, unsigned int>, std::shared_ptr<const CSerializeData> > mapPending;
+    std::map<FileKey, uint64_t> mapLastSeq;
+    size_t nQueuedBytes;
+    uint64_t nSeq;
+    uint64_t nDoneSeq;
+    bool fFailed;
+    bool fStop;
+    boost::thread* pthread;
+
+    //! Only touched by whoever processes ops: the thread, or the caller while it is not running.
+    boost::mutex csFiles;
+    std::map<FileKey, FILE*> mapFiles;
+    std::set<FileKey> setUnsynced;
+
+    bool Submit(Op& op, bool fWait);
+    void Process(std::deque<Op>& ops);
+    bool ProcessOp(const Op& op);
+    FILE* GetFile(const FileKey& key);
+    void CloseFiles();
+    void ThreadWrite();
+
+    CBlockFileWriter(const CBlockFileWriter&);
+    CBlockFileWriter& operator=(const CBlockFileWriter&);
+};
+
+extern CBlockFileWriter blockFileWriter;
+
+#endif // BITCOIN_BLOCKFILEWRITER_H
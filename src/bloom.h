@@ -68,9 +68,10 @@ private:
 
     unsigned int Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const;
 
-    // Private constructor for CRollingBloomFilter, no restrictions on size
+    // Private constructor for CRollingBloomFilter and the keystore's owned filter, no restrictions on size
     CBloomFilter(unsigned int nElements, double nFPRate, unsigned int nTweak);
     friend class CRollingBloomFilter;
+    friend class CBasicKeyStore;
 
 public:
     /**
@@ -30,6 +30,11 @@ UniValue GatewaysMarkDone(const CPubKey& pk, uint64_t txfee,uint256 withdrawtxid
 UniValue GatewaysPendingDeposits(const CPubKey& pk, uint256 bindtxid,std::string refcoin);
 UniValue GatewaysPendingWithdraws(const CPubKey& pk, uint256 bindtxid,std::string refcoin);
 UniValue GatewaysProcessedWithdraws(const CPubKey& pk, uint256 bindtxid,std::string refcoin);
+void GatewaysQueueBlockConnected(const CBlock &block);
+void GatewaysQueueBlockDisconnected(const CBlock &block);
+void GatewaysQueueTxAccepted(const CTransaction &tx);
+bool GatewaysQueueTxids(uint256 bindtxid, char *addr, std::vector<uint256> &txids);
+uint64_t GatewaysQueueWait(const CPubKey &pk, uint256 bindtxid, uint64_t sequence, int64_t nMillis);
 
 // CCcustom
 UniValue GatewaysInfo(uint256 bindtxid);
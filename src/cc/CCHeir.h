@@ -23,6 +23,8 @@
 //#define EVAL_HEIR 0xea
 
 bool HeirValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &tx, uint32_t nIn);
+void HeirBlockConnected(int32_t height, const CBlock &block);
+void HeirBlockDisconnected(const CBlock &block);
 
 class CoinHelper;
 class TokenHelper;
@@ -28,6 +28,9 @@ UniValue OracleData(const CPubKey& pk, int64_t txfee,uint256 oracletxid,std::vec
 // CCcustom
 UniValue OracleDataSample(uint256 reforacletxid,uint256 txid);
 UniValue OracleDataSamples(uint256 reforacletxid,char* batonaddr,int32_t num);
+UniValue OracleDataSamplesRange(uint256 reforacletxid,char *batonaddr,int32_t fromheight,int32_t toheight);
+void OraclesBlockConnected(int32_t height,const CBlock &block);
+void OraclesBlockDisconnected(const CBlock &block);
 UniValue OracleInfo(uint256 origtxid);
 UniValue OraclesList();
 
@@ -23,8 +23,12 @@
 
 #define PAYMENTS_TXFEE 10000
 #define PAYMENTS_MERGEOFSET 60 // 1H extra. 
+// the daily address snapshot and the height it was taken at, both guarded by cs_addresssnapshot
+extern CCriticalSection cs_addresssnapshot;
 extern std::vector <std::pair<CAmount, CTxDestination>> vAddressSnapshot;
 extern int32_t lastSnapShotHeight;
+void komodo_setaddresssnapshot(int32_t height, std::vector <std::pair<CAmount, CTxDestination>> &vSnapshot);
+int32_t payments_getallocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys,  std::vector<int64_t> &allocations);
 
 bool PaymentsValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &tx, uint32_t nIn);
 
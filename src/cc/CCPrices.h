@@ -20,6 +20,7 @@
 #include "komodo_defs.h"
 #include "CCinclude.h"
 int32_t komodo_priceget(int64_t *buf64,int32_t ind,int32_t height,int32_t numblocks);
+int32_t komodo_pricegetbatch(int64_t *buf64,int32_t *retvals,const int32_t *inds,int32_t numinds,int32_t height,int32_t numblocks);
 extern void GetKomodoEarlytxidScriptPub();
 extern CScript KOMODO_EARLYTXID_SCRIPTPUB;
 
@@ -46,6 +47,51 @@ extern CScript KOMODO_EARLYTXID_SCRIPTPUB;
 #define PRICES_MINAVAILFUNDFRACTION  0.1                             // leveraged bet limit < fund fraction
 
 bool PricesValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &tx, uint32_t nIn);
+void PricesBlockConnected(int32_t height, const CBlock &block);
+void PricesBlockDisconnected(int32_t height);
+
+typedef struct OneBetData {
+    int64_t positionsize;
+    int32_t firstheight;
+    int64_t costbasis;
+    int64_t profits;
+
+    OneBetData() { positionsize = 0; firstheight = 0; costbasis = 0; profits = 0; }  // it is important to clear costbasis as it will be calculated as minmax from inital value 0
+} onebetdata;
+
+typedef struct BetInfo {
+    uint256 txid;
+    int64_t averageCostbasis, firstprice, lastprice, liquidationprice, equity;
+    int64_t exitfee;
+    int32_t lastheight;
+    int16_t leverage;
+    bool isOpen, isRekt;
+    uint256 tokenid;
+
+    std::vector<uint16_t> vecparsed;
+    std::vector<onebetdata> bets;
+    CPubKey pk;
+
+    bool isUp;
+
+    BetInfo() { 
+        averageCostbasis = firstprice = lastprice = liquidationprice = equity = 0;
+        lastheight = 0;
+        leverage = 0;
+        exitfee = 0;
+        isOpen = isRekt = isUp = false;
+    }
+} BetInfo;
+
+// bet scans kept between rpcs and continued by connected blocks, at most PRICES_MAXSCANS
+#define PRICES_MAXSCANS 256
+int32_t prices_scanchain(uint256 bettxid, BetInfo &betinfo);
+// last scanned height and number of positions of the kept scan of bettxid, false if none is kept
+bool PricesBetScanInfo(uint256 bettxid, int32_t &height, int32_t &numpositions);
+
+// synthetic price on the j-th of numblocks rows of the prices komodo_pricegetbatch read for the indices of vec
+int64_t prices_interpretpricedata(const std::vector<uint16_t> &vec, const int64_t *prices, const int32_t *retvals, int32_t numblocks, int32_t j);
+bool prices_evalsynthetic(const std::vector<uint16_t> &vec, const int64_t *prices, int32_t numblocks, int32_t j, int64_t &price);
 
 // CCcustom
 UniValue PricesBet(int64_t txfee,int64_t amount,int16_t leverage,std::vector<std::string> synthetic);
@@ -17,140 +17,404 @@
 #include "CCtokens.h"
 
 
-UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode)
+// The Assets CC order book: unspent orders at the Assets CC global addresses, read from the
+// address index on first use and then kept up to date by AssetsBookBlockConnected and
+// AssetsBookBlockDisconnected, so that tokenorders does not read any transaction.
+// Orders are kept in the order the address index lists them: by address, then by outpoint.
+
+#define ASSETS_BOOK_COINS (-1)      // address kind of the bids, the asks are at the tokens addresses of each evalcode2
+#define ASSETS_BOOK_MAXUNDO 100     // connected blocks whose spent orders are kept for a disconnect
+
+struct CAssetOrder {
+    int32_t kind;
+    uint8_t funcid;
+    uint256 assetid, assetid2;
+    int64_t price;
+    std::vector<uint8_t> origpubkey;
+    int64_t nValue;                 // value of the order output
+    int64_t nValue0;                // value of vout 0 of the order tx
+};
+typedef std::pair<int32_t, COutPoint> CAssetOrderKey;
+
+static CCriticalSection cs_assetsbook;
+static bool fAssetsBookLoaded;
+static std::map<std::string, int32_t> mapAssetsBookAddresses;
+static std::map<COutPoint, CAssetOrder> mapAssetOrders;
+static std::set<CAssetOrderKey> setAssetOrders;
+static std::map<uint256, std::set<CAssetOrderKey> > mapAssetTokenOrders;
+static std::deque<std::pair<uint256, std::vector<std::pair<COutPoint, CAssetOrder> > > > assetsBookUndo;
+static uint64_t nAssetsBookBlocks;  // bumped on each block, a load across a block is not kept
+
+static CWaitableCriticalSection cs_assetsbookchanges;
+static CConditionVariable cvAssetsBookChange;
+static uint64_t nAssetsBookSequence;
+static std::map<uint256, uint64_t> mapAssetsBookTokenSequence;
+
+static bool AssetsDecodeOrder(const CTransaction &ordertx, int32_t n, int32_t kind, CAssetOrder &order)
 {
-	UniValue result(UniValue::VARR);  
+    uint8_t evalCode;
+    if (n >= ordertx.vout.size() || (order.funcid = DecodeAssetTokenOpRet(ordertx.vout.back().scriptPubKey, evalCode, order.assetid, order.assetid2, order.price, order.origpubkey)) == 0)
+        return false;
+    order.kind = kind;
+    order.nValue = ordertx.vout[n].nValue;
+    order.nValue0 = ordertx.vout[0].nValue;
+    return true;
+}
+
+static void AssetsScanOrders(int32_t kind, char *addr, std::vector<std::pair<COutPoint, CAssetOrder> > &orders)
+{
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    SetCCunspents(unspentOutputs, addr, true);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++)
+    {
+        CTransaction ordertx;
+        uint256 hashBlock;
+        CAssetOrder order;
+
+        LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "AssetsScanOrders() checking txid=" << it->first.txhash.GetHex() << std::endl);
+        if (myGetTransaction(it->first.txhash, ordertx, hashBlock) != 0 && AssetsDecodeOrder(ordertx, it->first.index, kind, order))
+            orders.push_back(std::make_pair(COutPoint(it->first.txhash, it->first.index), order));
+    }
+}
+
+// address of the given kind, cp is an Assets CC
+static void AssetsBookAddress(struct CCcontract_info *cp, int32_t kind, char *addr)
+{
+    if (kind == ASSETS_BOOK_COINS)
+        GetCCaddress(cp, addr, GetUnspendable(cp, NULL));
+    else {
+        cp->additionalTokensEvalcode2 = kind;
+        GetTokensCCaddress(cp, addr, GetUnspendable(cp, NULL));
+        cp->additionalTokensEvalcode2 = 0;
+    }
+}
+
+static void AssetsBookNotify(const uint256 &assetid)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_assetsbookchanges);
+        mapAssetsBookTokenSequence[assetid] = ++nAssetsBookSequence;
+    }
+    cvAssetsBookChange.notify_all();
+}
+
+static void AssetsBookAdd(const COutPoint &outpoint, const CAssetOrder &order)
+{
+    CAssetOrderKey key(order.kind, outpoint);
+    if (!mapAssetOrders.insert(std::make_pair(outpoint, order)).second)
+        return;
+    setAssetOrders.insert(key);
+    mapAssetTokenOrders[order.assetid].insert(key);
+    AssetsBookNotify(order.assetid);
+}
 
+static bool AssetsBookRemove(const COutPoint &outpoint, CAssetOrder &order)
+{
+    std::map<COutPoint, CAssetOrder>::iterator it = mapAssetOrders.find(outpoint);
+    if (it == mapAssetOrders.end())
+        return false;
+    order = it->second;
+    mapAssetOrders.erase(it);
+    CAssetOrderKey key(order.kind, outpoint);
+    setAssetOrders.erase(key);
+    std::map<uint256, std::set<CAssetOrderKey> >::iterator itToken = mapAssetTokenOrders.find(order.assetid);
+    if (itToken != mapAssetTokenOrders.end()) {
+        itToken->second.erase(key);
+        if (itToken->second.empty())
+            mapAssetTokenOrders.erase(itToken);
+    }
+    AssetsBookNotify(order.assetid);
+    return true;
+}
+
+static void AssetsBookUnload()
+{
+    fAssetsBookLoaded = false;
+    mapAssetOrders.clear();
+    setAssetOrders.clear();
+    mapAssetTokenOrders.clear();
+    assetsBookUndo.clear();
+    AssetsBookNotify(zeroid);
+}
+
+// scans the addresses without cs_main, the result is dropped if a block was connected or disconnected meanwhile
+static void AssetsBookLoad()
+{
     struct CCcontract_info *cpAssets, assetsC;
-    struct CCcontract_info *cpTokens, tokensC;
+    char addr[64];
+    std::map<std::string, int32_t> addresses;
+    std::vector<std::pair<COutPoint, CAssetOrder> > orders;
+    uint64_t blocks;
 
+    {
+        LOCK(cs_assetsbook);
+        if (fAssetsBookLoaded)
+            return;
+        blocks = nAssetsBookBlocks;
+    }
     cpAssets = CCinit(&assetsC, EVAL_ASSETS);
-    cpTokens = CCinit(&tokensC, EVAL_TOKENS);
+    for (int32_t kind = ASSETS_BOOK_COINS; kind <= 0xff; kind++) {
+        AssetsBookAddress(cpAssets, kind, addr);
+        addresses[addr] = kind;
+        AssetsScanOrders(kind, addr, orders);
+    }
 
-	auto addOrders = [&](struct CCcontract_info *cp, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it)
-	{
-		uint256 txid, hashBlock, assetid, assetid2;
-		int64_t price;
-		std::vector<uint8_t> origpubkey;
-		CTransaction ordertx;
-		uint8_t funcid, evalCode;
-		char numstr[32], funcidstr[16], origaddr[64], origtokenaddr[64];
-
-        txid = it->first.txhash;
-        LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() checking txid=" << txid.GetHex() << std::endl);
-        if ( myGetTransaction(txid, ordertx, hashBlock) != 0 )
-        {
-			// for logging: funcid = DecodeAssetOpRet(vintx.vout[vintx.vout.size() - 1].scriptPubKey, evalCode, assetid, assetid2, price, origpubkey);
-            if (ordertx.vout.size() > 0 && (funcid = DecodeAssetTokenOpRet(ordertx.vout[ordertx.vout.size()-1].scriptPubKey, evalCode, assetid, assetid2, price, origpubkey)) != 0)
-            {
-                LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() checking ordertx.vout.size()=" << ordertx.vout.size() << " funcid=" << (char)(funcid ? funcid : ' ') << " assetid=" << assetid.GetHex() << std::endl);
-
-                if (pk == CPubKey() && (refassetid == zeroid || assetid == refassetid)  // tokenorders
-                    || pk != CPubKey() && pk == pubkey2pk(origpubkey) && (funcid == 'S' || funcid == 's'))  // mytokenorders, returns only asks (is this correct?)
-                {
-
-                    LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() it->first.index=" << it->first.index << " ordertx.vout[it->first.index].nValue=" << ordertx.vout[it->first.index].nValue << std::endl);
-                    if (ordertx.vout[it->first.index].nValue == 0) {
-                        LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "addOrders() order with value=0 skipped" << std::endl);
-                        return;
-                    }
-
-                    UniValue item(UniValue::VOBJ);
-
-                    funcidstr[0] = funcid;
-                    funcidstr[1] = 0;
-                    item.push_back(Pair("funcid", funcidstr));
-                    item.push_back(Pair("txid", txid.GetHex()));
-                    item.push_back(Pair("vout", (int64_t)it->first.index));
-                    if (funcid == 'b' || funcid == 'B')
-                    {
-                        sprintf(numstr, "%.8f", (double)ordertx.vout[it->first.index].nValue / COIN);
-                        item.push_back(Pair("amount", numstr));
-                        sprintf(numstr, "%.8f", (double)ordertx.vout[0].nValue / COIN);
-                        item.push_back(Pair("bidamount", numstr));
-                    }
-                    else
-                    {
-                        sprintf(numstr, "%llu", (long long)ordertx.vout[it->first.index].nValue);
-                        item.push_back(Pair("amount", numstr));
-                        sprintf(numstr, "%llu", (long long)ordertx.vout[0].nValue);
-                        item.push_back(Pair("askamount", numstr));
-                    }
-                    if (origpubkey.size() == CPubKey::COMPRESSED_PUBLIC_KEY_SIZE)
-                    {
-                        GetCCaddress(cp, origaddr, pubkey2pk(origpubkey));  
-                        item.push_back(Pair("origaddress", origaddr));
-                        GetTokensCCaddress(cpTokens, origtokenaddr, pubkey2pk(origpubkey));
-                        item.push_back(Pair("origtokenaddress", origtokenaddr));
-
-                    }
-                    if (assetid != zeroid)
-                        item.push_back(Pair("tokenid", assetid.GetHex()));
-                    if (assetid2 != zeroid)
-                        item.push_back(Pair("otherid", assetid2.GetHex()));
-                    if (price > 0)
-                    {
-                        if (funcid == 's' || funcid == 'S' || funcid == 'e' || funcid == 'e')
-                        {
-                            sprintf(numstr, "%.8f", (double)price / COIN);
-                            item.push_back(Pair("totalrequired", numstr));
-                            sprintf(numstr, "%.8f", (double)price / (COIN * ordertx.vout[0].nValue));
-                            item.push_back(Pair("price", numstr));
-                        }
-                        else
-                        {
-                            item.push_back(Pair("totalrequired", (int64_t)price));
-                            sprintf(numstr, "%.8f", (double)ordertx.vout[0].nValue / (price * COIN));
-                            item.push_back(Pair("price", numstr));
-                        }
-                    }
-                    result.push_back(item);
-                    LOGSTREAM("ccassets", CCLOG_DEBUG1, stream << "addOrders() added order funcId=" << (char)(funcid ? funcid : ' ') << " it->first.index=" << it->first.index << " ordertx.vout[it->first.index].nValue=" << ordertx.vout[it->first.index].nValue << " tokenid=" << assetid.GetHex() << std::endl);
-                }
+    LOCK(cs_assetsbook);
+    if (fAssetsBookLoaded || blocks != nAssetsBookBlocks)
+        return;
+    mapAssetsBookAddresses.swap(addresses);
+    for (int i = 0; i < orders.size(); i++)
+        AssetsBookAdd(orders[i].first, orders[i].second);
+    fAssetsBookLoaded = true;
+    LogPrint("ccassets", "AssetsBookLoad() loaded %u orders\n", (unsigned int)mapAssetOrders.size());
+}
+
+void AssetsBookBlockConnected(const CBlock &block)
+{
+    LOCK(cs_assetsbook);
+    nAssetsBookBlocks++;
+    if (!fAssetsBookLoaded) {
+        // waiters cannot tell what changed without the book
+        AssetsBookNotify(zeroid);
+        return;
+    }
+
+    std::vector<std::pair<COutPoint, CAssetOrder> > spent;
+    for (int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        CAssetOrder order;
+        char addr[64];
+
+        if (!tx.IsCoinBase()) {
+            for (int j = 0; j < tx.vin.size(); j++) {
+                if (AssetsBookRemove(tx.vin[j].prevout, order))
+                    spent.push_back(std::make_pair(tx.vin[j].prevout, order));
             }
         }
-	};
+        for (int j = 0; j < tx.vout.size(); j++) {
+            std::map<std::string, int32_t>::const_iterator it;
+            if (tx.vout[j].scriptPubKey.IsPayToCryptoCondition() && Getscriptaddress(addr, tx.vout[j].scriptPubKey) &&
+                (it = mapAssetsBookAddresses.find(addr)) != mapAssetsBookAddresses.end() && AssetsDecodeOrder(tx, j, it->second, order))
+                AssetsBookAdd(COutPoint(tx.GetHash(), j), order);
+        }
+    }
+    assetsBookUndo.push_back(std::make_pair(block.GetHash(), spent));
+    if (assetsBookUndo.size() > ASSETS_BOOK_MAXUNDO)
+        assetsBookUndo.pop_front();
+}
 
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputsTokens, unspentOutputsDualEvalTokens, unspentOutputsCoins;
+void AssetsBookBlockDisconnected(const CBlock &block)
+{
+    LOCK(cs_assetsbook);
+    nAssetsBookBlocks++;
+    if (!fAssetsBookLoaded) {
+        AssetsBookNotify(zeroid);
+        return;
+    }
+    if (assetsBookUndo.empty() || assetsBookUndo.back().first != block.GetHash()) {
+        // deeper than the undo kept, read it again at the next query
+        AssetsBookUnload();
+        return;
+    }
 
-	char assetsUnspendableAddr[64];
-	GetCCaddress(cpAssets, assetsUnspendableAddr, GetUnspendable(cpAssets, NULL));
-	SetCCunspents(unspentOutputsCoins, assetsUnspendableAddr,true);
+    std::set<uint256> txids;
+    for (int i = block.vtx.size() - 1; i >= 0; i--) {
+        const CTransaction &tx = block.vtx[i];
+        CAssetOrder order;
+        txids.insert(tx.GetHash());
+        for (int j = 0; j < tx.vout.size(); j++)
+            AssetsBookRemove(COutPoint(tx.GetHash(), j), order);
+    }
+    const std::vector<std::pair<COutPoint, CAssetOrder> > &spent = assetsBookUndo.back().second;
+    for (int i = 0; i < spent.size(); i++) {
+        if (txids.count(spent[i].first.hash) == 0)  // not created and spent in this block
+            AssetsBookAdd(spent[i].first, spent[i].second);
+    }
+    assetsBookUndo.pop_back();
+}
 
-	char assetsTokensUnspendableAddr[64];
+// waits upto nMillis for the orders of tokenid, or of any token if zeroid, to change after sequence; returns the last change
+uint64_t AssetsBookWait(uint256 tokenid, uint64_t sequence, int64_t nMillis)
+{
+    AssetsBookLoad();
+
+    boost::system_time timeout = boost::get_system_time() + boost::posix_time::milliseconds(nMillis);
+    boost::unique_lock<boost::mutex> lock(cs_assetsbookchanges);
+    while (true) {
+        uint64_t last = nAssetsBookSequence;
+        if (tokenid != zeroid) {  // zeroid is also bumped when the book is dropped
+            std::map<uint256, uint64_t>::const_iterator it = mapAssetsBookTokenSequence.find(tokenid);
+            last = std::max(mapAssetsBookTokenSequence[zeroid], it != mapAssetsBookTokenSequence.end() ? it->second : (uint64_t)0);
+        }
+        if (last > sequence || !cvAssetsBookChange.timed_wait(lock, timeout))
+            return last;
+    }
+}
+
+static bool AssetOrderPrice(const CAssetOrder &order, double &price)
+{
+    if (order.price <= 0)
+        return false;
+    if (order.funcid == 's' || order.funcid == 'S' || order.funcid == 'e' || order.funcid == 'E')
+        price = (double)order.price / (COIN * order.nValue0);
+    else
+        price = (double)order.nValue0 / (order.price * COIN);
+    return true;
+}
+
+static UniValue AssetOrderJson(struct CCcontract_info *cp, struct CCcontract_info *cpTokens, const COutPoint &outpoint, const CAssetOrder &order)
+{
+    UniValue item(UniValue::VOBJ);
+    char numstr[32], funcidstr[16], origaddr[64], origtokenaddr[64];
+    double price;
+
+    funcidstr[0] = order.funcid;
+    funcidstr[1] = 0;
+    item.push_back(Pair("funcid", funcidstr));
+    item.push_back(Pair("txid", outpoint.hash.GetHex()));
+    item.push_back(Pair("vout", (int64_t)outpoint.n));
+    if (order.funcid == 'b' || order.funcid == 'B')
+    {
+        sprintf(numstr, "%.8f", (double)order.nValue / COIN);
+        item.push_back(Pair("amount", numstr));
+        sprintf(numstr, "%.8f", (double)order.nValue0 / COIN);
+        item.push_back(Pair("bidamount", numstr));
+    }
+    else
+    {
+        sprintf(numstr, "%llu", (long long)order.nValue);
+        item.push_back(Pair("amount", numstr));
+        sprintf(numstr, "%llu", (long long)order.nValue0);
+        item.push_back(Pair("askamount", numstr));
+    }
+    if (order.origpubkey.size() == CPubKey::COMPRESSED_PUBLIC_KEY_SIZE)
+    {
+        GetCCaddress(cp, origaddr, pubkey2pk(order.origpubkey));  
+        item.push_back(Pair("origaddress", origaddr));
+        GetTokensCCaddress(cpTokens, origtokenaddr, pubkey2pk(order.origpubkey));
+        item.push_back(Pair("origtokenaddress", origtokenaddr));
+
+    }
+    if (order.assetid != zeroid)
+        item.push_back(Pair("tokenid", order.assetid.GetHex()));
+    if (order.assetid2 != zeroid)
+        item.push_back(Pair("otherid", order.assetid2.GetHex()));
+    if (AssetOrderPrice(order, price))
+    {
+        if (order.funcid == 's' || order.funcid == 'S' || order.funcid == 'e' || order.funcid == 'E')
+        {
+            sprintf(numstr, "%.8f", (double)order.price / COIN);
+            item.push_back(Pair("totalrequired", numstr));
+        }
+        else
+            item.push_back(Pair("totalrequired", (int64_t)order.price));
+        sprintf(numstr, "%.8f", price);
+        item.push_back(Pair("price", numstr));
+    }
+    return item;
+}
+
+static bool AssetOrderIsBid(const CAssetOrder &order)
+{
+    return order.funcid == 'b' || order.funcid == 'B';
+}
+
+// best prices first: highest bids, then lowest asks
+static bool AssetOrderBetter(const std::pair<COutPoint, CAssetOrder> &a, const std::pair<COutPoint, CAssetOrder> &b)
+{
+    double pa, pb;
+    bool fa = AssetOrderPrice(a.second, pa), fb = AssetOrderPrice(b.second, pb);
+    if (AssetOrderIsBid(a.second) != AssetOrderIsBid(b.second))
+        return AssetOrderIsBid(a.second);
+    if (fa != fb)
+        return fa;
+    return fa && (AssetOrderIsBid(a.second) ? pa > pb : pa < pb);
+}
+
+// tokenorders and mytokenorders: with depth, only the depth best bids and asks, best first
+UniValue AssetOrders(uint256 refassetid, CPubKey pk, uint8_t additionalEvalCode, int32_t depth)
+{
+	UniValue result(UniValue::VARR);  
+
+    struct CCcontract_info *cpAssets, assetsC;
+    struct CCcontract_info *cpTokens, tokensC;
+
+    cpAssets = CCinit(&assetsC, EVAL_ASSETS);
+    cpTokens = CCinit(&tokensC, EVAL_TOKENS);
+
+    // the addresses listed: bids, asks, and for mytokenorders also dual eval asks (we do not need bids)
+    std::vector<int32_t> kinds;
+    kinds.push_back(ASSETS_BOOK_COINS);
+    uint8_t evalcode2 = 0;
     std::vector<uint8_t> vopretNonfungible;
     if (refassetid != zeroid) {
         GetNonfungibleData(refassetid, vopretNonfungible);
         if (vopretNonfungible.size() > 0)
-            cpAssets->additionalTokensEvalcode2 = vopretNonfungible.begin()[0];
+            evalcode2 = vopretNonfungible.begin()[0];
+    }
+    kinds.push_back(evalcode2);
+    if (additionalEvalCode != 0)
+        kinds.push_back(additionalEvalCode);
+
+    std::vector<std::pair<COutPoint, CAssetOrder> > orders;
+    bool fLoaded = false;
+    if (!KOMODO_NSPV_SUPERLITE) {
+        auto collect = [&]() {
+            const std::set<CAssetOrderKey> *keys = &setAssetOrders;
+            if (pk == CPubKey() && refassetid != zeroid) {
+                std::map<uint256, std::set<CAssetOrderKey> >::const_iterator it = mapAssetTokenOrders.find(refassetid);
+                if (it == mapAssetTokenOrders.end())
+                    return;
+                keys = &it->second;
+            }
+            for (int i = 0; i < kinds.size(); i++) {
+                for (std::set<CAssetOrderKey>::const_iterator it = keys->lower_bound(CAssetOrderKey(kinds[i], COutPoint(uint256(), 0)));
+                     it != keys->end() && it->first == kinds[i]; it++)
+                    orders.push_back(std::make_pair(it->second, mapAssetOrders[it->second]));
+            }
+        };
+        AssetsBookLoad();
+        LOCK(cs_assetsbook);
+        if ((fLoaded = fAssetsBookLoaded))
+            collect();
+    }
+    if (!fLoaded) {
+        // no book, or a block came in while it was read: scan the listed addresses
+        char addr[64];
+        for (int i = 0; i < kinds.size(); i++) {
+            AssetsBookAddress(cpAssets, kinds[i], addr);
+            AssetsScanOrders(kinds[i], addr, orders);
+        }
     }
-	GetTokensCCaddress(cpAssets, assetsTokensUnspendableAddr, GetUnspendable(cpAssets, NULL));
-	SetCCunspents(unspentOutputsTokens, assetsTokensUnspendableAddr,true);
 
-    // tokenbids:
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator itCoins = unspentOutputsCoins.begin();
-        itCoins != unspentOutputsCoins.end();
-        itCoins++)
-        addOrders(cpAssets, itCoins);
-    
-    // tokenasks:
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator itTokens = unspentOutputsTokens.begin();
-		itTokens != unspentOutputsTokens.end();
-		itTokens++)
-		addOrders(cpAssets, itTokens);
-
-    if (additionalEvalCode != 0) {  //this would be mytokenorders
-        char assetsDualEvalTokensUnspendableAddr[64];
-
-        // try also dual eval tokenasks (and we do not need bids):
-        cpAssets->additionalTokensEvalcode2 = additionalEvalCode;
-        GetTokensCCaddress(cpAssets, assetsDualEvalTokensUnspendableAddr, GetUnspendable(cpAssets, NULL));
-        SetCCunspents(unspentOutputsDualEvalTokens, assetsDualEvalTokensUnspendableAddr,true);
-
-        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator itDualEvalTokens = unspentOutputsDualEvalTokens.begin();
-            itDualEvalTokens != unspentOutputsDualEvalTokens.end();
-            itDualEvalTokens++)
-            addOrders(cpAssets, itDualEvalTokens);
+    std::vector<std::pair<COutPoint, CAssetOrder> > matched;
+    for (int i = 0; i < orders.size(); i++) {
+        const CAssetOrder &order = orders[i].second;
+        if (pk == CPubKey() && (refassetid == zeroid || order.assetid == refassetid)  // tokenorders
+            || pk != CPubKey() && pk == pubkey2pk(order.origpubkey) && (order.funcid == 's' || order.funcid == 'S'))  // mytokenorders, returns only asks (is this correct?)
+        {
+            if (order.nValue == 0) {
+                LOGSTREAM("ccassets", CCLOG_DEBUG2, stream << "AssetOrders() order with value=0 skipped" << std::endl);
+                continue;
+            }
+            matched.push_back(orders[i]);
+        }
+    }
+
+    if (depth > 0) {
+        std::stable_sort(matched.begin(), matched.end(), AssetOrderBetter);
+        int32_t nBids = 0, nAsks = 0;
+        std::vector<std::pair<COutPoint, CAssetOrder> > best;
+        for (int i = 0; i < matched.size(); i++) {
+            if (AssetOrderIsBid(matched[i].second) ? nBids++ < depth : nAsks++ < depth)
+                best.push_back(matched[i]);
+        }
+        matched.swap(best);
+    }
+
+    for (int i = 0; i < matched.size(); i++) {
+        result.push_back(AssetOrderJson(cpAssets, cpTokens, matched[i].first, matched[i].second));
+        LOGSTREAM("ccassets", CCLOG_DEBUG1, stream << "AssetOrders() added order funcId=" << (char)(matched[i].second.funcid ? matched[i].second.funcid : ' ') << " vout=" << matched[i].first.n << " nValue=" << matched[i].second.nValue << " tokenid=" << matched[i].second.assetid.GetHex() << std::endl);
     }
     return(result);
 }
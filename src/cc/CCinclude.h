@@ -241,7 +241,7 @@ extern CWallet* pwalletMain;  //!< global wallet object pointer to access wallet
 //extern CCoinsViewCache *pcoinsTip;
 
 /// @private seems old-style
-bool GetAddressUnspent(uint160 addressHash, int type,std::vector<std::pair<CAddressUnspentKey,CAddressUnspentValue> > &unspentOutputs);
+bool GetAddressUnspent(uint160 addressHash, int type,std::vector<std::pair<CAddressUnspentKey,CAddressUnspentValue> > &unspentOutputs,bool fAllAddresses);
 //CBlockIndex *komodo_getblockindex(uint256 hash);  //moved to komodo_def.h
 //int32_t komodo_nextheight();  //moved to komodo_def.h
 
@@ -343,7 +343,7 @@ bool GetCCParams(Eval* eval, const CTransaction &tx, uint32_t nIn,
 /// \cond INTERNAL
 int64_t OraclePrice(int32_t height,uint256 reforacletxid,char *markeraddr,char *format);
 uint256 OracleMerkle(int32_t height,uint256 reforacletxid,char *format,std::vector<struct oracle_merklepair>publishers);
-uint256 OraclesBatontxid(uint256 oracletxid,CPubKey pk);
+uint256 OraclesBatontxid(uint256 oracletxid,CPubKey pk,bool fIndexed);
 uint8_t DecodeOraclesCreateOpRet(const CScript &scriptPubKey,std::string &name,std::string &description,std::string &format);
 uint8_t DecodeOraclesOpRet(const CScript &scriptPubKey,uint256 &oracletxid,CPubKey &pk,int64_t &num);
 uint8_t DecodeOraclesData(const CScript &scriptPubKey,uint256 &oracletxid,uint256 &batontxid,CPubKey &pk,std::vector <uint8_t>&data);
@@ -789,7 +789,13 @@ bool Myprivkey(uint8_t myprivkey[]);
 int64_t CCduration(int32_t &numblocks,uint256 txid);
 
 /// @private
-uint256 CCOraclesReverseScan(char const *logcategory,uint256 &txid,int32_t height,uint256 reforacletxid,uint256 batontxid);
+uint256 CCOraclesReverseScan(char const *logcategory,uint256 &txid,int32_t height,uint256 reforacletxid,uint256 batontxid,bool fIndexed);
+
+/// @private
+int32_t OraclesIndexedSample(uint256 reforacletxid,uint256 batontxid,int32_t height,uint256 &sampletxid,std::vector<uint8_t> &data,uint256 &prevtxid);
+
+/// @private
+void OraclesSamplesTryLoad(uint256 reforacletxid,const CTransaction &tx);
 
 /// @private
 int32_t CCCointxidExists(char const *logcategory,uint256 cointxid);
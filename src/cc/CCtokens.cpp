@@ -916,6 +916,507 @@ std::string TokenTransfer(int64_t txfee, uint256 tokenid, vscript_t destpubkey,
 }
 
 
+// The tokens ledger: the unspent token outputs and the balance of each token at each address, read from the
+// address index on first use and then kept up to date by TokensLedgerBlockConnected and
+// TokensLedgerBlockDisconnected, so that balance queries do not read and validate every transaction.
+// A connected block is applied from the opreturns of its txs, without reading any other tx under cs_main;
+// its outputs are checked with IsTokensvout() at the first query of their token. The ledger is written to
+// TOKENS_LEDGER_FILENAME at shutdown and read back at the next start if the tip is the same.
+
+#define TOKENS_LEDGER_MAXUNDO 100   // connected blocks whose spent token outputs are kept for a disconnect
+
+static const char *TOKENS_LEDGER_FILENAME = "tokensledger.dat";
+static const int TOKENS_LEDGER_VERSION = 1;
+
+struct CTokenOutput {
+    uint256 tokenid;
+    std::string addr;
+    int64_t nValue;
+    bool fBurned;                   // sent to the burn pubkey
+    bool fValidated;                // checked the way AddTokenCCInputs() does, else only decoded from the opreturn
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(tokenid);
+        READWRITE(addr);
+        READWRITE(nValue);
+        READWRITE(fBurned);
+        READWRITE(fValidated);
+    }
+};
+
+struct CTokenHolding {
+    int64_t balance;
+    bool fBurned;
+    std::set<COutPoint> outputs;
+};
+
+struct CTokenLedger {
+    int64_t total;                  // of all unspent token outputs, burned ones included
+    int64_t burned;
+    int32_t holders;                // addresses with a balance, other than the burn addresses
+    std::map<std::string, CTokenHolding> holdings;
+};
+
+typedef std::vector<std::pair<COutPoint, CTokenOutput> > TokenOutputs;
+
+static CCriticalSection cs_tokensledger;
+static bool fTokensLedgerLoaded;
+static uint64_t nTokensLedgerSequence;  // bumped on each block, a load across a block is not kept
+static std::map<COutPoint, CTokenOutput> mapTokenOutputs;
+static std::map<uint256, CTokenLedger> mapTokenLedgers;     // of the validated outputs
+static std::map<uint256, std::set<COutPoint> > mapTokenUnvalidated;
+static std::deque<std::pair<uint256, TokenOutputs> > tokensLedgerUndo;
+
+// tokenid of a tx with a token opret
+static bool TokensDecodeTx(const CTransaction &tx, uint256 &tokenid)
+{
+    uint8_t funcid, evalCode;
+    std::vector<CPubKey> voutPubkeys;
+    std::vector<std::pair<uint8_t, vscript_t>> oprets;
+
+    if (tx.vout.size() == 0 || (funcid = DecodeTokenOpRet(tx.vout.back().scriptPubKey, evalCode, tokenid, voutPubkeys, oprets)) == 0)
+        return false;
+    if (funcid == 'c')
+        tokenid = tx.GetHash();
+    return true;
+}
+
+// addresses of the burn pubkey vouts of tx that HasBurnedTokensvouts() accepts
+static void TokensBurnAddresses(const CTransaction &tx, uint256 tokenid, std::set<std::string> &addrs)
+{
+    uint8_t dummyEvalCode, evalCode = EVAL_TOKENS, evalCode2 = 0;
+    uint256 tokenIdOpret;
+    std::vector<CPubKey> voutPubkeysDummy;
+    std::vector<std::pair<uint8_t, vscript_t>> oprets;
+    vscript_t vopretExtra, vopretNonfungible;
+    CPubKey burnpk = pubkey2pk(ParseHex(CC_BURNPUBKEY));
+    char addr[64];
+
+    if (DecodeTokenOpRet(tx.vout.back().scriptPubKey, dummyEvalCode, tokenIdOpret, voutPubkeysDummy, oprets) == 0)
+        return;
+    FilterOutNonCCOprets(oprets, vopretExtra);
+    GetNonfungibleData(tokenid, vopretNonfungible);
+    if (vopretNonfungible.size() > 0)
+        evalCode = vopretNonfungible.begin()[0];
+    if (vopretExtra.size() > 0)
+        evalCode2 = vopretExtra.begin()[0];
+    if (evalCode == EVAL_TOKENS && evalCode2 != 0) {
+        evalCode = evalCode2;
+        evalCode2 = 0;
+    }
+
+    if (Getscriptaddress(addr, MakeCC1vout(EVAL_TOKENS, 0, burnpk).scriptPubKey))
+        addrs.insert(addr);
+    if (Getscriptaddress(addr, MakeTokensCC1vout(evalCode, evalCode2, 0, burnpk).scriptPubKey))
+        addrs.insert(addr);
+    if (evalCode2 != 0 && Getscriptaddress(addr, MakeTokensCC1vout(evalCode2, evalCode, 0, burnpk).scriptPubKey))
+        addrs.insert(addr);
+}
+
+// checks vout v of a token tx the way AddTokenCCInputs() does
+static bool TokensDecodeOutput(struct CCcontract_info *cp, const CTransaction &tx, int32_t v, uint256 tokenid, const std::set<std::string> &burnaddrs, CTokenOutput &output)
+{
+    char addr[64];
+
+    if (v >= (int32_t)tx.vout.size() - 1 || !tx.vout[v].scriptPubKey.IsPayToCryptoCondition() || !Getscriptaddress(addr, tx.vout[v].scriptPubKey))
+        return false;
+    if ((output.nValue = IsTokensvout(true, true, cp, NULL, tx, v, tokenid)) <= 0)
+        return false;
+    output.tokenid = tokenid;
+    output.addr = addr;
+    output.fBurned = burnaddrs.count(output.addr) != 0;
+    output.fValidated = true;
+    return true;
+}
+
+// the CC outputs of the token txs of a block, decoded from their opreturns only
+static void TokensBlockOutputs(const CBlock &block, TokenOutputs &outputs)
+{
+    for (int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        CTokenOutput output;
+        uint256 tokenid;
+        char addr[64];
+
+        if (!TokensDecodeTx(tx, tokenid))
+            continue;
+        for (int32_t v = 0; v < (int32_t)tx.vout.size() - 1; v++) {
+            if (tx.vout[v].nValue > 0 && tx.vout[v].scriptPubKey.IsPayToCryptoCondition() && Getscriptaddress(addr, tx.vout[v].scriptPubKey)) {
+                output.tokenid = tokenid;
+                output.addr = addr;
+                output.nValue = tx.vout[v].nValue;
+                output.fBurned = false;
+                output.fValidated = false;
+                outputs.push_back(std::make_pair(COutPoint(tx.GetHash(), v), output));
+            }
+        }
+    }
+}
+
+static void TokensLedgerAdd(const COutPoint &outpoint, const CTokenOutput &output)
+{
+    if (!mapTokenOutputs.insert(std::make_pair(outpoint, output)).second)
+        return;
+    if (!output.fValidated) {
+        mapTokenUnvalidated[output.tokenid].insert(outpoint);
+        return;
+    }
+    CTokenLedger &ledger = mapTokenLedgers[output.tokenid];
+    std::map<std::string, CTokenHolding>::iterator it = ledger.holdings.find(output.addr);
+    if (it == ledger.holdings.end()) {
+        CTokenHolding holding;
+        holding.balance = 0;
+        holding.fBurned = output.fBurned;
+        it = ledger.holdings.insert(std::make_pair(output.addr, holding)).first;
+        if (!output.fBurned)
+            ledger.holders++;
+    }
+    it->second.balance += output.nValue;
+    it->second.outputs.insert(outpoint);
+    ledger.total += output.nValue;
+    if (output.fBurned)
+        ledger.burned += output.nValue;
+}
+
+static bool TokensLedgerRemove(const COutPoint &outpoint, CTokenOutput &output)
+{
+    std::map<COutPoint, CTokenOutput>::iterator itOutput = mapTokenOutputs.find(outpoint);
+    if (itOutput == mapTokenOutputs.end())
+        return false;
+    output = itOutput->second;
+    mapTokenOutputs.erase(itOutput);
+    if (!output.fValidated) {
+        std::map<uint256, std::set<COutPoint> >::iterator itUnvalidated = mapTokenUnvalidated.find(output.tokenid);
+        if (itUnvalidated != mapTokenUnvalidated.end()) {
+            itUnvalidated->second.erase(outpoint);
+            if (itUnvalidated->second.empty())
+                mapTokenUnvalidated.erase(itUnvalidated);
+        }
+        return true;
+    }
+
+    std::map<uint256, CTokenLedger>::iterator itLedger = mapTokenLedgers.find(output.tokenid);
+    if (itLedger == mapTokenLedgers.end())
+        return true;
+    CTokenLedger &ledger = itLedger->second;
+    std::map<std::string, CTokenHolding>::iterator it = ledger.holdings.find(output.addr);
+    if (it != ledger.holdings.end()) {
+        it->second.balance -= output.nValue;
+        it->second.outputs.erase(outpoint);
+        if (it->second.outputs.empty()) {
+            if (!it->second.fBurned)
+                ledger.holders--;
+            ledger.holdings.erase(it);
+        }
+    }
+    ledger.total -= output.nValue;
+    if (output.fBurned)
+        ledger.burned -= output.nValue;
+    if (ledger.holdings.empty())
+        mapTokenLedgers.erase(itLedger);
+    return true;
+}
+
+static void TokensLedgerUnload()
+{
+    fTokensLedgerLoaded = false;
+    mapTokenOutputs.clear();
+    mapTokenLedgers.clear();
+    mapTokenUnvalidated.clear();
+    tokensLedgerUndo.clear();
+}
+
+// reads and validates without cs_main, the result is dropped if a block was connected or disconnected meanwhile
+static void TokensLedgerLoad()
+{
+    struct CCcontract_info *cp, C;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    std::map<uint256, std::vector<int32_t> > mapTxOutputs;
+    TokenOutputs outputs;
+    uint64_t sequence;
+
+    {
+        LOCK(cs_tokensledger);
+        if (fTokensLedgerLoaded)
+            return;
+        sequence = nTokensLedgerSequence;
+    }
+    if (!GetAddressUnspent(uint160(), 3, unspentOutputs, true))  // all CC addresses
+        return;
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++)
+        mapTxOutputs[it->first.txhash].push_back(it->first.index);
+
+    // validating takes the longest, do it before locking the ledger
+    cp = CCinit(&C, EVAL_TOKENS);
+    for (std::map<uint256, std::vector<int32_t> >::const_iterator it = mapTxOutputs.begin(); it != mapTxOutputs.end(); it++) {
+        CTransaction tx;
+        uint256 hashBlock, tokenid;
+        std::set<std::string> burnaddrs;
+        CTokenOutput output;
+
+        if (myGetTransaction(it->first, tx, hashBlock) == 0 || !TokensDecodeTx(tx, tokenid))
+            continue;
+        TokensBurnAddresses(tx, tokenid, burnaddrs);
+        for (int i = 0; i < it->second.size(); i++)
+            if (TokensDecodeOutput(cp, tx, it->second[i], tokenid, burnaddrs, output))
+                outputs.push_back(std::make_pair(COutPoint(it->first, it->second[i]), output));
+    }
+
+    LOCK(cs_tokensledger);
+    if (fTokensLedgerLoaded || sequence != nTokensLedgerSequence)
+        return;
+    for (int i = 0; i < outputs.size(); i++)
+        TokensLedgerAdd(outputs[i].first, outputs[i].second);
+    fTokensLedgerLoaded = true;
+    LogPrint("cctokens", "TokensLedgerLoad() loaded %u token outputs of %u tokens\n", (unsigned int)mapTokenOutputs.size(), (unsigned int)mapTokenLedgers.size());
+}
+
+// checks the outputs of tokenid connected since the load, without cs_main or the ledger lock
+static void TokensLedgerValidate(uint256 tokenid)
+{
+    struct CCcontract_info *cp, C;
+    std::vector<COutPoint> unvalidated;
+    TokenOutputs validated;
+    std::set<COutPoint> invalid;
+
+    {
+        LOCK(cs_tokensledger);
+        std::map<uint256, std::set<COutPoint> >::const_iterator it = mapTokenUnvalidated.find(tokenid);
+        if (it == mapTokenUnvalidated.end())
+            return;
+        unvalidated.assign(it->second.begin(), it->second.end());
+    }
+
+    cp = CCinit(&C, EVAL_TOKENS);
+    CTransaction tx;
+    std::set<std::string> burnaddrs;
+    bool fRead = false;
+    for (int i = 0; i < unvalidated.size(); i++) {
+        CTokenOutput output;
+        uint256 hashBlock;
+
+        if (i == 0 || unvalidated[i].hash != unvalidated[i - 1].hash) {  // the outputs of a tx are next to each other
+            burnaddrs.clear();
+            if ((fRead = myGetTransaction(unvalidated[i].hash, tx, hashBlock) != 0))
+                TokensBurnAddresses(tx, tokenid, burnaddrs);
+        }
+        if (fRead && TokensDecodeOutput(cp, tx, unvalidated[i].n, tokenid, burnaddrs, output))
+            validated.push_back(std::make_pair(unvalidated[i], output));
+        else
+            invalid.insert(unvalidated[i]);
+    }
+
+    LOCK(cs_tokensledger);
+    CTokenOutput output;
+    for (int i = 0; i < validated.size(); i++) {
+        std::map<COutPoint, CTokenOutput>::const_iterator it = mapTokenOutputs.find(validated[i].first);
+        if (it != mapTokenOutputs.end() && !it->second.fValidated && TokensLedgerRemove(validated[i].first, output))
+            TokensLedgerAdd(validated[i].first, validated[i].second);
+    }
+    for (std::set<COutPoint>::const_iterator itInvalid = invalid.begin(); itInvalid != invalid.end(); itInvalid++) {
+        std::map<COutPoint, CTokenOutput>::const_iterator it = mapTokenOutputs.find(*itInvalid);
+        if (it != mapTokenOutputs.end() && !it->second.fValidated)  // else spent or disconnected meanwhile
+            TokensLedgerRemove(*itInvalid, output);
+    }
+}
+
+// false if the ledger cannot be used, then the caller scans the address index as before
+static bool TokensLedgerEnsureLoaded(uint256 tokenid)
+{
+    if (KOMODO_NSPV_SUPERLITE)
+        return false;
+    TokensLedgerLoad();
+    TokensLedgerValidate(tokenid);
+    LOCK(cs_tokensledger);
+    return fTokensLedgerLoaded;
+}
+
+void TokensLedgerBlockConnected(const CBlock &block)
+{
+    TokenOutputs outputs, spent;
+
+    AssertLockHeld(cs_main);
+    LOCK(cs_tokensledger);
+    nTokensLedgerSequence++;
+    if (!fTokensLedgerLoaded)
+        return;
+    TokensBlockOutputs(block, outputs);
+
+    int n = 0;
+    for (int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        CTokenOutput output;
+
+        if (!tx.IsCoinBase()) {
+            for (int j = 0; j < tx.vin.size(); j++) {
+                if (TokensLedgerRemove(tx.vin[j].prevout, output))
+                    spent.push_back(std::make_pair(tx.vin[j].prevout, output));
+            }
+        }
+        for (; n < outputs.size() && outputs[n].first.hash == tx.GetHash(); n++)
+            TokensLedgerAdd(outputs[n].first, outputs[n].second);
+    }
+    tokensLedgerUndo.push_back(std::make_pair(block.GetHash(), spent));
+    if (tokensLedgerUndo.size() > TOKENS_LEDGER_MAXUNDO)
+        tokensLedgerUndo.pop_front();
+}
+
+void TokensLedgerBlockDisconnected(const CBlock &block)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs_tokensledger);
+    nTokensLedgerSequence++;
+    if (!fTokensLedgerLoaded)
+        return;
+    if (tokensLedgerUndo.empty() || tokensLedgerUndo.back().first != block.GetHash()) {
+        // deeper than the undo kept, read it again at the next query
+        TokensLedgerUnload();
+        return;
+    }
+
+    std::set<uint256> txids;
+    for (int i = block.vtx.size() - 1; i >= 0; i--) {
+        const CTransaction &tx = block.vtx[i];
+        CTokenOutput output;
+        txids.insert(tx.GetHash());
+        for (int j = 0; j < tx.vout.size(); j++)
+            TokensLedgerRemove(COutPoint(tx.GetHash(), j), output);
+    }
+    const TokenOutputs &spent = tokensLedgerUndo.back().second;
+    for (int i = 0; i < spent.size(); i++) {
+        if (txids.count(spent[i].first.hash) == 0)  // not created and spent in this block
+            TokensLedgerAdd(spent[i].first, spent[i].second);
+    }
+    tokensLedgerUndo.pop_back();
+}
+
+// writes the ledger with the tip it is at, at shutdown
+void TokensLedgerWrite()
+{
+    TokenOutputs outputs;
+    std::vector<std::pair<uint256, TokenOutputs> > undo;
+    uint256 hashTip;
+
+    {
+        LOCK2(cs_main, cs_tokensledger);
+        if (!fTokensLedgerLoaded || chainActive.Tip() == NULL)
+            return;
+        hashTip = chainActive.Tip()->GetBlockHash();
+        outputs.assign(mapTokenOutputs.begin(), mapTokenOutputs.end());
+        undo.assign(tokensLedgerUndo.begin(), tokensLedgerUndo.end());
+    }
+    boost::filesystem::path path = GetDataDir() / TOKENS_LEDGER_FILENAME;
+    CAutoFile fileout(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        LogPrintf("%s: Failed to write tokens ledger to %s\n", __func__, path.string());
+        return;
+    }
+    try {
+        fileout << TOKENS_LEDGER_VERSION << hashTip << outputs << undo;
+    } catch (const std::exception& e) {
+        LogPrintf("%s: Failed to write tokens ledger to %s: %s\n", __func__, path.string(), e.what());
+    }
+}
+
+// reads the ledger written at shutdown if the tip is still the same, before any block is connected
+void TokensLedgerRead()
+{
+    TokenOutputs outputs;
+    std::vector<std::pair<uint256, TokenOutputs> > undo;
+    uint256 hashTip;
+    int nVersion = 0;
+
+    boost::filesystem::path path = GetDataDir() / TOKENS_LEDGER_FILENAME;
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    // missing until the first shutdown with a loaded ledger
+    if (filein.IsNull())
+        return;
+    try {
+        filein >> nVersion;
+        if (nVersion != TOKENS_LEDGER_VERSION)
+            return;
+        filein >> hashTip >> outputs >> undo;
+    } catch (const std::exception& e) {
+        LogPrintf("%s: Failed to read tokens ledger from %s: %s\n", __func__, path.string(), e.what());
+        return;
+    }
+
+    LOCK2(cs_main, cs_tokensledger);
+    if (fTokensLedgerLoaded || chainActive.Tip() == NULL || chainActive.Tip()->GetBlockHash() != hashTip)
+        return;
+    for (int i = 0; i < outputs.size(); i++)
+        TokensLedgerAdd(outputs[i].first, outputs[i].second);
+    tokensLedgerUndo.assign(undo.begin(), undo.end());
+    fTokensLedgerLoaded = true;
+    LogPrint("cctokens", "TokensLedgerRead() read %u token outputs of %u tokens\n", (unsigned int)mapTokenOutputs.size(), (unsigned int)mapTokenLedgers.size());
+}
+
+// burned amount and number of holders of tokenid; false if the ledger cannot be used
+bool TokensLedgerInfo(uint256 tokenid, int64_t &burned, int32_t &holders)
+{
+    if (!TokensLedgerEnsureLoaded(tokenid))
+        return false;
+    LOCK(cs_tokensledger);
+    if (!fTokensLedgerLoaded)
+        return false;
+    burned = 0;
+    holders = 0;
+    std::map<uint256, CTokenLedger>::const_iterator itLedger = mapTokenLedgers.find(tokenid);
+    if (itLedger != mapTokenLedgers.end()) {
+        burned = itLedger->second.burned;
+        holders = itLedger->second.holders;
+    }
+    return true;
+}
+
+// balance of tokenid at addr, and the outputs making it up if pOutputs is set; false if the ledger cannot be used
+bool TokensLedgerBalance(uint256 tokenid, const std::string &addr, int64_t &balance, std::vector<std::pair<COutPoint, int64_t> > *pOutputs)
+{
+    if (!TokensLedgerEnsureLoaded(tokenid))
+        return false;
+    LOCK(cs_tokensledger);
+    if (!fTokensLedgerLoaded)
+        return false;
+    balance = 0;
+    std::map<uint256, CTokenLedger>::const_iterator itLedger = mapTokenLedgers.find(tokenid);
+    if (itLedger == mapTokenLedgers.end())
+        return true;
+    std::map<std::string, CTokenHolding>::const_iterator it = itLedger->second.holdings.find(addr);
+    if (it == itLedger->second.holdings.end())
+        return true;
+    balance = it->second.balance;
+    if (pOutputs != NULL) {
+        for (std::set<COutPoint>::const_iterator itOutput = it->second.outputs.begin(); itOutput != it->second.outputs.end(); itOutput++)
+            pOutputs->push_back(std::make_pair(*itOutput, mapTokenOutputs[*itOutput].nValue));
+    }
+    return true;
+}
+
+// balance of tokenid at addr read from the address index, counting the outputs the ledger counts
+int64_t TokensScanBalance(uint256 tokenid, char *addr)
+{
+    struct CCcontract_info *cp, C;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    std::set<std::string> burnaddrs;
+    int64_t balance = 0;
+
+    cp = CCinit(&C, EVAL_TOKENS);
+    SetCCunspents(unspentOutputs, addr, true);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++) {
+        CTransaction tx;
+        uint256 hashBlock, txtokenid;
+        CTokenOutput output;
+
+        if (myGetTransaction(it->first.txhash, tx, hashBlock) != 0 && TokensDecodeTx(tx, txtokenid) && txtokenid == tokenid &&
+            TokensDecodeOutput(cp, tx, it->first.index, tokenid, burnaddrs, output) && output.addr == addr)
+            balance += output.nValue;
+    }
+    return balance;
+}
+
 int64_t GetTokenBalance(CPubKey pk, uint256 tokenid)
 {
 	uint256 hashBlock;
@@ -934,6 +1435,25 @@ int64_t GetTokenBalance(CPubKey pk, uint256 tokenid)
 
 	struct CCcontract_info *cp, C;
 	cp = CCinit(&C, EVAL_TOKENS);
+
+    // the ledger has the confirmed balance, less what is spent in the mempool as AddTokenCCInputs() does
+    std::vector<std::pair<COutPoint, int64_t> > outputs;
+    vscript_t vopretNonfungible;
+    int64_t balance;
+    char tokenaddr[64];
+
+    GetNonfungibleData(tokenid, vopretNonfungible);
+    if (vopretNonfungible.size() > 0)
+        cp->additionalTokensEvalcode2 = vopretNonfungible.begin()[0];
+    GetTokensCCaddress(cp, tokenaddr, pk);
+    if (TokensLedgerBalance(tokenid, tokenaddr, balance, &outputs))
+    {
+        LOCK(mempool.cs);
+        for (int i = 0; i < outputs.size(); i++)
+            if (mempool.mapNextTx.count(outputs[i].first) != 0)
+                balance -= outputs[i].second;
+        return(balance);
+    }
 	return(AddTokenCCInputs(cp, mtx, pk, tokenid, 0, 0));
 }
 
@@ -986,6 +1506,12 @@ UniValue TokenInfo(uint256 tokenid)
     if( !vopretNonfungible.empty() )    
         result.push_back(Pair("data", HexStr(vopretNonfungible)));
 
+    int64_t burned; int32_t holders;
+    if (TokensLedgerInfo(tokenid, burned, holders)) {
+        result.push_back(Pair("burned", burned));
+        result.push_back(Pair("holders", holders));
+    }
+
     if (tokenbaseTx.IsCoinImport()) { // if imported token
         ImportProof proof;
         CTransaction burnTx;
@@ -1023,6 +1549,45 @@ UniValue TokenInfo(uint256 tokenid)
 	return result;
 }
 
+// holders of tokenid, with the largest balances first
+UniValue TokenHolders(uint256 tokenid, int32_t count)
+{
+    UniValue result(UniValue::VOBJ), holders(UniValue::VARR);
+    std::vector<std::pair<int64_t, std::string> > balances;
+    int64_t total = 0, burned = 0;
+
+    if (!TokensLedgerEnsureLoaded(tokenid))
+        CCERR_RESULT("cctokens", CCLOG_INFO, stream << "token holders are not available on this node");
+    {
+        LOCK(cs_tokensledger);
+        std::map<uint256, CTokenLedger>::const_iterator itLedger = mapTokenLedgers.find(tokenid);
+        if (itLedger != mapTokenLedgers.end()) {
+            total = itLedger->second.total;
+            burned = itLedger->second.burned;
+            for (std::map<std::string, CTokenHolding>::const_iterator it = itLedger->second.holdings.begin(); it != itLedger->second.holdings.end(); it++)
+                if (!it->second.fBurned)
+                    balances.push_back(std::make_pair(it->second.balance, it->first));
+        }
+    }
+    std::sort(balances.begin(), balances.end(), [](const std::pair<int64_t, std::string> &a, const std::pair<int64_t, std::string> &b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    });
+
+    for (int i = 0; i < balances.size() && (count <= 0 || i < count); i++) {
+        UniValue item(UniValue::VOBJ);
+        item.push_back(Pair("address", balances[i].second));
+        item.push_back(Pair("balance", balances[i].first));
+        holders.push_back(item);
+    }
+    result.push_back(Pair("result", "success"));
+    result.push_back(Pair("tokenid", tokenid.GetHex()));
+    result.push_back(Pair("total", total));
+    result.push_back(Pair("burned", burned));
+    result.push_back(Pair("numholders", (int64_t)balances.size()));
+    result.push_back(Pair("holders", holders));
+    return(result);
+}
+
 UniValue TokenList()
 {
 	UniValue result(UniValue::VARR);
@@ -36,6 +36,16 @@ bool IsTokenMarkerVout(CTxOut vout);
 
 int64_t GetTokenBalance(CPubKey pk, uint256 tokenid);
 UniValue TokenInfo(uint256 tokenid);
+UniValue TokenHolders(uint256 tokenid, int32_t count);
 UniValue TokenList();
 
+// token ledger, kept up to date from the blocks connected to and disconnected from the tip
+void TokensLedgerBlockConnected(const CBlock &block);
+void TokensLedgerBlockDisconnected(const CBlock &block);
+bool TokensLedgerBalance(uint256 tokenid, const std::string &addr, int64_t &balance, std::vector<std::pair<COutPoint, int64_t> > *pOutputs);
+bool TokensLedgerInfo(uint256 tokenid, int64_t &burned, int32_t &holders);
+int64_t TokensScanBalance(uint256 tokenid, char *addr);
+void TokensLedgerWrite();
+void TokensLedgerRead();
+
 #endif
@@ -14,6 +14,7 @@
  ******************************************************************************/
 
 #include "CCinclude.h"
+#include "CCtokens.h"
 #include "key_io.h"
 
 std::vector<CPubKey> NULL_pubkeys;
@@ -557,27 +558,12 @@ int64_t CCfullsupply(uint256 tokenid)
 
 int64_t CCtoken_balance(char *coinaddr,uint256 reftokenid)
 {
-    int64_t price,sum = 0; int32_t numvouts; CTransaction tx; uint256 tokenid,txid,hashBlock; 
-	std::vector<uint8_t>  vopretExtra;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-	uint8_t evalCode;
+    int64_t sum = 0;
 
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
-    {
-        txid = it->first.txhash;
-        if ( myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts=tx.vout.size()) > 0 )
-        {
-            char str[65];
-			std::vector<CPubKey> voutTokenPubkeys;
-            std::vector<std::pair<uint8_t, vscript_t>>  oprets;
-            if ( reftokenid==txid || (DecodeTokenOpRet(tx.vout[numvouts-1].scriptPubKey, evalCode, tokenid, voutTokenPubkeys, oprets) != 0 && reftokenid == tokenid))
-            {
-                sum += it->second.satoshis;
-            }
-        }
-    }
-    return(sum);
+    // both count the token outputs that AddTokenCCInputs() would spend
+    if ( TokensLedgerBalance(reftokenid,coinaddr,sum,NULL) )
+        return(sum);
+    return(TokensScanBalance(reftokenid,coinaddr));
 }
 
 int32_t CC_vinselect(int32_t *aboveip,int64_t *abovep,int32_t *belowip,int64_t *belowp,struct CC_utxo utxos[],int32_t numunspents,int64_t value)
@@ -545,20 +545,38 @@ int64_t CCduration(int32_t &numblocks,uint256 txid)
     return(duration);
 }
 
-uint256 CCOraclesReverseScan(char const *logcategory,uint256 &txid,int32_t height,uint256 reforacletxid,uint256 batontxid)
+// fIndexed looks the samples up in the oracles index, which consensus code does not
+uint256 CCOraclesReverseScan(char const *logcategory,uint256 &txid,int32_t height,uint256 reforacletxid,uint256 batontxid,bool fIndexed)
 {
-    CTransaction tx; uint256 hash,mhash,bhash,hashBlock,oracletxid; int32_t len,len2,numvouts;
+    CTransaction tx; uint256 hash,mhash,bhash,hashBlock,oracletxid,sampletxid; int32_t len,len2,numvouts,found;
     int64_t val,merkleht; CPubKey pk; std::vector<uint8_t>data; char str[65],str2[65];
     
     txid = zeroid;
     LogPrint(logcategory,"start reverse scan %s\n",uint256_str(str,batontxid));
-    while ( myGetTransaction(batontxid,tx,hashBlock) != 0 && (numvouts= tx.vout.size()) > 0 )
+    while ( true )
     {
+        // confirmed samples are looked up in the oracles index where it has them
+        found = fIndexed ? OraclesIndexedSample(reforacletxid,batontxid,height,sampletxid,data,bhash) : -1;
+        if ( found == 0 )
+        {
+            LogPrint(logcategory,"not indexed along %s, continue from %s\n",uint256_str(str,batontxid),uint256_str(str2,bhash));
+            batontxid = bhash;
+            continue;
+        }
+        else if ( found > 0 )
+        {
+            batontxid = sampletxid;
+            merkleht = height;
+        }
+        else if ( myGetTransaction(batontxid,tx,hashBlock) == 0 || (numvouts= tx.vout.size()) <= 0 )
+            break;
         LogPrint(logcategory,"check %s\n",uint256_str(str,batontxid));
-        if ( DecodeOraclesData(tx.vout[numvouts-1].scriptPubKey,oracletxid,bhash,pk,data) == 'D' && oracletxid == reforacletxid )
+        if ( found > 0 || (DecodeOraclesData(tx.vout[numvouts-1].scriptPubKey,oracletxid,bhash,pk,data) == 'D' && oracletxid == reforacletxid) )
         {
             LogPrint(logcategory,"decoded %s\n",uint256_str(str,batontxid));
-            if ( oracle_format(&hash,&merkleht,0,'I',(uint8_t *)data.data(),0,(int32_t)data.size()) == sizeof(int32_t) && merkleht == height )
+            if ( found < 0 && fIndexed )
+                OraclesSamplesTryLoad(reforacletxid,tx);
+            if ( found > 0 || (oracle_format(&hash,&merkleht,0,'I',(uint8_t *)data.data(),0,(int32_t)data.size()) == sizeof(int32_t) && merkleht == height) )
             {
                 len = oracle_format(&hash,&val,0,'h',(uint8_t *)data.data(),sizeof(int32_t),(int32_t)data.size());
                 len2 = oracle_format(&mhash,&val,0,'h',(uint8_t *)data.data(),(int32_t)(sizeof(int32_t)+sizeof(uint256)),(int32_t)data.size());
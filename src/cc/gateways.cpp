@@ -649,7 +649,7 @@ bool GatewaysValidate(struct CCcontract_info *cp,Eval *eval,const CTransaction &
                             merkleroot = zeroid;
                             for (i=m=0; i<N; i++)
                             {
-                                if ( (mhash= CCOraclesReverseScan("gatewayscc-2",txid,height,oracletxid,OraclesBatontxid(oracletxid,pubkeys[i]))) != zeroid )
+                                if ( (mhash= CCOraclesReverseScan("gatewayscc-2",txid,height,oracletxid,OraclesBatontxid(oracletxid,pubkeys[i],false),false)) != zeroid )
                                 {
                                     if ( merkleroot == zeroid )
                                         merkleroot = mhash, m = 1;
@@ -946,7 +946,7 @@ UniValue GatewaysDeposit(const CPubKey& pk, uint64_t txfee,uint256 bindtxid,int3
     {
         pubkey33_str(str,(uint8_t *)&pubkeys[i]);
         LOGSTREAM("gatewayscc",CCLOG_INFO, stream << "pubkeys[" << i << "] " << str << std::endl);
-        if ( (mhash= CCOraclesReverseScan("gatewayscc-2",txid,height,oracletxid,OraclesBatontxid(oracletxid,pubkeys[i]))) != zeroid )
+        if ( (mhash= CCOraclesReverseScan("gatewayscc-2",txid,height,oracletxid,OraclesBatontxid(oracletxid,pubkeys[i],true),true)) != zeroid )
         {
             if ( merkleroot == zeroid )
                 merkleroot = mhash, m = 1;
@@ -1212,6 +1212,363 @@ UniValue GatewaysMarkDone(const CPubKey& pk, uint64_t txfee,uint256 completetxid
     CCERR_RESULT("gatewayscc",CCLOG_INFO, stream << "error adding funds for markdone");
 }
 
+// The gateways work queues: the unspent deposit, withdraw, partial signing and complete signing markers
+// (vout 0 of CC_MARKER_VALUE) by bindtxid. A marker address is read from the address index on its first
+// query, the gateways global address for withdraws and signings, the gateways address of the claimer for
+// deposits, and then kept up to date by GatewaysQueueBlockConnected and GatewaysQueueBlockDisconnected.
+// Markers spent in the mempool are left out when queried; GatewaysQueueWait lets the signer nodes wait for
+// a change of the queue of a bindtxid instead of polling. Only txids are kept, and a block is applied from
+// the opreturns of its txs: a partial or complete signing takes the bindtxid of its withdraw from the
+// withdraws seen, or else its withdraw is read at the next query.
+
+#define GATEWAYS_QUEUE_MAXUNDO 100  // connected blocks whose spent markers are kept for a disconnect
+
+struct CGatewaysMarker {
+    uint256 bindtxid;       // null while the withdraw of a partial or complete signing is not known
+    uint256 withdrawtxid;   // of a partial or complete signing
+    std::string addr;
+};
+
+static CCriticalSection cs_gatewaysqueue;
+static std::set<std::string> setGatewaysQueueAddrs;
+static std::map<COutPoint, CGatewaysMarker> mapGatewaysMarkers;
+static std::map<uint256, std::set<COutPoint> > mapGatewaysQueues;
+static std::map<COutPoint, CGatewaysMarker> mapGatewaysUnresolved;  // signings whose withdraw is read at the next query
+static std::map<uint256, uint256> mapGatewaysWithdraws;              // bindtxid by withdrawtxid, of the withdraws seen
+static std::deque<std::pair<uint256, std::vector<std::pair<COutPoint, CGatewaysMarker> > > > gatewaysQueueUndo;
+
+static CWaitableCriticalSection cs_gatewaysqueuechanges;
+static CConditionVariable cvGatewaysQueueChange;
+static uint64_t nGatewaysQueueSequence;
+static std::map<uint256, uint64_t> mapGatewaysQueueSequence;
+
+// funcid of a marker tx, with the bindtxid of a deposit or withdraw and the withdrawtxid of a partial or complete
+// signing; only the opreturn is read
+static uint8_t GatewaysMarkerDecode(const CTransaction &tx, uint256 &bindtxid, uint256 &withdrawtxid)
+{
+    std::string coin,hex; std::vector<CPubKey> publishers; std::vector<uint256> txids; std::vector<uint8_t> proof;
+    uint256 tokenid,cointxid; CPubKey pubkey; int32_t height,claimvout,numvouts; int64_t amount; uint8_t K;
+
+    bindtxid = withdrawtxid = zeroid;
+    if ( (numvouts=tx.vout.size()) < 2 || tx.vout[0].nValue != CC_MARKER_VALUE || !tx.vout[0].scriptPubKey.IsPayToCryptoCondition() )
+        return 0;
+    switch ( DecodeGatewaysOpRet(tx.vout[numvouts-1].scriptPubKey) )
+    {
+        case 'D':
+            return DecodeGatewaysDepositOpRet(tx.vout[numvouts-1].scriptPubKey,bindtxid,coin,publishers,txids,height,cointxid,claimvout,hex,proof,pubkey,amount);
+        case 'W':
+            return DecodeGatewaysWithdrawOpRet(tx.vout[numvouts-1].scriptPubKey,tokenid,bindtxid,coin,pubkey,amount);
+        case 'P':
+            return DecodeGatewaysPartialOpRet(tx.vout[numvouts-1].scriptPubKey,withdrawtxid,coin,K,pubkey,hex);
+        case 'S':
+            return DecodeGatewaysCompleteSigningOpRet(tx.vout[numvouts-1].scriptPubKey,withdrawtxid,coin,K,hex);
+        default:
+            return 0;
+    }
+}
+
+// bindtxid of a withdraw read from its tx
+static bool GatewaysWithdrawBindtxid(const uint256 &withdrawtxid, uint256 &bindtxid)
+{
+    CTransaction withdrawtx; std::string coin; uint256 hashBlock,tokenid; CPubKey pubkey; int64_t amount; int32_t numvouts;
+
+    return myGetTransaction(withdrawtxid,withdrawtx,hashBlock) != 0 && (numvouts=withdrawtx.vout.size()) > 0 &&
+        DecodeGatewaysWithdrawOpRet(withdrawtx.vout[numvouts-1].scriptPubKey,tokenid,bindtxid,coin,pubkey,amount) == 'W';
+}
+
+// the unspent markers at addr read from the address index, leaving out those spent in the mempool if fMempool
+static void GatewaysScanMarkers(char *addr, bool fMempool, std::vector<std::pair<uint256, CTransaction> > &markers)
+{
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs; CTransaction tx; uint256 hashBlock;
+
+    SetCCunspents(unspentOutputs,addr,true);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    {
+        if ( it->first.index == 0 && it->second.satoshis == CC_MARKER_VALUE && myGetTransaction(it->first.txhash,tx,hashBlock) != 0 &&
+            (!fMempool || myIsutxo_spentinmempool(ignoretxid,ignorevin,it->first.txhash,0) == 0) )
+            markers.push_back(std::make_pair(it->first.txhash,tx));
+    }
+}
+
+static void GatewaysQueueNotify(const uint256 &bindtxid)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_gatewaysqueuechanges);
+        mapGatewaysQueueSequence[bindtxid] = ++nGatewaysQueueSequence;
+    }
+    cvGatewaysQueueChange.notify_all();
+}
+
+static void GatewaysQueueAdd(const COutPoint &outpoint, const CGatewaysMarker &marker)
+{
+    if ( marker.bindtxid.IsNull() )
+    {
+        // waiters cannot tell which queue it goes to until it is read
+        if ( mapGatewaysUnresolved.insert(std::make_pair(outpoint,marker)).second )
+            GatewaysQueueNotify(zeroid);
+        return;
+    }
+    if ( !mapGatewaysMarkers.insert(std::make_pair(outpoint,marker)).second )
+        return;
+    mapGatewaysQueues[marker.bindtxid].insert(outpoint);
+    GatewaysQueueNotify(marker.bindtxid);
+}
+
+static bool GatewaysQueueRemove(const COutPoint &outpoint, CGatewaysMarker &marker)
+{
+    std::map<COutPoint, CGatewaysMarker>::iterator it = mapGatewaysMarkers.find(outpoint);
+    if ( it == mapGatewaysMarkers.end() )
+    {
+        if ( (it=mapGatewaysUnresolved.find(outpoint)) == mapGatewaysUnresolved.end() )
+            return false;
+        marker = it->second;
+        mapGatewaysUnresolved.erase(it);
+        return true;
+    }
+    marker = it->second;
+    mapGatewaysMarkers.erase(it);
+    std::map<uint256, std::set<COutPoint> >::iterator itQueue = mapGatewaysQueues.find(marker.bindtxid);
+    if ( itQueue != mapGatewaysQueues.end() )
+    {
+        itQueue->second.erase(outpoint);
+        if ( itQueue->second.empty() )
+            mapGatewaysQueues.erase(itQueue);
+    }
+    GatewaysQueueNotify(marker.bindtxid);
+    return true;
+}
+
+// decodes a marker tx into marker, taking the bindtxid of a signing from the withdraws seen
+static bool GatewaysQueueDecode(const CTransaction &tx, const std::string &addr, CGatewaysMarker &marker)
+{
+    uint8_t funcid = GatewaysMarkerDecode(tx,marker.bindtxid,marker.withdrawtxid);
+
+    marker.addr = addr;
+    if ( funcid == 'W' )
+        mapGatewaysWithdraws[tx.GetHash()] = marker.bindtxid;
+    else if ( funcid == 'P' || funcid == 'S' )
+    {
+        std::map<uint256, uint256>::const_iterator it = mapGatewaysWithdraws.find(marker.withdrawtxid);
+        if ( it != mapGatewaysWithdraws.end() )
+            marker.bindtxid = it->second;
+    }
+    return funcid == 'D' || funcid == 'W' || funcid == 'P' || funcid == 'S';
+}
+
+static void GatewaysQueueUnload()
+{
+    setGatewaysQueueAddrs.clear();
+    mapGatewaysMarkers.clear();
+    mapGatewaysQueues.clear();
+    mapGatewaysUnresolved.clear();
+    mapGatewaysWithdraws.clear();
+    gatewaysQueueUndo.clear();
+    GatewaysQueueNotify(zeroid);
+}
+
+// needs cs_main, so that no block is connected meanwhile
+static void GatewaysQueueLoad(const std::string &addr)
+{
+    std::vector<std::pair<uint256, CTransaction> > markers; CGatewaysMarker marker;
+
+    AssertLockHeld(cs_main);
+    if ( setGatewaysQueueAddrs.count(addr) != 0 )
+        return;
+    GatewaysScanMarkers((char *)addr.c_str(),false,markers);
+    for (int32_t i=0; i<markers.size(); i++)
+    {
+        if ( GatewaysQueueDecode(markers[i].second,addr,marker) )
+        {
+            if ( marker.bindtxid.IsNull() && GatewaysWithdrawBindtxid(marker.withdrawtxid,marker.bindtxid) )
+                mapGatewaysWithdraws[marker.withdrawtxid] = marker.bindtxid;
+            if ( !marker.bindtxid.IsNull() )
+                GatewaysQueueAdd(COutPoint(markers[i].first,0),marker);
+        }
+    }
+    setGatewaysQueueAddrs.insert(addr);
+    // the undo kept so far misses the markers of addr, so a disconnect of those blocks reads all addresses again
+    gatewaysQueueUndo.clear();
+    LogPrint("gatewayscc","GatewaysQueueLoad() loaded %s, %u markers in all\n",addr.c_str(),(unsigned int)mapGatewaysMarkers.size());
+}
+
+// reads the withdraws of the signings connected before their withdraw was seen, without cs_main or the queue lock
+static void GatewaysQueueResolve()
+{
+    std::vector<std::pair<COutPoint, uint256> > unresolved,resolved; uint256 bindtxid;
+
+    {
+        LOCK(cs_gatewaysqueue);
+        for (std::map<COutPoint, CGatewaysMarker>::const_iterator it=mapGatewaysUnresolved.begin(); it!=mapGatewaysUnresolved.end(); it++)
+            unresolved.push_back(std::make_pair(it->first,it->second.withdrawtxid));
+    }
+    for (int32_t i=0; i<unresolved.size(); i++)
+        resolved.push_back(std::make_pair(unresolved[i].first,GatewaysWithdrawBindtxid(unresolved[i].second,bindtxid) ? bindtxid : zeroid));
+
+    LOCK(cs_gatewaysqueue);
+    for (int32_t i=0; i<resolved.size(); i++)
+    {
+        std::map<COutPoint, CGatewaysMarker>::iterator it = mapGatewaysUnresolved.find(resolved[i].first);
+        if ( it == mapGatewaysUnresolved.end() )  // spent or disconnected meanwhile
+            continue;
+        CGatewaysMarker marker = it->second;
+        mapGatewaysUnresolved.erase(it);
+        // a signing of no withdraw is left out, as by the address index scan
+        if ( !(marker.bindtxid=resolved[i].second).IsNull() )
+        {
+            mapGatewaysWithdraws[marker.withdrawtxid] = marker.bindtxid;
+            GatewaysQueueAdd(resolved[i].first,marker);
+        }
+    }
+}
+
+void GatewaysQueueBlockConnected(const CBlock &block)
+{
+    LOCK(cs_gatewaysqueue);
+    if ( setGatewaysQueueAddrs.empty() )
+        return;
+
+    std::vector<std::pair<COutPoint, CGatewaysMarker> > spent;
+    for (int32_t i=0; i<block.vtx.size(); i++)
+    {
+        const CTransaction &tx = block.vtx[i];
+        CGatewaysMarker marker; char addr[64];
+
+        if ( !tx.IsCoinBase() )
+        {
+            for (int32_t j=0; j<tx.vin.size(); j++)
+                if ( GatewaysQueueRemove(tx.vin[j].prevout,marker) )
+                    spent.push_back(std::make_pair(tx.vin[j].prevout,marker));
+        }
+        if ( tx.vout.size() > 1 && tx.vout[0].nValue == CC_MARKER_VALUE && Getscriptaddress(addr,tx.vout[0].scriptPubKey) &&
+            setGatewaysQueueAddrs.count(addr) != 0 && GatewaysQueueDecode(tx,addr,marker) )
+            GatewaysQueueAdd(COutPoint(tx.GetHash(),0),marker);
+    }
+    gatewaysQueueUndo.push_back(std::make_pair(block.GetHash(),spent));
+    if ( gatewaysQueueUndo.size() > GATEWAYS_QUEUE_MAXUNDO )
+        gatewaysQueueUndo.pop_front();
+}
+
+void GatewaysQueueBlockDisconnected(const CBlock &block)
+{
+    LOCK(cs_gatewaysqueue);
+    if ( setGatewaysQueueAddrs.empty() )
+        return;
+    if ( gatewaysQueueUndo.empty() || gatewaysQueueUndo.back().first != block.GetHash() )
+    {
+        // deeper than the undo kept, read the addresses again at their next query
+        GatewaysQueueUnload();
+        return;
+    }
+
+    std::set<uint256> txids; CGatewaysMarker marker;
+    for (int32_t i=block.vtx.size()-1; i>=0; i--)
+    {
+        txids.insert(block.vtx[i].GetHash());
+        GatewaysQueueRemove(COutPoint(block.vtx[i].GetHash(),0),marker);
+        mapGatewaysWithdraws.erase(block.vtx[i].GetHash());
+    }
+    const std::vector<std::pair<COutPoint, CGatewaysMarker> > &spent = gatewaysQueueUndo.back().second;
+    for (int32_t i=0; i<spent.size(); i++)
+        if ( txids.count(spent[i].first.hash) == 0 )  // not created and spent in this block
+            GatewaysQueueAdd(spent[i].first,spent[i].second);
+    gatewaysQueueUndo.pop_back();
+}
+
+// a tx accepted to the mempool that spends a queued marker changes the queue of its bindtxid
+void GatewaysQueueTxAccepted(const CTransaction &tx)
+{
+    LOCK(cs_gatewaysqueue);
+    for (int32_t i=0; i<tx.vin.size(); i++)
+    {
+        std::map<COutPoint, CGatewaysMarker>::const_iterator it = mapGatewaysMarkers.find(tx.vin[i].prevout);
+        if ( it != mapGatewaysMarkers.end() )
+            GatewaysQueueNotify(it->second.bindtxid);
+    }
+}
+
+// the txids of the markers at addr in the queue of bindtxid that are not spent in the mempool, false if there is no queue
+bool GatewaysQueueTxids(uint256 bindtxid, char *addr, std::vector<uint256> &txids)
+{
+    std::vector<COutPoint> queued; bool fLoaded;
+
+    if ( KOMODO_NSPV_SUPERLITE )
+        return false;
+    {
+        LOCK(cs_gatewaysqueue);
+        fLoaded = setGatewaysQueueAddrs.count(addr) != 0;
+    }
+    if ( !fLoaded )
+    {
+        LOCK2(cs_main,cs_gatewaysqueue);
+        GatewaysQueueLoad(addr);
+    }
+    GatewaysQueueResolve();
+    {
+        LOCK(cs_gatewaysqueue);
+        if ( setGatewaysQueueAddrs.count(addr) == 0 )  // dropped by a reorg meanwhile
+            return false;
+        std::map<uint256, std::set<COutPoint> >::const_iterator itQueue = mapGatewaysQueues.find(bindtxid);
+        if ( itQueue != mapGatewaysQueues.end() )
+            for (std::set<COutPoint>::const_iterator it=itQueue->second.begin(); it!=itQueue->second.end(); it++)
+                if ( mapGatewaysMarkers[*it].addr == addr )
+                    queued.push_back(*it);
+    }
+    LOCK(mempool.cs);
+    for (int32_t i=0; i<queued.size(); i++)
+        if ( mempool.mapNextTx.count(queued[i]) == 0 )
+            txids.push_back(queued[i].hash);
+    return true;
+}
+
+// the markers of GatewaysQueueTxids with their txs, or the markers at addr read from the address index when
+// there is no queue
+static void GatewaysQueueMarkers(uint256 bindtxid, char *addr, std::vector<std::pair<uint256, CTransaction> > &markers)
+{
+    std::vector<uint256> txids; CTransaction tx; uint256 hashBlock;
+
+    if ( !GatewaysQueueTxids(bindtxid,addr,txids) )
+    {
+        GatewaysScanMarkers(addr,true,markers);
+        return;
+    }
+    for (int32_t i=0; i<txids.size(); i++)
+        if ( myGetTransaction(txids[i],tx,hashBlock) != 0 )
+            markers.push_back(std::make_pair(txids[i],tx));
+}
+
+// waits upto nMillis for the queue of bindtxid to change after sequence, reading the gateways global address
+// and the deposit address of pk first; returns the last change
+uint64_t GatewaysQueueWait(const CPubKey &pk, uint256 bindtxid, uint64_t sequence, int64_t nMillis)
+{
+    struct CCcontract_info *cp,C; char coinaddr[64],depositaddr[64]; bool fLoaded;
+
+    cp = CCinit(&C,EVAL_GATEWAYS);
+    _GetCCaddress(coinaddr,EVAL_GATEWAYS,GetUnspendable(cp,0));
+    _GetCCaddress(depositaddr,EVAL_GATEWAYS,pk);
+    {
+        LOCK(cs_gatewaysqueue);
+        fLoaded = setGatewaysQueueAddrs.count(coinaddr) != 0 && setGatewaysQueueAddrs.count(depositaddr) != 0;
+    }
+    if ( !fLoaded )
+    {
+        LOCK2(cs_main,cs_gatewaysqueue);
+        GatewaysQueueLoad(coinaddr);
+        GatewaysQueueLoad(depositaddr);
+    }
+    GatewaysQueueResolve();
+
+    boost::system_time timeout = boost::get_system_time() + boost::posix_time::milliseconds(nMillis);
+    boost::unique_lock<boost::mutex> lock(cs_gatewaysqueuechanges);
+    while ( true )
+    {
+        // zeroid is bumped when the queues are dropped
+        std::map<uint256, uint64_t>::const_iterator it = mapGatewaysQueueSequence.find(bindtxid);
+        uint64_t last = std::max(mapGatewaysQueueSequence[zeroid], it != mapGatewaysQueueSequence.end() ? it->second : (uint64_t)0);
+        if ( last > sequence || !cvGatewaysQueueChange.timed_wait(lock,timeout) )
+            return last;
+    }
+}
+
 UniValue GatewaysPendingDeposits(const CPubKey& pk, uint256 bindtxid,std::string refcoin)
 {
     UniValue result(UniValue::VOBJ),pending(UniValue::VARR); CTransaction tx; std::string coin,hex,pub; 
@@ -1219,7 +1576,7 @@ UniValue GatewaysPendingDeposits(const CPubKey& pk, uint256 bindtxid,std::string
     uint256 tmpbindtxid,hashBlock,txid,tokenid,oracletxid,cointxid; uint8_t M,N,taddr,prefix,prefix2,wiftype;
     char depositaddr[65],coinaddr[65],str[65],destaddr[65],txidaddr[65]; std::vector<uint8_t> proof;
     int32_t numvouts,vout,claimvout,height; int64_t totalsupply,nValue,amount; struct CCcontract_info *cp,C;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    std::vector<std::pair<uint256, CTransaction> > markers;
 
     cp = CCinit(&C,EVAL_GATEWAYS);
     mypk = pk.IsValid()?pk:pubkey2pk(Mypubkey());
@@ -1237,15 +1594,14 @@ UniValue GatewaysPendingDeposits(const CPubKey& pk, uint256 bindtxid,std::string
         result.push_back(Pair("error",strprintf("invalid bindtxid %s coin.%s",uint256_str(str,bindtxid),coin.c_str())));     
         return(result);
     }  
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    GatewaysQueueMarkers(bindtxid,coinaddr,markers);
+    for (std::vector<std::pair<uint256, CTransaction> >::const_iterator it=markers.begin(); it!=markers.end(); it++)
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        nValue = (int64_t)it->second.satoshis;
-        if ( vout == 0 && nValue == CC_MARKER_VALUE && myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts=tx.vout.size())>0 &&
+        txid = it->first;
+        tx = it->second;
+        if ( (numvouts=tx.vout.size())>0 &&
             DecodeGatewaysDepositOpRet(tx.vout[numvouts-1].scriptPubKey,tmpbindtxid,coin,publishers,txids,height,cointxid,claimvout,hex,proof,destpub,amount) == 'D'
-            && tmpbindtxid==bindtxid && refcoin == coin && myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0)
+            && tmpbindtxid==bindtxid && refcoin == coin)
         {   
             UniValue obj(UniValue::VOBJ);
             obj.push_back(Pair("cointxid",uint256_str(str,cointxid)));
@@ -1273,7 +1629,7 @@ UniValue GatewaysPendingWithdraws(const CPubKey& pk, uint256 bindtxid,std::strin
     std::vector<CPubKey> msigpubkeys; uint256 hashBlock,tokenid,txid,tmpbindtxid,tmptokenid,oracletxid,withdrawtxid; uint8_t K,M,N,taddr,prefix,prefix2,wiftype;
     char funcid,depositaddr[65],coinaddr[65],tokensaddr[65],destaddr[65],str[65],withaddr[65],numstr[32],signeraddr[65],txidaddr[65];
     int32_t i,n,numvouts,vout,queueflag; int64_t totalsupply,amount,nValue; struct CCcontract_info *cp,C;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    std::vector<std::pair<uint256, CTransaction> > markers;
 
     cp = CCinit(&C,EVAL_GATEWAYS);
     mypk = pk.IsValid()?pk:pubkey2pk(Mypubkey());
@@ -1300,15 +1656,14 @@ UniValue GatewaysPendingWithdraws(const CPubKey& pk, uint256 bindtxid,std::strin
             queueflag = 1;
             break;
         }    
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    GatewaysQueueMarkers(bindtxid,coinaddr,markers);
+    for (std::vector<std::pair<uint256, CTransaction> >::const_iterator it=markers.begin(); it!=markers.end(); it++)
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        nValue = (int64_t)it->second.satoshis;
+        txid = it->first;
+        tx = it->second;
         K=0;
-        if ( vout == 0 && nValue == CC_MARKER_VALUE && myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts= tx.vout.size())>0 &&
-            (funcid=DecodeGatewaysOpRet(tx.vout[numvouts-1].scriptPubKey))!=0 && (funcid=='W' || funcid=='P') && myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0)
+        if ( (numvouts= tx.vout.size())>0 &&
+            (funcid=DecodeGatewaysOpRet(tx.vout[numvouts-1].scriptPubKey))!=0 && (funcid=='W' || funcid=='P'))
         {
             if (funcid=='W')
             {
@@ -1359,10 +1714,10 @@ UniValue GatewaysProcessedWithdraws(const CPubKey& pk, uint256 bindtxid,std::str
 {
     UniValue result(UniValue::VOBJ),processed(UniValue::VARR); CTransaction tx; std::string coin,hex; 
     CPubKey mypk,gatewayspk,withdrawpub; std::vector<CPubKey> msigpubkeys;
-    uint256 withdrawtxid,hashBlock,txid,tokenid,tmptokenid,oracletxid; uint8_t K,M,N,taddr,prefix,prefix2,wiftype;
+    uint256 withdrawtxid,hashBlock,txid,tokenid,tmptokenid,tmpbindtxid,oracletxid; uint8_t K,M,N,taddr,prefix,prefix2,wiftype;
     char depositaddr[65],coinaddr[65],str[65],numstr[32],withaddr[65],txidaddr[65];
     int32_t i,n,numvouts,vout,queueflag; int64_t totalsupply,nValue,amount; struct CCcontract_info *cp,C;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    std::vector<std::pair<uint256, CTransaction> > markers;
 
     cp = CCinit(&C,EVAL_GATEWAYS);
     mypk = pk.IsValid()?pk:pubkey2pk(Mypubkey());
@@ -1388,17 +1743,16 @@ UniValue GatewaysProcessedWithdraws(const CPubKey& pk, uint256 bindtxid,std::str
             queueflag = 1;
             break;
         }    
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    GatewaysQueueMarkers(bindtxid,coinaddr,markers);
+    for (std::vector<std::pair<uint256, CTransaction> >::const_iterator it=markers.begin(); it!=markers.end(); it++)
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        nValue = (int64_t)it->second.satoshis;
-        if ( vout == 0 && nValue == CC_MARKER_VALUE && myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts= tx.vout.size())>0 &&
-            DecodeGatewaysCompleteSigningOpRet(tx.vout[numvouts-1].scriptPubKey,withdrawtxid,coin,K,hex) == 'S' && refcoin == coin && myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0)
+        txid = it->first;
+        tx = it->second;
+        if ( (numvouts= tx.vout.size())>0 &&
+            DecodeGatewaysCompleteSigningOpRet(tx.vout[numvouts-1].scriptPubKey,withdrawtxid,coin,K,hex) == 'S' && refcoin == coin)
         {   
             if (myGetTransaction(withdrawtxid,tx,hashBlock) != 0 && (numvouts= tx.vout.size())>0
-                && DecodeGatewaysWithdrawOpRet(tx.vout[numvouts-1].scriptPubKey,tmptokenid,bindtxid,coin,withdrawpub,amount) == 'W' || refcoin!=coin || tmptokenid!=tokenid)          
+                && DecodeGatewaysWithdrawOpRet(tx.vout[numvouts-1].scriptPubKey,tmptokenid,tmpbindtxid,coin,withdrawpub,amount) == 'W' && refcoin==coin && tmptokenid==tokenid && tmpbindtxid==bindtxid)
             {
                 UniValue obj(UniValue::VOBJ);
                 obj.push_back(Pair("completesigningtxid",uint256_str(str,txid)));
@@ -387,15 +387,55 @@ void CheckVinPubkey(std::vector<CTxIn> vins, CPubKey pubkey, bool &hasPubkey, bo
 	}
 }
 
+// Latest state of the heir plans looked up so far: the unspent outputs at the 1of2 address of each plan sent
+// by the owner's own txs for the plan, kept up to date by HeirBlockConnected so that the address is only
+// scanned on the first lookup of a plan. HeirBlockDisconnected drops the plans instead of undoing the block,
+// they are scanned again on the next lookup.
+// Only the rpc calls use the kept plans, HeirValidate always scans the address index.
+
+struct CHeirPlanState {
+    uint256 tokenid;
+    CPubKey ownerPubkey, heirPubkey;
+    int64_t inactivityTime;
+    std::string heirName, memo;
+    CScript fundingOpretScript;
+    std::string coinaddr;
+    // (-height, outpoint) -> (funcId, hasHeirSpendingBegun), so the latest output comes first
+    std::map<std::pair<int32_t, COutPoint>, std::pair<uint8_t, uint8_t> > outputs;
+};
+
+static CCriticalSection cs_heirplans;
+static std::map<uint256, CHeirPlanState> mapHeirPlans;
+static std::map<COutPoint, std::pair<uint256, int32_t> > mapHeirPlanOutputs;   // -> fundingtxid, height
+static uint64_t nHeirPlansSequence;     // bumped on each block, a scan across a block is not kept
+
+static void HeirPlanAdd(const uint256 &fundingtxid, CHeirPlanState &plan, const COutPoint &outpoint, int32_t height, uint8_t funcId, uint8_t hasHeirSpendingBegun)
+{
+    plan.outputs[std::make_pair(-height, outpoint)] = std::make_pair(funcId, hasHeirSpendingBegun);
+    mapHeirPlanOutputs[outpoint] = std::make_pair(fundingtxid, height);
+}
+
+// the latest tx of the plan is the one at the greatest height, and the first in the address index order of those
+static uint256 HeirPlanLatest(const uint256 &fundingtxid, const CHeirPlanState &plan, uint8_t &funcId, uint8_t &hasHeirSpendingBegun)
+{
+    if (plan.outputs.empty())
+        return fundingtxid;
+    funcId = plan.outputs.begin()->second.first;
+    hasHeirSpendingBegun = plan.outputs.begin()->second.second;
+    return plan.outputs.begin()->first.second.hash;
+}
+
 /**
  * find the latest funding tx: it may be the first F tx or one of A or C tx's
- * Note: this function is also called from validation code (use non-locking calls)
+ * Note: this function is also called from validation code (use non-locking calls), which passes fKeptPlans = false
  */
-uint256 _FindLatestFundingTx(uint256 fundingtxid, uint8_t& funcId, uint256 &tokenid, CPubKey& ownerPubkey, CPubKey& heirPubkey, int64_t& inactivityTime, std::string& heirName, std::string& memo, CScript& fundingOpretScript, uint8_t &hasHeirSpendingBegun)
+uint256 _FindLatestFundingTx(uint256 fundingtxid, uint8_t& funcId, uint256 &tokenid, CPubKey& ownerPubkey, CPubKey& heirPubkey, int64_t& inactivityTime, std::string& heirName, std::string& memo, CScript& fundingOpretScript, uint8_t &hasHeirSpendingBegun, bool fKeptPlans)
 {
     CTransaction fundingtx;
     uint256 hashBlock;
     const bool allowSlow = false;
+    CHeirPlanState plan;
+    uint64_t sequence = 0;
     
     //char markeraddr[64];
     //CCtxidaddr(markeraddr, fundingtxid);
@@ -403,6 +443,22 @@ uint256 _FindLatestFundingTx(uint256 fundingtxid, uint8_t& funcId, uint256 &toke
     
     hasHeirSpendingBegun = 0;
     funcId = 0;
+
+    if (fKeptPlans) {
+        LOCK(cs_heirplans);
+        std::map<uint256, CHeirPlanState>::const_iterator it = mapHeirPlans.find(fundingtxid);
+        if (it != mapHeirPlans.end()) {
+            tokenid = it->second.tokenid;
+            ownerPubkey = it->second.ownerPubkey;
+            heirPubkey = it->second.heirPubkey;
+            inactivityTime = it->second.inactivityTime;
+            heirName = it->second.heirName;
+            memo = it->second.memo;
+            fundingOpretScript = it->second.fundingOpretScript;
+            return HeirPlanLatest(fundingtxid, it->second, funcId, hasHeirSpendingBegun);
+        }
+        sequence = nHeirPlansSequence;
+    }
     
     // get initial funding tx and set it as initial lasttx:
     if (myGetTransaction(fundingtxid, fundingtx, hashBlock) && fundingtx.vout.size()) {
@@ -432,9 +488,6 @@ uint256 _FindLatestFundingTx(uint256 fundingtxid, uint8_t& funcId, uint256 &toke
     SetCCunspents(unspentOutputs, coinaddr,true);				 // get vector with tx's with unspent vouts of 1of2pubkey address:
     //std::cerr << "FindLatestFundingTx() using 1of2address=" << coinaddr << " unspentOutputs.size()=" << unspentOutputs.size() << '\n';
     
-    int32_t maxBlockHeight = 0; // max block height
-    uint256 latesttxid = fundingtxid;
-    
     // try to find the last funding or spending tx by checking fundingtxid in 'opreturn':
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++) {
         CTransaction regtx;
@@ -447,7 +500,6 @@ uint256 _FindLatestFundingTx(uint256 fundingtxid, uint8_t& funcId, uint256 &toke
         
         //NOTE: maybe called from validation code:
         if (myGetTransaction(txid, regtx, hash)) {
-            //std::cerr << "FindLatestFundingTx() found tx for txid=" << txid.GetHex() << " blockHeight=" << blockHeight << " maxBlockHeight=" << maxBlockHeight << '\n';
             uint256 fundingTxidInOpret;
             uint256 tokenidInOpret;  // not to contaminate the tokenid from the params!
             uint8_t tmpFuncId;
@@ -456,33 +508,106 @@ uint256 _FindLatestFundingTx(uint256 fundingtxid, uint8_t& funcId, uint256 &toke
             CScript heirScript = (regtx.vout.size() > 0) ? regtx.vout[regtx.vout.size() - 1].scriptPubKey : CScript();
             tmpFuncId = DecodeHeirEitherOpRet(heirScript, tokenidInOpret, fundingTxidInOpret, hasHeirSpendingBegunInOpret, true);
             if (tmpFuncId != 0 && fundingtxid == fundingTxidInOpret && (tokenid == zeroid || tokenid == tokenidInOpret)) {  // check tokenid also
-                
-                if (blockHeight > maxBlockHeight) {
-
-					// check owner pubkey in vins
-					bool isOwner = false;
-					bool isNonOwner = false;
-
-					CheckVinPubkey(regtx.vin, ownerPubkey, isOwner, isNonOwner);
-
-					// we ignore 'donations' tx (with non-owner inputs) for calculating if heir is allowed to spend:
-					if (isOwner && !isNonOwner) {
-						hasHeirSpendingBegun = hasHeirSpendingBegunInOpret;
-						maxBlockHeight = blockHeight;
-						latesttxid = txid;
-						funcId = tmpFuncId;
-					}
-                    
-                    //std::cerr << "FindLatestFundingTx() txid=" << latesttxid.GetHex() << " at blockHeight=" << maxBlockHeight
-                    //	<< " opreturn type=" << (char)(funcId ? funcId : ' ') << " hasHeirSpendingBegun=" << (int)hasHeirSpendingBegun << " - set as current lasttxid" << '\n';
-                }
+
+                // check owner pubkey in vins
+                bool isOwner = false;
+                bool isNonOwner = false;
+
+                CheckVinPubkey(regtx.vin, ownerPubkey, isOwner, isNonOwner);
+
+                // we ignore 'donations' tx (with non-owner inputs) for calculating if heir is allowed to spend:
+                if (isOwner && !isNonOwner && blockHeight > 0)
+                    plan.outputs[std::make_pair(-blockHeight, COutPoint(txid, it->first.index))] = std::make_pair(tmpFuncId, hasHeirSpendingBegunInOpret);
             }
         }
     }
-    
+
+    uint256 latesttxid = HeirPlanLatest(fundingtxid, plan, funcId, hasHeirSpendingBegun);
+
+    // keep the plan if no block came in meanwhile and it is not going to change with the mempool
+    if (fKeptPlans && !KOMODO_NSPV_SUPERLITE && !hashBlock.IsNull()) {
+        LOCK(cs_heirplans);
+        if (sequence == nHeirPlansSequence && mapHeirPlans.count(fundingtxid) == 0) {
+            CHeirPlanState &cached = mapHeirPlans[fundingtxid];
+            cached.tokenid = tokenid;
+            cached.ownerPubkey = ownerPubkey;
+            cached.heirPubkey = heirPubkey;
+            cached.inactivityTime = inactivityTime;
+            cached.heirName = heirName;
+            cached.memo = memo;
+            cached.fundingOpretScript = fundingOpretScript;
+            cached.coinaddr = coinaddr;
+            for (std::map<std::pair<int32_t, COutPoint>, std::pair<uint8_t, uint8_t> >::const_iterator it = plan.outputs.begin(); it != plan.outputs.end(); it++)
+                HeirPlanAdd(fundingtxid, cached, it->first.second, -it->first.first, it->second.first, it->second.second);
+        }
+    }
     return latesttxid;
 }
 
+void HeirBlockConnected(int32_t height, const CBlock &block)
+{
+    LOCK(cs_heirplans);
+    nHeirPlansSequence++;
+    if (mapHeirPlans.empty())
+        return;
+
+    for (int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        uint256 tokenidInOpret, fundingTxidInOpret;
+        uint8_t funcId, hasHeirSpendingBegunInOpret;
+        char addr[64];
+
+        if (!tx.IsCoinBase()) {
+            for (int j = 0; j < tx.vin.size(); j++) {
+                std::map<COutPoint, std::pair<uint256, int32_t> >::iterator itOutput = mapHeirPlanOutputs.find(tx.vin[j].prevout);
+                if (itOutput != mapHeirPlanOutputs.end()) {
+                    std::map<uint256, CHeirPlanState>::iterator itPlan = mapHeirPlans.find(itOutput->second.first);
+                    if (itPlan != mapHeirPlans.end())
+                        itPlan->second.outputs.erase(std::make_pair(-itOutput->second.second, itOutput->first));
+                    mapHeirPlanOutputs.erase(itOutput);
+                }
+            }
+        }
+
+        CScript heirScript = (tx.vout.size() > 0) ? tx.vout[tx.vout.size() - 1].scriptPubKey : CScript();
+        if ((funcId = DecodeHeirEitherOpRet(heirScript, tokenidInOpret, fundingTxidInOpret, hasHeirSpendingBegunInOpret, true)) == 0)
+            continue;
+        std::map<uint256, CHeirPlanState>::iterator itPlan = mapHeirPlans.find(fundingTxidInOpret);
+        if (itPlan == mapHeirPlans.end() || (itPlan->second.tokenid != zeroid && itPlan->second.tokenid != tokenidInOpret))
+            continue;
+        bool isOwner = false, isNonOwner = false;
+        CheckVinPubkey(tx.vin, itPlan->second.ownerPubkey, isOwner, isNonOwner);
+        if (!isOwner || isNonOwner)
+            continue;
+        for (int j = 0; j < tx.vout.size(); j++) {
+            if (tx.vout[j].scriptPubKey.IsPayToCryptoCondition() && Getscriptaddress(addr, tx.vout[j].scriptPubKey) && itPlan->second.coinaddr == addr)
+                HeirPlanAdd(fundingTxidInOpret, itPlan->second, COutPoint(tx.GetHash(), j), height, funcId, hasHeirSpendingBegunInOpret);
+        }
+    }
+}
+
+void HeirBlockDisconnected(const CBlock &block)
+{
+    LOCK(cs_heirplans);
+    nHeirPlansSequence++;
+    if (mapHeirPlans.empty())
+        return;
+
+    // heir outputs are only spent by txs with a heir opreturn, blocks without any do not change a plan
+    for (int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        uint256 tokenidInOpret, fundingTxidInOpret;
+        uint8_t hasHeirSpendingBegunInOpret;
+
+        CScript heirScript = (tx.vout.size() > 0) ? tx.vout[tx.vout.size() - 1].scriptPubKey : CScript();
+        if (DecodeHeirEitherOpRet(heirScript, tokenidInOpret, fundingTxidInOpret, hasHeirSpendingBegunInOpret, true) != 0) {
+            mapHeirPlans.clear();
+            mapHeirPlanOutputs.clear();
+            return;
+        }
+    }
+}
+
 // overload for validation code
 uint256 FindLatestFundingTx(uint256 fundingtxid, uint256 &tokenid, CScript& opRetScript, uint8_t &hasHeirSpendingBegun)
 {
@@ -492,7 +617,7 @@ uint256 FindLatestFundingTx(uint256 fundingtxid, uint256 &tokenid, CScript& opRe
     int64_t inactivityTime;
     std::string heirName, memo;
     
-    return _FindLatestFundingTx(fundingtxid, funcId, tokenid, ownerPubkey, heirPubkey, inactivityTime, heirName, memo, opRetScript, hasHeirSpendingBegun);
+    return _FindLatestFundingTx(fundingtxid, funcId, tokenid, ownerPubkey, heirPubkey, inactivityTime, heirName, memo, opRetScript, hasHeirSpendingBegun, false);
 }
 
 // overload for transaction creation code
@@ -500,7 +625,7 @@ uint256 FindLatestFundingTx(uint256 fundingtxid, uint8_t& funcId, uint256 &token
 {
     CScript opRetScript;
     
-    return _FindLatestFundingTx(fundingtxid, funcId, tokenid, ownerPubkey, heirPubkey, inactivityTime, heirName, memo, opRetScript, hasHeirSpendingBegun);
+    return _FindLatestFundingTx(fundingtxid, funcId, tokenid, ownerPubkey, heirPubkey, inactivityTime, heirName, memo, opRetScript, hasHeirSpendingBegun, true);
 }
 
 // add inputs of 1 of 2 cc address
@@ -432,7 +432,7 @@ int32_t CheckGATEWAYimport(CTransaction importTx,CTransaction burnTx,std::string
     merkleroot = zeroid;
     for (i = m = 0; i < n; i++)
     {
-        if ((mhash = CCOraclesReverseScan("importgateway-1",txid, height, oracletxid, OraclesBatontxid(oracletxid, pubkeys[i]))) != zeroid)
+        if ((mhash = CCOraclesReverseScan("importgateway-1",txid, height, oracletxid, OraclesBatontxid(oracletxid, pubkeys[i], false), false)) != zeroid)
         {
             if (merkleroot == zeroid)
                 merkleroot = mhash, m = 1;
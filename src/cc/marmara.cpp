@@ -154,14 +154,407 @@ int32_t MarmaraGetcreatetxid(uint256 &createtxid,uint256 txid)
     return(-1);
 }
 
+// The Marmara index: the confirmed part of the baton chain of each credit loop walked so far, the unspent outputs
+// of each activated (1of2) address queried so far with their totals, and the open issuance markers at the Marmara
+// global address. Each part is read on its first query under cs_main and then kept up to date by
+// MarmaraBlockConnected and MarmaraBlockDisconnected; outputs spent in the mempool are left out when queried.
+// NSPV superlite clients have no spent index of their own and keep reading the address index of their server.
+
+#define MARMARA_INDEX_MAXUNDO 100  // connected blocks whose spent outputs are kept for a disconnect
+
+struct CMarmaraActivated {
+    CAmount nValue;
+    CScript scriptPubKey;
+    int32_t height;
+    uint8_t funcid;  // 'C', 'P' or 'L' of the coinbase opret of its tx, 0 for any other tx
+    CPubKey pk;
+    int32_t unlockht;
+};
+
+struct CMarmaraActivatedAddr {
+    std::map<COutPoint, CMarmaraActivated> outputs;
+    CAmount nTotal;
+    CAmount nLocked;  // of the 'L' outputs
+    CMarmaraActivatedAddr() : nTotal(0), nLocked(0) {}
+};
+
+struct CMarmaraIssuance {
+    CPubKey senderpk;
+    int64_t amount;
+    int32_t matures;
+    std::string currency;
+};
+
+struct CMarmaraIndexUndo {
+    uint256 hashBlock;
+    std::vector<std::pair<COutPoint, std::pair<std::string, CMarmaraActivated> > > activated;
+    std::vector<std::pair<COutPoint, CMarmaraIssuance> > issuances;
+};
+
+static CCriticalSection cs_marmaraindex;
+static std::map<uint256, std::vector<uint256> > mapMarmaraLoops;  // createtxid -> chain, vout 0 of the last one unspent
+static std::multimap<uint256, uint256> mapMarmaraLoopTips;         // last of a chain -> createtxid
+static std::map<std::string, CMarmaraActivatedAddr> mapMarmaraActivated;
+static std::map<COutPoint, std::string> mapMarmaraActivatedAddrs;
+static bool fMarmaraIssuancesLoaded;
+static std::string strMarmaraIssuancesAddr;
+static std::map<COutPoint, CMarmaraIssuance> mapMarmaraIssuances;
+static std::deque<CMarmaraIndexUndo> marmaraIndexUndo;
+
+static CMarmaraActivated MarmaraActivatedOutput(const CTransaction &tx, int32_t vout, int32_t height)
+{
+    CMarmaraActivated output; int32_t ht;
+    output.nValue = tx.vout[vout].nValue;
+    output.scriptPubKey = tx.vout[vout].scriptPubKey;
+    output.height = height;
+    output.unlockht = 0;
+    output.funcid = DecodeMaramaraCoinbaseOpRet(tx.vout[tx.vout.size()-1].scriptPubKey,output.pk,ht,output.unlockht);
+    return(output);
+}
+
+// the issuance of an 'I' tx whose marker vout 1 is at addr
+static bool MarmaraIssuanceOutput(const CTransaction &tx, const std::string &addr, CMarmaraIssuance &issuance)
+{
+    uint256 createtxid; int32_t numvouts; char markeraddr[64];
+    if ( tx.IsCoinBase() != 0 || (numvouts= tx.vout.size()) <= 2 || tx.vout[numvouts - 1].nValue != 0 )
+        return false;
+    if ( Getscriptaddress(markeraddr,tx.vout[1].scriptPubKey) == 0 || addr != markeraddr )
+        return false;
+    return MarmaraDecodeLoopOpret(tx.vout[numvouts-1].scriptPubKey,createtxid,issuance.senderpk,issuance.amount,issuance.matures,issuance.currency) == 'I';
+}
+
+// the unspent outputs at the activated address coinaddr read from the address index, leaving out those spent in
+// the mempool if fMempool
+static void MarmaraScanActivated(char *coinaddr, bool fMempool, std::vector<std::pair<COutPoint, CMarmaraActivated> > &outputs)
+{
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs; CTransaction tx; uint256 hashBlock; int32_t vout;
+
+    SetCCunspents(unspentOutputs,coinaddr,true);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    {
+        vout = (int32_t)it->first.index;
+        if ( myGetTransaction(it->first.txhash,tx,hashBlock) != 0 && vout < tx.vout.size() &&
+            (!fMempool || myIsutxo_spentinmempool(ignoretxid,ignorevin,it->first.txhash,vout) == 0) )
+            outputs.push_back(std::make_pair(COutPoint(it->first.txhash,vout),MarmaraActivatedOutput(tx,vout,it->second.blockHeight)));
+    }
+}
+
+// the open issuance markers at the Marmara global address coinaddr read from the address index
+static void MarmaraScanIssuances(char *coinaddr, std::vector<std::pair<COutPoint, CMarmaraIssuance> > &issuances)
+{
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs; CTransaction tx; uint256 hashBlock; CMarmaraIssuance issuance;
+
+    SetCCunspents(unspentOutputs,coinaddr,true);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    {
+        if ( it->first.index != 1 )
+            continue;
+        if ( myGetTransaction(it->first.txhash,tx,hashBlock) == 0 )
+            LogPrintf("error getting tx\n");
+        else if ( MarmaraIssuanceOutput(tx,coinaddr,issuance) )
+            issuances.push_back(std::make_pair(COutPoint(it->first.txhash,1),issuance));
+    }
+}
+
+static void MarmaraActivatedAdd(const std::string &addr, const COutPoint &outpoint, const CMarmaraActivated &output)
+{
+    CMarmaraActivatedAddr &activated = mapMarmaraActivated[addr];
+    if ( !activated.outputs.insert(std::make_pair(outpoint,output)).second )
+        return;
+    activated.nTotal += output.nValue;
+    if ( output.funcid == 'L' )
+        activated.nLocked += output.nValue;
+    mapMarmaraActivatedAddrs[outpoint] = addr;
+}
+
+static bool MarmaraActivatedRemove(const COutPoint &outpoint, std::string &addr, CMarmaraActivated &output)
+{
+    std::map<COutPoint, std::string>::iterator it = mapMarmaraActivatedAddrs.find(outpoint);
+    if ( it == mapMarmaraActivatedAddrs.end() )
+        return false;
+    addr = it->second;
+    mapMarmaraActivatedAddrs.erase(it);
+    CMarmaraActivatedAddr &activated = mapMarmaraActivated[addr];
+    std::map<COutPoint, CMarmaraActivated>::iterator itOutput = activated.outputs.find(outpoint);
+    if ( itOutput == activated.outputs.end() )
+        return false;
+    output = itOutput->second;
+    activated.outputs.erase(itOutput);
+    activated.nTotal -= output.nValue;
+    if ( output.funcid == 'L' )
+        activated.nLocked -= output.nValue;
+    return true;
+}
+
+// the baton chains are exact without an undo, only the address parts are read again after a deep reorg
+static void MarmaraIndexUnload()
+{
+    mapMarmaraActivated.clear();
+    mapMarmaraActivatedAddrs.clear();
+    fMarmaraIssuancesLoaded = false;
+    strMarmaraIssuancesAddr.clear();
+    mapMarmaraIssuances.clear();
+    marmaraIndexUndo.clear();
+}
+
+// needs cs_main, so that no block is connected meanwhile
+static const std::vector<uint256> &MarmaraLoopLoad(const uint256 &createtxid)
+{
+    uint256 txid,spenttxid; int32_t vini,height; std::vector<uint256> chain;
+
+    AssertLockHeld(cs_main);
+    std::map<uint256, std::vector<uint256> >::const_iterator it = mapMarmaraLoops.find(createtxid);
+    if ( it != mapMarmaraLoops.end() )
+        return it->second;
+    txid = createtxid;
+    chain.push_back(txid);
+    while ( CCgetspenttxid(spenttxid,vini,height,txid,0) == 0 && height > 0 )  // a mempool spend has no height
+    {
+        chain.push_back(spenttxid);
+        txid = spenttxid;
+    }
+    mapMarmaraLoopTips.insert(std::make_pair(txid,createtxid));
+    return mapMarmaraLoops[createtxid] = chain;
+}
+
+// needs cs_main, so that no block is connected meanwhile
+static const CMarmaraActivatedAddr &MarmaraActivatedLoad(const std::string &addr)
+{
+    std::vector<std::pair<COutPoint, CMarmaraActivated> > outputs;
+
+    AssertLockHeld(cs_main);
+    std::map<std::string, CMarmaraActivatedAddr>::const_iterator it = mapMarmaraActivated.find(addr);
+    if ( it != mapMarmaraActivated.end() )
+        return it->second;
+    MarmaraScanActivated((char *)addr.c_str(),false,outputs);
+    CMarmaraActivatedAddr &activated = mapMarmaraActivated[addr];
+    for (int32_t i=0; i<outputs.size(); i++)
+        MarmaraActivatedAdd(addr,outputs[i].first,outputs[i].second);
+    // the undo kept so far misses the outputs of addr, so a disconnect of those blocks reads all addresses again
+    marmaraIndexUndo.clear();
+    LogPrint("marmara","MarmaraActivatedLoad() loaded %s, %u outputs\n",addr.c_str(),(unsigned int)activated.outputs.size());
+    return activated;
+}
+
+// needs cs_main, so that no block is connected meanwhile
+static void MarmaraIssuancesLoad(const std::string &addr)
+{
+    std::vector<std::pair<COutPoint, CMarmaraIssuance> > issuances;
+
+    AssertLockHeld(cs_main);
+    if ( fMarmaraIssuancesLoaded )
+        return;
+    MarmaraScanIssuances((char *)addr.c_str(),issuances);
+    mapMarmaraIssuances.insert(issuances.begin(),issuances.end());
+    strMarmaraIssuancesAddr = addr;
+    fMarmaraIssuancesLoaded = true;
+    marmaraIndexUndo.clear();  // as for an activated address
+    LogPrint("marmara","MarmaraIssuancesLoad() loaded %s, %u open issuances\n",addr.c_str(),(unsigned int)mapMarmaraIssuances.size());
+}
+
+void MarmaraBlockConnected(int32_t height,const CBlock &block)
+{
+    LOCK(cs_marmaraindex);
+    if ( mapMarmaraLoops.empty() && mapMarmaraActivated.empty() && !fMarmaraIssuancesLoaded )
+        return;
+
+    CMarmaraIndexUndo undo;
+    undo.hashBlock = block.GetHash();
+    for (int32_t i=0; i<block.vtx.size(); i++)
+    {
+        const CTransaction &tx = block.vtx[i];
+        uint256 txid = tx.GetHash(); CMarmaraActivated output; CMarmaraIssuance issuance; std::string addr; char coinaddr[64];
+
+        if ( !tx.IsCoinBase() )
+        {
+            for (int32_t j=0; j<tx.vin.size(); j++)
+            {
+                const COutPoint &prevout = tx.vin[j].prevout;
+                if ( MarmaraActivatedRemove(prevout,addr,output) )
+                    undo.activated.push_back(std::make_pair(prevout,std::make_pair(addr,output)));
+                std::map<COutPoint, CMarmaraIssuance>::iterator itIssuance = mapMarmaraIssuances.find(prevout);
+                if ( itIssuance != mapMarmaraIssuances.end() )
+                {
+                    undo.issuances.push_back(*itIssuance);
+                    mapMarmaraIssuances.erase(itIssuance);
+                }
+                if ( prevout.n == 0 )  // the baton, or the approval of a createtxid, moves on
+                {
+                    std::vector<uint256> createtxids;
+                    std::pair<std::multimap<uint256, uint256>::iterator, std::multimap<uint256, uint256>::iterator> range = mapMarmaraLoopTips.equal_range(prevout.hash);
+                    for (std::multimap<uint256, uint256>::iterator it=range.first; it!=range.second; it++)
+                        createtxids.push_back(it->second);
+                    mapMarmaraLoopTips.erase(range.first,range.second);
+                    for (int32_t k=0; k<createtxids.size(); k++)
+                    {
+                        mapMarmaraLoops[createtxids[k]].push_back(txid);
+                        mapMarmaraLoopTips.insert(std::make_pair(txid,createtxids[k]));
+                    }
+                }
+            }
+        }
+        if ( !mapMarmaraActivated.empty() )
+        {
+            for (int32_t j=0; j<tx.vout.size(); j++)
+                if ( tx.vout[j].scriptPubKey.IsPayToCryptoCondition() != 0 && Getscriptaddress(coinaddr,tx.vout[j].scriptPubKey) != 0 && mapMarmaraActivated.count(coinaddr) != 0 )
+                    MarmaraActivatedAdd(coinaddr,COutPoint(txid,j),MarmaraActivatedOutput(tx,j,height));
+        }
+        if ( fMarmaraIssuancesLoaded && MarmaraIssuanceOutput(tx,strMarmaraIssuancesAddr,issuance) )
+            mapMarmaraIssuances[COutPoint(txid,1)] = issuance;
+    }
+    marmaraIndexUndo.push_back(undo);
+    if ( marmaraIndexUndo.size() > MARMARA_INDEX_MAXUNDO )
+        marmaraIndexUndo.pop_front();
+}
+
+void MarmaraBlockDisconnected(const CBlock &block)
+{
+    LOCK(cs_marmaraindex);
+    std::set<uint256> txids; CMarmaraActivated output; std::string addr;
+    for (int32_t i=block.vtx.size()-1; i>=0; i--)
+    {
+        uint256 txid = block.vtx[i].GetHash();
+        std::vector<uint256> createtxids;
+        std::pair<std::multimap<uint256, uint256>::iterator, std::multimap<uint256, uint256>::iterator> range = mapMarmaraLoopTips.equal_range(txid);
+        for (std::multimap<uint256, uint256>::iterator it=range.first; it!=range.second; it++)
+            createtxids.push_back(it->second);
+        mapMarmaraLoopTips.erase(range.first,range.second);
+        for (int32_t k=0; k<createtxids.size(); k++)
+        {
+            std::vector<uint256> &chain = mapMarmaraLoops[createtxids[k]];
+            chain.pop_back();
+            if ( chain.empty() )
+                mapMarmaraLoops.erase(createtxids[k]);
+            else mapMarmaraLoopTips.insert(std::make_pair(chain.back(),createtxids[k]));
+        }
+        txids.insert(txid);
+    }
+    if ( mapMarmaraActivated.empty() && !fMarmaraIssuancesLoaded )
+        return;
+    if ( marmaraIndexUndo.empty() || marmaraIndexUndo.back().hashBlock != block.GetHash() )
+    {
+        // deeper than the undo kept, read the addresses again at their next query
+        MarmaraIndexUnload();
+        return;
+    }
+
+    for (int32_t i=block.vtx.size()-1; i>=0; i--)
+    {
+        for (int32_t j=0; j<block.vtx[i].vout.size(); j++)
+        {
+            COutPoint outpoint(block.vtx[i].GetHash(),j);
+            MarmaraActivatedRemove(outpoint,addr,output);
+            mapMarmaraIssuances.erase(outpoint);
+        }
+    }
+    const CMarmaraIndexUndo &undo = marmaraIndexUndo.back();
+    for (int32_t i=0; i<undo.activated.size(); i++)
+        if ( txids.count(undo.activated[i].first.hash) == 0 && mapMarmaraActivated.count(undo.activated[i].second.first) != 0 )  // not created and spent in this block
+            MarmaraActivatedAdd(undo.activated[i].second.first,undo.activated[i].first,undo.activated[i].second.second);
+    for (int32_t i=0; i<undo.issuances.size(); i++)
+        if ( txids.count(undo.issuances[i].first.hash) == 0 )
+            mapMarmaraIssuances.insert(undo.issuances[i]);
+    marmaraIndexUndo.pop_back();
+}
+
+// the confirmed part of the baton chain starting at createtxid, false if there is no index
+static bool MarmaraLoopChain(const uint256 &createtxid, std::vector<uint256> &chain)
+{
+    if ( KOMODO_NSPV_SUPERLITE )
+        return false;
+    LOCK2(cs_main,cs_marmaraindex);
+    chain = MarmaraLoopLoad(createtxid);
+    return true;
+}
+
+// the unspent outputs at the activated address coinaddr that are not spent in the mempool
+static void MarmaraActivatedOutputs(char *coinaddr, std::vector<std::pair<COutPoint, CMarmaraActivated> > &outputs)
+{
+    std::vector<std::pair<COutPoint, CMarmaraActivated> > indexed;
+
+    if ( KOMODO_NSPV_SUPERLITE )
+    {
+        MarmaraScanActivated(coinaddr,true,outputs);
+        return;
+    }
+    {
+        LOCK2(cs_main,cs_marmaraindex);
+        const CMarmaraActivatedAddr &activated = MarmaraActivatedLoad(coinaddr);
+        indexed.assign(activated.outputs.begin(),activated.outputs.end());
+    }
+    LOCK(mempool.cs);
+    for (int32_t i=0; i<indexed.size(); i++)
+        if ( mempool.mapNextTx.count(indexed[i].first) == 0 )
+            outputs.push_back(indexed[i]);
+}
+
+// the confirmed balance of the activated address coinaddr and the part of it from locks
+static void MarmaraActivatedTotals(char *coinaddr, int64_t &total, int64_t &locked)
+{
+    total = locked = 0;
+    if ( KOMODO_NSPV_SUPERLITE )
+    {
+        std::vector<std::pair<COutPoint, CMarmaraActivated> > outputs;
+        MarmaraScanActivated(coinaddr,false,outputs);
+        for (int32_t i=0; i<outputs.size(); i++)
+        {
+            total += outputs[i].second.nValue;
+            if ( outputs[i].second.funcid == 'L' )
+                locked += outputs[i].second.nValue;
+        }
+        return;
+    }
+    LOCK2(cs_main,cs_marmaraindex);
+    const CMarmaraActivatedAddr &activated = MarmaraActivatedLoad(coinaddr);
+    total = activated.nTotal;
+    locked = activated.nLocked;
+}
+
+// the open issuance markers at the Marmara global address coinaddr
+static void MarmaraOpenIssuances(char *coinaddr, std::vector<std::pair<COutPoint, CMarmaraIssuance> > &issuances)
+{
+    if ( KOMODO_NSPV_SUPERLITE )
+    {
+        MarmaraScanIssuances(coinaddr,issuances);
+        return;
+    }
+    LOCK2(cs_main,cs_marmaraindex);
+    MarmaraIssuancesLoad(coinaddr);
+    issuances.assign(mapMarmaraIssuances.begin(),mapMarmaraIssuances.end());
+}
+
+// the stakes of pk at its activated address coinaddr, outputs of Marmara coinbases and locks of pk that are not
+// spent in the mempool, in the form of the address index
+void MarmaraActivatedUnspents(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,char *coinaddr,CPubKey pk)
+{
+    std::vector<std::pair<COutPoint, CMarmaraActivated> > outputs; uint160 hashBytes; int32_t type = 0;
+
+    if ( CBitcoinAddress(coinaddr).GetIndexKey(hashBytes,type,true) == 0 )
+        return;
+    MarmaraActivatedOutputs(coinaddr,outputs);
+    for (int32_t i=0; i<outputs.size(); i++)
+    {
+        const CMarmaraActivated &output = outputs[i].second;
+        if ( output.funcid != 0 && output.pk == pk )
+            unspentOutputs.push_back(std::make_pair(CAddressUnspentKey(type,hashBytes,outputs[i].first.hash,outputs[i].first.n),CAddressUnspentValue(output.nValue,output.scriptPubKey,output.height)));
+    }
+}
+
 int32_t MarmaraGetbatontxid(std::vector<uint256> &creditloop,uint256 &batontxid,uint256 txid)
 {
-    uint256 createtxid,spenttxid; int64_t value; int32_t vini,height,n=0,vout = 0;
+    uint256 createtxid,spenttxid; int64_t value; int32_t vini,height,n=0,vout = 0; std::vector<uint256> chain;
     memset(&batontxid,0,sizeof(batontxid));
     if ( MarmaraGetcreatetxid(createtxid,txid) == 0 )
     {
         txid = createtxid;
         //LogPrintf("txid.%s -> createtxid %s\n",txid.GetHex().c_str(),createtxid.GetHex().c_str());
+        if ( MarmaraLoopChain(createtxid,chain) && chain.size() > 1 )
+        {
+            // the confirmed hops are known, only the last one and the unconfirmed end are followed
+            creditloop.insert(creditloop.end(),chain.begin(),chain.end()-2);
+            n = (int32_t)chain.size() - 2;
+            txid = chain[chain.size()-2];
+        }
         while ( CCgetspenttxid(spenttxid,vini,height,txid,vout) == 0 )
         {
             creditloop.push_back(txid);
@@ -385,32 +778,32 @@ int64_t AddMarmaraCoinbases(struct CCcontract_info *cp,CMutableTransaction &mtx,
 
 int64_t AddMarmarainputs(CMutableTransaction &mtx,std::vector<CPubKey> &pubkeys,char *coinaddr,int64_t total,int32_t maxinputs)
 {
-    uint64_t threshold,nValue,totalinputs = 0; uint256 txid,hashBlock; CTransaction tx; int32_t numvouts,ht,unlockht,vout,i,n = 0; uint8_t funcid; CPubKey pk; std::vector<int64_t> vals;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-    SetCCunspents(unspentOutputs,coinaddr,true);
+    uint64_t threshold,nValue,totalinputs = 0; uint256 txid; int32_t vout,i,n = 0; uint8_t funcid; std::vector<int64_t> vals;
+    std::vector<std::pair<COutPoint, CMarmaraActivated> > outputs;
+    MarmaraActivatedOutputs(coinaddr,outputs);
     if ( maxinputs > CC_MAXVINS )
         maxinputs = CC_MAXVINS;
     if ( maxinputs > 0 )
         threshold = total/maxinputs;
     else threshold = total;
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    for (std::vector<std::pair<COutPoint, CMarmaraActivated> >::const_iterator it=outputs.begin(); it!=outputs.end(); it++)
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        if ( it->second.satoshis < threshold )
+        txid = it->first.hash;
+        vout = (int32_t)it->first.n;
+        if ( it->second.nValue < threshold )
             continue;
-        if ( myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts= tx.vout.size()) > 0 && vout < numvouts && tx.vout[vout].scriptPubKey.IsPayToCryptoCondition() != 0 && myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0 )
+        if ( it->second.scriptPubKey.IsPayToCryptoCondition() != 0 )
         {
-            if ( (funcid= DecodeMaramaraCoinbaseOpRet(tx.vout[numvouts-1].scriptPubKey,pk,ht,unlockht)) == 'C' || funcid == 'P' || funcid == 'L' )
+            if ( (funcid= it->second.funcid) == 'C' || funcid == 'P' || funcid == 'L' )
             {
-                //char str[64]; LogPrintf("(%s) %s/v%d %.8f ht.%d unlockht.%d\n",coinaddr,uint256_str(str,txid),vout,(double)it->second.satoshis/COIN,ht,unlockht);
+                //char str[64]; LogPrintf("(%s) %s/v%d %.8f ht.%d unlockht.%d\n",coinaddr,uint256_str(str,txid),vout,(double)it->second.nValue/COIN,it->second.height,it->second.unlockht);
                 if ( total != 0 && maxinputs != 0 )
                 {
                     mtx.vin.push_back(CTxIn(txid,vout,CScript()));
-                    pubkeys.push_back(pk);
+                    pubkeys.push_back(it->second.pk);
                 }
-                totalinputs += it->second.satoshis;
-                vals.push_back(it->second.satoshis);
+                totalinputs += it->second.nValue;
+                vals.push_back(it->second.nValue);
                 n++;
                 if ( maxinputs != 0 && total == 0 )
                     continue;
@@ -432,7 +825,7 @@ int64_t AddMarmarainputs(CMutableTransaction &mtx,std::vector<CPubKey> &pubkeys,
 UniValue MarmaraLock(uint64_t txfee,int64_t amount,int32_t height)
 {
     CMutableTransaction tmpmtx,mtx = CreateNewContextualCMutableTransaction(Params().GetConsensus(), komodo_nextheight());
-    UniValue result(UniValue::VOBJ); struct CCcontract_info *cp,C; CPubKey Marmarapk,mypk,pk; int32_t unlockht,refunlockht,vout,ht,numvouts; int64_t nValue,val,inputsum=0,threshold,remains,change = 0; std::string rawtx,errorstr; char coinaddr[64]; uint256 txid,hashBlock; CTransaction tx; uint8_t funcid;
+    UniValue result(UniValue::VOBJ); struct CCcontract_info *cp,C; CPubKey Marmarapk,mypk; int32_t refunlockht,vout; int64_t nValue,val,inputsum=0,threshold,remains,change = 0; std::string rawtx,errorstr; char coinaddr[64]; uint256 txid; uint8_t funcid;
     if ( txfee == 0 )
         txfee = 10000;
     if ( (height & 1) != 0 )
@@ -455,24 +848,24 @@ UniValue MarmaraLock(uint64_t txfee,int64_t amount,int32_t height)
         result.push_back(Pair("height",height));
         result.push_back(Pair("unlockht",refunlockht));
         remains = (amount + txfee) - inputsum;
-        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+        std::vector<std::pair<COutPoint, CMarmaraActivated> > outputs;
         GetCCaddress1of2(cp,coinaddr,Marmarapk,mypk);
-        SetCCunspents(unspentOutputs,coinaddr,true);
+        MarmaraActivatedOutputs(coinaddr,outputs);
         threshold = remains / (MARMARA_VINS+1);
         uint8_t mypriv[32];
         Myprivkey(mypriv);
         CCaddr1of2set(cp,Marmarapk,mypk,mypriv,coinaddr);
-        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+        for (std::vector<std::pair<COutPoint, CMarmaraActivated> >::const_iterator it=outputs.begin(); it!=outputs.end(); it++)
         {
-            txid = it->first.txhash;
-            vout = (int32_t)it->first.index;
-            if ( (nValue= it->second.satoshis) < threshold )
+            txid = it->first.hash;
+            vout = (int32_t)it->first.n;
+            if ( (nValue= it->second.nValue) < threshold )
                 continue;
-            if ( myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts= tx.vout.size()) > 0 && vout < numvouts && tx.vout[vout].scriptPubKey.IsPayToCryptoCondition() != 0 && myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0 )
+            if ( it->second.scriptPubKey.IsPayToCryptoCondition() != 0 )
             {
-                if ( (funcid= DecodeMaramaraCoinbaseOpRet(tx.vout[numvouts-1].scriptPubKey,pk,ht,unlockht)) == 'C' || funcid == 'P' || funcid == 'L' )
+                if ( (funcid= it->second.funcid) == 'C' || funcid == 'P' || funcid == 'L' )
                 {
-                    if ( unlockht < refunlockht )
+                    if ( it->second.unlockht < refunlockht )
                     {
                         mtx.vin.push_back(CTxIn(txid,vout,CScript()));
                         //LogPrintf("merge CC vout %s/v%d %.8f unlockht.%d < ref.%d\n",txid.GetHex().c_str(),vout,(double)nValue/COIN,unlockht,refunlockht);
@@ -663,33 +1056,20 @@ UniValue MarmaraSettlement(uint64_t txfee,uint256 refbatontxid)
 
 int32_t MarmaraGetCreditloops(int64_t &totalamount,std::vector<uint256> &issuances,int64_t &totalclosed,std::vector<uint256> &closed,struct CCcontract_info *cp,int32_t firstheight,int32_t lastheight,int64_t minamount,int64_t maxamount,CPubKey refpk,std::string refcurrency)
 {
-    char coinaddr[64]; CPubKey Marmarapk,senderpk; int64_t amount; uint256 createtxid,txid,hashBlock; CTransaction tx; int32_t numvouts,vout,matures,n=0; std::string currency;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    char coinaddr[64]; CPubKey Marmarapk; int32_t n=0; std::vector<std::pair<COutPoint, CMarmaraIssuance> > open;
     Marmarapk = GetUnspendable(cp,0);
     GetCCaddress(cp,coinaddr,Marmarapk);
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    // do all txid, conditional on spent/unspent
+    MarmaraOpenIssuances(coinaddr,open);
     //LogPrintf("check coinaddr.(%s)\n",coinaddr);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    for (std::vector<std::pair<COutPoint, CMarmaraIssuance> >::const_iterator it=open.begin(); it!=open.end(); it++)
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        //fprintf(stderr,"txid.%s/v%d\n",txid.GetHex().c_str(),vout);
-        if ( vout == 1 && myGetTransaction(txid,tx,hashBlock) != 0 )
+        const CMarmaraIssuance &issuance = it->second;
+        n++;
+        if ( issuance.currency == refcurrency && issuance.matures >= firstheight && issuance.matures <= lastheight && issuance.amount >= minamount && issuance.amount <= maxamount && (refpk.size() == 0 || issuance.senderpk == refpk) )
         {
-            if ( tx.IsCoinBase() == 0 && (numvouts= tx.vout.size()) > 2 && tx.vout[numvouts - 1].nValue == 0 )
-            {
-                if ( MarmaraDecodeLoopOpret(tx.vout[numvouts-1].scriptPubKey,createtxid,senderpk,amount,matures,currency) == 'I' )
-                {
-                    n++;
-                    if ( currency == refcurrency && matures >= firstheight && matures <= lastheight && amount >= minamount && amount <= maxamount && (refpk.size() == 0 || senderpk == refpk) )
-                    {
-                        issuances.push_back(txid);
-                        totalamount += amount;
-                    }
-                }
-            }
-        } else LogPrintf("error getting tx\n");
+            issuances.push_back(it->first.hash);
+            totalamount += issuance.amount;
+        }
     }
     return(n);
 }
@@ -1053,7 +1433,7 @@ UniValue MarmaraPoolPayout(uint64_t txfee,int32_t firstheight,double perc,char *
 UniValue MarmaraInfo(CPubKey refpk,int32_t firstheight,int32_t lastheight,int64_t minamount,int64_t maxamount,std::string currency)
 {
     CMutableTransaction mtx; std::vector<CPubKey> pubkeys;
-    UniValue result(UniValue::VOBJ),a(UniValue::VARR),b(UniValue::VARR); int32_t i,n,matches; int64_t totalclosed=0,totalamount=0; std::vector<uint256> issuances,closed; char coinaddr[64];
+    UniValue result(UniValue::VOBJ),a(UniValue::VARR),b(UniValue::VARR); int32_t i,n,matches; int64_t totalclosed=0,totalamount=0,activated,locked; std::vector<uint256> issuances,closed; char coinaddr[64];
     CPubKey Marmarapk; struct CCcontract_info *cp,C;
     cp = CCinit(&C,EVAL_MARMARA);
     Marmarapk = GetUnspendable(cp,0);
@@ -1064,7 +1444,9 @@ UniValue MarmaraInfo(CPubKey refpk,int32_t firstheight,int32_t lastheight,int64_
     
     GetCCaddress1of2(cp,coinaddr,Marmarapk,Mypubkey());
     result.push_back(Pair("myCCactivated",coinaddr));
-    result.push_back(Pair("activated",ValueFromAmount(CCaddress_balance(coinaddr,1))));
+    MarmaraActivatedTotals(coinaddr,activated,locked);
+    result.push_back(Pair("activated",ValueFromAmount(activated)));
+    result.push_back(Pair("locked",ValueFromAmount(locked)));
     result.push_back(Pair("activated16",ValueFromAmount(AddMarmarainputs(mtx,pubkeys,coinaddr,0,MARMARA_VINS))));
     
     GetCCaddress(cp,coinaddr,Mypubkey());
@@ -197,10 +197,116 @@ CPubKey OracleBatonPk(char *batonaddr,struct CCcontract_info *cp)
     return(batonpk);
 }
 
-int64_t OracleCurrentDatafee(uint256 reforacletxid,char *markeraddr,CPubKey publisher)
+// The oracles index: the registrations of each oracle, the 'R' txs with a marker at the oracle marker address in
+// the order the address index lists them, and the data samples of each oracle and baton address, the 'D' txs paying
+// their baton to the address in block order. Both are read from the address index on first use and then kept up to
+// date by OraclesBlockConnected and OraclesBlockDisconnected. The markers are paid to a pubkey that nobody has the
+// key of and are never spent, and the samples are only ever appended, so no undo is kept.
+// Only the rpc calls use the index, they pass fIndexed. Consensus code scans the address index and reads the txs as
+// before, so that its result does not depend on what the index has read in. The index is only read in from where
+// cs_main is free or already held; otherwise the rpc calls scan as well.
+
+#define ORACLES_SAMPLES_CACHED 128  // latest samples of an oracle and baton address whose data is kept
+
+struct COracleRegistration {
+    int32_t height;
+    CPubKey pk;
+    int64_t datafee;
+};
+
+struct COracleSample {
+    uint256 txid, batontxid;        // the sample and the one whose baton it spends
+    int32_t height;                 // of its block
+    int32_t start;                  // position of the first sample of its baton chain
+    bool fDataHeight;
+    int64_t dataheight;             // the height the data starts with, as gateways merkle roots do
+};
+
+struct COracleSamples {
+    std::vector<COracleSample> samples;
+    std::map<std::pair<int32_t, int64_t>, std::vector<int32_t> > mapChainHeights;  // (start, dataheight) -> positions
+    std::map<int32_t, std::vector<uint8_t> > mapData;                              // position -> data of the latest samples
+};
+typedef std::pair<uint256, std::string> COracleSamplesKey;
+typedef std::map<uint256, std::pair<COracleSamplesKey, int32_t> > COracleSampleTxids;
+
+static CCriticalSection cs_oraclesindex;
+static std::map<uint256, std::map<uint256, COracleRegistration> > mapOracleRegistrations;
+static std::map<COracleSamplesKey, COracleSamples> mapOracleSamples;
+static COracleSampleTxids mapOracleSampleTxids;
+
+// needs cs_main, so that no block is connected meanwhile
+static void OracleRegistrationsLoad(uint256 reforacletxid)
 {
-    uint256 txid,oracletxid,hashBlock; int64_t datafee=0,dfee; int32_t dheight=0,vout,height,numvouts; CTransaction tx; CPubKey pk;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs; std::map<uint256, COracleRegistration> registrations;
+    COracleRegistration reg; CTransaction tx; uint256 hashBlock,oracletxid; char markeraddr[64];
+
+    AssertLockHeld(cs_main);
+    {
+        LOCK(cs_oraclesindex);
+        if ( mapOracleRegistrations.count(reforacletxid) != 0 )
+            return;
+    }
+    CCtxidaddr(markeraddr,reforacletxid);
+    SetCCunspents(unspentOutputs,markeraddr,false);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    {
+        if ( myGetTransaction(it->first.txhash,tx,hashBlock) != 0 && tx.vout.size() > 0 &&
+            DecodeOraclesOpRet(tx.vout[tx.vout.size()-1].scriptPubKey,oracletxid,reg.pk,reg.datafee) == 'R' && oracletxid == reforacletxid )
+        {
+            reg.height = (int32_t)it->second.blockHeight;
+            registrations[it->first.txhash] = reg;
+        }
+    }
+    LOCK(cs_oraclesindex);
+    mapOracleRegistrations[reforacletxid].swap(registrations);
+}
+
+// the registrations of reforacletxid by txid; false if they are not read in and cs_main is busy
+static bool OracleRegistrations(uint256 reforacletxid,std::vector<std::pair<uint256, COracleRegistration> > &registrations)
+{
+    std::map<uint256, std::map<uint256, COracleRegistration> >::const_iterator it;
+
+    if ( KOMODO_NSPV_SUPERLITE )
+        return false;
+    {
+        LOCK(cs_oraclesindex);
+        if ( (it= mapOracleRegistrations.find(reforacletxid)) != mapOracleRegistrations.end() )
+        {
+            registrations.assign(it->second.begin(),it->second.end());
+            return true;
+        }
+    }
+    {
+        TRY_LOCK(cs_main,lockMain);
+        if ( !lockMain )
+            return false;
+        OracleRegistrationsLoad(reforacletxid);
+    }
+    LOCK(cs_oraclesindex);
+    if ( (it= mapOracleRegistrations.find(reforacletxid)) == mapOracleRegistrations.end() )
+        return false;
+    registrations.assign(it->second.begin(),it->second.end());
+    return true;
+}
+
+int64_t OracleCurrentDatafee(uint256 reforacletxid,char *markeraddr,CPubKey publisher,bool fIndexed)
+{
+    uint256 txid,oracletxid,hashBlock; int64_t datafee=0,dfee; int32_t dheight=0,vout,height,numvouts; CTransaction tx; CPubKey pk; char refmarkeraddr[64];
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs; std::vector<std::pair<uint256, COracleRegistration> > registrations;
+    CCtxidaddr(refmarkeraddr,reforacletxid);
+    if ( fIndexed && strcmp(refmarkeraddr,markeraddr) == 0 && OracleRegistrations(reforacletxid,registrations) )
+    {
+        for (std::vector<std::pair<uint256, COracleRegistration> >::const_iterator it=registrations.begin(); it!=registrations.end(); it++)
+        {
+            if ( it->second.pk == publisher && (it->second.height > dheight || (it->second.height == dheight && it->second.datafee < datafee)) )
+            {
+                dheight = it->second.height;
+                datafee = it->second.datafee;
+            }
+        }
+        return(datafee);
+    }
     SetCCunspents(unspentOutputs,markeraddr,false);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
     {
@@ -227,7 +333,7 @@ int64_t OracleCurrentDatafee(uint256 reforacletxid,char *markeraddr,CPubKey publ
     return(datafee);
 }
 
-int64_t OracleDatafee(CScript &scriptPubKey,uint256 oracletxid,CPubKey publisher)
+int64_t OracleDatafee(CScript &scriptPubKey,uint256 oracletxid,CPubKey publisher,bool fIndexed)
 {
     CTransaction oracletx; char markeraddr[64]; uint256 hashBlock; std::string name,description,format; int32_t numvouts; int64_t datafee = 0;
     if ( myGetTransaction(oracletxid,oracletx,hashBlock) != 0 && (numvouts= oracletx.vout.size()) > 0 )
@@ -235,7 +341,7 @@ int64_t OracleDatafee(CScript &scriptPubKey,uint256 oracletxid,CPubKey publisher
         if ( DecodeOraclesCreateOpRet(oracletx.vout[numvouts-1].scriptPubKey,name,description,format) == 'C' )
         {
             CCtxidaddr(markeraddr,oracletxid);
-            datafee = OracleCurrentDatafee(oracletxid,markeraddr,publisher);
+            datafee = OracleCurrentDatafee(oracletxid,markeraddr,publisher,fIndexed);
         }
         else
         {
@@ -305,13 +411,27 @@ uint256 OracleBatonUtxo(uint64_t txfee,struct CCcontract_info *cp,uint256 refora
     return(batontxid);
 }
 
-uint256 OraclesBatontxid(uint256 reforacletxid,CPubKey refpk)
+uint256 OraclesBatontxid(uint256 reforacletxid,CPubKey refpk,bool fIndexed)
 {
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
     CTransaction regtx; uint256 hash,txid,batontxid,oracletxid; CPubKey pk; int32_t numvouts,height,maxheight=0; int64_t datafee; char markeraddr[64],batonaddr[64]; std::vector <uint8_t> data; struct CCcontract_info *cp,C;
+    std::vector<std::pair<uint256, COracleRegistration> > registrations;
     batontxid = zeroid;
     cp = CCinit(&C,EVAL_ORACLES);
     CCtxidaddr(markeraddr,reforacletxid);
+    if ( fIndexed && OracleRegistrations(reforacletxid,registrations) )
+    {
+        for (std::vector<std::pair<uint256, COracleRegistration> >::const_iterator it=registrations.begin(); it!=registrations.end(); it++)
+        {
+            if ( it->second.pk == refpk && myGetTransaction(it->first,regtx,hash) != 0 )
+            {
+                Getscriptaddress(batonaddr,regtx.vout[1].scriptPubKey);
+                batontxid = OracleBatonUtxo(10000,cp,reforacletxid,batonaddr,refpk,data);
+                break;
+            }
+        }
+        return(batontxid);
+    }
     SetCCunspents(unspentOutputs,markeraddr,false);
     //char str[67]; LogPrintf("markeraddr.(%s) %s\n",markeraddr,pubkey33_str(str,(uint8_t *)&refpk));
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
@@ -458,6 +578,256 @@ int32_t oracle_parse_data_format(std::vector<uint8_t> data,std::string format)
     else return (offset);
 }
 
+// oracletxid, baton address, spent baton and data of a sample tx
+static bool OracleDecodeSample(const CTransaction &tx,uint256 &oracletxid,std::string &batonaddr,uint256 &batontxid,std::vector<uint8_t> &data)
+{
+    CPubKey pk; char addr[64]; int32_t numvouts;
+    if ( (numvouts= tx.vout.size()) < 2 || tx.vout[1].nValue != CC_MARKER_VALUE ||
+        DecodeOraclesData(tx.vout[numvouts-1].scriptPubKey,oracletxid,batontxid,pk,data) != 'D' || Getscriptaddress(addr,tx.vout[1].scriptPubKey) == 0 )
+        return false;
+    batonaddr = addr;
+    return true;
+}
+
+static void OracleSamplesAppend(const COracleSamplesKey &key,COracleSamples &samples,COracleSampleTxids &txids,const uint256 &txid,int32_t height,const uint256 &batontxid,const std::vector<uint8_t> &data)
+{
+    COracleSample sample; COracleSampleTxids::const_iterator it; uint256 hash; int32_t pos = samples.samples.size();
+
+    if ( txids.count(txid) != 0 )
+        return;
+    sample.txid = txid;
+    sample.batontxid = batontxid;
+    sample.height = height;
+    if ( (it= txids.find(batontxid)) != txids.end() && it->second.first == key )
+        sample.start = samples.samples[it->second.second].start;
+    else sample.start = pos;
+    sample.fDataHeight = oracle_format(&hash,&sample.dataheight,0,'I',(uint8_t *)data.data(),0,(int32_t)data.size()) == sizeof(int32_t);
+    samples.samples.push_back(sample);
+    txids[txid] = std::make_pair(key,pos);
+    if ( sample.fDataHeight )
+        samples.mapChainHeights[std::make_pair(sample.start,sample.dataheight)].push_back(pos);
+    samples.mapData[pos] = data;
+    if ( samples.mapData.size() > ORACLES_SAMPLES_CACHED )
+        samples.mapData.erase(samples.mapData.begin());
+}
+
+// removes the latest sample of its oracle and baton address; false if txid is indexed but not the latest
+static bool OracleSamplesPop(const uint256 &txid)
+{
+    COracleSampleTxids::iterator it = mapOracleSampleTxids.find(txid);
+    if ( it == mapOracleSampleTxids.end() )
+        return true;
+    COracleSamples &samples = mapOracleSamples[it->second.first];
+    int32_t pos = it->second.second;
+    if ( pos != (int32_t)samples.samples.size()-1 )
+        return false;
+    const COracleSample &sample = samples.samples[pos];
+    if ( sample.fDataHeight )
+    {
+        std::map<std::pair<int32_t, int64_t>, std::vector<int32_t> >::iterator itHeight = samples.mapChainHeights.find(std::make_pair(sample.start,sample.dataheight));
+        if ( itHeight != samples.mapChainHeights.end() )
+        {
+            itHeight->second.pop_back();
+            if ( itHeight->second.empty() )
+                samples.mapChainHeights.erase(itHeight);
+        }
+    }
+    samples.mapData.erase(pos);
+    samples.samples.pop_back();
+    mapOracleSampleTxids.erase(it);
+    return true;
+}
+
+static void OracleSamplesUnload(const COracleSamplesKey &key)
+{
+    std::map<COracleSamplesKey, COracleSamples>::iterator it = mapOracleSamples.find(key);
+    if ( it == mapOracleSamples.end() )
+        return;
+    for (int32_t i=0; i<it->second.samples.size(); i++)
+        mapOracleSampleTxids.erase(it->second.samples[i].txid);
+    mapOracleSamples.erase(it);
+}
+
+// needs cs_main, so that no block is connected meanwhile
+static void OracleSamplesLoad(uint256 reforacletxid,const std::string &batonaddr)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex; COracleSamplesKey key(reforacletxid,batonaddr);
+    COracleSamples samples; COracleSampleTxids txids; CTransaction tx; uint256 hashBlock,oracletxid,batontxid; std::string addr; std::vector<uint8_t> data;
+
+    AssertLockHeld(cs_main);
+    {
+        LOCK(cs_oraclesindex);
+        if ( mapOracleSamples.count(key) != 0 )
+            return;
+    }
+    SetCCtxids(addressIndex,(char *)batonaddr.c_str(),true);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++)
+    {
+        if ( it->second >= 0 && txids.count(it->first.txhash) == 0 && myGetTransaction(it->first.txhash,tx,hashBlock) != 0 &&
+            OracleDecodeSample(tx,oracletxid,addr,batontxid,data) && oracletxid == reforacletxid && addr == batonaddr )
+            OracleSamplesAppend(key,samples,txids,it->first.txhash,(int32_t)it->first.blockHeight,batontxid,data);
+    }
+    LOCK(cs_oraclesindex);
+    mapOracleSampleTxids.insert(txids.begin(),txids.end());
+    mapOracleSamples[key] = samples;
+    LogPrint("oraclescc","OracleSamplesLoad() loaded %u samples of %s at %s\n",(unsigned int)samples.samples.size(),reforacletxid.GetHex().c_str(),batonaddr.c_str());
+}
+
+// reads in the samples of reforacletxid at batonaddr if needed, waiting for cs_main if fWait and otherwise only if it is free;
+// false if they cannot be used
+static bool OracleSamplesEnsureLoaded(uint256 reforacletxid,const std::string &batonaddr,bool fWait)
+{
+    if ( KOMODO_NSPV_SUPERLITE )
+        return false;
+    {
+        LOCK(cs_oraclesindex);
+        if ( mapOracleSamples.count(COracleSamplesKey(reforacletxid,batonaddr)) != 0 )
+            return true;
+    }
+    if ( fWait )
+    {
+        LOCK(cs_main);
+        OracleSamplesLoad(reforacletxid,batonaddr);
+    }
+    else
+    {
+        TRY_LOCK(cs_main,lockMain);
+        if ( !lockMain )
+            return false;
+        OracleSamplesLoad(reforacletxid,batonaddr);
+    }
+    return true;
+}
+
+// reads in the samples along the baton chain of the sample tx if cs_main is free, for CCOraclesReverseScan
+void OraclesSamplesTryLoad(uint256 reforacletxid,const CTransaction &tx)
+{
+    uint256 oracletxid,batontxid; std::string batonaddr; std::vector<uint8_t> data;
+    if ( OracleDecodeSample(tx,oracletxid,batonaddr,batontxid,data) && oracletxid == reforacletxid )
+        OracleSamplesEnsureLoaded(reforacletxid,batonaddr,false);
+}
+
+// The latest sample whose data starts with height along the baton chain back from the confirmed sample batontxid of
+// reforacletxid: 1 with its txid and data, 0 if the index has none and prevtxid is the baton the chain starts from,
+// -1 if batontxid is not indexed.
+int32_t OraclesIndexedSample(uint256 reforacletxid,uint256 batontxid,int32_t height,uint256 &sampletxid,std::vector<uint8_t> &data,uint256 &prevtxid)
+{
+    CTransaction tx; uint256 hashBlock,oracletxid; std::string batonaddr;
+    {
+        LOCK(cs_oraclesindex);
+        COracleSampleTxids::const_iterator it = mapOracleSampleTxids.find(batontxid);
+        if ( it == mapOracleSampleTxids.end() || it->second.first.first != reforacletxid )
+            return(-1);
+        const COracleSamples &samples = mapOracleSamples[it->second.first];
+        int32_t pos = it->second.second, start = samples.samples[pos].start;
+        std::map<std::pair<int32_t, int64_t>, std::vector<int32_t> >::const_iterator itHeight = samples.mapChainHeights.find(std::make_pair(start,(int64_t)height));
+        if ( itHeight == samples.mapChainHeights.end() || itHeight->second.front() > pos )
+        {
+            prevtxid = samples.samples[start].batontxid;
+            return(0);
+        }
+        pos = *(std::upper_bound(itHeight->second.begin(),itHeight->second.end(),pos) - 1);
+        sampletxid = samples.samples[pos].txid;
+        std::map<int32_t, std::vector<uint8_t> >::const_iterator itData = samples.mapData.find(pos);
+        if ( itData != samples.mapData.end() )
+        {
+            data = itData->second;
+            return(1);
+        }
+    }
+    if ( myGetTransaction(sampletxid,tx,hashBlock) == 0 || !OracleDecodeSample(tx,oracletxid,batonaddr,prevtxid,data) )
+        return(-1);
+    return(1);
+}
+
+// the confirmed samples of reforacletxid at batonaddr in blocks fromheight to toheight, the latest first and at most num of
+// them unless num is 0; false if the index cannot be used
+static bool OracleSamplesList(uint256 reforacletxid,const std::string &batonaddr,int32_t fromheight,int32_t toheight,int32_t num,std::vector<std::pair<COracleSample, std::vector<uint8_t> > > &list)
+{
+    CTransaction tx; uint256 hashBlock,oracletxid,batontxid; std::string addr;
+
+    if ( !OracleSamplesEnsureLoaded(reforacletxid,batonaddr,true) )
+        return false;
+    {
+        LOCK(cs_oraclesindex);
+        std::map<COracleSamplesKey, COracleSamples>::const_iterator it = mapOracleSamples.find(COracleSamplesKey(reforacletxid,batonaddr));
+        if ( it == mapOracleSamples.end() )  // dropped meanwhile
+            return false;
+        const std::vector<COracleSample> &samples = it->second.samples;
+        for (int32_t i=samples.size()-1; i>=0 && (num == 0 || list.size() < num); i--)
+        {
+            if ( samples[i].height > toheight )
+                continue;
+            if ( samples[i].height < fromheight )
+                break;
+            std::map<int32_t, std::vector<uint8_t> >::const_iterator itData = it->second.mapData.find(i);
+            list.push_back(std::make_pair(samples[i],itData != it->second.mapData.end() ? itData->second : std::vector<uint8_t>()));
+        }
+    }
+    for (int32_t i=0; i<list.size(); i++)
+    {
+        if ( list[i].second.empty() && (myGetTransaction(list[i].first.txid,tx,hashBlock) == 0 ||
+            !OracleDecodeSample(tx,oracletxid,addr,batontxid,list[i].second)) )
+            return false;
+    }
+    return true;
+}
+
+void OraclesBlockConnected(int32_t height,const CBlock &block)
+{
+    LOCK(cs_oraclesindex);
+    if ( mapOracleRegistrations.empty() && mapOracleSamples.empty() )
+        return;
+    for (int32_t i=0; i<block.vtx.size(); i++)
+    {
+        const CTransaction &tx = block.vtx[i];
+        std::map<uint256, std::map<uint256, COracleRegistration> >::iterator itReg; std::map<COracleSamplesKey, COracleSamples>::iterator itSamples;
+        COracleRegistration reg; uint256 oracletxid,batontxid; std::string batonaddr; std::vector<uint8_t> data; char markeraddr[64],addr[64];
+
+        if ( OracleDecodeSample(tx,oracletxid,batonaddr,batontxid,data) )
+        {
+            if ( (itSamples= mapOracleSamples.find(COracleSamplesKey(oracletxid,batonaddr))) != mapOracleSamples.end() )
+                OracleSamplesAppend(itSamples->first,itSamples->second,mapOracleSampleTxids,tx.GetHash(),height,batontxid,data);
+        }
+        else if ( tx.vout.size() > 0 && DecodeOraclesOpRet(tx.vout[tx.vout.size()-1].scriptPubKey,oracletxid,reg.pk,reg.datafee) == 'R' &&
+            (itReg= mapOracleRegistrations.find(oracletxid)) != mapOracleRegistrations.end() )
+        {
+            CCtxidaddr(markeraddr,oracletxid);
+            for (int32_t j=0; j<tx.vout.size(); j++)
+            {
+                if ( Getscriptaddress(addr,tx.vout[j].scriptPubKey) != 0 && strcmp(addr,markeraddr) == 0 )
+                {
+                    reg.height = height;
+                    itReg->second[tx.GetHash()] = reg;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void OraclesBlockDisconnected(const CBlock &block)
+{
+    LOCK(cs_oraclesindex);
+    if ( mapOracleRegistrations.empty() && mapOracleSamples.empty() )
+        return;
+    for (int32_t i=block.vtx.size()-1; i>=0; i--)
+    {
+        const CTransaction &tx = block.vtx[i];
+        std::map<uint256, std::map<uint256, COracleRegistration> >::iterator itReg;
+        uint256 oracletxid,batontxid; std::string batonaddr; std::vector<uint8_t> data; CPubKey pk; int64_t datafee;
+
+        if ( OracleDecodeSample(tx,oracletxid,batonaddr,batontxid,data) )
+        {
+            if ( !OracleSamplesPop(tx.GetHash()) )
+                OracleSamplesUnload(COracleSamplesKey(oracletxid,batonaddr));
+        }
+        else if ( tx.vout.size() > 0 && DecodeOraclesOpRet(tx.vout[tx.vout.size()-1].scriptPubKey,oracletxid,pk,datafee) == 'R' &&
+            (itReg= mapOracleRegistrations.find(oracletxid)) != mapOracleRegistrations.end() )
+            itReg->second.erase(tx.GetHash());
+    }
+}
+
 int64_t _correlate_price(int64_t *prices,int32_t n,int64_t price)
 {
     int32_t i,count = 0; int64_t diff,threshold = (price >> 8);
@@ -587,7 +957,7 @@ bool OraclesDataValidate(struct CCcontract_info *cp,Eval* eval,const CTransactio
     CTransaction vinTx; uint256 hashBlock,activehash; int32_t i,numvins,numvouts; int64_t inputs=0,outputs=0,assetoshis; CScript scriptPubKey;
     numvins = tx.vin.size();
     numvouts = tx.vout.size();
-    if ( OracleDatafee(scriptPubKey,oracletxid,publisher) != datafee )
+    if ( OracleDatafee(scriptPubKey,oracletxid,publisher,false) != datafee )
         return eval->Invalid("mismatched datafee");
     scriptPubKey = MakeCC1vout(cp->evalcode,0,publisher).scriptPubKey;
     for (i=0; i<numvins; i++)
@@ -981,7 +1351,7 @@ UniValue OracleData(const CPubKey& pk, int64_t txfee,uint256 oracletxid,std::vec
     mypk = pk.IsValid()?pk:pubkey2pk(Mypubkey());
     if ( data.size() > 8192 )
         CCERR_RESULT("oraclescc",CCLOG_INFO, stream << "datasize " << (int32_t)data.size() << " is too big");
-    if ( (datafee= OracleDatafee(pubKey,oracletxid,mypk)) <= 0 )
+    if ( (datafee= OracleDatafee(pubKey,oracletxid,mypk,true)) <= 0 )
         CCERR_RESULT("oraclescc",CCLOG_INFO, stream << "datafee " << (double)datafee/COIN << "is illegal");
     if ( myGetTransaction(oracletxid,tx,hashBlock) != 0 && (numvouts=tx.vout.size()) > 0 )
     {
@@ -1071,7 +1441,7 @@ UniValue OracleDataSamples(uint256 reforacletxid,char* batonaddr,int32_t num)
 {
     UniValue result(UniValue::VOBJ),b(UniValue::VARR); CTransaction tx,oracletx; uint256 txid,hashBlock,btxid,oracletxid; 
     CPubKey pk; std::string name,description,format; int32_t numvouts,n=0,vout; std::vector<uint8_t> data; char *formatstr = 0, addr[64];
-    std::vector<uint256> txids; int64_t nValue;
+    std::vector<uint256> txids; int64_t nValue; std::vector<std::pair<COracleSample, std::vector<uint8_t> > > samples;
     
     result.push_back(Pair("result","success"));
     if ( myGetTransaction(reforacletxid,oracletx,hashBlock) != 0 && (numvouts=oracletx.vout.size()) > 0 )
@@ -1101,6 +1471,20 @@ UniValue OracleDataSamples(uint256 reforacletxid,char* batonaddr,int32_t num)
                     }
                 }
             }
+            if ( OracleSamplesList(reforacletxid,batonaddr,0,std::numeric_limits<int32_t>::max(),num != 0 ? num-n : 0,samples) )
+            {
+                if ( (formatstr= (char *)format.c_str()) == 0 )
+                    formatstr = (char *)"";
+                for (int32_t i=0; i<samples.size(); i++)
+                {
+                    UniValue a(UniValue::VOBJ);
+                    a.push_back(Pair("txid",samples[i].first.txid.GetHex()));
+                    a.push_back(Pair("data",OracleFormat((uint8_t *)samples[i].second.data(),(int32_t)samples[i].second.size(),formatstr,(int32_t)format.size())));
+                    b.push_back(a);
+                }
+                result.push_back(Pair("samples",b));
+                return(result);
+            }
             SetCCtxids(txids,batonaddr,true,EVAL_ORACLES,reforacletxid,'D');
             if (txids.size()>0)
             {
@@ -1136,6 +1520,32 @@ UniValue OracleDataSamples(uint256 reforacletxid,char* batonaddr,int32_t num)
     return(result);
 }
 
+UniValue OracleDataSamplesRange(uint256 reforacletxid,char *batonaddr,int32_t fromheight,int32_t toheight)
+{
+    UniValue result(UniValue::VOBJ),b(UniValue::VARR); CTransaction oracletx; uint256 hashBlock; std::string name,description,format;
+    int32_t numvouts; char *formatstr; std::vector<std::pair<COracleSample, std::vector<uint8_t> > > samples;
+
+    if ( myGetTransaction(reforacletxid,oracletx,hashBlock) == 0 || (numvouts=oracletx.vout.size()) <= 0 )
+        CCERR_RESULT("oraclescc",CCLOG_INFO, stream << "cant find oracletxid " << reforacletxid.GetHex());
+    if ( DecodeOraclesCreateOpRet(oracletx.vout[numvouts-1].scriptPubKey,name,description,format) != 'C' )
+        CCERR_RESULT("oraclescc",CCLOG_INFO, stream << "invalid oracletxid " << reforacletxid.GetHex());
+    if ( !OracleSamplesList(reforacletxid,batonaddr,fromheight,toheight,0,samples) )
+        CCERR_RESULT("oraclescc",CCLOG_INFO, stream << "samples index not available");
+    if ( (formatstr= (char *)format.c_str()) == 0 )
+        formatstr = (char *)"";
+    for (int32_t i=samples.size()-1; i>=0; i--)
+    {
+        UniValue a(UniValue::VOBJ);
+        a.push_back(Pair("txid",samples[i].first.txid.GetHex()));
+        a.push_back(Pair("height",samples[i].first.height));
+        a.push_back(Pair("data",OracleFormat((uint8_t *)samples[i].second.data(),(int32_t)samples[i].second.size(),formatstr,(int32_t)format.size())));
+        b.push_back(a);
+    }
+    result.push_back(Pair("result","success"));
+    result.push_back(Pair("samples",b));
+    return(result);
+}
+
 UniValue OracleInfo(uint256 origtxid)
 {
     UniValue result(UniValue::VOBJ),a(UniValue::VARR);
@@ -1143,7 +1553,7 @@ UniValue OracleInfo(uint256 origtxid)
     CMutableTransaction mtx = CreateNewContextualCMutableTransaction(Params().GetConsensus(), komodo_nextheight());
     CTransaction tx; std::string name,description,format; uint256 hashBlock,txid,oracletxid,batontxid; CPubKey pk;
     struct CCcontract_info *cp,C; int64_t datafee,funding; char str[67],markeraddr[64],numstr[64],batonaddr[64]; std::vector <uint8_t> data;
-    std::map<CPubKey,std::pair<uint256,int32_t>> publishers;
+    std::map<CPubKey,std::pair<uint256,int32_t>> publishers; std::vector<std::pair<uint256, COracleRegistration> > registrations;
 
     cp = CCinit(&C,EVAL_ORACLES);
     CCtxidaddr(markeraddr,origtxid);
@@ -1164,18 +1574,32 @@ UniValue OracleInfo(uint256 origtxid)
             result.push_back(Pair("description",description));
             result.push_back(Pair("format",format));
             result.push_back(Pair("marker",markeraddr));
-            SetCCunspents(unspentOutputs,markeraddr,false);
-            for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+            if ( OracleRegistrations(origtxid,registrations) )
             {
-                txid = it->first.txhash;
-                height = (int32_t)it->second.blockHeight;
-                if ( myGetTransaction(txid,tx,hashBlock) != 0 && tx.vout.size() > 0 &&
-                    DecodeOraclesOpRet(tx.vout[tx.vout.size()-1].scriptPubKey,oracletxid,pk,datafee) == 'R' && oracletxid == origtxid )
+                for (std::vector<std::pair<uint256, COracleRegistration> >::const_iterator it=registrations.begin(); it!=registrations.end(); it++)
                 {
-                    if (publishers.find(pk)==publishers.end() || height>publishers[pk].second)
+                    if (publishers.find(it->second.pk)==publishers.end() || it->second.height>publishers[it->second.pk].second)
                     {
-                        publishers[pk].first=txid;
-                        publishers[pk].second=height;
+                        publishers[it->second.pk].first=it->first;
+                        publishers[it->second.pk].second=it->second.height;
+                    }
+                }
+            }
+            else
+            {
+                SetCCunspents(unspentOutputs,markeraddr,false);
+                for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+                {
+                    txid = it->first.txhash;
+                    height = (int32_t)it->second.blockHeight;
+                    if ( myGetTransaction(txid,tx,hashBlock) != 0 && tx.vout.size() > 0 &&
+                        DecodeOraclesOpRet(tx.vout[tx.vout.size()-1].scriptPubKey,oracletxid,pk,datafee) == 'R' && oracletxid == origtxid )
+                    {
+                        if (publishers.find(pk)==publishers.end() || height>publishers[pk].second)
+                        {
+                            publishers[pk].first=txid;
+                            publishers[pk].second=height;
+                        }
                     }
                 }
             }
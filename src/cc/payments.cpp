@@ -249,6 +249,7 @@ int64_t IsPaymentsvout(struct CCcontract_info *cp,const CTransaction& tx,int32_t
 
 bool payments_game(int32_t &top, int32_t &bottom)
 {
+    LOCK(cs_addresssnapshot);
     uint64_t x;
     uint256 tmphash = chainActive[lastSnapShotHeight]->GetBlockHash();
     memcpy(&x,&tmphash,sizeof(x));
@@ -275,21 +276,33 @@ bool payments_lockedblocks(uint256 blockhash,int32_t lockedblocks,int32_t &block
     return true;
 }
 
-int32_t payments_getallocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys,  std::vector<int64_t> &allocations)
+// Snapshot allocations by (snapshot height, top, bottom, excluded scriptPubKeys), so that a release is validated in the
+// mempool, in its block and by paymentsrelease from one walk of the snapshot. The total is kept as a decimal mpz string.
+// A snapshot at another height replaces the cache.
+#define PAYMENTS_ALLOCATIONS_CACHED 64
+
+struct CPaymentsAllocations {
+    int32_t n;
+    std::vector<CScript> scriptPubKeys;
+    std::vector<int64_t> allocations;
+    std::string total;
+};
+typedef std::tuple<int32_t, int32_t, int32_t, std::vector<std::vector<uint8_t>> > CPaymentsAllocationsKey;
+
+static CCriticalSection cs_paymentsallocations;
+static std::map<CPaymentsAllocationsKey, CPaymentsAllocations> mapPaymentsAllocations;
+
+static int32_t payments_snapshotallocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys,  std::vector<int64_t> &allocations)
 {
-    mpz_t mpzAllocation; int32_t i =0;
+    mpz_t mpzAllocation; int32_t i =0; std::set<CScript> excluded;
+    for ( auto skipkey : excludeScriptPubKeys )
+        excluded.insert(CScript(skipkey.begin(), skipkey.end()));
     for (int32_t j = bottom; j < vAddressSnapshot.size(); j++)
     {
         auto &address = vAddressSnapshot[j];
         CScript scriptPubKey = GetScriptForDestination(address.second); 
-        bool skip = false;
         // skip excluded addresses. 
-        for ( auto skipkey : excludeScriptPubKeys ) 
-        {
-            if ( scriptPubKey == CScript(skipkey.begin(), skipkey.end()) )
-                skip = true;
-        }
-        if ( !skip )
+        if ( excluded.count(scriptPubKey) == 0 )
         {
             mpz_init(mpzAllocation); 
             i++;
@@ -306,6 +319,41 @@ int32_t payments_getallocations(int32_t top, int32_t bottom, const std::vector<s
     return(i);
 }
 
+int32_t payments_getallocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys,  std::vector<int64_t> &allocations)
+{
+    // the walk and the height it is cached under must be of the same snapshot
+    LOCK(cs_addresssnapshot);
+    CPaymentsAllocationsKey key(lastSnapShotHeight,top,bottom,excludeScriptPubKeys); CPaymentsAllocations cached; mpz_t mpzTotal;
+    {
+        LOCK(cs_paymentsallocations);
+        std::map<CPaymentsAllocationsKey, CPaymentsAllocations>::const_iterator it = mapPaymentsAllocations.find(key);
+        if ( it != mapPaymentsAllocations.end() )
+            cached = it->second;
+        else cached.n = -1;
+    }
+    if ( cached.n < 0 )
+    {
+        mpz_init(mpzTotal);
+        cached.n = payments_snapshotallocations(top, bottom, excludeScriptPubKeys, mpzTotal, cached.scriptPubKeys, cached.allocations);
+        std::vector<char> str(mpz_sizeinbase(mpzTotal,10) + 2);
+        cached.total = mpz_get_str(str.data(),10,mpzTotal);
+        mpz_clear(mpzTotal);
+
+        LOCK(cs_paymentsallocations);
+        if ( !mapPaymentsAllocations.empty() && std::get<0>(mapPaymentsAllocations.begin()->first) != lastSnapShotHeight )
+            mapPaymentsAllocations.clear();
+        if ( mapPaymentsAllocations.size() >= PAYMENTS_ALLOCATIONS_CACHED )
+            mapPaymentsAllocations.erase(mapPaymentsAllocations.begin());
+        mapPaymentsAllocations[key] = cached;
+    }
+    scriptPubKeys.insert(scriptPubKeys.end(), cached.scriptPubKeys.begin(), cached.scriptPubKeys.end());
+    allocations.insert(allocations.end(), cached.allocations.begin(), cached.allocations.end());
+    mpz_init_set_str(mpzTotal, cached.total.c_str(), 10);
+    mpz_add(mpzTotalAllocations,mpzTotalAllocations,mpzTotal);
+    mpz_clear(mpzTotal);
+    return(cached.n);
+}
+
 int32_t payments_gettokenallocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excludeScriptPubKeys, uint256 tokenid, mpz_t &mpzTotalAllocations, std::vector<CScript> &scriptPubKeys,  std::vector<int64_t> &allocations)
 {
     /*
@@ -405,7 +453,8 @@ bool PaymentsValidate(struct CCcontract_info *cp,Eval* eval,const CTransaction &
                 }
                 else if ( funcid == 'S' || funcid == 'O' )
                 {
-                    // snapshot payment
+                    // snapshot payment, the checks, the game and the allocations all of one snapshot
+                    LOCK(cs_addresssnapshot);
                     if ( KOMODO_SNAPSHOT_INTERVAL == 0 )
                         return(eval->Invalid("snapshots not activated on this chain"));
                     if ( vAddressSnapshot.size() == 0 )
@@ -808,7 +857,8 @@ UniValue PaymentsRelease(struct CCcontract_info *cp,char *jsonstr)
                 }
                 else if ( funcid == 'S' || funcid == 'O' )
                 {
-                    // normal snapshot
+                    // normal snapshot, the checks, the game and the allocations all of one snapshot
+                    LOCK(cs_addresssnapshot);
                     if ( vAddressSnapshot.size() == 0 )
                     {
                         result.push_back(Pair("result","error"));
@@ -80,38 +80,11 @@ GetKomodoEarlytxidScriptPub is on line #2080 of komodo_bitcoind.h
 #define NVOUT_CCMARKER 1
 #define NVOUT_NORMALMARKER 3
 
-typedef struct OneBetData {
-    int64_t positionsize;
-    int32_t firstheight;
-    int64_t costbasis;
-    int64_t profits;
-
-    OneBetData() { positionsize = 0; firstheight = 0; costbasis = 0; profits = 0; }  // it is important to clear costbasis as it will be calculated as minmax from inital value 0
-} onebetdata;
-
-typedef struct BetInfo {
-    uint256 txid;
-    int64_t averageCostbasis, firstprice, lastprice, liquidationprice, equity;
-    int64_t exitfee;
-    int32_t lastheight;
-    int16_t leverage;
-    bool isOpen, isRekt;
-    uint256 tokenid;
-
-    std::vector<uint16_t> vecparsed;
-    std::vector<onebetdata> bets;
-    CPubKey pk;
-
-    bool isUp;
-
-    BetInfo() { 
-        averageCostbasis = firstprice = lastprice = liquidationprice = equity = 0;
-        lastheight = 0;
-        leverage = 0;
-        exitfee = 0;
-        isOpen = isRekt = isUp = false;
-    }
-} BetInfo;
+#ifndef TESTMODE
+#define PRICES_COSTBASIS_PERIOD PRICES_DAYWINDOW
+#else
+#define PRICES_COSTBASIS_PERIOD 7
+#endif
 
 typedef struct MatchedBookTotal {
 
@@ -965,12 +938,170 @@ int32_t prices_syntheticvec(std::vector<uint16_t> &vec, std::vector<std::string>
     return(0);
 }
 
-// calculates price for synthetic expression
-int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t minmax, int16_t leverage)
+// synthetic expression compiled once, shared by all bets on it
+typedef struct PricesPlan {
+    std::vector<uint16_t> vec;
+    std::vector<int32_t> inds;      // price index read by each index opcode, in order
+    bool isValid;                   // no stack errors and nonzero weights, so only the prices can make it fail
+    std::string expression, reduced;
+} PricesPlan;
+
+#define PRICES_MAXPLANS 4096
+#define PRICES_SCANWINDOW 64     // heights evaluated at once by bet scans
+
+static CCriticalSection cs_pricesplans;
+static std::map<std::vector<uint16_t>, std::shared_ptr<const PricesPlan> > pricesplans;
+
+static std::shared_ptr<const PricesPlan> prices_getplan(const std::vector<uint16_t> &vec)
+{
+    LOCK(cs_pricesplans);
+    std::map<std::vector<uint16_t>, std::shared_ptr<const PricesPlan> >::iterator it = pricesplans.find(vec);
+    if (it != pricesplans.end())
+        return it->second;
+
+    std::shared_ptr<PricesPlan> plan = std::make_shared<PricesPlan>();
+    int32_t depth = 0, den = 0;
+    plan->vec = vec;
+    plan->isValid = true;
+    for (int i = 0; i < vec.size() && plan->isValid; i++) {
+        uint16_t value = vec[i] & (KOMODO_MAXPRICES - 1);
+        switch (vec[i] & KOMODO_PRICEMASK) {
+        case 0:
+            plan->inds.push_back(value);
+            plan->isValid = (++depth <= 4);
+            break;
+        case PRICES_WEIGHT:
+            plan->isValid = (depth-- == 1);
+            den += value;
+            break;
+        case PRICES_MULT:
+        case PRICES_DIV:
+            plan->isValid = (depth-- >= 2);
+            break;
+        case PRICES_INV:
+            plan->isValid = (depth >= 1);
+            break;
+        case PRICES_MDD:
+        case PRICES_MMD:
+        case PRICES_MMM:
+        case PRICES_DDD:
+            plan->isValid = (depth >= 3);
+            depth -= 2;
+            break;
+        default:
+            plan->isValid = false;
+            break;
+        }
+    }
+    plan->isValid = plan->isValid && depth == 0 && den != 0;
+    plan->expression = prices_getsourceexpression(vec);
+    plan->reduced = prices_getreducedexpr(plan->expression);
+
+    if (pricesplans.size() >= PRICES_MAXPLANS)
+        pricesplans.clear();
+    pricesplans[vec] = plan;
+    return plan;
+}
+
+#ifdef __SIZEOF_INT128__
+// evaluates a valid plan on the j-th of numblocks rows of each index read by komodo_pricegetbatch,
+// with the same truncating arithmetic as prices_interpretprice. 128 bits hold every intermediate
+// except the product of "***", which is checked. Fails wherever prices_interpretprice would fail or
+// its result would not fit in 64 bits, leaving those cases to it.
+static bool prices_evalplan(const PricesPlan &plan, const int64_t *pricedata, int32_t numblocks, int32_t j, int64_t &price)
+{
+    typedef __int128 int128_t;
+    const int128_t maxprice = std::numeric_limits<int64_t>::max(), minprice = std::numeric_limits<int64_t>::min();
+    const int128_t maxproduct = (int128_t)1 << 64;
+    int64_t pricestack[4], a, b, c, den = 0;
+    int128_t result, totalprice = 0;
+    int32_t depth = 0, nextind = 0;
+
+    for (int i = 0; i < plan.vec.size(); i++) {
+        uint16_t value = plan.vec[i] & (KOMODO_MAXPRICES - 1);
+        switch (plan.vec[i] & KOMODO_PRICEMASK) {
+        case 0:
+            if ((pricestack[depth++] = pricedata[((size_t)nextind++ * numblocks + j) * PRICES_MAXDATAPOINTS + 2]) == 0)
+                return false;
+            continue;
+        case PRICES_WEIGHT:
+            totalprice += (int128_t)pricestack[--depth] * value;
+            den += value;
+            continue;
+        case PRICES_MULT:
+            b = pricestack[--depth];
+            a = pricestack[--depth];
+            result = (int128_t)a * b / SATOSHIDEN;
+            break;
+        case PRICES_DIV:
+            b = pricestack[--depth];
+            a = pricestack[--depth];
+            if (b == 0)
+                return false;
+            result = (int128_t)a * SATOSHIDEN / b;
+            break;
+        case PRICES_INV:
+            a = pricestack[--depth];
+            if (a == 0)
+                return false;
+            result = (int128_t)SATOSHIDEN * SATOSHIDEN / a;
+            break;
+        case PRICES_MDD:
+            c = pricestack[--depth];
+            b = pricestack[--depth];
+            a = pricestack[--depth];
+            if (b == 0 || c == 0)
+                return false;
+            result = (int128_t)a * SATOSHIDEN / b * SATOSHIDEN / c;
+            break;
+        case PRICES_MMD:
+            c = pricestack[--depth];
+            b = pricestack[--depth];
+            a = pricestack[--depth];
+            if (c == 0)
+                return false;
+            result = (int128_t)a * b / c;
+            break;
+        case PRICES_MMM:
+            c = pricestack[--depth];
+            b = pricestack[--depth];
+            a = pricestack[--depth];
+            result = (int128_t)a * b / SATOSHIDEN;
+            if (result >= maxproduct || result <= -maxproduct)
+                return false;
+            result = result * c / SATOSHIDEN;
+            break;
+        case PRICES_DDD:
+            c = pricestack[--depth];
+            b = pricestack[--depth];
+            a = pricestack[--depth];
+            if (a == 0 || b == 0 || c == 0)
+                return false;
+            result = (int128_t)SATOSHIDEN * SATOSHIDEN / a * SATOSHIDEN / b * SATOSHIDEN / c;
+            break;
+        default:
+            return false;
+        }
+        if (result > maxprice || result < minprice)
+            return false;
+        pricestack[depth++] = (int64_t)result;
+    }
+    result = totalprice / den;
+    if (result > maxprice || result < minprice)
+        return false;
+    price = (int64_t)result;
+    return true;
+}
+#endif
+
+// calculates price for synthetic expression with gmp on the j-th of numblocks rows of the prices
+// komodo_pricegetbatch read for its indices, reporting why it failed
+int64_t prices_interpretpricedata(const std::vector<uint16_t> &vec, const int64_t *prices, const int32_t *retvals, int32_t numblocks, int32_t j)
 {
-    int32_t i, value, errcode, depth, retval = -1;
+    int32_t i, value, errcode, depth, nextind, retval = -1;
     uint16_t opcode;
-    int64_t *pricedata, pricestack[4], a, b, c;
+    int64_t pricestack[4], a, b, c;
+    const int64_t *pricedata;
 
     mpz_t mpzTotalPrice, mpzPriceValue, mpzDen, mpzA, mpzB, mpzC, mpzResult;
 
@@ -983,7 +1114,7 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
     mpz_init(mpzC);
     mpz_init(mpzResult);
 
-    pricedata = (int64_t *)calloc(sizeof(*pricedata) * 3, 1 + PRICES_DAYWINDOW * 2 + PRICES_SMOOTHWIDTH);
+    nextind = 0;
     depth = errcode = 0;
     mpz_set_si(mpzTotalPrice, 0);
     mpz_set_si(mpzDen, 0);
@@ -1000,7 +1131,8 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
         {
         case 0: // indices 
             pricestack[depth] = 0;
-            if (komodo_priceget(pricedata, value, height, 1) >= 0)
+            pricedata = &prices[((size_t)nextind * numblocks + j) * PRICES_MAXDATAPOINTS];
+            if (retvals[nextind++] >= 0)
             {
                 //std::cerr << "prices_syntheticprice" << " pricedata[0]=" << pricedata[0] << " pricedata[1]=" << pricedata[1] << " pricedata[2]=" << pricedata[2] << std::endl;
                 // push price to the prices stack
@@ -1061,6 +1193,10 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
                 b = pricestack[--depth];
                 a = pricestack[--depth];
                 // pricestack[depth++] = (a * SATOSHIDEN) / b;
+                if (b == 0) {
+                    errcode = -15;
+                    break;
+                }
                 mpz_set_si(mpzA, a);
                 mpz_set_si(mpzB, b);
                 mpz_mul_ui(mpzResult, mpzA, SATOSHIDEN);
@@ -1075,6 +1211,10 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
             if (depth >= 1) {
                 a = pricestack[--depth];
                 // pricestack[depth++] = (SATOSHIDEN * SATOSHIDEN) / a;
+                if (a == 0) {
+                    errcode = -15;
+                    break;
+                }
                 mpz_set_si(mpzA, a);
                 mpz_set_ui(mpzResult, SATOSHIDEN);
                 mpz_mul_ui(mpzResult, mpzResult, SATOSHIDEN);           
@@ -1091,6 +1231,10 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
                 b = pricestack[--depth];
                 a = pricestack[--depth];
                 // pricestack[depth++] = (((a * SATOSHIDEN) / b) * SATOSHIDEN) / c;
+                if (b == 0 || c == 0) {
+                    errcode = -15;
+                    break;
+                }
                 mpz_set_si(mpzA, a);
                 mpz_set_si(mpzB, b);
                 mpz_set_si(mpzC, c);
@@ -1110,6 +1254,10 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
                 b = pricestack[--depth];
                 a = pricestack[--depth];
                 // pricestack[depth++] = (a * b) / c;
+                if (c == 0) {
+                    errcode = -15;
+                    break;
+                }
                 mpz_set_si(mpzA, a);
                 mpz_set_si(mpzB, b);
                 mpz_set_si(mpzC, c);
@@ -1146,6 +1294,10 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
                 b = pricestack[--depth];
                 a = pricestack[--depth];
                 //pricestack[depth++] = (((((SATOSHIDEN * SATOSHIDEN) / a) * SATOSHIDEN) / b) * SATOSHIDEN) / c;
+                if (a == 0 || b == 0 || c == 0) {
+                    errcode = -15;
+                    break;
+                }
                 mpz_set_si(mpzA, a);
                 mpz_set_si(mpzB, b);
                 mpz_set_si(mpzC, c);
@@ -1183,7 +1335,6 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
  //           std::cerr << "prices_syntheticprice pricestack empty" << std::endl;
 
     }
-    free(pricedata);
     mpz_clear(mpzResult);
     mpz_clear(mpzA);
     mpz_clear(mpzB);
@@ -1215,6 +1366,10 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
         std::cerr << "prices_syntheticprice price is zero, not enough historic data yet" << std::endl;
         return errcode;
     }
+    if (errcode == -15) {
+        std::cerr << "prices_syntheticprice division by zero" << std::endl;
+        return errcode;
+    }
     if (den == 0) {
         std::cerr << "prices_syntheticprice den==0 return err=-11" << std::endl;
         return(-11);
@@ -1232,29 +1387,83 @@ int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t
     return priceIndex;
 }
 
-// calculates costbasis and profit/loss for the bet
-int32_t prices_syntheticprofits(int64_t &costbasis, int32_t firstheight, int32_t height, int16_t leverage, std::vector<uint16_t> vec, int64_t positionsize,  int64_t &profits, int64_t &outprice)
+// calculates price for synthetic expression with gmp, reading the prices of all its indices at once
+static int64_t prices_interpretprice(const std::vector<uint16_t> &vec, int32_t height)
 {
-    int64_t price;
-#ifndef TESTMODE
-    const int32_t COSTBASIS_PERIOD = PRICES_DAYWINDOW;
+    std::vector<int32_t> inds, retvals;
+    std::vector<int64_t> prices;
+
+    for (int i = 0; i < vec.size(); i++)
+        if ((vec[i] & KOMODO_PRICEMASK) == 0)
+            inds.push_back(vec[i] & (KOMODO_MAXPRICES - 1));
+    if (inds.empty())
+        return prices_interpretpricedata(vec, NULL, NULL, 1, 0);
+    retvals.resize(inds.size());
+    prices.resize(inds.size() * PRICES_MAXDATAPOINTS);
+    komodo_pricegetbatch(&prices[0], &retvals[0], &inds[0], inds.size(), height, 1);
+    return prices_interpretpricedata(vec, &prices[0], &retvals[0], 1, 0);
+}
+
+// calculates price for synthetic expression with its compiled plan, on the same rows as
+// prices_interpretpricedata. False where the plan cannot decide, which is left to the interpreter
+bool prices_evalsynthetic(const std::vector<uint16_t> &vec, const int64_t *prices, int32_t numblocks, int32_t j, int64_t &price)
+{
+#ifdef __SIZEOF_INT128__
+    std::shared_ptr<const PricesPlan> plan = prices_getplan(vec);
+    return plan->isValid && prices_evalplan(*plan, prices, numblocks, j, price);
 #else
-    const int32_t COSTBASIS_PERIOD = 7;
+    return false;
 #endif
+}
 
-
-    if (height < firstheight) {
-        LogPrintf( "requested height is lower than bet firstheight.%d\n", height);
-        return -1;
+// calculates prices for synthetic expression at numblocks heights from height on, reading all prices at once.
+// Stops after the first height without a price, returns the number of prices[] set
+static int32_t prices_syntheticprices(const std::vector<uint16_t> &vec, int32_t height, int32_t numblocks, int64_t *prices)
+{
+    std::shared_ptr<const PricesPlan> plan = prices_getplan(vec);
+    int32_t i, j;
+
+#ifdef __SIZEOF_INT128__
+    if (plan->isValid && plan->inds.size() > 0) {
+        std::vector<int64_t> pricedata(plan->inds.size() * numblocks * PRICES_MAXDATAPOINTS);
+        std::vector<int32_t> retvals(plan->inds.size());
+
+        komodo_pricegetbatch(&pricedata[0], &retvals[0], &plan->inds[0], plan->inds.size(), height, numblocks);
+        for (i = 0; i < retvals.size() && retvals[i] >= 0; i++)
+            ;
+        if (i == retvals.size()) {
+            for (j = 0; j < numblocks; j++) {
+                if (!prices_evalplan(*plan, &pricedata[0], numblocks, j, prices[j]) && (prices[j] = prices_interpretpricedata(vec, &pricedata[0], &retvals[0], numblocks, j)) < 0)
+                    return j + 1;
+            }
+            return numblocks;
+        }
+    }
+#endif
+    if (numblocks > 1) {
+        // the window runs past the stored prices
+        for (j = 0; j < numblocks; j++) {
+            if (prices_syntheticprices(vec, height + j, 1, &prices[j]) != 1 || prices[j] < 0)
+                return j + 1;
+        }
+        return numblocks;
     }
+    prices[0] = prices_interpretprice(vec, height);
+    return 1;
+}
 
-    int32_t minmax = (height < firstheight + COSTBASIS_PERIOD);  // if we are within 24h then use min or max value 
+// calculates price for synthetic expression
+int64_t prices_syntheticprice(std::vector<uint16_t> vec, int32_t height, int32_t minmax, int16_t leverage)
+{
+    int64_t price;
+    prices_syntheticprices(vec, height, 1, &price);
+    return price;
+}
 
-    if ((price = prices_syntheticprice(vec, height, minmax, leverage)) < 0)
-    {
-        LogPrintf( "error getting synthetic price at height.%d\n", height);
-        return -1;
-    }
+// calculates costbasis and profit/loss for the bet at height, where the synthetic price is price
+static int32_t prices_priceprofits(int64_t &costbasis, int32_t firstheight, int32_t height, int16_t leverage, int64_t price, int64_t positionsize, int64_t &profits, int64_t &outprice)
+{
+    int32_t minmax = (height < firstheight + PRICES_COSTBASIS_PERIOD);  // if we are within 24h then use min or max value 
 
     // clear lowest positions:
     //price /= PRICES_POINTFACTOR;
@@ -1342,6 +1551,27 @@ int32_t prices_syntheticprofits(int64_t &costbasis, int32_t firstheight, int32_t
     return 0; //  (positionsize + addedbets + profits);
 }
 
+// calculates costbasis and profit/loss for the bet
+int32_t prices_syntheticprofits(int64_t &costbasis, int32_t firstheight, int32_t height, int16_t leverage, std::vector<uint16_t> vec, int64_t positionsize,  int64_t &profits, int64_t &outprice)
+{
+    int64_t price;
+
+
+    if (height < firstheight) {
+        LogPrintf( "requested height is lower than bet firstheight.%d\n", height);
+        return -1;
+    }
+
+    int32_t minmax = (height < firstheight + PRICES_COSTBASIS_PERIOD);  // if we are within 24h then use min or max value 
+
+    if ((price = prices_syntheticprice(vec, height, minmax, leverage)) < 0)
+    {
+        LogPrintf( "error getting synthetic price at height.%d\n", height);
+        return -1;
+    }
+    return prices_priceprofits(costbasis, firstheight, height, leverage, price, positionsize, profits, outprice);
+}
+
 // makes result json object
 void prices_betjson(UniValue &result, std::vector<OneBetData> bets, int16_t leverage, int32_t endheight, int64_t lastprice)
 {
@@ -1599,48 +1829,240 @@ UniValue PricesAddFunding(int64_t txfee, uint256 bettxid, int64_t amount)
     return(result);
 }
 
-// scan chain from the initial bet's first position upto the chain tip and calculate bet's costbasises and profits, breaks if rekt detected 
-int32_t prices_scanchain(std::vector<OneBetData> &bets, int16_t leverage, std::vector<uint16_t> vec, int64_t &lastprice, int32_t &endheight) {
+// scan state of a bet, kept so that no height is evaluated twice for it:
+// connected blocks continue the scans of open bets, rpcs continue from where the last scan stopped.
+// At most PRICES_MAXSCANS are kept, the least recently used go first.
+typedef struct PricesBetScan {
+    int16_t leverage;
+    std::vector<uint16_t> vec;
+    std::vector<OneBetData> bets;   // costbasises and profits as of height
+    int32_t height;                 // last scanned height, or the bet's firstheight if none
+    int64_t lastprice;
+    bool isRekt;                    // equity reached the margin at height, nothing more to scan
+    bool isOpen;
+    uint64_t lastused;
+} PricesBetScan;
+
+static CCriticalSection cs_pricesscans;
+static std::map<uint256, PricesBetScan> pricesscans;
+static uint64_t pricesscansused;
+static uint64_t pricesscansdisconnects;   // scans made across a disconnect are not kept
+
+static void prices_trimscans()
+{
+    AssertLockHeld(cs_pricesscans);
+    while (pricesscans.size() > PRICES_MAXSCANS) {
+        std::map<uint256, PricesBetScan>::iterator oldest = pricesscans.begin();
+        for (std::map<uint256, PricesBetScan>::iterator it = pricesscans.begin(); it != pricesscans.end(); it++) {
+            if (it->second.lastused < oldest->second.lastused)
+                oldest = it;
+        }
+        pricesscans.erase(oldest);
+    }
+}
 
-    if (bets.size() == 0)
-        return -1;
+static void prices_initscan(PricesBetScan &scan, const std::vector<OneBetData> &bets, int16_t leverage, const std::vector<uint16_t> &vec)
+{
+    scan.leverage = leverage;
+    scan.vec = vec;
+    scan.bets.clear();
+    for (int i = 0; i < bets.size(); i++) {
+        OneBetData bet;
+        bet.positionsize = bets[i].positionsize;
+        bet.firstheight = bets[i].firstheight;
+        scan.bets.push_back(bet);
+    }
+    scan.height = scan.bets[0].firstheight;
+    scan.lastprice = 0;
+    scan.isRekt = false;
+    scan.lastused = 0;
+}
 
-    bool stop = false;
-    for (int32_t height = bets[0].firstheight+1; ; height++)   // the last datum for 24h is the costbasis value
-    {
-        int64_t totalposition = 0;
-        int64_t totalprofits = 0;
+// scan is still valid for bets if they only add positions opened after its last height
+static bool prices_canresumescan(const PricesBetScan &scan, const std::vector<OneBetData> &bets, int16_t leverage, const std::vector<uint16_t> &vec)
+{
+    if (scan.bets.size() == 0 || scan.bets.size() > bets.size() || scan.leverage != leverage || scan.vec != vec)
+        return false;
+    for (int i = 0; i < bets.size(); i++) {
+        if (i < scan.bets.size() && (bets[i].positionsize != scan.bets[i].positionsize || bets[i].firstheight != scan.bets[i].firstheight))
+            return false;
+        if (i >= scan.bets.size() && bets[i].firstheight < scan.height)
+            return false;
+    }
+    return true;
+}
 
-        // scan upto the chain tip
-        for (int i = 0; i < bets.size(); i++) {
+// continue the scan upto the chain tip and calculate bet's costbasises and profits, stops if rekt detected 
+static void prices_continuescan(PricesBetScan &scan)
+{
+    int32_t tipheight = komodo_currentheight();
+    if (scan.isRekt)
+        return;
+    for (int32_t height = scan.height + 1; height <= tipheight; )   // the last datum for 24h is the costbasis value
+    {
+        // evaluate the synthetic for the heights upto the tip at once
+        int64_t prices[PRICES_SCANWINDOW];
+        int32_t numblocks = std::min(PRICES_SCANWINDOW, tipheight - height + 1);
+        if ((numblocks = prices_syntheticprices(scan.vec, height, numblocks, prices)) <= 0)
+            return;
 
-            if (height > bets[i].firstheight) {
+        for (int32_t j = 0; j < numblocks; j++, height++) {
+            int64_t totalposition = 0;
+            int64_t totalprofits = 0;
+            int64_t lastprice = scan.lastprice;
 
-                int32_t retcode = prices_syntheticprofits(bets[i].costbasis, bets[i].firstheight, height, leverage, vec, bets[i].positionsize, bets[i].profits, lastprice);
-                if (retcode < 0) {
-                    std::cerr << "prices_scanchain() prices_syntheticprofits returned -1, finishing..." << std::endl;
-                    stop = true;
-                    break;
+            if (prices[j] < 0) {
+                LogPrintf( "error getting synthetic price at height.%d\n", height);
+                return;
+            }
+            for (int i = 0; i < scan.bets.size(); i++) {
+                if (height > scan.bets[i].firstheight) {
+                    prices_priceprofits(scan.bets[i].costbasis, scan.bets[i].firstheight, height, scan.leverage, prices[j], scan.bets[i].positionsize, scan.bets[i].profits, lastprice);
+                    totalposition += scan.bets[i].positionsize;
+                    totalprofits += scan.bets[i].profits;
                 }
-                totalposition += bets[i].positionsize;
-                totalprofits += bets[i].profits;
+            }
+
+            scan.height = height;
+            scan.lastprice = lastprice;
+            int64_t equity = totalposition + totalprofits;
+            if (equity <= (int64_t)((double)totalposition * prices_minmarginpercent(scan.leverage)))
+            {   // we are in loss
+                scan.isRekt = true;
+                return;
             }
         }
+    }
+}
 
-        if (stop)
-            break;
+// take the scan back to height, if no costbasis changed after it
+static bool prices_rollbackscan(PricesBetScan &scan, int32_t height)
+{
+    int64_t lastprice = 0;
+    if (height <= scan.bets[0].firstheight)
+        return false;
+    for (int i = 0; i < scan.bets.size(); i++) {
+        if (scan.bets[i].firstheight < height && height + 1 < scan.bets[i].firstheight + PRICES_COSTBASIS_PERIOD)
+            return false;
+    }
+    for (int i = 0; i < scan.bets.size(); i++) {
+        if (scan.bets[i].firstheight >= height)
+            scan.bets[i].costbasis = scan.bets[i].profits = 0;
+        else if (prices_syntheticprofits(scan.bets[i].costbasis, scan.bets[i].firstheight, height, scan.leverage, scan.vec, scan.bets[i].positionsize, scan.bets[i].profits, lastprice) < 0)
+            return false;
+    }
+    scan.height = height;
+    scan.lastprice = lastprice;
+    scan.isRekt = false;
+    return true;
+}
 
-        endheight = height;
-        int64_t equity = totalposition + totalprofits;
-        if (equity <= (int64_t)((double)totalposition * prices_minmarginpercent(leverage)))
-        {   // we are in loss
-            break;
+// scan chain from the initial bet's first position upto the chain tip and calculate bet's costbasises and profits, breaks if rekt detected 
+int32_t prices_scanchain(uint256 bettxid, BetInfo &betinfo) {
+
+    PricesBetScan scan;
+    uint64_t disconnects;
+    std::map<uint256, PricesBetScan>::iterator it;
+
+    if (betinfo.bets.size() == 0)
+        return -1;
+
+    {
+        LOCK(cs_pricesscans);
+        if ((it = pricesscans.find(bettxid)) != pricesscans.end())
+            scan = it->second;
+        disconnects = pricesscansdisconnects;
+    }
+    if (prices_canresumescan(scan, betinfo.bets, betinfo.leverage, betinfo.vecparsed)) {
+        for (int i = scan.bets.size(); i < betinfo.bets.size(); i++)
+            scan.bets.push_back(betinfo.bets[i]);
+    }
+    else
+        prices_initscan(scan, betinfo.bets, betinfo.leverage, betinfo.vecparsed);
+    scan.isOpen = betinfo.isOpen;
+
+    // scanned on a copy, a full history scan must not hold up block connects
+    prices_continuescan(scan);
+
+    {
+        LOCK(cs_pricesscans);
+        it = pricesscans.find(bettxid);
+        if (disconnects == pricesscansdisconnects && (it == pricesscans.end() || it->second.height <= scan.height)) {
+            scan.lastused = ++pricesscansused;
+            pricesscans[bettxid] = scan;
+            prices_trimscans();
         }
+        else if (it != pricesscans.end())
+            it->second.lastused = ++pricesscansused;
     }
 
+    betinfo.bets = scan.bets;
+    if (scan.height > scan.bets[0].firstheight) {
+        betinfo.lastprice = scan.lastprice;
+        betinfo.lastheight = scan.height;
+    }
     return 0;
 }
 
+bool PricesBetScanInfo(uint256 bettxid, int32_t &height, int32_t &numpositions)
+{
+    LOCK(cs_pricesscans);
+    std::map<uint256, PricesBetScan>::iterator it = pricesscans.find(bettxid);
+    if (it == pricesscans.end())
+        return false;
+    height = it->second.height;
+    numpositions = it->second.bets.size();
+    return true;
+}
+
+// continue the scans of open bets with the prices of a new block, and add the positions it funds
+void PricesBlockConnected(int32_t height, const CBlock &block)
+{
+    LOCK(cs_pricesscans);
+    if (pricesscans.empty())
+        return;
+
+    for (int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        uint256 bettxid;
+        CPubKey pk;
+        int64_t amount;
+        std::map<uint256, PricesBetScan>::iterator it;
+
+        // a tx that is not really in the baton chain will fail prices_canresumescan at the next rpc
+        if (tx.vout.size() > 0 && prices_addopretdecode(tx.vout.back().scriptPubKey, bettxid, pk, amount) == 'A' &&
+            (it = pricesscans.find(bettxid)) != pricesscans.end() && it->second.height <= height) {
+            OneBetData added;
+            added.positionsize = amount;
+            added.firstheight = height;
+            it->second.bets.push_back(added);
+        }
+    }
+    for (std::map<uint256, PricesBetScan>::iterator it = pricesscans.begin(); it != pricesscans.end(); it++) {
+        if (it->second.isOpen)
+            prices_continuescan(it->second);
+    }
+}
+
+// forget what was scanned from a disconnected block on
+void PricesBlockDisconnected(int32_t height)
+{
+    LOCK(cs_pricesscans);
+    pricesscansdisconnects++;
+    for (std::map<uint256, PricesBetScan>::iterator it = pricesscans.begin(); it != pricesscans.end(); ) {
+        PricesBetScan &scan = it->second;
+        if (scan.bets.size() == 0 || scan.bets[0].firstheight >= height) {
+            pricesscans.erase(it++);
+            continue;
+        }
+        while (scan.bets.back().firstheight >= height)
+            scan.bets.pop_back();
+        if (scan.height >= height && !prices_rollbackscan(scan, height - 1))
+            prices_initscan(scan, scan.bets, scan.leverage, scan.vec);
+        it++;
+    }
+}
+
 // pricescostbasis rpc impl: set cost basis (open price) for the bet (deprecated)
 UniValue PricesSetcostbasis(int64_t txfee, uint256 bettxid)
 {
@@ -1796,7 +2218,7 @@ int32_t prices_getbetinfo(uint256 bettxid, BetInfo &betinfo)
             }
 
 
-            if (prices_scanchain(betinfo.bets, betinfo.leverage, betinfo.vecparsed, betinfo.lastprice, betinfo.lastheight) < 0) {
+            if (prices_scanchain(bettxid, betinfo) < 0) {
                 return -4;
             }
 
@@ -2124,9 +2546,9 @@ UniValue PricesInfo(uint256 bettxid, int32_t refheight)
 
     result.push_back(Pair("open", betinfo.isOpen ? 1 : 0 ));
 
-    std::string expr = prices_getsourceexpression(betinfo.vecparsed);
-    result.push_back(Pair("expression", expr));
-    result.push_back(Pair("reduced", prices_getreducedexpr(expr)));
+    std::shared_ptr<const PricesPlan> plan = prices_getplan(betinfo.vecparsed);
+    result.push_back(Pair("expression", plan->expression));
+    result.push_back(Pair("reduced", plan->reduced));
 //            result.push_back(Pair("batontxid", batontxid.GetHex()));
     result.push_back(Pair("costbasis", ValueFromAmount(betinfo.averageCostbasis)));
 #ifdef TESTMODE
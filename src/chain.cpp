@@ -177,3 +177,9 @@ void CBlockIndex::BuildSkip()
     if (pprev)
         pskip = pprev->GetAncestor(GetSkipHeight(GetHeight()));
 }
+
+void CBlockIndex::BuildSkip(const std::vector<CBlockIndex*>& vAncestors)
+{
+    if (pprev)
+        pskip = vAncestors[GetSkipHeight(GetHeight())];
+}
@@ -464,6 +464,10 @@ public:
     //! Build the skiplist pointer for this entry.
     void BuildSkip();
 
+    //! Build the skiplist pointer from a height-indexed list of this entry's
+    //! ancestors, without touching any other entry.
+    void BuildSkip(const std::vector<CBlockIndex*>& vAncestors);
+
     //! Efficiently find an ancestor of this block.
     CBlockIndex* GetAncestor(int height);
     const CBlockIndex* GetAncestor(int height) const;
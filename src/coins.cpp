@@ -99,7 +99,13 @@ bool CCoinsViewBacked::GetStats(CCoinsStats &stats) const { return base->GetStat
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0) { }
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false),
+    cacheCoins(CCoinsMap::allocator_type(&pool)),
+    cacheSproutAnchors(CAnchorsSproutMap::allocator_type(&pool)),
+    cacheSaplingAnchors(CAnchorsSaplingMap::allocator_type(&pool)),
+    cacheSproutNullifiers(CNullifiersMap::allocator_type(&pool)),
+    cacheSaplingNullifiers(CNullifiersMap::allocator_type(&pool)),
+    cachedCoinsUsage(0) { }
 
 CCoinsViewCache::~CCoinsViewCache()
 {
@@ -107,12 +113,8 @@ CCoinsViewCache::~CCoinsViewCache()
 }
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
-    return memusage::DynamicUsage(cacheCoins) +
-           memusage::DynamicUsage(cacheSproutAnchors) +
-           memusage::DynamicUsage(cacheSaplingAnchors) +
-           memusage::DynamicUsage(cacheSproutNullifiers) +
-           memusage::DynamicUsage(cacheSaplingNullifiers) +
-           cachedCoinsUsage;
+    // The pool holds the nodes and bucket arrays of all the maps.
+    return pool.DynamicMemoryUsage() + cachedCoinsUsage;
 }
 
 CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const {
@@ -123,6 +125,7 @@ CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const
     if (!base->GetCoins(txid, tmp))
         return cacheCoins.end();
     CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
+    ret->second.SetBase(tmp);
     tmp.swap(ret->second.coins);
     if (ret->second.coins.IsPruned()) {
         // The parent only has an empty entry for this txid; we can consider our
@@ -368,6 +371,8 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
         } else if (ret.first->second.coins.IsPruned()) {
             // The parent view only has a pruned entry for this; mark it as fresh.
             ret.first->second.flags = CCoinsCacheEntry::FRESH;
+        } else {
+            ret.first->second.SetBase(ret.first->second.coins);
         }
     } else {
         cachedCoinUsage = ret.first->second.coins.DynamicMemoryUsage();
@@ -551,6 +556,38 @@ bool CCoinsViewCache::Flush() {
     cacheSproutNullifiers.clear();
     cacheSaplingNullifiers.clear();
     cachedCoinsUsage = 0;
+    pool.Release();
+    return fOk;
+}
+
+bool CCoinsViewCache::Sync() {
+    assert(!hasModifier);
+    CCoinsMap mapDirty((CCoinsMap::allocator_type(&pool)));
+    for (CCoinsMap::const_iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY)
+            mapDirty.insert(*it);
+    }
+    bool fOk = base->BatchWrite(mapDirty, hashBlock, hashSproutAnchor, hashSaplingAnchor, cacheSproutAnchors, cacheSaplingAnchors, cacheSproutNullifiers, cacheSaplingNullifiers);
+    cacheSproutAnchors.clear();
+    cacheSaplingAnchors.clear();
+    cacheSproutNullifiers.clear();
+    cacheSaplingNullifiers.clear();
+
+    // The parent now matches us; drop what was spent and rebase the rest.
+    cachedCoinsUsage = 0;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.coins.IsPruned()) {
+            CCoinsMap::iterator itOld = it++;
+            cacheCoins.erase(itOld);
+            continue;
+        }
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            it->second.flags = 0;
+            it->second.SetBase(it->second.coins);
+        }
+        cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
+        it++;
+    }
     return fOk;
 }
 
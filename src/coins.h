@@ -30,6 +30,7 @@
 #include "uint256.h"
 #include "base58.h"
 #include "pubkey.h"
+#include "support/allocators/pool.h"
 
 #include <assert.h>
 #include <stdint.h>
@@ -296,13 +297,24 @@ struct CCoinsCacheEntry
 {
     CCoins coins; // The actual cached data.
     unsigned char flags;
+    std::vector<bool> vBaseAvail; // Which outputs the parent view had when this entry was loaded.
+    int nBaseHeight; // The height the parent view had for them.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
         FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
     };
 
-    CCoinsCacheEntry() : coins(), flags(0) {}
+    CCoinsCacheEntry() : coins(), flags(0), nBaseHeight(0) {}
+
+    //! Remember which outputs the parent view holds, so writing the entry back
+    //! only has to touch the outputs that were spent or created since.
+    void SetBase(const CCoins &base) {
+        vBaseAvail.assign(base.vout.size(), false);
+        for (unsigned int i = 0; i < base.vout.size(); i++)
+            vBaseAvail[i] = !base.vout[i].IsNull();
+        nBaseHeight = base.nHeight;
+    }
 };
 
 struct CAnchorsSproutCacheEntry
@@ -349,10 +361,17 @@ enum ShieldedType
     SAPLING,
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
-typedef boost::unordered_map<uint256, CAnchorsSproutCacheEntry, CCoinsKeyHasher> CAnchorsSproutMap;
-typedef boost::unordered_map<uint256, CAnchorsSaplingCacheEntry, CCoinsKeyHasher> CAnchorsSaplingMap;
-typedef boost::unordered_map<uint256, CNullifiersCacheEntry, CCoinsKeyHasher> CNullifiersMap;
+/** The cache maps take their nodes from their CCoinsViewCache's CNodePool. */
+template <typename Entry>
+struct CCoinsCacheMap {
+    typedef boost::unordered_map<uint256, Entry, CCoinsKeyHasher, std::equal_to<uint256>,
+                                 pool_allocator<std::pair<const uint256, Entry> > > type;
+};
+
+typedef CCoinsCacheMap<CCoinsCacheEntry>::type CCoinsMap;
+typedef CCoinsCacheMap<CAnchorsSproutCacheEntry>::type CAnchorsSproutMap;
+typedef CCoinsCacheMap<CAnchorsSaplingCacheEntry>::type CAnchorsSaplingMap;
+typedef CCoinsCacheMap<CNullifiersCacheEntry>::type CNullifiersMap;
 
 struct CCoinsStats
 {
@@ -501,6 +520,9 @@ protected:
     /* Whether this cache has an active modifier. */
     bool hasModifier;
 
+    /* Node memory for the maps below; must outlive them. */
+    mutable CNodePool pool;
+
     /**
      * Make mutable so that we can "fill the cache" even from Get-methods
      * declared as "const". 
@@ -573,6 +595,13 @@ public:
      */
     bool Flush();
 
+    /**
+     * Like Flush(), but only the dirty entries are pushed and the unspent ones
+     * stay cached (and clean) afterwards, so a periodic write does not throw
+     * away the working set.
+     */
+    bool Sync();
+
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
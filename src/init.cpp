@@ -27,6 +27,7 @@
 #include "primitives/block.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockfilewriter.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/upgrades.h"
@@ -48,11 +49,13 @@
 #include "scheduler.h"
 #include "txdb.h"
 #include "torcontrol.h"
+#include "transaction_builder.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include "validationinterface.h"
 #ifdef ENABLE_WALLET
+#include "wallet/asyncrpcoperation_rescan.h"
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 #endif
@@ -100,6 +103,8 @@ extern bool VERUS_MINTBLOCKS;
 extern char ASSETCHAINS_SYMBOL[];
 extern int32_t KOMODO_SNAPSHOT_INTERVAL;
 extern void komodo_init(int32_t height);
+extern void TokensLedgerRead();
+extern void TokensLedgerWrite();
 
 ZCJoinSplit* pzcashParams = NULL;
 
@@ -256,6 +261,7 @@ void Shutdown()
             LogPrintf("%s: Failed to write fee estimates to %s\n", __func__, est_path.string());
         fFeeEstimatesInitialized = false;
     }
+    TokensLedgerWrite();
 
     {
         LOCK(cs_main);
@@ -271,6 +277,7 @@ void Shutdown()
         delete pblocktree;
         pblocktree = NULL;
     }
+    blockFileWriter.Stop();
 #ifdef ENABLE_WALLET
     if (pwalletMain)
         pwalletMain->Flush(true);
@@ -412,6 +419,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-banscore=<n>", strprintf(_("Threshold for disconnecting misbehaving peers (default: %u)"), 100));
     strUsage += HelpMessageOpt("-bantime=<n>", strprintf(_("Number of seconds to keep misbehaving peers from reconnecting (default: %u)"), 86400));
     strUsage += HelpMessageOpt("-bind=<addr>", _("Bind to given address and always listen on it. Use [host]:port notation for IPv6"));
+    strUsage += HelpMessageOpt("-compactblocks", strprintf(_("Negotiate compact block relay (BIP152) with peers (default: %u)"), DEFAULT_COMPACT_BLOCKS));
+    strUsage += HelpMessageOpt("-compactblockhbpeer=<netmask>", _("Ask peers from the given netmask or IP address to push new blocks to us as compact blocks without announcing them first. Can be specified multiple times."));
     strUsage += HelpMessageOpt("-connect=<ip>", _("Connect only to the specified node(s)"));
     strUsage += HelpMessageOpt("-discover", _("Discover own IP addresses (default: 1 when listening and no -externalip or -proxy)"));
     strUsage += HelpMessageOpt("-dns", _("Allow DNS lookups for -addnode, -seednode and -connect") + " " + _("(default: 1)"));
@@ -421,6 +430,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-listen", _("Accept connections from outside (default: 1 if no -proxy or -connect)"));
     strUsage += HelpMessageOpt("-listenonion", strprintf(_("Automatically create Tor hidden service (default: %d)"), DEFAULT_LISTEN_ONION));
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
+    strUsage += HelpMessageOpt("-msgworkers=<n>", strprintf(_("Serve data requests from peers on <n> threads besides the message handler (0 to %d, default: %d)"), MAX_MESSAGE_WORKERS, DEFAULT_MESSAGE_WORKERS));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), 5000));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), 1000));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
@@ -433,6 +443,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), 1));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+#ifdef HAVE_SYS_EPOLL_H
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Wait for socket events with <mode>: select or epoll (default: %s)"), DEFAULT_SOCKETEVENTS));
+#endif
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -450,6 +463,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"),
         CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-asyncrescan", strprintf(_("Run wallet rescans (on startup and from the import RPCs) as asynchronous operations; requires -server (default: %u)"), 0));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-rescanbatchsize=<n>", strprintf("Number of blocks read and committed per step of an asynchronous rescan (default: %u)", RESCAN_DEFAULT_BATCH_SIZE));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet.dat") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), 0));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), 1));
@@ -694,6 +710,15 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
             if (!file)
                 break; // This error is logged in OpenBlockFile
             LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+            // Have the OS read the next file while this one is processed
+            CDiskBlockPos posNext(nFile + 1, 0);
+            if (boost::filesystem::exists(GetBlockPosFilename(posNext, "blk"))) {
+                FILE *fileNext = OpenBlockFile(posNext, true);
+                if (fileNext) {
+                    AdviseSequentialRead(fileNext);
+                    fclose(fileNext);
+                }
+            }
             LoadExternalBlockFile(file, &pos);
             nFile++;
         }
@@ -1003,8 +1028,22 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     // Make sure enough file descriptors are available
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
+    std::string strSocketEvents = GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+    if (strSocketEvents == "epoll") {
+#ifdef HAVE_SYS_EPOLL_H
+        fSocketEventsEpoll = true;
+#else
+        return InitError(_("-socketevents=epoll is not supported on this platform"));
+#endif
+    } else if (strSocketEvents != "select") {
+        return InitError(strprintf(_("Unknown -socketevents mode '%s'"), strSocketEvents));
+    }
     nMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    // select() cannot watch sockets numbered past FD_SETSIZE; epoll is only
+    // bound by the descriptor limit below.
+    if (!fSocketEventsEpoll)
+        nMaxConnections = std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS));
+    nMaxConnections = std::max(nMaxConnections, 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -1073,6 +1112,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    nMessageWorkers = std::max(0, std::min((int)GetArg("-msgworkers", DEFAULT_MESSAGE_WORKERS), MAX_MESSAGE_WORKERS));
+
     fServer = GetBoolArg("-server", false);
 
     // block pruning; get the amount of disk space (in MB) to allot for block & undo files
@@ -1169,6 +1210,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     nMaxDatacarrierBytes = GetArg("-datacarriersize", nMaxDatacarrierBytes);
 
     fAlerts = GetBoolArg("-alerts", DEFAULT_ALERTS);
+    fCompactBlocks = GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS);
 
     // Option to startup with mocktime set (used for regression testing):
     SetMockTime(GetArg("-mocktime", 0)); // SetMockTime(0) is a no-op
@@ -1321,6 +1363,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    LogPrintf("Using %u threads for serving peer data requests\n", nMessageWorkers);
+    for (int i=0; i<nMessageWorkers; i++)
+        threadGroup.create_thread(&ThreadMessageWorker);
+
+    // Block and undo files are written on a thread of their own
+    blockFileWriter.Start();
+
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
@@ -1422,6 +1471,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         }
     }
 
+    if (mapArgs.count("-compactblockhbpeer")) {
+        BOOST_FOREACH(const std::string& net, mapMultiArgs["-compactblockhbpeer"]) {
+            CSubNet subnet(net);
+            if (!subnet.IsValid())
+                return InitError(strprintf(_("Invalid netmask specified in -compactblockhbpeer: '%s'"), net));
+            vCompactBlockHBPeers.push_back(subnet);
+        }
+    }
+
     bool proxyRandomize = GetBoolArg("-proxyrandomize", true);
     // -proxy sets a proxy for all outgoing network traffic
     // -noproxy (or -proxy=0) as well as the empty string can be used to not set a proxy, this is the default
@@ -1632,6 +1690,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
                 if (fRequestShutdown) break;
 
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading chainstate database, you may need to rebuild it using -reindex");
+                    break;
+                }
+
+                if (fRequestShutdown) break;
+
                 if (!LoadBlockIndex()) {
                     strLoadError = _("Error loading block database");
                     break;
@@ -1739,6 +1804,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (!est_filein.IsNull())
         mempool.ReadFeeEstimates(est_filein);
     fFeeEstimatesInitialized = true;
+    TokensLedgerRead();
 
 
     // ********************************************************* Step 8: load wallet
@@ -1848,7 +1914,21 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             else
                 pindexRescan = chainActive.Genesis();
         }
-        if (chainActive.Tip() && chainActive.Tip() != pindexRescan)
+        int nPendingRescan = -1;
+        {
+            // An asynchronous rescan was interrupted; pick up where it left off
+            CWalletDB walletdb(strWalletFile);
+            if (walletdb.ReadRescanHeight(nPendingRescan) && nPendingRescan > chainActive.Height())
+                nPendingRescan = -1;
+        }
+        bool fAsyncRescan = fServer && (GetBoolArg("-asyncrescan", false) || nPendingRescan >= 0) && !GetBoolArg("-zapwallettxes", false);
+        if (fAsyncRescan && ((chainActive.Tip() && chainActive.Tip() != pindexRescan) || nPendingRescan >= 0))
+        {
+            int nRescanHeight = (chainActive.Tip() && chainActive.Tip() != pindexRescan) ? pindexRescan->GetHeight() : nPendingRescan;
+            LogPrintf("Queueing asynchronous rescan from block %i\n", nRescanHeight);
+            QueueWalletRescan(pwalletMain, nRescanHeight);
+        }
+        else if (chainActive.Tip() && chainActive.Tip() != pindexRescan)
         {
             uiInterface.InitMessage(_("Rescanning..."));
             LogPrintf("Rescanning last %i blocks (from block %i)...\n", chainActive.Height() - pindexRescan->GetHeight(), pindexRescan->GetHeight());
@@ -21,6 +21,7 @@
 #include "keystore.h"
 
 #include "key.h"
+#include "random.h"
 #include "util.h"
 
 #include <boost/foreach.hpp>
@@ -67,10 +68,65 @@ bool CBasicKeyStore::GetHDSeed(HDSeed& seedOut) const
     }
 }
 
+//! Initial number of elements the owned filter is sized for
+static const unsigned int OWNED_FILTER_MIN_CAPACITY = 1000;
+//! False positive rate of the owned filter while within its capacity
+static const double OWNED_FILTER_FP_RATE = 0.0001;
+
+void CBasicKeyStore::AddToOwnedFilter(const std::vector<unsigned char>& vKey)
+{
+    AssertLockHeld(cs_KeyStore);
+    if (nOwnedElements >= nOwnedCapacity) {
+        nOwnedCapacity = std::max(OWNED_FILTER_MIN_CAPACITY, 2 * nOwnedCapacity);
+        // not a P2P filter, so not held to MAX_BLOOM_FILTER_SIZE
+        filterOwned = CBloomFilter(nOwnedCapacity, OWNED_FILTER_FP_RATE, GetRand(std::numeric_limits<unsigned int>::max()));
+        nOwnedElements = 0;
+        FillOwnedFilter();
+    }
+    filterOwned.insert(vKey);
+    nOwnedElements++;
+}
+
+void CBasicKeyStore::FillOwnedFilter()
+{
+    for (const KeyMap::value_type& item : mapKeys) {
+        filterOwned.insert(std::vector<unsigned char>(item.first.begin(), item.first.end()));
+        nOwnedElements++;
+    }
+    for (const ScriptMap::value_type& item : mapScripts) {
+        filterOwned.insert(std::vector<unsigned char>(item.first.begin(), item.first.end()));
+        nOwnedElements++;
+    }
+    for (const CScript& script : setWatchOnly) {
+        filterOwned.insert(std::vector<unsigned char>(script.begin(), script.end()));
+        nOwnedElements++;
+    }
+}
+
+bool CBasicKeyStore::MayHaveKey(const CKeyID &address) const
+{
+    LOCK(cs_KeyStore);
+    return nOwnedElements > 0 && filterOwned.contains(std::vector<unsigned char>(address.begin(), address.end()));
+}
+
+bool CBasicKeyStore::MayHaveCScript(const CScriptID &hash) const
+{
+    LOCK(cs_KeyStore);
+    return nOwnedElements > 0 && filterOwned.contains(std::vector<unsigned char>(hash.begin(), hash.end()));
+}
+
+bool CBasicKeyStore::MayHaveWatchOnly(const CScript &dest) const
+{
+    LOCK(cs_KeyStore);
+    return !setWatchOnly.empty() && filterOwned.contains(std::vector<unsigned char>(dest.begin(), dest.end()));
+}
+
 bool CBasicKeyStore::AddKeyPubKey(const CKey& key, const CPubKey &pubkey)
 {
     LOCK(cs_KeyStore);
-    mapKeys[pubkey.GetID()] = key;
+    CKeyID keyID = pubkey.GetID();
+    mapKeys[keyID] = key;
+    AddToOwnedFilter(std::vector<unsigned char>(keyID.begin(), keyID.end()));
     return true;
 }
 
@@ -80,7 +136,9 @@ bool CBasicKeyStore::AddCScript(const CScript& redeemScript)
         return error("CBasicKeyStore::AddCScript(): redeemScripts > %i bytes are invalid", MAX_SCRIPT_ELEMENT_SIZE);
 
     LOCK(cs_KeyStore);
-    mapScripts[CScriptID(redeemScript)] = redeemScript;
+    CScriptID scriptID(redeemScript);
+    mapScripts[scriptID] = redeemScript;
+    AddToOwnedFilter(std::vector<unsigned char>(scriptID.begin(), scriptID.end()));
     return true;
 }
 
@@ -106,6 +164,7 @@ bool CBasicKeyStore::AddWatchOnly(const CScript &dest)
 {
     LOCK(cs_KeyStore);
     setWatchOnly.insert(dest);
+    AddToOwnedFilter(std::vector<unsigned char>(dest.begin(), dest.end()));
     return true;
 }
 
@@ -21,6 +21,7 @@
 #ifndef BITCOIN_KEYSTORE_H
 #define BITCOIN_KEYSTORE_H
 
+#include "bloom.h"
 #include "key.h"
 #include "pubkey.h"
 #include "script/script.h"
@@ -146,7 +147,30 @@ protected:
     SaplingFullViewingKeyMap mapSaplingFullViewingKeys;
     SaplingIncomingViewingKeyMap mapSaplingIncomingViewingKeys;
 
+    /**
+     * Probabilistic index over the key IDs, script IDs and watch-only
+     * scripts held by this store, so IsMine can reject foreign outputs with
+     * a few hash probes. It is rebuilt at twice the size whenever it fills
+     * up, without the P2P size limit; entries are never removed, which only
+     * costs false positives.
+     */
+    CBloomFilter filterOwned;
+    unsigned int nOwnedElements = 0;
+    unsigned int nOwnedCapacity = 0;
+
+    //! Caller must hold cs_KeyStore
+    void AddToOwnedFilter(const std::vector<unsigned char>& vKey);
+    //! Insert every owned element into filterOwned; caller must hold cs_KeyStore
+    virtual void FillOwnedFilter();
+
 public:
+    //! False only if no key with this ID can be held here
+    bool MayHaveKey(const CKeyID &address) const;
+    //! False only if no redeem script with this ID can be held here
+    bool MayHaveCScript(const CScriptID &hash) const;
+    //! False only if this script cannot be watch-only here
+    bool MayHaveWatchOnly(const CScript &dest) const;
+
     bool SetHDSeed(const HDSeed& seed);
     bool HaveHDSeed() const;
     bool GetHDSeed(HDSeed& seedOut) const;
@@ -16,6 +16,12 @@
 // paxdeposit equivalent in reverse makes opreturn and KMD does the same in reverse
 #include "komodo_defs.h"
 
+#include <atomic>
+#ifndef _WIN32
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
 /*#include "secp256k1/include/secp256k1.h"
 #include "secp256k1/include/secp256k1_schnorrsig.h"
 #include "secp256k1/include/secp256k1_musig.h"
@@ -1626,6 +1632,9 @@ struct komodo_priceinfo
 {
     FILE *fp;
     char symbol[64];
+    std::atomic<uint8_t *> map;   // mapping of the whole file, replaced by a larger one as it grows
+    std::atomic<uint64_t> size;   // bytes of the file readers may look at
+    uint64_t mapsize;             // only touched by the writer
 } PRICES[KOMODO_MAXPRICES];
 
 uint32_t PriceCache[KOMODO_LOCALPRICE_CACHESIZE][KOMODO_MAXPRICES];//4+sizeof(Cryptos)/sizeof(*Cryptos)+sizeof(Forex)/sizeof(*Forex)];
@@ -2709,10 +2718,98 @@ int64_t komodo_priceave(int64_t *buf,int64_t *correlated,int32_t cskip)
     return((price*7 + halfave*5 + thirdave*3 + fourthave*2 + decayprice + buf[PRICES_DAYWINDOW-1]) / 19);
 }
 
+pthread_mutex_t pricemutex;
+std::atomic<uint32_t> pricesequence; // odd while komodo_pricesupdate is writing
+
+// The price files are read through shared read/write mappings, so readers
+// never seek or take pricemutex: they copy what they need and retry if
+// komodo_pricesupdate wrote in the meantime. The only writer appends through
+// the same mapping under pricemutex. A mapping that became too small is
+// replaced by one twice its size and left in place, as readers may still use it.
+#define KOMODO_PRICEMAP_MINSIZE (1024 * 1024)
+
+#ifndef _WIN32
+static int32_t komodo_pricemap(int32_t ind,uint64_t needed)
+{
+    uint64_t mapsize; void *ptr;
+    if ( needed <= PRICES[ind].mapsize )
+        return(0);
+    mapsize = PRICES[ind].mapsize < KOMODO_PRICEMAP_MINSIZE ? KOMODO_PRICEMAP_MINSIZE : PRICES[ind].mapsize;
+    while ( mapsize < needed )
+        mapsize <<= 1;
+    if ( (ptr= mmap(0,mapsize,PROT_READ|PROT_WRITE,MAP_SHARED,fileno(PRICES[ind].fp),0)) == MAP_FAILED )
+    {
+        LogPrintf("error mapping %llu bytes of prices/%s\n",(long long)mapsize,PRICES[ind].symbol);
+        return(-1);
+    }
+    PRICES[ind].mapsize = mapsize;
+    PRICES[ind].map.store((uint8_t *)ptr,std::memory_order_release);
+    return(0);
+}
+#endif
+
+static int32_t komodo_pricesopen(int32_t ind)
+{
+    long filesize;
+    if ( fflush(PRICES[ind].fp) != 0 || fseek(PRICES[ind].fp,0,SEEK_END) != 0 || (filesize= ftell(PRICES[ind].fp)) < 0 )
+        return(-1);
+#ifndef _WIN32
+    if ( komodo_pricemap(ind,filesize) < 0 )
+        return(-1);
+#endif
+    PRICES[ind].size.store(filesize,std::memory_order_release);
+    return(0);
+}
+
+// caller holds pricemutex
+static int32_t komodo_priceswrite(int32_t ind,uint64_t offset,const void *src,size_t len)
+{
+    uint64_t size = PRICES[ind].size.load(std::memory_order_relaxed);
+#ifndef _WIN32
+    if ( offset+len > size )
+    {
+        if ( komodo_pricemap(ind,offset+len) < 0 || ftruncate(fileno(PRICES[ind].fp),offset+len) != 0 )
+            return(-1);
+    }
+    memcpy(PRICES[ind].map.load(std::memory_order_relaxed) + offset,src,len);
+#else
+    if ( fseek(PRICES[ind].fp,offset,SEEK_SET) != 0 || fwrite(src,1,len,PRICES[ind].fp) != len || fflush(PRICES[ind].fp) != 0 )
+        return(-1);
+#endif
+    if ( offset+len > size )
+        PRICES[ind].size.store(offset+len,std::memory_order_release);
+    return(0);
+}
+
+// readers other than the writer have to go through komodo_pricegetbatch
+static int32_t komodo_pricesread(void *dest,int32_t ind,int64_t offset,size_t len)
+{
+    if ( offset < 0 || (uint64_t)offset+len > PRICES[ind].size.load(std::memory_order_acquire) )
+        return(-1);
+#ifndef _WIN32
+    memcpy(dest,PRICES[ind].map.load(std::memory_order_acquire) + offset,len);
+#else
+    if ( fseek(PRICES[ind].fp,offset,SEEK_SET) != 0 || fread(dest,1,len,PRICES[ind].fp) != len )
+        return(-1);
+#endif
+    return(0);
+}
+
+static void komodo_pricesbeginwrite()
+{
+    pricesequence.store(pricesequence.load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+static void komodo_pricesendwrite()
+{
+    pricesequence.store(pricesequence.load(std::memory_order_relaxed) + 1,std::memory_order_release);
+}
+
 int32_t komodo_pricesinit()
 {
     static int32_t didinit;
-    int32_t i,num=0,createflag = 0;
+    int32_t i,j,num=0,createflag = 0;
     if ( didinit != 0 )
         return(-1);
     didinit = 1;
@@ -2749,6 +2846,14 @@ int32_t komodo_pricesinit()
         fputc(0,PRICES[0].fp);
         fflush(PRICES[0].fp);
     }
+    for (j=0; j<i; j++)
+    {
+        if ( PRICES[j].fp != 0 && komodo_pricesopen(j) < 0 )
+        {
+            LogPrintf("error mapping prices/%s\n",PRICES[j].symbol);
+            num--;
+        }
+    }
     LogPrintf("pricesinit done i.%d num.%d numprices.%d\n",i,num,(int32_t)(komodo_cbopretsize(ASSETCHAINS_CBOPRET)/sizeof(uint32_t)));
     if ( i != num || i != komodo_cbopretsize(ASSETCHAINS_CBOPRET)/sizeof(uint32_t) )
     {
@@ -2758,8 +2863,6 @@ int32_t komodo_pricesinit()
     return(0);
 }
 
-pthread_mutex_t pricemutex;
-
 // PRICES file layouts
 // [0] rawprice32 / timestamp
 // [1] correlated
@@ -2788,14 +2891,12 @@ void komodo_pricesupdate(int32_t height,CBlock *pblock)
         if ( PRICES[0].fp != 0 )
         {
             pthread_mutex_lock(&pricemutex);
-            fseek(PRICES[0].fp,height * numprices * sizeof(uint32_t),SEEK_SET);
-            if ( fwrite(rawprices,sizeof(uint32_t),numprices,PRICES[0].fp) != numprices )
+            komodo_pricesbeginwrite();
+            if ( komodo_priceswrite(0,(uint64_t)height * numprices * sizeof(uint32_t),rawprices,numprices * sizeof(uint32_t)) < 0 )
                 LogPrintf("error writing rawprices for ht.%d\n",height);
-            else fflush(PRICES[0].fp);
             if ( height > PRICES_DAYWINDOW )
             {
-                fseek(PRICES[0].fp,(height-width+1) * numprices * sizeof(uint32_t),SEEK_SET);
-                if ( fread(ptr32,sizeof(uint32_t),width*numprices,PRICES[0].fp) == width*numprices )
+                if ( komodo_pricesread(ptr32,0,(int64_t)(height-width+1) * numprices * sizeof(uint32_t),width*numprices*sizeof(uint32_t)) == 0 )
                 {
                     rngval = seed;
                     for (ind=1; ind<numprices; ind++)
@@ -2809,24 +2910,20 @@ void komodo_pricesupdate(int32_t height,CBlock *pblock)
                         rngval = (rngval*11109 + 13849);
                         if ( (correlated= komodo_pricecorrelated(rngval,ind,&ptr32[offset],-numprices,0,PRICES_SMOOTHWIDTH)) > 0 )
                         {
-                            fseek(PRICES[ind].fp,height * sizeof(int64_t) * PRICES_MAXDATAPOINTS,SEEK_SET);
                             memset(buf,0,sizeof(buf));
                             buf[0] = rawprices[ind];
                             buf[1] = rawprices[0]; // timestamp
                             memcpy(&buf[2],&correlated,sizeof(correlated));
-                            if ( fwrite(buf,1,sizeof(buf),PRICES[ind].fp) != sizeof(buf) )
+                            if ( komodo_priceswrite(ind,(uint64_t)height * sizeof(int64_t) * PRICES_MAXDATAPOINTS,buf,sizeof(buf)) < 0 )
                                 LogPrintf("error fwrite buf for ht.%d ind.%d\n",height,ind);
                             else if ( height > PRICES_DAYWINDOW*2 )
                             {
-                                fseek(PRICES[ind].fp,(height-PRICES_DAYWINDOW+1) * PRICES_MAXDATAPOINTS * sizeof(int64_t),SEEK_SET);
-                                if ( fread(ptr64,sizeof(int64_t),PRICES_DAYWINDOW*PRICES_MAXDATAPOINTS,PRICES[ind].fp) == PRICES_DAYWINDOW*PRICES_MAXDATAPOINTS )
+                                if ( komodo_pricesread(ptr64,ind,(int64_t)(height-PRICES_DAYWINDOW+1) * PRICES_MAXDATAPOINTS * sizeof(int64_t),PRICES_DAYWINDOW*PRICES_MAXDATAPOINTS*sizeof(int64_t)) == 0 )
                                 {
                                     if ( (smoothed= komodo_priceave(tmpbuf,&ptr64[(PRICES_DAYWINDOW-1)*PRICES_MAXDATAPOINTS+1],-PRICES_MAXDATAPOINTS)) > 0 )
                                     {
-                                        fseek(PRICES[ind].fp,(height * PRICES_MAXDATAPOINTS + 2) * sizeof(int64_t),SEEK_SET);
-                                        if ( fwrite(&smoothed,1,sizeof(smoothed),PRICES[ind].fp) != sizeof(smoothed) )
+                                        if ( komodo_priceswrite(ind,((uint64_t)height * PRICES_MAXDATAPOINTS + 2) * sizeof(int64_t),&smoothed,sizeof(smoothed)) < 0 )
                                             LogPrintf("error fwrite smoothed for ht.%d ind.%d\n",height,ind);
-                                        else fflush(PRICES[ind].fp);
                                     } else LogPrintf("error price_smoothed ht.%d ind.%d\n",height,ind);
                                 } else LogPrintf("error fread ptr64 for ht.%d ind.%d\n",height,ind);
                             }
@@ -2835,21 +2932,56 @@ void komodo_pricesupdate(int32_t height,CBlock *pblock)
                     LogPrintf("height.%d\n",height);
                 } else LogPrintf("error reading rawprices for ht.%d\n",height);
             } else LogPrintf("height.%d <= width.%d\n",height,width);
+            komodo_pricesendwrite();
             pthread_mutex_unlock(&pricemutex);
         } else LogPrintf("null PRICES[0].fp\n");
     } else LogPrintf("numprices mismatch, height.%d\n",height);
 }
 
-int32_t komodo_priceget(int64_t *buf64,int32_t ind,int32_t height,int32_t numblocks)
+// copies numblocks rows from height on for each of inds[0..numinds-1] into consecutive slices of buf64,
+// all as of the same komodo_pricesupdate; retvals[i] is what komodo_priceget returns for inds[i]
+int32_t komodo_pricegetbatch(int64_t *buf64,int32_t *retvals,const int32_t *inds,int32_t numinds,int32_t height,int32_t numblocks)
 {
-    FILE *fp; int32_t retval = PRICES_MAXDATAPOINTS;
+    int32_t i,ind,num = 0; uint32_t seq; size_t len = numblocks * PRICES_MAXDATAPOINTS * sizeof(int64_t);
+#ifdef _WIN32
     pthread_mutex_lock(&pricemutex);
-    if ( ind < KOMODO_MAXPRICES && (fp= PRICES[ind].fp) != 0 )
+#endif
+    while ( 1 )
     {
-        fseek(fp,height * PRICES_MAXDATAPOINTS * sizeof(int64_t),SEEK_SET);
-        if ( fread(buf64,sizeof(int64_t),numblocks*PRICES_MAXDATAPOINTS,fp) != numblocks*PRICES_MAXDATAPOINTS )
-            retval = -1;
+#ifndef _WIN32
+        if ( ((seq= pricesequence.load(std::memory_order_acquire)) & 1) != 0 )
+        {
+            sched_yield();
+            continue;
+        }
+#endif
+        for (num=i=0; i<numinds; i++)
+        {
+            retvals[i] = PRICES_MAXDATAPOINTS;
+            if ( (ind= inds[i]) >= 0 && ind < KOMODO_MAXPRICES && PRICES[ind].fp != 0 )
+            {
+                if ( komodo_pricesread(&buf64[i * numblocks * PRICES_MAXDATAPOINTS],ind,(int64_t)height * PRICES_MAXDATAPOINTS * sizeof(int64_t),len) < 0 )
+                    retvals[i] = -1;
+            }
+            if ( retvals[i] >= 0 )
+                num++;
+        }
+#ifndef _WIN32
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ( pricesequence.load(std::memory_order_relaxed) != seq )
+            continue;
+#endif
+        break;
     }
+#ifdef _WIN32
     pthread_mutex_unlock(&pricemutex);
+#endif
+    return(num);
+}
+
+int32_t komodo_priceget(int64_t *buf64,int32_t ind,int32_t height,int32_t numblocks)
+{
+    int32_t retval;
+    komodo_pricegetbatch(buf64,&retval,&ind,1,height,numblocks);
     return(retval);
 }
@@ -27,6 +27,8 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockencodings.h"
+#include "blockfilewriter.h"
 #include "importcoin.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -62,9 +64,12 @@
 #include <vector>
 
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/function.hpp>
 #include <boost/math/distributions/poisson.hpp>
+#include <boost/optional.hpp>
 #include <boost/thread.hpp>
 #include <boost/static_assert.hpp>
 
@@ -90,6 +95,21 @@ int32_t komodo_block2pubkey33(uint8_t *pubkey33,CBlock *block);
 bool Getscriptaddress(char *destaddr,const CScript &scriptPubKey);
 void komodo_setactivation(int32_t height);
 void komodo_pricesupdate(int32_t height,CBlock *pblock);
+void PricesBlockConnected(int32_t height,const CBlock &block);
+void PricesBlockDisconnected(int32_t height);
+void AssetsBookBlockConnected(const CBlock &block);
+void AssetsBookBlockDisconnected(const CBlock &block);
+void TokensLedgerBlockConnected(const CBlock &block);
+void TokensLedgerBlockDisconnected(const CBlock &block);
+void HeirBlockConnected(int32_t height,const CBlock &block);
+void HeirBlockDisconnected(const CBlock &block);
+void GatewaysQueueBlockConnected(const CBlock &block);
+void GatewaysQueueBlockDisconnected(const CBlock &block);
+void GatewaysQueueTxAccepted(const CTransaction &tx);
+void OraclesBlockConnected(int32_t height,const CBlock &block);
+void OraclesBlockDisconnected(const CBlock &block);
+void MarmaraBlockConnected(int32_t height,const CBlock &block);
+void MarmaraBlockDisconnected(const CBlock &block);
 
 BlockMap mapBlockIndex;
 CChain chainActive;
@@ -98,6 +118,7 @@ static int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nMessageWorkers = 0;
 bool fExperimentalMode = true;
 bool fImporting = false;
 bool fReindex = false;
@@ -114,6 +135,8 @@ bool fCoinbaseEnforcedProtectionEnabled = true;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 bool fAlerts = DEFAULT_ALERTS;
+bool fCompactBlocks = DEFAULT_COMPACT_BLOCKS;
+std::vector<CSubNet> vCompactBlockHBPeers;
 /* If the tip is older than this (in seconds), the node is considered to be in initial block download.
  */
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -265,6 +288,8 @@ namespace {
         int64_t nTime;  //! Time of "getdata" request in microseconds.
         bool fValidatedHeaders;  //! Whether this block has validated headers at the time of request.
         int64_t nTimeDisconnect; //! The timeout for this block request (for disconnecting a slow peer)
+        int nInFlightBefore; //! Number of blocks already in flight from the same peer at the time of request.
+        std::shared_ptr<PartiallyDownloadedBlock> partialBlock; //! Optional, set while reconstructing a compact block.
     };
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -274,6 +299,10 @@ namespace {
     /** Number of preferable block download peers. */
     int nPreferredDownload = 0;
 
+    /** Number of block requests moved to a faster peer, and of download window stalls. Protected by cs_main. */
+    uint64_t nBlocksReassigned = 0;
+    uint64_t nBlockStalls = 0;
+
     /** Dirty block index entries. */
     set<CBlockIndex*> setDirtyBlockIndex;
 
@@ -326,8 +355,22 @@ namespace {
         list<QueuedBlock> vBlocksInFlight;
         int nBlocksInFlight;
         int nBlocksInFlightValidHeaders;
+        //! How many blocks may be in flight from this peer; adapted to its measured download speed.
+        int nBlocksInFlightLimit;
+        //! Smoothed time until a block request is answered, not counting earlier requests it waited behind (microseconds).
+        int64_t nBlockRttMicros;
+        //! Smoothed time between two blocks while the peer has more of our requests to serve (microseconds).
+        int64_t nBlockIntervalMicros;
+        //! When the last requested block from this peer arrived (microseconds).
+        int64_t nLastBlockReceived;
+        int nBlocksReceived;
+        int nBlocksReassigned;
         //! Whether we consider this a preferred download peer.
         bool fPreferredDownload;
+        //! Whether this peer can serve us compact blocks (it sent us a version 1 sendcmpct).
+        bool fProvidesHeaderAndIDs;
+        //! Whether this peer wants new blocks announced as compact blocks.
+        bool fPreferHeaderAndIDs;
 
         CNodeState() {
             fCurrentlyConnected = false;
@@ -340,7 +383,15 @@ namespace {
             nStallingSince = 0;
             nBlocksInFlight = 0;
             nBlocksInFlightValidHeaders = 0;
+            nBlocksInFlightLimit = DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER;
+            nBlockRttMicros = 0;
+            nBlockIntervalMicros = 0;
+            nLastBlockReceived = 0;
+            nBlocksReceived = 0;
+            nBlocksReassigned = 0;
             fPreferredDownload = false;
+            fProvidesHeaderAndIDs = false;
+            fPreferHeaderAndIDs = false;
         }
     };
 
@@ -417,38 +468,74 @@ namespace {
          pcoinsTip->Uncache(removed);*/
     }
 
+    // Requires cs_main.
+    void EraseBlockInFlight(map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight) {
+        CNodeState *state = State(itInFlight->second.first);
+        nQueuedValidatedHeaders -= itInFlight->second.second->fValidatedHeaders;
+        state->nBlocksInFlightValidHeaders -= itInFlight->second.second->fValidatedHeaders;
+        state->vBlocksInFlight.erase(itInFlight->second.second);
+        state->nBlocksInFlight--;
+        state->nStallingSince = 0;
+        mapBlocksInFlight.erase(itInFlight);
+    }
+
+    void UpdateAverage(int64_t& nAverage, int64_t nSample) {
+        nAverage = nAverage == 0 ? nSample : nAverage + (nSample - nAverage) / 8;
+    }
+
+    // Requires cs_main.
+    /** Update the download speed of a peer with a block it delivered, and size its in-flight limit to match. */
+    void UpdateBlockDownloadSpeed(CNodeState *state, const QueuedBlock& queued, int64_t nNow) {
+        // While earlier requests were still being served, the time since the previous block is what this
+        // one took on its own; the rest of its latency was spent waiting behind them.
+        if (queued.nInFlightBefore > 0)
+            UpdateAverage(state->nBlockIntervalMicros, std::max<int64_t>(nNow - std::max(queued.nTime, state->nLastBlockReceived), 1));
+        UpdateAverage(state->nBlockRttMicros, std::max<int64_t>(nNow - queued.nTime - queued.nInFlightBefore * state->nBlockIntervalMicros, 1));
+        state->nLastBlockReceived = nNow;
+        state->nBlocksReceived++;
+
+        if (state->nBlockIntervalMicros > 0) {
+            // Keep twice the bandwidth-delay product in flight, so the peer never idles waiting for our next getdata.
+            int64_t nLimit = 2 * (state->nBlockRttMicros / state->nBlockIntervalMicros + 1);
+            state->nBlocksInFlightLimit = std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(MAX_BLOCKS_IN_TRANSIT_PER_PEER, nLimit));
+        }
+    }
+
     // Requires cs_main.
     // Returns a bool indicating whether we requested this block.
-    bool MarkBlockAsReceived(const uint256& hash) {
+    // The speed of nodeFrom is updated only if it is the peer the block is in flight from; a late delivery
+    // by a peer the request was taken from says nothing about the peer it was moved to.
+    bool MarkBlockAsReceived(const uint256& hash, NodeId nodeFrom = -1) {
         map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
         if (itInFlight != mapBlocksInFlight.end()) {
-            CNodeState *state = State(itInFlight->second.first);
-            nQueuedValidatedHeaders -= itInFlight->second.second->fValidatedHeaders;
-            state->nBlocksInFlightValidHeaders -= itInFlight->second.second->fValidatedHeaders;
-            state->vBlocksInFlight.erase(itInFlight->second.second);
-            state->nBlocksInFlight--;
-            state->nStallingSince = 0;
-            mapBlocksInFlight.erase(itInFlight);
+            if (itInFlight->second.first == nodeFrom)
+                UpdateBlockDownloadSpeed(State(nodeFrom), *itInFlight->second.second, GetTimeMicros());
+            EraseBlockInFlight(itInFlight);
             return true;
         }
         return false;
     }
 
     // Requires cs_main.
-    void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL) {
+    // If pit is given, it is set to the new queue entry so the caller can attach a partial block to it.
+    void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL, list<QueuedBlock>::iterator *pit = NULL) {
         CNodeState *state = State(nodeid);
         assert(state != NULL);
 
         // Make sure it's not listed somewhere already.
-        MarkBlockAsReceived(hash);
+        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+        if (itInFlight != mapBlocksInFlight.end())
+            EraseBlockInFlight(itInFlight);
 
         int64_t nNow = GetTimeMicros();
-        QueuedBlock newentry = {hash, pindex, nNow, pindex != NULL, GetBlockTimeout(nNow, nQueuedValidatedHeaders, consensusParams)};
+        QueuedBlock newentry = {hash, pindex, nNow, pindex != NULL, GetBlockTimeout(nNow, nQueuedValidatedHeaders, consensusParams), state->nBlocksInFlight};
         nQueuedValidatedHeaders += newentry.fValidatedHeaders;
         list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
         state->nBlocksInFlight++;
         state->nBlocksInFlightValidHeaders += newentry.fValidatedHeaders;
         mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
+        if (pit)
+            *pit = it;
     }
 
     /** Check whether the last unknown block a peer advertized is not yet known. */
@@ -505,8 +592,18 @@ namespace {
         return pa;
     }
 
+    // Requires cs_main.
+    /** Whether a block in flight from owner is late enough that asking taker for it instead should get it sooner. */
+    bool IsBlockRequestLate(const QueuedBlock& queued, const CNodeState *owner, const CNodeState *taker, int64_t nNow) {
+        if (queued.partialBlock)
+            return false;
+        return ::IsBlockRequestLate(nNow - queued.nTime, queued.nInFlightBefore, owner->nBlockRttMicros, owner->nBlockIntervalMicros,
+                                    taker->nBlockRttMicros, taker->nBlockIntervalMicros, taker->nBlocksInFlight);
+    }
+
     /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
-     *  at most count entries. */
+     *  at most count entries. Blocks in flight from another peer for much longer than its speed predicts
+     *  are added as well, if this peer should deliver them sooner. */
     void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller) {
         if (count == 0)
             return;
@@ -545,6 +642,7 @@ namespace {
         int nWindowEnd = state->pindexLastCommonBlock->GetHeight() + BLOCK_DOWNLOAD_WINDOW;
         int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->GetHeight(), nWindowEnd + 1);
         NodeId waitingfor = -1;
+        int64_t nNow = GetTimeMicros();
         while (pindexWalk->GetHeight() < nMaxHeight) {
             // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
             // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -583,9 +681,24 @@ namespace {
                     if (vBlocks.size() == count) {
                         return;
                     }
-                } else if (waitingfor == -1) {
-                    // This is the first already-in-flight block.
-                    waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                } else {
+                    const pair<NodeId, list<QueuedBlock>::iterator>& inFlight = mapBlocksInFlight[pindex->GetBlockHash()];
+                    CNodeState *stateOwner = State(inFlight.first);
+                    if (inFlight.first != nodeid && pindex->GetHeight() <= nWindowEnd && IsBlockRequestLate(*inFlight.second, stateOwner, state, nNow)) {
+                        // Take the block over rather than let the window wait for it; the caller moves the request.
+                        LogPrint("net", "Reassigning block %s (%d) from peer=%d to peer=%d\n", pindex->GetBlockHash().ToString(),
+                                 pindex->GetHeight(), inFlight.first, nodeid);
+                        stateOwner->nBlocksInFlightLimit = std::max(MIN_BLOCKS_IN_TRANSIT_PER_PEER, stateOwner->nBlocksInFlightLimit / 2);
+                        stateOwner->nBlocksReassigned++;
+                        nBlocksReassigned++;
+                        vBlocks.push_back(pindex);
+                        if (vBlocks.size() == count) {
+                            return;
+                        }
+                    } else if (waitingfor == -1) {
+                        // This is the first already-in-flight block.
+                        waitingfor = inFlight.first;
+                    }
                 }
             }
         }
@@ -605,9 +718,36 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->GetHeight());
     }
+    stats.nBlocksInFlightLimit = state->nBlocksInFlightLimit;
+    stats.nBlockRttMicros = state->nBlockRttMicros;
+    stats.nBlockIntervalMicros = state->nBlockIntervalMicros;
+    stats.nBlocksReceived = state->nBlocksReceived;
+    stats.nBlocksReassigned = state->nBlocksReassigned;
+    stats.fStalling = state->nStallingSince != 0;
     return true;
 }
 
+bool IsBlockRequestLate(int64_t nElapsed, int nInFlightBefore, int64_t nOwnerRtt, int64_t nOwnerInterval,
+                        int64_t nTakerRtt, int64_t nTakerInterval, int nTakerInFlight) {
+    if (nTakerInterval == 0)
+        return false;
+    int64_t nExpected = nOwnerInterval > 0 ?
+        nOwnerRtt + (nInFlightBefore + 1) * nOwnerInterval :
+        BLOCK_STALLING_TIMEOUT * 1000000;
+    if (nElapsed < std::max<int64_t>(BLOCK_REASSIGN_TIMEOUT * 1000000, BLOCK_REASSIGN_FACTOR * nExpected))
+        return false;
+    return nTakerRtt + (nTakerInFlight + 1) * nTakerInterval < nElapsed;
+}
+
+void GetDownloadStats(CDownloadStats& stats) {
+    LOCK(cs_main);
+    stats.nWindow = BLOCK_DOWNLOAD_WINDOW;
+    stats.nBlocksInFlight = mapBlocksInFlight.size();
+    stats.nBlocksInFlightValidHeaders = nQueuedValidatedHeaders;
+    stats.nBlocksReassigned = nBlocksReassigned;
+    stats.nStalls = nBlockStalls;
+}
+
 void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.GetHeight.connect(&GetHeight);
@@ -679,9 +819,18 @@ bool komodo_snapshot2(std::map <std::string, CAmount> &addressAmounts)
     else return false;
 }
 
+CCriticalSection cs_addresssnapshot;
 int32_t lastSnapShotHeight = 0;
 std::vector <std::pair<CAmount, CTxDestination>> vAddressSnapshot;
 
+// replace the address snapshot and the height it was taken at as one
+void komodo_setaddresssnapshot(int32_t height, std::vector <std::pair<CAmount, CTxDestination>> &vSnapshot)
+{
+    LOCK(cs_addresssnapshot);
+    vAddressSnapshot.swap(vSnapshot);
+    lastSnapShotHeight = height;
+}
+
 bool komodo_dailysnapshot(int32_t height)
 {
     int reorglimit = 100; 
@@ -709,8 +858,11 @@ bool komodo_dailysnapshot(int32_t height)
     }
     LogPrintf( "doing snapshot for height.%i undo_height.%i\n", height, undo_height);
     // if we already did this height dont bother doing it again, this is just a reorg. The actual snapshot height cannot be reorged.
-    if ( undo_height == lastSnapShotHeight )
-        return true;
+    {
+        LOCK(cs_addresssnapshot);
+        if ( undo_height == lastSnapShotHeight )
+            return true;
+    }
     std::map <std::string, int64_t> addressAmounts;
     if ( !komodo_snapshot2(addressAmounts) )
         return false;
@@ -756,18 +908,19 @@ bool komodo_dailysnapshot(int32_t height)
             }
         }
     }
-    vAddressSnapshot.clear(); // clear existing snapshot
+    // built aside, readers see the old snapshot and its height until both are replaced
+    std::vector <std::pair<CAmount, CTxDestination>> vSnapshot;
     // convert address string to destination for easier conversion to what ever is required, eg, scriptPubKey. 
     for ( auto element : addressAmounts)
-        vAddressSnapshot.push_back(make_pair(element.second, DecodeDestination(element.first)));
+        vSnapshot.push_back(make_pair(element.second, DecodeDestination(element.first)));
     // sort the vector by amount, highest at top.
-    std::sort(vAddressSnapshot.rbegin(), vAddressSnapshot.rend());
+    std::sort(vSnapshot.rbegin(), vSnapshot.rend());
     //for (int j = 0; j < 50; j++) 
-    //    LogPrintf( "j.%i address.%s nValue.%li\n",j, CBitcoinAddress(vAddressSnapshot[j].second).ToString().c_str(), vAddressSnapshot[j].first );
+    //    LogPrintf( "j.%i address.%s nValue.%li\n",j, CBitcoinAddress(vSnapshot[j].second).ToString().c_str(), vSnapshot[j].first );
     // include only top 3999 address.
-    if ( vAddressSnapshot.size() > 3999 ) vAddressSnapshot.resize(3999);
-    lastSnapShotHeight = undo_height; 
-    LogPrintf( "vAddressSnapshot.size.%li\n", vAddressSnapshot.size());
+    if ( vSnapshot.size() > 3999 ) vSnapshot.resize(3999);
+    LogPrintf( "vAddressSnapshot.size.%li\n", vSnapshot.size());
+    komodo_setaddresssnapshot(undo_height, vSnapshot);
     return true;
 }
 
@@ -2113,6 +2266,8 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                 }
             }
         }
+        if ( ASSETCHAINS_CC != 0 && &pool == &mempool )
+            GatewaysQueueTxAccepted(tx);
     }
     // This should be here still? 
     //SyncWithWallets(tx, NULL); 
@@ -2167,12 +2322,13 @@ bool GetAddressIndex(uint160 addressHash, int type,
 }
 
 bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       bool fAllAddresses)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs, fAllAddresses))
         return error("unable to get txids for address");
 
     return true;
@@ -2376,21 +2532,17 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
 
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
-    // Open history file to append
-    CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("WriteBlockToDisk: OpenBlockFile failed");
-
-    // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, block);
-    fileout << FLATDATA(messageStart) << nSize;
-
-    // Write block
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("WriteBlockToDisk: ftell failed");
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    // Serialize index header and block; the block file writer puts them on disk
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    unsigned int nSize = GetSerializeSize(ss, block);
+    ss.reserve(CBlockFileWriter::RECORD_HEADER_SIZE + nSize);
+    ss << FLATDATA(messageStart) << nSize << block;
+
+    CSerializeData vData;
+    ss.GetAndClear(vData);
+    if (!blockFileWriter.Write(false, pos, vData))
+        return error("WriteBlockToDisk: writing to %s failed", pos.ToString());
+    pos.nPos += CBlockFileWriter::RECORD_HEADER_SIZE;
 
     return true;
 }
@@ -2400,21 +2552,36 @@ bool ReadBlockFromDisk(int32_t height,CBlock& block, const CDiskBlockPos& pos,bo
     uint8_t pubkey33[33];
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
+    // A block that is not written out yet is read from the block file writer's queue
+    std::shared_ptr<const CSerializeData> pending = blockFileWriter.GetPending(false, pos);
+    if (pending)
     {
-        //LogPrintf("readblockfromdisk err A\n");
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+        try {
+            CDataStream ss(pending->begin() + CBlockFileWriter::RECORD_HEADER_SIZE, pending->end(), SER_DISK, CLIENT_VERSION);
+            ss >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
+    else
+    {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+        {
+            //LogPrintf("readblockfromdisk err A\n");
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+        }
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        LogPrintf("readblockfromdisk err B\n");
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            LogPrintf("readblockfromdisk err B\n");
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
     // Check the header
     if ( 0 && checkPOW != 0 )
@@ -2669,6 +2836,7 @@ void Misbehaving(NodeId pnode, int howmuch)
     if (howmuch == 0)
         return;
 
+    LOCK(cs_main);
     CNodeState *state = State(pnode);
     if (state == NULL)
         return;
@@ -3001,46 +3169,54 @@ namespace {
 
     bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
     {
-        // Open history file to append
-        CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
-        if (fileout.IsNull())
-            return error("%s: OpenUndoFile failed", __func__);
-
-        // Write index header
-        unsigned int nSize = GetSerializeSize(fileout, blockundo);
-        fileout << FLATDATA(messageStart) << nSize;
-
-        // Write undo data
-        long fileOutPos = ftell(fileout.Get());
-        if (fileOutPos < 0)
-            return error("%s: ftell failed", __func__);
-        pos.nPos = (unsigned int)fileOutPos;
-        fileout << blockundo;
+        // Serialize index header and undo data; the block file writer puts them on disk
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        unsigned int nSize = GetSerializeSize(ss, blockundo);
+        ss.reserve(CBlockFileWriter::RECORD_HEADER_SIZE + nSize + 32);
+        ss << FLATDATA(messageStart) << nSize << blockundo;
 
         // calculate & write checksum
         CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
         hasher << hashBlock;
         hasher << blockundo;
-        fileout << hasher.GetHash();
+        ss << hasher.GetHash();
 //LogPrintf("hashBlock.%s hasher.%s\n",hashBlock.GetHex().c_str(),hasher.GetHash().GetHex().c_str());
+
+        CSerializeData vData;
+        ss.GetAndClear(vData);
+        if (!blockFileWriter.Write(true, pos, vData))
+            return error("%s: writing to %s failed", __func__, pos.ToString());
+        pos.nPos += CBlockFileWriter::RECORD_HEADER_SIZE;
         return true;
     }
 
     bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
     {
-        // Open history file to read
-        CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-        if (filein.IsNull())
-            return error("%s: OpenBlockFile failed", __func__);
-
-        // Read block
         uint256 hashChecksum;
-        try {
-            filein >> blockundo;
-            filein >> hashChecksum;
-        }
-        catch (const std::exception& e) {
-            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        std::shared_ptr<const CSerializeData> pending = blockFileWriter.GetPending(true, pos);
+        if (pending) {
+            try {
+                CDataStream ss(pending->begin() + CBlockFileWriter::RECORD_HEADER_SIZE, pending->end(), SER_DISK, CLIENT_VERSION);
+                ss >> blockundo;
+                ss >> hashChecksum;
+            }
+            catch (const std::exception& e) {
+                return error("%s: Deserialize error - %s", __func__, e.what());
+            }
+        } else {
+            // Open history file to read
+            CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("%s: OpenBlockFile failed", __func__);
+
+            // Read block
+            try {
+                filein >> blockundo;
+                filein >> hashChecksum;
+            }
+            catch (const std::exception& e) {
+                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+            }
         }
         // Verify checksum
         CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
@@ -3314,27 +3490,12 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     return fClean;
 }
 
-void static FlushBlockFile(bool fFinalize = false)
+/** Wait for all queued block and undo writes, and commit them to disk. */
+bool static FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
 
-    CDiskBlockPos posOld(nLastBlockFile, 0);
-
-    FILE *fileOld = OpenBlockFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
-            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
-        FileCommit(fileOld);
-        fclose(fileOld);
-    }
-
-    fileOld = OpenUndoFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
-            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nUndoSize);
-        FileCommit(fileOld);
-        fclose(fileOld);
-    }
+    return blockFileWriter.Sync(nLastBlockFile, fFinalize, vinfoBlockFile[nLastBlockFile].nSize, vinfoBlockFile[nLastBlockFile].nUndoSize);
 }
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
@@ -3968,7 +4129,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             if (!CheckDiskSpace(0))
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
-            FlushBlockFile();
+            if (!FlushBlockFile())
+                return AbortNode(state, "Failed to write block and undo files");
             // Then update all block file information (which may refer to block and undo files).
             {
                 std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
@@ -4003,7 +4165,10 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            // Only empty the cache when it is too large or we are shutting
+            // down; otherwise write the dirty entries and keep it warm.
+            bool fEvict = mode == FLUSH_STATE_ALWAYS || fCacheLarge || fCacheCritical;
+            if (!(fEvict ? pcoinsTip->Flush() : pcoinsTip->Sync()))
                 return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
         }
@@ -4118,6 +4283,17 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
         assert(view.Flush());
         DisconnectNotarisations(block);
     }
+    if ( KOMODO_NSPV_FULLNODE && ASSETCHAINS_CBOPRET != 0 )
+        PricesBlockDisconnected(pindexDelete->GetHeight());
+    if ( ASSETCHAINS_CC != 0 )
+    {
+        AssetsBookBlockDisconnected(block);
+        TokensLedgerBlockDisconnected(block);
+        HeirBlockDisconnected(block);
+        GatewaysQueueBlockDisconnected(block);
+        OraclesBlockDisconnected(block);
+        MarmaraBlockDisconnected(block);
+    }
     pindexDelete->segid = -2;
     pindexDelete->nNotaryPay = 0; 
     pindexDelete->newcoins = 0;
@@ -4328,6 +4504,15 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
 
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
+    if ( ASSETCHAINS_CC != 0 )
+    {
+        AssetsBookBlockConnected(*pblock);
+        TokensLedgerBlockConnected(*pblock);
+        HeirBlockConnected(pindexNew->GetHeight(),*pblock);
+        GatewaysQueueBlockConnected(*pblock);
+        OraclesBlockConnected(pindexNew->GetHeight(),*pblock);
+        MarmaraBlockConnected(pindexNew->GetHeight(),*pblock);
+    }
     if ( KOMODO_NSPV_FULLNODE )
     {
         // Tell wallet about transactions that went from mempool
@@ -4359,7 +4544,10 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     if ( KOMODO_NSPV_FULLNODE )
     {
         if ( ASSETCHAINS_CBOPRET != 0 )
+        {
             komodo_pricesupdate(pindexNew->GetHeight(),pblock);
+            PricesBlockConnected(pindexNew->GetHeight(),*pblock);
+        }
         if ( ASSETCHAINS_SAPLING <= 0 && pindexNew->nTime > KOMODO_SAPLING_ACTIVATION - 24*3600 )
             komodo_activate_sapling(pindexNew);
         if ( ASSETCHAINS_CC != 0 && KOMODO_SNAPSHOT_INTERVAL != 0 && (pindexNew->GetHeight() % KOMODO_SNAPSHOT_INTERVAL) == 0 && pindexNew->GetHeight() >= KOMODO_SNAPSHOT_INTERVAL )
@@ -4679,10 +4867,30 @@ bool ActivateBestChain(bool fSkipdpow, CValidationState &state, CBlock *pblock)
             // Don't relay blocks if pruning -- could cause a peer to try to download, resulting
             // in a stalled download if the block file is pruned before the request.
             if (nLocalServices & NODE_NETWORK) {
-                LOCK(cs_vNodes);
+                // Peers that asked for high-bandwidth compact block relay get the new tip pushed
+                // straight away as a cmpctblock instead of an inv, saving them the getdata round-trip.
+                // This only makes sense for a single block extending the previous tip.
+                boost::optional<CBlockHeaderAndShortTxIDs> cmpctblock;
+                if (fCompactBlocks && !fInitialDownload && pindexNewTip->pprev == pindexFork) {
+                    // Encoded before cs_vNodes is taken, which the disk read must not hold up.
+                    CBlock block;
+                    if (pblock && pblock->GetHash() == hashNewTip)
+                        cmpctblock = CBlockHeaderAndShortTxIDs(*pblock);
+                    else if (ReadBlockFromDisk(block, pindexNewTip, 1))
+                        cmpctblock = CBlockHeaderAndShortTxIDs(block);
+                }
+                LOCK2(cs_main, cs_vNodes);
                 BOOST_FOREACH(CNode* pnode, vNodes)
                 if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
+                {
+                    CNodeState *nodestate = State(pnode->GetId());
+                    if (cmpctblock && nodestate != NULL && nodestate->fPreferHeaderAndIDs) {
+                        pnode->AddInventoryKnown(CInv(MSG_BLOCK, hashNewTip));
+                        pnode->PushMessage("cmpctblock", *cmpctblock);
+                        continue;
+                    }
                     pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                }
             }
             // Notify external listeners about the new tip.
             GetMainSignals().UpdatedBlockTip(pindexNewTip);
@@ -4966,7 +5174,8 @@ bool FindBlockPos(int32_t tmpflag,CValidationState &state, CDiskBlockPos &pos, u
         if (!fKnown) {
             LogPrintf("Leaving block file %i: %s\n", nFile, (*ptr)[nFile].ToString());
         }
-        FlushBlockFile(!fKnown);
+        if (!FlushBlockFile(!fKnown))
+            return AbortNode(state, "Failed to write block and undo files");
         //LogPrintf( "nFile = %i size.%li maxTempFileSize0.%u maxTempFileSize1.%u\n",nFile,tmpBlockFiles.size(),maxTempFileSize0,maxTempFileSize1);
         if ( tmpflag != 0 && tmpBlockFiles.size() >= 3 )
         {
@@ -5045,12 +5254,7 @@ bool FindBlockPos(int32_t tmpflag,CValidationState &state, CDiskBlockPos &pos, u
             if (fPruneMode)
                 fCheckForPruning = true;
             if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
-                FILE *file = OpenBlockFile(pos);
-                if (file) {
-                    LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * BLOCKFILE_CHUNK_SIZE, pos.nFile);
-                    AllocateFileRange(file, pos.nPos, nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos);
-                    fclose(file);
-                }
+                blockFileWriter.Allocate(false, pos, nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos);
             }
             else
                 return state.Error("out of disk space");
@@ -5085,12 +5289,7 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
         if (fPruneMode)
             fCheckForPruning = true;
         if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
-            FILE *file = OpenUndoFile(pos);
-            if (file) {
-                LogPrintf("Pre-allocating up to position 0x%x in rev%05u.dat\n", nNewChunks * UNDOFILE_CHUNK_SIZE, pos.nFile);
-                AllocateFileRange(file, pos.nPos, nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos);
-                fclose(file);
-            }
+            blockFileWriter.Allocate(true, pos, nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos);
         }
         else
             return state.Error("out of disk space");
@@ -5821,7 +6020,7 @@ bool ProcessNewBlock(bool from_miner,int32_t height,CValidationState &state, CNo
         if ( chainActive.LastTip() != 0 )
             komodo_currentheight_set(chainActive.LastTip()->GetHeight());
         checked = CheckBlock(&futureblock,height!=0?height:komodo_block2height(pblock),0,*pblock, state, verifier,0);
-        bool fRequested = MarkBlockAsReceived(hash);
+        bool fRequested = MarkBlockAsReceived(hash, pfrom ? pfrom->GetId() : -1);
         fRequested |= fForceProcessing;
         if ( checked != 0 && komodo_checkPOW(0,0,pblock,height) < 0 ) //from_miner && ASSETCHAINS_STAKED == 0
         {
@@ -6054,6 +6253,9 @@ FILE* OpenDiskFile(const CDiskBlockPos &pos, const char *prefix, bool fReadOnly)
     //static int32_t didinit[256];
     if (pos.IsNull())
         return NULL;
+    // Readers see records still queued for the file only once they are written
+    if (fReadOnly)
+        blockFileWriter.WaitForFile(strcmp(prefix, "rev") == 0, pos.nFile);
     boost::filesystem::path path = GetBlockPosFilename(pos, prefix);
     boost::filesystem::create_directories(path.parent_path());
     FILE* file = fopen(path.string().c_str(), "rb+");
@@ -6093,6 +6295,31 @@ boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char
     return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
 }
 
+/** Arrays of block index entries loaded at startup, by start address and length. */
+static std::map<CBlockIndex*, size_t> mapBlockIndexArenas;
+
+void AddBlockIndexArena(CBlockIndex *pindexes, size_t n)
+{
+    mapBlockIndexArenas[pindexes] = n;
+}
+
+/** Delete all entries of mapBlockIndex, whether allocated one by one or in an arena. */
+static void FreeBlockIndexEntries()
+{
+    BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
+        std::map<CBlockIndex*, size_t>::iterator it = mapBlockIndexArenas.upper_bound(entry.second);
+        if (it != mapBlockIndexArenas.begin()) {
+            --it;
+            if (entry.second < it->first + it->second)
+                continue;
+        }
+        delete entry.second;
+    }
+    for (std::map<CBlockIndex*, size_t>::iterator it = mapBlockIndexArenas.begin(); it != mapBlockIndexArenas.end(); it++)
+        delete[] it->first;
+    mapBlockIndexArenas.clear();
+}
+
 CBlockIndex * InsertBlockIndex(uint256 hash)
 {
     if (hash.IsNull())
@@ -6116,19 +6343,51 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
 
 //void komodo_pindex_init(CBlockIndex *pindex,int32_t height);
 
+/** Run fn over [0, nItems) in one contiguous range per core. */
+static void ParallelForRanges(size_t nItems, const boost::function<void(size_t, size_t)>& fn)
+{
+    size_t nThreads = std::max(1u, boost::thread::hardware_concurrency());
+    size_t nChunk = (nItems + nThreads - 1) / nThreads;
+    if (nChunk == 0)
+        return;
+    boost::thread_group threadGroup;
+    for (size_t begin = nChunk; begin < nItems; begin += nChunk)
+        threadGroup.create_thread(boost::bind<void>(fn, begin, std::min(begin + nChunk, nItems)));
+    fn(0, std::min(nChunk, nItems));
+    threadGroup.join_all();
+}
+
+static void ComputeBlockProofs(const vector<pair<int, CBlockIndex*> >& vSortedByHeight, std::vector<CChainPower>& vProof, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++)
+        vProof[i] = GetBlockProof(*vSortedByHeight[i].second);
+}
+
+static void BuildSkipsOnChain(const vector<pair<int, CBlockIndex*> >& vSortedByHeight, const std::vector<CBlockIndex*>& vChain, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        CBlockIndex* pindex = vSortedByHeight[i].second;
+        int nHeight = pindex->GetHeight();
+        if (nHeight >= 0 && nHeight < (int)vChain.size() && vChain[nHeight] == pindex)
+            pindex->BuildSkip(vChain);
+    }
+}
+
 bool static LoadBlockIndexDB()
 {
     const CChainParams& chainparams = Params();
+    int64_t nStart = GetTimeMillis();
     LogPrintf("%s: start loading guts\n", __func__);
     if (!pblocktree->LoadBlockIndexGuts())
         return false;
-    LogPrintf("%s: loaded guts\n", __func__);
+    LogPrintf("%s: loaded guts in %dms\n", __func__, (int)(GetTimeMillis() - nStart));
     boost::this_thread::interruption_point();
     
     if (ShutdownRequested())
         return false;
 
     // Calculate chainPower
+    int64_t nSortStart = GetTimeMillis();
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
@@ -6141,6 +6400,13 @@ bool static LoadBlockIndexDB()
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
     //LogPrintf("load blockindexDB sorted %u\n",(uint32_t)time(NULL));
 
+    // The proof of each block only depends on the block itself, so compute
+    // them all in parallel; the serial pass below then only has to add them up.
+    int64_t nProofStart = GetTimeMillis();
+    std::vector<CChainPower> vProof(vSortedByHeight.size());
+    ParallelForRanges(vSortedByHeight.size(), boost::bind(&ComputeBlockProofs, boost::cref(vSortedByHeight), boost::ref(vProof), _1, _2));
+
+    int64_t nChainStart = GetTimeMillis();
     uiInterface.ShowProgress(_("Loading block index DB..."), 0, false);
     int cur_height_num = 0;
 
@@ -6149,7 +6415,7 @@ bool static LoadBlockIndexDB()
         boost::this_thread::interruption_point();
 
         CBlockIndex* pindex = item.second;
-        pindex->chainPower = (pindex->pprev ? CChainPower(pindex) + pindex->pprev->chainPower : CChainPower(pindex)) + GetBlockProof(*pindex);
+        pindex->chainPower = (pindex->pprev ? CChainPower(pindex) + pindex->pprev->chainPower : CChainPower(pindex)) + vProof[cur_height_num];
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
@@ -6195,8 +6461,6 @@ bool static LoadBlockIndexDB()
             setBlockIndexCandidates.insert(pindex);
         if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->chainPower > pindexBestInvalid->chainPower))
             pindexBestInvalid = pindex;
-        if (pindex->pprev)
-            pindex->BuildSkip();
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
         //komodo_pindex_init(pindex,(int32_t)pindex->GetHeight());
@@ -6206,6 +6470,32 @@ bool static LoadBlockIndexDB()
 
     uiInterface.ShowProgress("", 100, false);
 
+    // Skip pointers only point at ancestors. For blocks on the best header
+    // chain those are known by height up front, so set them in parallel;
+    // the few blocks on side branches are done afterwards in height order,
+    // when all their ancestors have theirs.
+    int64_t nSkipStart = GetTimeMillis();
+    std::vector<CBlockIndex*> vChain;
+    if (pindexBestHeader != NULL) {
+        vChain.resize(pindexBestHeader->GetHeight() + 1);
+        for (CBlockIndex* pindex = pindexBestHeader; pindex != NULL; pindex = pindex->pprev) {
+            if (pindex->GetHeight() < 0 || pindex->GetHeight() >= (int)vChain.size())
+                break;
+            vChain[pindex->GetHeight()] = pindex;
+        }
+    }
+    ParallelForRanges(vSortedByHeight.size(), boost::bind(&BuildSkipsOnChain, boost::cref(vSortedByHeight), boost::cref(vChain), _1, _2));
+    BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
+    {
+        CBlockIndex* pindex = item.second;
+        int nHeight = pindex->GetHeight();
+        if (pindex->pprev && !(nHeight >= 0 && nHeight < (int)vChain.size() && vChain[nHeight] == pindex))
+            pindex->BuildSkip();
+    }
+    LogPrintf("%s: %u entries: sorted in %dms, proofs in %dms, chain power in %dms, skip list in %dms\n", __func__,
+              (unsigned int)vSortedByHeight.size(), (int)(nProofStart - nSortStart), (int)(nChainStart - nProofStart),
+              (int)(nSkipStart - nChainStart), (int)(GetTimeMillis() - nSkipStart));
+
     //LogPrintf("load blockindexDB chained %u\n",(uint32_t)time(NULL));
 
     // Load block file info
@@ -6600,9 +6890,7 @@ void UnloadBlockIndex()
     mapNodeState.clear();
     recentRejects.reset(NULL);
 
-    BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
-    }
+    FreeBlockIndexEntries();
     mapBlockIndex.clear();
     fHavePruned = false;
 }
@@ -6684,104 +6972,211 @@ bool InitBlockIndex() {
 
 
 
+/** Most bytes of block file read ahead and deserialized in parallel before the blocks are processed in order. */
+static const uint64_t EXTERNAL_BLOCK_BATCH_SIZE = 32 * 1024 * 1024;
+/** Most blocks in such a batch. */
+static const size_t EXTERNAL_BLOCK_BATCH_COUNT = 1024;
+/** Most bytes of out of order blocks kept in memory until their parent is loaded. */
+static const size_t MAX_UNKNOWN_PARENT_MEMORY = 256 * 1024 * 1024;
+
+/** A block record read from an external block file. */
+struct CExternalBlock
+{
+    uint64_t nMagicPos;     //! Where the record starts
+    uint64_t nPos;          //! Where the block starts
+    unsigned int nSize;     //! Size given in the record header
+    unsigned int nUsed;     //! Bytes of the record the block took
+    CDataStream ss;
+    std::shared_ptr<CBlock> pblock;
+    uint256 hash;
+    std::string strError;
+
+    CExternalBlock(uint64_t nMagicPosIn, uint64_t nPosIn, unsigned int nSizeIn) :
+        nMagicPos(nMagicPosIn), nPos(nPosIn), nSize(nSizeIn), nUsed(0), ss(SER_DISK, CLIENT_VERSION) {}
+};
+
+static void DeserializeExternalBlocks(std::vector<CExternalBlock>& vBlocks, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        CExternalBlock& rec = vBlocks[i];
+        try {
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            rec.ss >> *pblock;
+            rec.nUsed = rec.nSize - rec.ss.size();
+            rec.hash = pblock->GetHash();
+            rec.pblock = pblock;
+        } catch (const std::exception& e) {
+            rec.strError = e.what();
+        }
+        rec.ss.clear();
+    }
+}
+
+/** Out of order block waiting for its parent; the block itself is kept when memory allows. */
+struct CUnknownParentBlock
+{
+    CDiskBlockPos pos;
+    std::shared_ptr<CBlock> pblock;
+    size_t nMemory;
+
+    CUnknownParentBlock() : nMemory(0) {}
+};
+
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
 {
     const CChainParams& chainparams = Params();
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+    // Map of blocks with unknown parent
+    static std::multimap<uint256, CUnknownParentBlock> mapBlocksUnknownParent;
+    static size_t nUnknownParentMemory = 0;
     int64_t nStart = GetTimeMillis();
 
+    // Reading blocks from disk is cheaper when the OS does so ahead of us
+    AdviseSequentialRead(fileIn);
+
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        //CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE(10000000), MAX_BLOCK_SIZE(10000000)+8, SER_DISK, CLIENT_VERSION);
+        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor. It has
+        // to be able to rewind over a whole batch, to rescan from a record that is not a block.
+        CBufferedFile blkdat(fileIn, EXTERNAL_BLOCK_BATCH_SIZE + 2*MAX_BLOCK_SIZE(10000000), EXTERNAL_BLOCK_BATCH_SIZE + MAX_BLOCK_SIZE(10000000)+8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        bool fEnd = false;
+        while (!fEnd) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE(10000000))
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+            // Read the next batch of records as they are
+            std::vector<CExternalBlock> vBatch;
+            vBatch.reserve(EXTERNAL_BLOCK_BATCH_COUNT);
+            uint64_t nBatchStart = nRewind;
+            while (vBatch.size() < EXTERNAL_BLOCK_BATCH_COUNT && nRewind - nBatchStart < EXTERNAL_BLOCK_BATCH_SIZE) {
+                blkdat.SetPos(nRewind);
+                if (blkdat.eof()) {
+                    fEnd = true;
+                    break;
+                }
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                uint64_t nMagicPos = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[MESSAGE_START_SIZE];
+                    blkdat.FindByte(Params().MessageStart()[0]);
+                    nMagicPos = blkdat.GetPos();
+                    nRewind = nMagicPos+1;
+                    blkdat >> FLATDATA(buf);
+                    if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SIZE(10000000))
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    fEnd = true;
+                    break;
+                }
+                try {
+                    // read block
+                    uint64_t nBlockPos = blkdat.GetPos();
+                    blkdat.SetLimit(nBlockPos + nSize);
+                    vBatch.push_back(CExternalBlock(nMagicPos, nBlockPos, nSize));
+                    vBatch.back().ss.resize(nSize);
+                    blkdat.read(&vBatch.back().ss[0], nSize);
+                    nRewind = blkdat.GetPos();
+                } catch (const std::exception& e) {
+                    vBatch.pop_back();
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                }
             }
-            try {
-                // read block
-                CBlock block;
-                uint64_t nBlockPos = blkdat.GetPos();
+
+            // Deserialize and hash the blocks on all cores
+            ParallelForRanges(vBatch.size(), boost::bind(&DeserializeExternalBlocks, boost::ref(vBatch), _1, _2));
+
+            // and process them in file order
+            for (size_t i = 0; i < vBatch.size(); i++) {
+                CExternalBlock& rec = vBatch[i];
+                if (!rec.pblock) {
+                    // Not a block after all: scan again from just after its start, as if the records
+                    // read behind it had not been seen yet.
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, rec.strError);
+                    nRewind = rec.nMagicPos + 1;
+                    fEnd = false;
+                    break;
+                }
+                CBlock& block = *rec.pblock;
+                uint256 hash = rec.hash;
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                blkdat >> block;
-                
-                nRewind = blkdat.GetPos();
+                    dbp->nPos = rec.nPos;
 
                 // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
                 if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
                     LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
                              block.hashPrevBlock.ToString());
+                    CUnknownParentBlock unknown;
+                    if (nUnknownParentMemory + rec.nUsed <= MAX_UNKNOWN_PARENT_MEMORY) {
+                        unknown.pblock = rec.pblock;
+                        unknown.nMemory = rec.nUsed;
+                        nUnknownParentMemory += unknown.nMemory;
+                    }
                     if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(0,0,state, NULL, &block, true, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && komodo_blockheight(hash) % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), komodo_blockheight(hash));
-                }
+                        unknown.pos = *dbp;
+                    if (unknown.pblock || dbp)
+                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, unknown));
+                } else {
+                    // process in case the block isn't known yet
+                    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                        CValidationState state;
+                        if (ProcessNewBlock(0,0,state, NULL, &block, true, dbp))
+                            nLoaded++;
+                        if (state.IsError()) {
+                            fEnd = true;
+                            break;
+                        }
+                    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && komodo_blockheight(hash) % 1000 == 0) {
+                        LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), komodo_blockheight(hash));
+                    }
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(mapBlockIndex.count(hash)!=0?mapBlockIndex[hash]->GetHeight():0,block, it->second,1))
-                        {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                      head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(0,0,dummy, NULL, &block, true, &it->second))
+                    NotifyHeaderTip();
+
+                    // Recursively process earlier encountered successors of this block
+                    deque<uint256> queue;
+                    queue.push_back(hash);
+                    while (!queue.empty()) {
+                        uint256 head = queue.front();
+                        queue.pop_front();
+                        std::pair<std::multimap<uint256, CUnknownParentBlock>::iterator, std::multimap<uint256, CUnknownParentBlock>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                        while (range.first != range.second) {
+                            std::multimap<uint256, CUnknownParentBlock>::iterator it = range.first;
+                            CUnknownParentBlock& unknown = it->second;
+                            CBlock blockChild;
+                            CBlock* pblockChild = unknown.pblock.get();
+                            nUnknownParentMemory -= unknown.nMemory;
+                            if (!pblockChild && ReadBlockFromDisk(mapBlockIndex.count(hash)!=0?mapBlockIndex[hash]->GetHeight():0,blockChild, unknown.pos,1))
+                                pblockChild = &blockChild;
+                            if (pblockChild)
                             {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
+                                LogPrintf("%s: Processing out of order child %s of %s\n", __func__, pblockChild->GetHash().ToString(),
+                                          head.ToString());
+                                CValidationState dummy;
+                                if (ProcessNewBlock(0,0,dummy, NULL, pblockChild, true, unknown.pos.IsNull() ? NULL : &unknown.pos))
+                                {
+                                    nLoaded++;
+                                    queue.push_back(pblockChild->GetHash());
+                                }
                             }
+                            range.first++;
+                            mapBlocksUnknownParent.erase(it);
+                            NotifyHeaderTip();
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
                     }
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+
+                if (rec.nUsed < rec.nSize) {
+                    // The block ended before its record did; scan on from where it ended.
+                    nRewind = rec.nPos + rec.nUsed;
+                    fEnd = false;
+                    break;
+                }
             }
         }
     } catch (const std::runtime_error& e) {
@@ -7089,14 +7484,99 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+/** Number of recently served blocks near the tip kept as complete messages. */
+static const size_t MAX_HOT_BLOCK_MESSAGES = 8;
+static CCriticalSection cs_hotBlockMessages;
+static std::list<std::pair<uint256, std::shared_ptr<const CSerializeData> > > listHotBlockMessages;
+
+/**
+ * Get the "block" message for the block at pos, taking its bytes as they are
+ * stored rather than deserializing and reserializing it. Only the header is
+ * parsed, to check the hash. With fHot the message is taken from, or added to,
+ * the cache of recently served blocks, so peers asking for the same block
+ * share one buffer.
+ */
+std::shared_ptr<const CSerializeData> ReadBlockMessage(const CDiskBlockPos& pos, const uint256& hash, bool fHot)
+{
+    if (fHot) {
+        LOCK(cs_hotBlockMessages);
+        for (std::list<std::pair<uint256, std::shared_ptr<const CSerializeData> > >::iterator it = listHotBlockMessages.begin(); it != listHotBlockMessages.end(); it++) {
+            if (it->first == hash) {
+                listHotBlockMessages.splice(listHotBlockMessages.begin(), listHotBlockMessages, it);
+                return it->second;
+            }
+        }
+    }
+
+    std::shared_ptr<CSerializeData> pmsg = std::make_shared<CSerializeData>();
+    CSerializeData& vMsg = *pmsg;
+    CBlockHeader header;
+    std::shared_ptr<const CSerializeData> pending = blockFileWriter.GetPending(false, pos);
+    if (pending) {
+        // A block that is not written out yet is taken from the block file writer's queue
+        vMsg.resize(CMessageHeader::HEADER_SIZE);
+        vMsg.insert(vMsg.end(), pending->begin() + CBlockFileWriter::RECORD_HEADER_SIZE, pending->end());
+        try {
+            CDataStream ss(vMsg.begin() + CMessageHeader::HEADER_SIZE, vMsg.end(), SER_DISK, CLIENT_VERSION);
+            ss >> header;
+        } catch (const std::exception& e) {
+            error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+            return nullptr;
+        }
+        if (header.GetHash() != hash) {
+            error("%s: block at %s is not %s", __func__, pos.ToString(), hash.ToString());
+            return nullptr;
+        }
+    } else {
+        // The block is stored behind the network magic and its size
+        if (pos.nPos < 8) {
+            error("%s: invalid position %s", __func__, pos.ToString());
+            return nullptr;
+        }
+        CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - 4), true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull()) {
+            error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+            return nullptr;
+        }
+        try {
+            unsigned int nSize;
+            filein >> nSize >> header;
+            if (header.GetHash() != hash) {
+                error("%s: block at %s is not %s", __func__, pos.ToString(), hash.ToString());
+                return nullptr;
+            }
+            CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+            ssHeader << header;
+            if (nSize < ssHeader.size() || nSize > MAX_PROTOCOL_MESSAGE_LENGTH - CMessageHeader::HEADER_SIZE) {
+                error("%s: bad block size %u at %s", __func__, nSize, pos.ToString());
+                return nullptr;
+            }
+            vMsg.resize(CMessageHeader::HEADER_SIZE + nSize);
+            memcpy(&vMsg[CMessageHeader::HEADER_SIZE], &ssHeader[0], ssHeader.size());
+            filein.read(&vMsg[CMessageHeader::HEADER_SIZE + ssHeader.size()], nSize - ssHeader.size());
+        } catch (const std::exception& e) {
+            error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+            return nullptr;
+        }
+    }
+    FrameMessage("block", vMsg);
+
+    if (fHot) {
+        LOCK(cs_hotBlockMessages);
+        listHotBlockMessages.push_front(std::make_pair(hash, pmsg));
+        if (listHotBlockMessages.size() > MAX_HOT_BLOCK_MESSAGES)
+            listHotBlockMessages.pop_back();
+    }
+    return pmsg;
+}
+
+// Does not need cs_main; blocks are read from disk without holding it.
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
-
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
@@ -7107,47 +7587,73 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
                 bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end())
+                CBlockIndex *pindex = NULL;
+                CDiskBlockPos pos;
+                bool fNearTip = false;
+                uint256 hashTip;
                 {
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        static const int nOneMonth = 30 * 24 * 60 * 60;
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a month older (both in time, and in
-                        // best equivalent proof of work) than the best header chain we know about.
-                        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                        (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
-                        (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, Params().GetConsensus()) < nOneMonth);
-                        if (!send) {
-                            LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+                    LOCK(cs_main);
+                    BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+                    if (mi != mapBlockIndex.end())
+                    {
+                        if (chainActive.Contains(mi->second)) {
+                            send = true;
+                        } else {
+                            static const int nOneMonth = 30 * 24 * 60 * 60;
+                            // To prevent fingerprinting attacks, only send blocks outside of the active
+                            // chain if they are valid, and no more than a month older (both in time, and in
+                            // best equivalent proof of work) than the best header chain we know about.
+                            send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+                            (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
+                            (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, Params().GetConsensus()) < nOneMonth);
+                            if (!send) {
+                                LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+                            }
                         }
                     }
+                    // Pruned nodes may have deleted the block, so check whether
+                    // it's available before trying to send.
+                    send = send && (mi->second->nStatus & BLOCK_HAVE_DATA);
+                    if (send)
+                    {
+                        pindex = mi->second;
+                        pos = pindex->GetBlockPos();
+                        fNearTip = pindex->GetHeight() >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
+                        hashTip = chainActive.Tip()->GetBlockHash();
+                    }
                 }
-                // Pruned nodes may have deleted the block, so check whether
-                // it's available before trying to send.
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                if (send)
                 {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second,1))
+                    if (inv.type == MSG_BLOCK || (inv.type == MSG_CMPCT_BLOCK && !fNearTip))
                     {
-                        assert(!"cannot load block from disk");
+                        // Send the block as it is stored on disk. For older blocks the
+                        // peer is unlikely to have the transactions in its mempool, so the
+                        // round-trips of a getblocktxn would cost more than the full block.
+                        std::shared_ptr<const CSerializeData> pmsg = ReadBlockMessage(pos, inv.hash, fNearTip);
+                        if (!pmsg)
+                        {
+                            // cs_main is not held, so the block file may have been pruned meanwhile
+                            LogPrint("net", "%s: cannot load block %s from disk, peer=%d\n", __func__, inv.hash.ToString(), pfrom->id);
+                            vNotFound.push_back(inv);
+                        }
+                        else
+                            pfrom->PushSerializedMessage(pmsg);
                     }
                     else
                     {
-                        if (inv.type == MSG_BLOCK)
+                        CBlock block;
+                        if (!ReadBlockFromDisk(pindex->GetHeight(), block, pos, 1) || block.GetHash() != inv.hash)
                         {
-                            //uint256 hash; int32_t z;
-                            //hash = block.GetHash();
-                            //for (z=31; z>=0; z--)
-                            //    LogPrintf("%02x",((uint8_t *)&hash)[z]);
-                            //LogPrintf(" send block %d\n",komodo_block2height(&block));
-                            pfrom->PushMessage("block", block);
+                            LogPrint("net", "%s: cannot load block %s from disk, peer=%d\n", __func__, inv.hash.ToString(), pfrom->id);
+                            vNotFound.push_back(inv);
+                        }
+                        else if (inv.type == MSG_CMPCT_BLOCK)
+                        {
+                            CBlockHeaderAndShortTxIDs cmpctblock(block);
+                            pfrom->PushMessage("cmpctblock", cmpctblock);
                         }
                         else // MSG_FILTERED_BLOCK)
                         {
@@ -7178,7 +7684,7 @@ void static ProcessGetData(CNode* pfrom)
                         // and we want it right after the last block so they don't
                         // wait for other stuff first.
                         vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
+                        vInv.push_back(CInv(MSG_BLOCK, hashTip));
                         pfrom->PushMessage("inv", vInv);
                         pfrom->hashContinue.SetNull();
                     }
@@ -7214,7 +7720,7 @@ void static ProcessGetData(CNode* pfrom)
             // Track requests for our stuff.
             GetMainSignals().Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
                 break;
         }
     }
@@ -7431,6 +7937,17 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             LOCK(cs_main);
             State(pfrom->GetId())->fCurrentlyConnected = true;
         }
+
+        // Offer compact block relay (BIP152). Peers that do not know the
+        // message ignore it, so this needs no protocol version gate.
+        if (fCompactBlocks) {
+            bool fAnnounceUsingCMPCTBLOCK = false;
+            BOOST_FOREACH(const CSubNet& subnet, vCompactBlockHBPeers)
+                if (subnet.Match((CNetAddr)pfrom->addr))
+                    fAnnounceUsingCMPCTBLOCK = true;
+            uint64_t nCMPCTBLOCKVersion = 1;
+            pfrom->PushMessage("sendcmpct", fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+        }
     }
 
 
@@ -7677,8 +8194,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), inv.hash);
                     CNodeState *nodestate = State(pfrom->GetId());
                     if (chainActive.Tip()->GetBlockTime() > GetTime() - chainparams.GetConsensus().nPowTargetSpacing * 20 &&
-                        nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-                        vToFetch.push_back(inv);
+                        nodestate->nBlocksInFlight < nodestate->nBlocksInFlightLimit) {
+                        // Near the tip, ask for a compact block when the peer can serve one.
+                        vToFetch.push_back(nodestate->fProvidesHeaderAndIDs ? CInv(MSG_CMPCT_BLOCK, inv.hash) : inv);
                         // Mark block as in flight already, even though the actual "getdata" message only goes out
                         // later (within the same cs_main lock, though).
                         MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
@@ -8080,6 +8598,222 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
+    else if (strCommand == "sendcmpct")
+    {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        // Only version 1 is defined; ignore anything else so a future version can be negotiated.
+        if (nCMPCTBLOCKVersion == 1) {
+            LOCK(cs_main);
+            CNodeState *nodestate = State(pfrom->GetId());
+            nodestate->fProvidesHeaderAndIDs = true;
+            nodestate->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        const uint256 hash = cmpctblock.header.GetHash();
+        LogPrint("cmpctblock", "received cmpctblock %s (%u txs) peer=%d\n", hash.ToString(), cmpctblock.BlockTxCount(), pfrom->id);
+        pfrom->AddInventoryKnown(CInv(MSG_BLOCK, hash));
+
+        bool fBlockReconstructed = false;
+        CBlock block;
+        {
+            LOCK(cs_main);
+
+            if (mapBlockIndex.find(cmpctblock.header.hashPrevBlock) == mapBlockIndex.end()) {
+                // Doesn't connect to anything we know; sync the headers first, as for an inv.
+                if (!IsInitialBlockDownload())
+                    pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), uint256());
+                return true;
+            }
+
+            CBlockIndex *pindex = NULL;
+            CValidationState state;
+            int32_t futureblock = 0;
+            if (!AcceptBlockHeader(&futureblock, cmpctblock.header, state, &pindex)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS) && futureblock == 0) {
+                    if (nDoS > 0)
+                        Misbehaving(pfrom->GetId(), nDoS);
+                    return error("invalid header received in cmpctblock");
+                }
+                return true;
+            }
+            if (pindex == NULL)
+                return true;
+            UpdateBlockAvailability(pfrom->GetId(), hash);
+
+            // Nothing to do if we already have the block or it is not worth fetching now.
+            if (pindex->nStatus & BLOCK_HAVE_DATA)
+                return true;
+            if (!(pindex->chainPower > chainActive.Tip()->chainPower) || IsInitialBlockDownload())
+                return true;
+
+            const Consensus::Params& consensusParams = chainparams.GetConsensus();
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+            bool fAlreadyInFlight = itInFlight != mapBlocksInFlight.end();
+            CNodeState *nodestate = State(pfrom->GetId());
+
+            if (pindex->pprev != chainActive.Tip()) {
+                // Not a direct successor of our tip; reconstructing it would not let us connect it
+                // any sooner, so fetch the whole block the usual way.
+                bool fInFlightFromPeer = fAlreadyInFlight && itInFlight->second.first == pfrom->GetId();
+                if (fInFlightFromPeer || (!fAlreadyInFlight && nodestate->nBlocksInFlight < nodestate->nBlocksInFlightLimit)) {
+                    vector<CInv> vGetData;
+                    vGetData.push_back(CInv(MSG_BLOCK, hash));
+                    MarkBlockAsInFlight(pfrom->GetId(), hash, consensusParams, pindex);
+                    pfrom->PushMessage("getdata", vGetData);
+                }
+                return true;
+            }
+
+            if (fAlreadyInFlight && itInFlight->second.first != pfrom->GetId())
+                return true; // someone else is already sending it to us
+
+            list<QueuedBlock>::iterator itQueued;
+            MarkBlockAsInFlight(pfrom->GetId(), hash, consensusParams, pindex, &itQueued);
+            itQueued->partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+            PartiallyDownloadedBlock& partialBlock = *itQueued->partialBlock;
+
+            ReadStatus status = partialBlock.InitData(cmpctblock, std::vector<std::pair<uint256, CTransactionRef>>());
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(hash);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us an invalid cmpctblock", pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                // Short ID collision; fall back to the full block.
+                vector<CInv> vGetData;
+                vGetData.push_back(CInv(MSG_BLOCK, hash));
+                MarkBlockAsInFlight(pfrom->GetId(), hash, consensusParams, pindex);
+                pfrom->PushMessage("getdata", vGetData);
+                return true;
+            }
+
+            BlockTransactionsRequest req;
+            for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                if (!partialBlock.IsTxAvailable(i))
+                    req.indexes.push_back(i);
+            }
+            if (!req.indexes.empty()) {
+                req.blockhash = hash;
+                LogPrint("cmpctblock", "requesting %u of %u txs of cmpctblock %s from peer=%d\n", req.indexes.size(), cmpctblock.BlockTxCount(), hash.ToString(), pfrom->id);
+                pfrom->PushMessage("getblocktxn", req);
+                return true;
+            }
+
+            status = partialBlock.FillBlock(block, std::vector<CTransactionRef>());
+            if (status != READ_STATUS_OK) {
+                vector<CInv> vGetData;
+                vGetData.push_back(CInv(MSG_BLOCK, hash));
+                MarkBlockAsInFlight(pfrom->GetId(), hash, consensusParams, pindex);
+                pfrom->PushMessage("getdata", vGetData);
+                return true;
+            }
+            fBlockReconstructed = true;
+        }
+
+        if (fBlockReconstructed) {
+            // The block stays marked in flight, so ProcessNewBlock treats it as requested.
+            CValidationState state;
+            ProcessNewBlock(0, 0, state, pfrom, &block, false, NULL);
+            int nDoS;
+            if (state.IsInvalid(nDoS) && nDoS > 0) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), nDoS);
+            }
+        }
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+
+        BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+        if (it == mapBlockIndex.end() || it->second == NULL || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint("net", "peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+            return true;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, it->second, 1))
+            return error("%s: cannot load block %s from disk", __func__, req.blockhash.ToString());
+
+        if (it->second->GetHeight() < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+            // Too deep to be a block the peer is still reconstructing; just send it whole.
+            pfrom->PushMessage("block", block);
+            return true;
+        }
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us a getblocktxn with out-of-bounds tx indices", pfrom->id);
+            }
+            resp.txn[i] = std::make_shared<const CTransaction>(block.vtx[req.indexes[i]]);
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        bool fBlockRead = false;
+        CBlock block;
+        {
+            LOCK(cs_main);
+
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(resp.blockhash);
+            if (itInFlight == mapBlocksInFlight.end() || !itInFlight->second.second->partialBlock ||
+                itInFlight->second.first != pfrom->GetId()) {
+                LogPrint("net", "peer %d sent us block transactions for block we weren't expecting\n", pfrom->id);
+                return true;
+            }
+
+            CBlockIndex *pindex = itInFlight->second.second->pindex;
+            PartiallyDownloadedBlock& partialBlock = *itInFlight->second.second->partialBlock;
+            ReadStatus status = partialBlock.FillBlock(block, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("peer %d sent us invalid compact block/non-matching block transactions", pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                // Might have collided, fall back to getdata now :(
+                vector<CInv> vGetData;
+                vGetData.push_back(CInv(MSG_BLOCK, resp.blockhash));
+                MarkBlockAsInFlight(pfrom->GetId(), resp.blockhash, chainparams.GetConsensus(), pindex);
+                pfrom->PushMessage("getdata", vGetData);
+                return true;
+            }
+            fBlockRead = true;
+        }
+
+        if (fBlockRead) {
+            CValidationState state;
+            ProcessNewBlock(0, 0, state, pfrom, &block, false, NULL);
+            int nDoS;
+            if (state.IsInvalid(nDoS) && nDoS > 0) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), nDoS);
+            }
+        }
+    }
+
+
     else if (strCommand == "mempool")
     {
         LOCK2(cs_main, pfrom->cs_filter);
@@ -8236,6 +8970,198 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     return true;
 }
 
+/** Process one message, turning exceptions from it into log entries. */
+static void ProcessMessageLogged(CNode* pfrom, const string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    unsigned int nMessageSize = vRecv.size();
+    bool fRet = false;
+    try
+    {
+        fRet = ProcessMessage(pfrom, strCommand, vRecv, nTimeReceived);
+        boost::this_thread::interruption_point();
+    }
+    catch (const std::ios_base::failure& e)
+    {
+        pfrom->PushMessage("reject", strCommand, REJECT_MALFORMED, string("error parsing message"));
+        if (strstr(e.what(), "end of data"))
+        {
+            // Allow exceptions from under-length message on vRecv
+            LogPrintf("%s(%s, %u bytes): Exception '%s' caught, normally caused by a message being shorter than its stated length\n", __func__, SanitizeString(strCommand), nMessageSize, e.what());
+        }
+        else if (strstr(e.what(), "size too large"))
+        {
+            // Allow exceptions from over-long size
+            LogPrintf("%s(%s, %u bytes): Exception '%s' caught\n", __func__, SanitizeString(strCommand), nMessageSize, e.what());
+        }
+        else
+        {
+            //PrintExceptionContinue(&e, "ProcessMessages()");
+        }
+    }
+    catch (const boost::thread_interrupted&) {
+        throw;
+    }
+    catch (const std::exception& e) {
+        PrintExceptionContinue(&e, "ProcessMessages()");
+    } catch (...) {
+        PrintExceptionContinue(NULL, "ProcessMessages()");
+    }
+
+    if (!fRet)
+        LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->id);
+}
+
+/**
+ * Requests that only read chain state and answer the peer who sent them are
+ * served by a pool of worker threads (-msgworkers), so that a burst of them
+ * does not hold up block and transaction processing on the message handler
+ * thread. Each command has its own queue and the workers take from the
+ * queues in turn. A peer has at most one message with a worker at a time,
+ * and the message handler thread leaves it alone until that message is done,
+ * so every peer still sees its messages handled in order by one thread at a
+ * time. getnSPV stays on the handler thread, as its handlers read the active
+ * chain without cs_main, and so does getaddr, as the addresses queued for a
+ * peer are also filled and sent by the handler thread without a lock.
+ */
+static bool IsWorkerCommand(const string& strCommand)
+{
+    return strCommand == "getdata" || strCommand == "getheaders" || strCommand == "getblocks" ||
+           strCommand == "getblocktxn";
+}
+
+struct CMessageTask
+{
+    CNode* pnode;
+    string strCommand;          // empty: continue with the peer's pending getdata requests
+    CDataStream vRecv;
+    int64_t nTimeReceived;
+
+    CMessageTask() : pnode(NULL), vRecv(SER_NETWORK, PROTOCOL_VERSION), nTimeReceived(0) {}
+};
+
+/** Commands with their own entry in the statistics; the rest are counted together. */
+static const size_t MAX_MESSAGE_STATS = 64;
+
+static boost::mutex cs_messageQueues;
+static boost::condition_variable condMessageQueues;
+static std::map<string, std::deque<CMessageTask> > mapMessageQueues;
+static string strLastMessageQueue;
+static std::map<string, CMessageStats> mapMessageStats;
+
+static CMessageStats& MessageStats(const string& strCommand)
+{
+    std::map<string, CMessageStats>::iterator it = mapMessageStats.find(strCommand);
+    if (it != mapMessageStats.end())
+        return it->second;
+    if (mapMessageStats.size() >= MAX_MESSAGE_STATS)
+        return mapMessageStats["other"];
+    return mapMessageStats[strCommand];
+}
+
+static void RecordMessageStats(const string& strCommand, int64_t nTimeReceived, int64_t nStart, int64_t nEnd)
+{
+    boost::unique_lock<boost::mutex> lock(cs_messageQueues);
+    CMessageStats& stats = MessageStats(strCommand.empty() ? "getdata" : strCommand);
+    stats.nProcessed++;
+    stats.nTotalWaitMicros += nStart - nTimeReceived;
+    stats.nMaxWaitMicros = std::max(stats.nMaxWaitMicros, nStart - nTimeReceived);
+    stats.nTotalRunMicros += nEnd - nStart;
+}
+
+void GetMessageStats(std::map<string, CMessageStats>& mapStats)
+{
+    boost::unique_lock<boost::mutex> lock(cs_messageQueues);
+    mapStats = mapMessageStats;
+}
+
+// requires LOCK(cs_vRecvMsg)
+// Hands a message (or, with an empty command, the pending getdata requests) of
+// pfrom to the workers. Returns false if it has to be processed here instead.
+static bool QueueMessageTask(CNode* pfrom, const string& strCommand, const CDataStream* pvRecv, int64_t nTimeReceived)
+{
+    if (nMessageWorkers <= 0 || !pfrom->fSuccessfullyConnected || (!strCommand.empty() && !IsWorkerCommand(strCommand)))
+        return false;
+
+    {
+        LOCK(cs_vNodes);
+        pfrom->AddRef();
+    }
+    pfrom->fMessageInFlight = true;
+
+    CMessageTask task;
+    task.pnode = pfrom;
+    task.strCommand = strCommand;
+    if (pvRecv != NULL)
+        task.vRecv = CDataStream(pvRecv->begin(), pvRecv->end(), pvRecv->GetType(), pvRecv->GetVersion());
+    task.nTimeReceived = nTimeReceived;
+
+    const string strQueue = strCommand.empty() ? "getdata" : strCommand;
+    {
+        boost::unique_lock<boost::mutex> lock(cs_messageQueues);
+        std::deque<CMessageTask>& queue = mapMessageQueues[strQueue];
+        queue.push_back(CMessageTask());
+        std::swap(queue.back(), task);
+        CMessageStats& stats = MessageStats(strQueue);
+        stats.fWorker = true;
+        stats.nQueued++;
+    }
+    condMessageQueues.notify_one();
+    return true;
+}
+
+// requires cs_messageQueues
+static bool PopMessageTask(CMessageTask& task)
+{
+    if (mapMessageQueues.empty())
+        return false;
+    // Take from the queue after the one served last, so that no command can
+    // starve the others.
+    std::map<string, std::deque<CMessageTask> >::iterator it = mapMessageQueues.upper_bound(strLastMessageQueue);
+    for (size_t i = 0; i < mapMessageQueues.size(); i++, it++) {
+        if (it == mapMessageQueues.end())
+            it = mapMessageQueues.begin();
+        if (!it->second.empty()) {
+            std::swap(task, it->second.front());
+            it->second.pop_front();
+            strLastMessageQueue = it->first;
+            MessageStats(it->first).nQueued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadMessageWorker()
+{
+    RenameThread("komodo-msgwork");
+    while (true)
+    {
+        CMessageTask task;
+        {
+            boost::unique_lock<boost::mutex> lock(cs_messageQueues);
+            while (!PopMessageTask(task))
+                condMessageQueues.wait(lock);
+        }
+
+        CNode* pfrom = task.pnode;
+        int64_t nStart = GetTimeMicros();
+        if (!pfrom->fDisconnect) {
+            if (task.strCommand.empty())
+                ProcessGetData(pfrom);
+            else
+                ProcessMessageLogged(pfrom, task.strCommand, task.vRecv, task.nTimeReceived);
+        }
+        RecordMessageStats(task.strCommand, task.nTimeReceived, nStart, GetTimeMicros());
+
+        pfrom->fMessageInFlight = false;
+        {
+            LOCK(cs_vNodes);
+            pfrom->Release();
+        }
+        WakeMessageHandler();
+    }
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -8252,8 +9178,12 @@ bool ProcessMessages(CNode* pfrom)
     //
     bool fOk = true;
 
-    if (!pfrom->vRecvGetData.empty())
+    if (!pfrom->vRecvGetData.empty()) {
+        // A worker now owns vRecvGetData until it is done
+        if (QueueMessageTask(pfrom, "", NULL, GetTimeMicros()))
+            return fOk;
         ProcessGetData(pfrom);
+    }
 
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
@@ -8310,41 +9240,11 @@ bool ProcessMessages(CNode* pfrom)
         }
 
         // Process message
-        bool fRet = false;
-        try
-        {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
-            boost::this_thread::interruption_point();
-        }
-        catch (const std::ios_base::failure& e)
-        {
-            pfrom->PushMessage("reject", strCommand, REJECT_MALFORMED, string("error parsing message"));
-            if (strstr(e.what(), "end of data"))
-            {
-                // Allow exceptions from under-length message on vRecv
-                LogPrintf("%s(%s, %u bytes): Exception '%s' caught, normally caused by a message being shorter than its stated length\n", __func__, SanitizeString(strCommand), nMessageSize, e.what());
-            }
-            else if (strstr(e.what(), "size too large"))
-            {
-                // Allow exceptions from over-long size
-                LogPrintf("%s(%s, %u bytes): Exception '%s' caught\n", __func__, SanitizeString(strCommand), nMessageSize, e.what());
-            }
-            else
-            {
-                //PrintExceptionContinue(&e, "ProcessMessages()");
-            }
-        }
-        catch (const boost::thread_interrupted&) {
-            throw;
-        }
-        catch (const std::exception& e) {
-            PrintExceptionContinue(&e, "ProcessMessages()");
-        } catch (...) {
-            PrintExceptionContinue(NULL, "ProcessMessages()");
-        }
-
-        if (!fRet)
-            LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->id);
+        if (QueueMessageTask(pfrom, strCommand, &vRecv, msg.nTime))
+            break;
+        int64_t nStart = GetTimeMicros();
+        ProcessMessageLogged(pfrom, strCommand, vRecv, msg.nTime);
+        RecordMessageStats(strCommand, msg.nTime, nStart, GetTimeMicros());
 
         break;
     }
@@ -8574,10 +9474,10 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         //
         static uint256 zero;
         vector<CInv> vGetData;
-        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < state.nBlocksInFlightLimit) {
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            FindNextBlocksToDownload(pto->GetId(), state.nBlocksInFlightLimit - state.nBlocksInFlight, vToDownload, staller);
             BOOST_FOREACH(CBlockIndex *pindex, vToDownload) {
                 vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), consensusParams, pindex);
@@ -8585,8 +9485,12 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                          pindex->GetHeight(), pto->id);
             }
             if (state.nBlocksInFlight == 0 && staller != -1) {
-                if (State(staller)->nStallingSince == 0) {
-                    State(staller)->nStallingSince = nNow;
+                CNodeState *stateStaller = State(staller);
+                if (stateStaller->nStallingSince == 0) {
+                    stateStaller->nStallingSince = nNow;
+                    // Give the staller less of the window until it proves faster again.
+                    stateStaller->nBlocksInFlightLimit = std::max(MIN_BLOCKS_IN_TRANSIT_PER_PEER, stateStaller->nBlocksInFlightLimit / 2);
+                    nBlockStalls++;
                     LogPrint("net", "Stall started peer=%d\n", staller);
                 }
             }
@@ -8650,10 +9554,7 @@ public:
 //        BlockMap::iterator it1 = mapBlockIndex.begin();
 //        for (; it1 != mapBlockIndex.end(); it1++)
 //            delete (*it1).second;
-        BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-            delete entry.second;
-        }
-
+        FreeBlockIndexEntries();
         mapBlockIndex.clear();
 
         // orphan transactions
@@ -75,6 +75,8 @@ static const unsigned int DEFAULT_BLOCK_MIN_SIZE = 0;
 static const unsigned int DEFAULT_BLOCK_PRIORITY_SIZE = DEFAULT_BLOCK_MAX_SIZE / 2;
 /** Default for accepting alerts from the P2P network. */
 static const bool DEFAULT_ALERTS = true;
+/** Default for -compactblocks, whether to negotiate BIP152 compact block relay with peers. */
+static const bool DEFAULT_COMPACT_BLOCKS = true;
 /** Minimum alert priority for enabling safe mode. */
 static const int ALERT_PRIORITY_SAFE_MODE = 4000;
 /** Maximum reorg length we will accept before we shut down and alert the user. */
@@ -100,10 +102,21 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
-static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Maximum number of message worker threads allowed */
+static const int MAX_MESSAGE_WORKERS = 16;
+/** -msgworkers default (threads serving read-only peer requests, 0 = serve them on the message handler thread) */
+static const int DEFAULT_MESSAGE_WORKERS = 2;
+/** Number of blocks that can be requested at any given time from a single peer, until its download speed is known. */
+static const int DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds of the per-peer limit on blocks in flight, which follows the peer's measured latency and throughput. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 64;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
+/** Factor by which a block must be later than its peer's measured speed predicts before it is requested from a faster peer. */
+static const int BLOCK_REASSIGN_FACTOR = 3;
+/** Minimum time in seconds a block is in flight before it may be requested from a faster peer. */
+static const unsigned int BLOCK_REASSIGN_TIMEOUT = 1;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 160;
@@ -158,6 +171,7 @@ extern bool fExperimentalMode;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern int nMessageWorkers;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
@@ -168,6 +182,9 @@ extern bool fCoinbaseEnforcedProtectionEnabled;
 extern size_t nCoinCacheUsage;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
+extern bool fCompactBlocks;
+/** Peers matching one of these subnets are asked to announce new blocks to us as compact blocks. */
+extern std::vector<CSubNet> vCompactBlockHBPeers;
 extern int64_t nMaxTipAge;
 
 /** Best header we've seen so far (used for getheaders queries' starting points). */
@@ -241,6 +258,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the thread serving queued read-only peer requests */
+void ThreadMessageWorker();
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -281,6 +300,8 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
 
 /** Create a new block index entry for a given block hash */
 CBlockIndex * InsertBlockIndex(uint256 hash);
+/** Hand over an array of block index entries allocated with new[] at startup; it is freed with mapBlockIndex. */
+void AddBlockIndexArena(CBlockIndex *pindexes, size_t n);
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Increase a node's misbehavior score. */
@@ -300,8 +321,48 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int nBlocksInFlightLimit;
+    int64_t nBlockRttMicros;        // smoothed time until a block request is answered, 0 if unknown
+    int64_t nBlockIntervalMicros;   // smoothed time between blocks while the peer is busy, 0 if unknown
+    int nBlocksReceived;
+    int nBlocksReassigned;          // requests moved from this peer to a faster one
+    bool fStalling;
 };
 
+/** State of the block download scheduler */
+struct CDownloadStats {
+    int nWindow;
+    int nBlocksInFlight;
+    int nBlocksInFlightValidHeaders;
+    uint64_t nBlocksReassigned;
+    uint64_t nStalls;
+};
+
+/** Get the state of the block download scheduler; per-peer details are in CNodeStateStats. */
+void GetDownloadStats(CDownloadStats& stats);
+/**
+ * Whether a block requested nElapsed microseconds ago, behind nInFlightBefore other requests to a peer with the
+ * given round-trip and interval estimates (0 if unknown), is late enough to ask a second peer for it, and whether
+ * that peer, with nTakerInFlight requests already pending, should deliver it sooner. All times in microseconds.
+ */
+bool IsBlockRequestLate(int64_t nElapsed, int nInFlightBefore, int64_t nOwnerRtt, int64_t nOwnerInterval,
+                        int64_t nTakerRtt, int64_t nTakerInterval, int nTakerInFlight);
+
+/** Processing statistics of one P2P command */
+struct CMessageStats {
+    bool fWorker;               // served by the worker pool rather than the message handler thread
+    int64_t nQueued;            // messages waiting for a worker right now
+    uint64_t nProcessed;
+    int64_t nTotalWaitMicros;   // time from receipt until processing started
+    int64_t nMaxWaitMicros;
+    int64_t nTotalRunMicros;
+
+    CMessageStats() : fWorker(false), nQueued(0), nProcessed(0), nTotalWaitMicros(0), nMaxWaitMicros(0), nTotalRunMicros(0) {}
+};
+
+/** Get processing statistics per P2P command */
+void GetMessageStats(std::map<std::string, CMessageStats>& mapStats);
+
 struct CTimestampIndexIteratorKey {
     unsigned int timestamp;
 
@@ -802,13 +863,21 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                      int start = 0, int end = 0);
+/** The unspent outputs of addressHash, or with fAllAddresses of all addresses of type, for example 3 for the CC addresses */
 bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       bool fAllAddresses = false);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos,bool checkPOW);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex,bool checkPOW);
+/**
+ * The framed "block" message for the block stored at pos, read without
+ * reserializing the block, or null if it cannot be read or is not hash.
+ * With fHot it comes from, or goes into, the cache of recently served blocks.
+ */
+std::shared_ptr<const CSerializeData> ReadBlockMessage(const CDiskBlockPos& pos, const uint256& hash, bool fHot);
 bool PruneOneBlockFile(bool tempfile, const int fileNumber);
 
 /** Functions for validating blocks and updating the block tree */
@@ -95,6 +95,8 @@ AtomicCounter ehSolverRuns;
 AtomicCounter solutionTargetChecks;
 static AtomicCounter minedBlocks;
 AtomicTimer miningTimer;
+AtomicCounter saplingProofsCreated;
+AtomicTimer provingTimer;
 CCriticalSection cs_metrics;
 
 double AtomicTimer::rate(const int64_t count)
@@ -77,6 +77,8 @@ extern AtomicCounter transactionsValidated;
 extern AtomicCounter ehSolverRuns;
 extern AtomicCounter solutionTargetChecks;
 extern AtomicTimer miningTimer;
+extern AtomicCounter saplingProofsCreated;
+extern AtomicTimer provingTimer;
 
 void TrackMinedBlock(uint256 hash);
 
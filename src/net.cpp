@@ -37,6 +37,11 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
 #endif
 
 #include <boost/filesystem.hpp>
@@ -94,6 +99,7 @@ CAddrMan addrman;
 int nMaxConnections = DEFAULT_MAX_PEER_CONNECTIONS;
 bool fAddressesInitialized = false;
 std::atomic<bool> fNetworkActive = { true };
+bool fSocketEventsEpoll = false;
 bool setBannedIsDirty = false;
 bool GetNetworkActive() { return fNetworkActive; };
 
@@ -121,6 +127,43 @@ CCriticalSection cs_nLastNodeId;
 static CSemaphore *semOutbound = NULL;
 static boost::condition_variable messageHandlerCondition;
 
+#ifdef HAVE_SYS_EPOLL_H
+static int hEpollFd = -1;
+/** Peers with readiness the socket handler has not used up yet. */
+static std::set<CNode*> setNodesReady;
+#endif
+
+/** Start watching a peer's socket, edge-triggered, when epoll is in use. */
+static bool SocketEventsAdd(CNode *pnode)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpollFd == -1)
+        return true;
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(hEpollFd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("epoll_ctl add failed: %s\n", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+#endif
+    return true;
+}
+
+/**
+ * Stop watching a peer's socket. Closing it would do the same, unless a child
+ * process still holds the descriptor, so do it explicitly before the close.
+ */
+static void SocketEventsRemove(SOCKET hSocket)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpollFd != -1) {
+        struct epoll_event event;
+        epoll_ctl(hEpollFd, EPOLL_CTL_DEL, hSocket, &event);
+    }
+#endif
+}
+
 // Denial-of-service detection/prevention
 // Key is IP address, value is banned-until-time
 banmap_t setBanned;
@@ -409,7 +452,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!fSocketEventsEpoll && !IsSelectableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -423,6 +466,8 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
 
         {
             LOCK(cs_vNodes);
+            if (!SocketEventsAdd(pnode))
+                pnode->CloseSocketDisconnect();
             vNodes.push_back(pnode);
         }
 
@@ -444,6 +489,7 @@ void CNode::CloseSocketDisconnect()
     if (hSocket != INVALID_SOCKET)
     {
         LogPrint("net", "disconnecting peer=%d\n", id);
+        SocketEventsRemove(hSocket);
         CloseSocket(hSocket);
     }
 
@@ -787,26 +833,62 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 
 
 
+/** Most queued messages handed to the kernel in one gather send. */
+static const size_t SEND_IOV_MAX = 64;
+
 // requires LOCK(cs_vSend)
-void SocketSendData(CNode *pnode)
+// Returns whether the send queue was emptied; if not, the socket's send buffer
+// is full (or the peer was disconnected).
+bool SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<std::shared_ptr<const CSerializeData> >::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
+        size_t nRequested = 0;
+#ifdef _WIN32
+        const CSerializeData &data = **it;
         assert(data.size() > pnode->nSendOffset);
-        int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        nRequested = data.size() - pnode->nSendOffset;
+        int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], nRequested, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+        // Send as many queued messages as fit in one call, straight from
+        // their buffers.
+        struct iovec iov[SEND_IOV_MAX];
+        size_t nIov = 0;
+        size_t nOffset = pnode->nSendOffset;
+        for (std::deque<std::shared_ptr<const CSerializeData> >::iterator jt = it; jt != pnode->vSendMsg.end() && nIov < SEND_IOV_MAX; ++jt) {
+            const CSerializeData &data = **jt;
+            assert(data.size() > nOffset);
+            iov[nIov].iov_base = const_cast<char*>(&data[nOffset]);
+            iov[nIov].iov_len = data.size() - nOffset;
+            nRequested += iov[nIov].iov_len;
+            nIov++;
+            nOffset = 0;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = nIov;
+        int nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
-            if (pnode->nSendOffset == data.size()) {
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                size_t nRemaining = (*it)->size() - pnode->nSendOffset;
+                if (nLeft < nRemaining) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nRemaining;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= (*it)->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            if ((size_t)nBytes < nRequested) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -824,11 +906,13 @@ void SocketSendData(CNode *pnode)
         }
     }
 
-    if (it == pnode->vSendMsg.end()) {
+    bool fEmptied = (it == pnode->vSendMsg.end());
+    if (fEmptied) {
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+    return fEmptied;
 }
 
 static list<CNode*> vNodesDisconnected;
@@ -1019,7 +1103,8 @@ static bool AttemptToEvictConnection(bool fPreferNewConnection) {
     return true;
 }
 
-static void AcceptConnection(const ListenSocket& hListenSocket) {
+// Returns false once there is no pending connection left to accept.
+static bool AcceptConnection(const ListenSocket& hListenSocket) {
     struct sockaddr_storage sockaddr;
     socklen_t len = sizeof(sockaddr);
     SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
@@ -1054,21 +1139,21 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
         int nErr = WSAGetLastError();
         if (nErr != WSAEWOULDBLOCK)
             LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
-        return;
+        return false;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (!fSocketEventsEpoll && !IsSelectableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
-        return;
+        return true;
     }
 
     if (CNode::IsBanned(addr) && !whitelisted)
     {
         LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
         CloseSocket(hSocket);
-        return;
+        return true;
     }
 
     if (nInbound >= nMaxInbound)
@@ -1077,7 +1162,7 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
             // No connection to evict, disconnect the new connection
             LogPrint("net", "failed to find an eviction candidate - connection dropped (full)\n");
             CloseSocket(hSocket);
-            return;
+            return true;
         }
     }
 
@@ -1086,7 +1171,7 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
         // No connection to evict, disconnect the new connection
         LogPrint("net", "too many connections from %s, connection refused\n", addr.ToString());
         CloseSocket(hSocket);
-        return;
+        return true;
     }
 
     // According to the internet TCP_NODELAY is not carried into accepted sockets
@@ -1106,77 +1191,322 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
 
     {
         LOCK(cs_vNodes);
+        if (!SocketEventsAdd(pnode))
+            pnode->CloseSocketDisconnect();
         vNodes.push_back(pnode);
     }
+    return true;
 }
 
-void ThreadSocketHandler()
+static void DisconnectNodes(unsigned int& nPrevNodeCount)
 {
-    unsigned int nPrevNodeCount = 0;
-    while (true)
     {
-        //
-        // Disconnect nodes
-        //
+        LOCK(cs_vNodes);
+        // Disconnect unused nodes
+        vector<CNode*> vNodesCopy = vNodes;
+        BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
-            LOCK(cs_vNodes);
-            // Disconnect unused nodes
-            vector<CNode*> vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            if (pnode->fDisconnect ||
+                (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty()))
             {
-                if (pnode->fDisconnect ||
-                    (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty()))
-                {
-                    // remove from vNodes
-                    vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                // remove from vNodes
+                vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+#ifdef HAVE_SYS_EPOLL_H
+                setNodesReady.erase(pnode);
+#endif
 
-                    // release outbound grant (if any)
-                    pnode->grantOutbound.Release();
+                // release outbound grant (if any)
+                pnode->grantOutbound.Release();
 
-                    // close socket and cleanup
-                    pnode->CloseSocketDisconnect();
+                // close socket and cleanup
+                pnode->CloseSocketDisconnect();
 
-                    // hold in disconnected pool until all refs are released
-                    if (pnode->fNetworkNode || pnode->fInbound)
-                        pnode->Release();
-                    vNodesDisconnected.push_back(pnode);
-                }
+                // hold in disconnected pool until all refs are released
+                if (pnode->fNetworkNode || pnode->fInbound)
+                    pnode->Release();
+                vNodesDisconnected.push_back(pnode);
             }
         }
+    }
+    {
+        // Delete disconnected nodes
+        list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
+        BOOST_FOREACH(CNode* pnode, vNodesDisconnectedCopy)
         {
-            // Delete disconnected nodes
-            list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
-            BOOST_FOREACH(CNode* pnode, vNodesDisconnectedCopy)
+            // wait until threads are done using it
+            if (pnode->GetRefCount() <= 0)
             {
-                // wait until threads are done using it
-                if (pnode->GetRefCount() <= 0)
+                bool fDelete = false;
                 {
-                    bool fDelete = false;
+                    TRY_LOCK(pnode->cs_vSend, lockSend);
+                    if (lockSend)
                     {
-                        TRY_LOCK(pnode->cs_vSend, lockSend);
-                        if (lockSend)
+                        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                        if (lockRecv)
                         {
-                            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                            if (lockRecv)
-                            {
-                                TRY_LOCK(pnode->cs_inventory, lockInv);
-                                if (lockInv)
-                                    fDelete = true;
-                            }
+                            TRY_LOCK(pnode->cs_inventory, lockInv);
+                            if (lockInv)
+                                fDelete = true;
                         }
                     }
-                    if (fDelete)
+                }
+                if (fDelete)
+                {
+                    vNodesDisconnected.remove(pnode);
+                    delete pnode;
+                }
+            }
+        }
+    }
+    if(vNodes.size() != nPrevNodeCount) {
+        nPrevNodeCount = vNodes.size();
+        uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
+    }
+}
+
+// requires LOCK(cs_vRecvMsg)
+// Reads once from the socket. Returns whether more data may be waiting.
+static bool SocketRecvData(CNode *pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    if (nBytes > 0)
+    {
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+            pnode->CloseSocketDisconnect();
+        pnode->nLastRecv = GetTime();
+        pnode->nRecvBytes += nBytes;
+        pnode->RecordBytesRecv(nBytes);
+        // A short read drained the socket; anything arriving later is
+        // signalled anew.
+        return nBytes == sizeof(pchBuf) && pnode->hSocket != INVALID_SOCKET;
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect)
+            LogPrint("net", "socket closed\n");
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+        {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return false;
+}
+
+static void InactivityCheck(CNode *pnode)
+{
+    int64_t nTime = GetTime();
+    if (nTime - pnode->nTimeConnected > 60)
+    {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+        {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
+        {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        }
+        else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+        {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/** Most events taken from the kernel per wait. */
+static const int EPOLL_MAX_EVENTS = 1024;
+/** Most connections accepted from one listening socket per wakeup. */
+static const int EPOLL_MAX_ACCEPTS = 64;
+/** Most reads from one peer before the others get their turn. */
+static const int EPOLL_MAX_READS_PER_PEER = 4;
+
+static bool SocketEventsInit()
+{
+    hEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (hEpollFd == -1) {
+        LogPrintf("epoll_create1 failed: %s\n", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    // Listening sockets are level-triggered, so one accept per wakeup is
+    // enough; their events carry no node.
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        if (epoll_ctl(hEpollFd, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0) {
+            LogPrintf("epoll_ctl add failed: %s\n", NetworkErrorString(WSAGetLastError()));
+            close(hEpollFd);
+            hEpollFd = -1;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Socket handler loop for epoll. Only peers with fresh or unused readiness
+ * are visited; everything that has to look at all peers (timeouts, and a send
+ * retry as a safety net) runs once a second.
+ */
+static void ThreadSocketHandlerEpoll()
+{
+    unsigned int nPrevNodeCount = 0;
+    int64_t nLastSweep = 0;
+    bool fMoreToRead = false;
+    std::vector<struct epoll_event> vEvents(EPOLL_MAX_EVENTS);
+    while (true)
+    {
+        DisconnectNodes(nPrevNodeCount);
+
+        int nEvents = epoll_wait(hEpollFd, &vEvents[0], vEvents.size(), fMoreToRead ? 0 : 50);
+        boost::this_thread::interruption_point();
+        if (nEvents < 0) {
+            int nErr = WSAGetLastError();
+            if (nErr != WSAEINTR) {
+                LogPrintf("socket epoll error %s\n", NetworkErrorString(nErr));
+                MilliSleep(50);
+            }
+            nEvents = 0;
+        }
+
+        bool fAccept = false;
+        for (int i = 0; i < nEvents; i++) {
+            CNode* pnode = static_cast<CNode*>(vEvents[i].data.ptr);
+            if (pnode == NULL) {
+                fAccept = true;
+                continue;
+            }
+            if (vEvents[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                pnode->fRecvReady = true;
+            if (vEvents[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                pnode->fSendReady = true;
+            setNodesReady.insert(pnode);
+        }
+
+        //
+        // Accept new connections
+        //
+        if (fAccept) {
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+                for (int n = 0; hListenSocket.socket != INVALID_SOCKET && n < EPOLL_MAX_ACCEPTS; n++)
+                    if (!AcceptConnection(hListenSocket))
+                        break;
+        }
+
+        //
+        // Service ready sockets
+        //
+        fMoreToRead = false;
+        vector<CNode*> vNodesReady(setNodesReady.begin(), setNodesReady.end());
+        BOOST_FOREACH(CNode* pnode, vNodesReady)
+        {
+            boost::this_thread::interruption_point();
+
+            if (pnode->hSocket == INVALID_SOCKET) {
+                setNodesReady.erase(pnode);
+                continue;
+            }
+
+            // As with select(), drain the send queue before receiving more.
+            bool fSendQueued = true;
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend) {
+                    if (pnode->fSendReady && !pnode->vSendMsg.empty())
+                        pnode->fSendReady = SocketSendData(pnode);
+                    fSendQueued = !pnode->vSendMsg.empty();
+                }
+            }
+
+            if (pnode->fRecvReady && !fSendQueued)
+            {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv)
+                {
+                    int nReads = 0;
+                    while (pnode->fRecvReady && pnode->hSocket != INVALID_SOCKET &&
+                           (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                            pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
                     {
-                        vNodesDisconnected.remove(pnode);
-                        delete pnode;
+                        if (nReads++ == EPOLL_MAX_READS_PER_PEER) {
+                            fMoreToRead = true;
+                            break;
+                        }
+                        pnode->fRecvReady = SocketRecvData(pnode);
                     }
                 }
             }
+
+            // Peers that still have unread data (held back by the flood limit,
+            // a pending send or a busy lock) are retried on the next round.
+            if (pnode->hSocket == INVALID_SOCKET || !(pnode->fRecvReady || (fSendQueued && pnode->fSendReady)))
+                setNodesReady.erase(pnode);
         }
-        if(vNodes.size() != nPrevNodeCount) {
-            nPrevNodeCount = vNodes.size();
-            uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
+
+        //
+        // Inactivity checking
+        //
+        if (GetTime() != nLastSweep) {
+            nLastSweep = GetTime();
+            vector<CNode*> vNodesCopy;
+            {
+                LOCK(cs_vNodes);
+                vNodesCopy = vNodes;
+                BOOST_FOREACH(CNode* pnode, vNodesCopy)
+                    pnode->AddRef();
+            }
+            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            {
+                if (pnode->hSocket == INVALID_SOCKET)
+                    continue;
+                {
+                    TRY_LOCK(pnode->cs_vSend, lockSend);
+                    if (lockSend && !pnode->vSendMsg.empty())
+                        SocketSendData(pnode);
+                }
+                InactivityCheck(pnode);
+            }
+            {
+                LOCK(cs_vNodes);
+                BOOST_FOREACH(CNode* pnode, vNodesCopy)
+                    pnode->Release();
+            }
         }
+    }
+}
+#endif
+
+void ThreadSocketHandler()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (hEpollFd != -1) {
+        ThreadSocketHandlerEpoll();
+        return;
+    }
+#endif
+    unsigned int nPrevNodeCount = 0;
+    while (true)
+    {
+        DisconnectNodes(nPrevNodeCount);
 
         //
         // Find which sockets have data to receive
@@ -1294,39 +1624,7 @@ void ThreadSocketHandler()
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
-                {
-                    {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        if (nBytes > 0)
-                        {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
-                                pnode->CloseSocketDisconnect();
-                            pnode->nLastRecv = GetTime();
-                            pnode->nRecvBytes += nBytes;
-                            pnode->RecordBytesRecv(nBytes);
-                        }
-                        else if (nBytes == 0)
-                        {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                LogPrint("net", "socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        }
-                        else if (nBytes < 0)
-                        {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                            {
-                                if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
-                }
+                    SocketRecvData(pnode);
             }
 
             //
@@ -1344,30 +1642,7 @@ void ThreadSocketHandler()
             //
             // Inactivity checking
             //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60)
-            {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
-                {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
-                {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
-                {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                }
-                else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
-                {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
-            }
+            InactivityCheck(pnode);
         }
         {
             LOCK(cs_vNodes);
@@ -1669,6 +1944,11 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 }
 
 
+void WakeMessageHandler()
+{
+    messageHandlerCondition.notify_one();
+}
+
 void ThreadMessageHandler()
 {
     boost::mutex condition_mutex;
@@ -1695,7 +1975,7 @@ void ThreadMessageHandler()
 
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
-            if (pnode->fDisconnect)
+            if (pnode->fDisconnect || pnode->fMessageInFlight)
                 continue;
 
             // Receive messages
@@ -1706,7 +1986,7 @@ void ThreadMessageHandler()
                     if (!g_signals.ProcessMessages(pnode))
                         pnode->CloseSocketDisconnect();
 
-                    if (pnode->nSendSize < SendBufferSize())
+                    if (!pnode->fMessageInFlight && pnode->nSendSize < SendBufferSize())
                     {
                         if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
                         {
@@ -1718,6 +1998,7 @@ void ThreadMessageHandler()
             boost::this_thread::interruption_point();
 
             // Send messages
+            if (!pnode->fMessageInFlight)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
@@ -1946,6 +2227,14 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     else
         threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "dnsseed", &ThreadDNSAddressSeed));
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (fSocketEventsEpoll && hEpollFd == -1 && !SocketEventsInit()) {
+        LogPrintf("Falling back to select() for socket events\n");
+        fSocketEventsEpoll = false;
+    }
+#endif
+    LogPrintf("Using %s for socket events\n", fSocketEventsEpoll ? "epoll" : "select");
+
     // Send and receive from sockets, accept connections
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "net", &ThreadSocketHandler));
 
@@ -2002,6 +2291,12 @@ public:
         vNodes.clear();
         vNodesDisconnected.clear();
         vhListenSocket.clear();
+#ifdef HAVE_SYS_EPOLL_H
+        if (hEpollFd != -1)
+            close(hEpollFd);
+        hEpollFd = -1;
+        setNodesReady.clear();
+#endif
         delete semOutbound;
         semOutbound = NULL;
         delete pnodeLocalHost;
@@ -2241,9 +2536,12 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     fNetworkNode = false;
     fSuccessfullyConnected = false;
     fDisconnect = false;
+    fMessageInFlight = false;
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    fRecvReady = false;
+    fSendReady = false;
     hashContinue = uint256();
     nStartingHeight = -1;
     fGetAddr = false;
@@ -2366,9 +2664,10 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    std::shared_ptr<CSerializeData> pmsg = std::make_shared<CSerializeData>();
+    ssSend.GetAndClear(*pmsg);
+    std::deque<std::shared_ptr<const CSerializeData> >::iterator it = vSendMsg.insert(vSendMsg.end(), pmsg);
+    nSendSize += pmsg->size();
 
     // If write queue empty, attempt "optimistic write"
     if (it == vSendMsg.begin())
@@ -2377,6 +2676,35 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
 
+void FrameMessage(const char* pszCommand, CSerializeData& vMsg)
+{
+    assert(vMsg.size() >= CMessageHeader::HEADER_SIZE);
+    unsigned int nSize = vMsg.size() - CMessageHeader::HEADER_SIZE;
+    uint256 hash = Hash(vMsg.begin() + CMessageHeader::HEADER_SIZE, vMsg.end());
+    CMessageHeader hdr(Params().MessageStart(), pszCommand, nSize);
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << hdr;
+    assert(ssHeader.size() == CMessageHeader::HEADER_SIZE);
+    memcpy(&vMsg[0], &ssHeader[0], CMessageHeader::HEADER_SIZE);
+}
+
+void CNode::PushSerializedMessage(const std::shared_ptr<const CSerializeData>& pmsg)
+{
+    LOCK(cs_vSend);
+    assert(ssSend.size() == 0);
+    assert(pmsg->size() >= CMessageHeader::HEADER_SIZE);
+    LogPrint("net", "sending: serialized message (%d bytes) peer=%d\n", pmsg->size() - CMessageHeader::HEADER_SIZE, id);
+
+    std::deque<std::shared_ptr<const CSerializeData> >::iterator it = vSendMsg.insert(vSendMsg.end(), pmsg);
+    nSendSize += pmsg->size();
+
+    // If write queue empty, attempt "optimistic write"
+    if (it == vSendMsg.begin())
+        SocketSendData(this);
+}
+
 size_t GetNodeCount(NumConnections flags)
 {
     LOCK(cs_vNodes);
@@ -37,6 +37,7 @@
 #include "util.h"
 
 #include <deque>
+#include <memory>
 #include <stdint.h>
 
 #ifndef _WIN32
@@ -76,10 +77,17 @@ static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 384;
+/** -socketevents default: edge-triggered epoll where the platform has it */
+#ifdef HAVE_SYS_EPOLL_H
+static const char * const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char * const DEFAULT_SOCKETEVENTS = "select";
+#endif
 /** The period before a network upgrade activates, where connections to upgrading peers are preferred (in blocks). */
 static const int NETWORK_UPGRADE_PEER_PREFERENCE_BLOCK_PERIOD = 24 * 24 * 3;
 
 extern std::atomic<bool> fNetworkActive;
+extern bool fSocketEventsEpoll;
 extern bool setBannedIsDirty;
 
 unsigned int ReceiveFloodSize();
@@ -97,7 +105,13 @@ unsigned short GetListenPort();
 bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhitelisted = false);
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
-void SocketSendData(CNode *pnode);
+bool SocketSendData(CNode *pnode);
+/**
+ * Turn a buffer holding CMessageHeader::HEADER_SIZE bytes of room followed by
+ * a payload into a complete message, by writing the header in front.
+ */
+void FrameMessage(const char* pszCommand, CSerializeData& vMsg);
+void WakeMessageHandler();
 
 void GetBanned(banmap_t &banmap);
 void SetBanned(const banmap_t &banmap);
@@ -293,8 +307,12 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    // queued messages; a message sent to many peers shares one buffer
+    std::deque<std::shared_ptr<const CSerializeData> > vSendMsg;
     CCriticalSection cs_vSend;
+    // socket readiness last reported by epoll; only used by the socket handler thread
+    bool fRecvReady;
+    bool fSendReady;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
@@ -324,6 +342,9 @@ public:
     bool fNetworkNode;
     bool fSuccessfullyConnected;
     bool fDisconnect;
+    // A message of this peer is being served by a message worker; the message
+    // handler thread leaves the peer alone until it is done.
+    std::atomic<bool> fMessageInFlight;
     // We use fRelayTxes for two purposes -
     // a) it allows us to not relay tx invs before receiving the peer's version message
     // b) the peer may tell us in its version message that we should not relay tx invs
@@ -485,6 +506,10 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage() UNLOCK_FUNCTION(cs_vSend);
 
+    // Queue a message completed by FrameMessage as it is. The buffer is
+    // shared, not copied, so it must not be changed afterwards.
+    void PushSerializedMessage(const std::shared_ptr<const CSerializeData>& pmsg);
+
     void PushVersion();
 
 
@@ -169,6 +169,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "kvupdate", 4 },
     { "z_importkey", 2 },
     { "z_importviewingkey", 2 },
+    { "z_rescan", 0 },
     { "z_getpaymentdisclosure", 1},
     { "z_getpaymentdisclosure", 2},
     // crosschain
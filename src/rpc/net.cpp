@@ -107,7 +107,13 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"inflight_limit\": n,       (numeric) How many blocks may be asked from this peer at once\n"
+            "    \"block_rtt\": n,            (numeric) Smoothed time in seconds until a block request is answered\n"
+            "    \"block_interval\": n,       (numeric) Smoothed time in seconds between blocks while the peer is busy\n"
+            "    \"blocks_received\": n,      (numeric) Requested blocks received from this peer\n"
+            "    \"blocks_reassigned\": n,    (numeric) Block requests moved from this peer to a faster one\n"
+            "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -157,6 +163,11 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("inflight_limit", statestats.nBlocksInFlightLimit));
+            obj.push_back(Pair("block_rtt", statestats.nBlockRttMicros / 1e6));
+            obj.push_back(Pair("block_interval", statestats.nBlockIntervalMicros / 1e6));
+            obj.push_back(Pair("blocks_received", statestats.nBlocksReceived));
+            obj.push_back(Pair("blocks_reassigned", statestats.nBlocksReassigned));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
@@ -428,6 +439,120 @@ UniValue getnettotals(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return obj;
 }
 
+UniValue getmessagestats(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getmessagestats\n"
+            "\nReturns how the P2P messages received so far were processed, per command.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"command\": {\n"
+            "    \"queue\": \"xxxx\",   (string) \"worker\" if served by the worker pool (-msgworkers), else \"handler\"\n"
+            "    \"depth\": n,          (numeric) Messages currently waiting for a worker\n"
+            "    \"processed\": n,      (numeric) Messages processed\n"
+            "    \"avgwait\": n,        (numeric) Average time from receipt until processing started, in microseconds\n"
+            "    \"maxwait\": n,        (numeric) Longest such time, in microseconds\n"
+            "    \"avgtime\": n         (numeric) Average processing time, in microseconds\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmessagestats", "")
+            + HelpExampleRpc("getmessagestats", "")
+       );
+
+    std::map<std::string, CMessageStats> mapStats;
+    GetMessageStats(mapStats);
+
+    UniValue ret(UniValue::VOBJ);
+    BOOST_FOREACH(const PAIRTYPE(std::string, CMessageStats)& item, mapStats)
+    {
+        const CMessageStats& stats = item.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("queue", stats.fWorker ? "worker" : "handler"));
+        obj.push_back(Pair("depth", stats.nQueued));
+        obj.push_back(Pair("processed", stats.nProcessed));
+        obj.push_back(Pair("avgwait", stats.nProcessed ? stats.nTotalWaitMicros / (int64_t)stats.nProcessed : 0));
+        obj.push_back(Pair("maxwait", stats.nMaxWaitMicros));
+        obj.push_back(Pair("avgtime", stats.nProcessed ? stats.nTotalRunMicros / (int64_t)stats.nProcessed : 0));
+        ret.push_back(Pair(item.first, obj));
+    }
+    return ret;
+}
+
+UniValue getdownloadstate(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getdownloadstate\n"
+            "\nReturns the state of the block download scheduler.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"initialblockdownload\": true|false, (boolean) Whether the node is in initial block download\n"
+            "  \"blocks\": n,               (numeric) Height of the active chain\n"
+            "  \"headers\": n,              (numeric) Height of the best known header\n"
+            "  \"window\": n,               (numeric) How far beyond the last block in common with a peer blocks are fetched\n"
+            "  \"inflight\": n,             (numeric) Blocks requested and not yet received\n"
+            "  \"inflight_validated\": n,   (numeric) Of those, blocks whose headers were validated when requested\n"
+            "  \"reassigned\": n,           (numeric) Block requests moved from a late peer to a faster one\n"
+            "  \"stalls\": n,               (numeric) Times the download window had to wait for a single peer\n"
+            "  \"peers\": [\n"
+            "    {\n"
+            "      \"id\": n,               (numeric) Peer index\n"
+            "      \"inflight\": n,         (numeric) Blocks in flight from this peer\n"
+            "      \"inflight_limit\": n,   (numeric) How many blocks may be asked from this peer at once\n"
+            "      \"block_rtt\": n,        (numeric) Smoothed time in seconds until a block request is answered\n"
+            "      \"block_interval\": n,   (numeric) Smoothed time in seconds between blocks while the peer is busy\n"
+            "      \"blocks_received\": n,  (numeric) Requested blocks received from this peer\n"
+            "      \"blocks_reassigned\": n,(numeric) Block requests moved from this peer to a faster one\n"
+            "      \"stalling\": true|false (boolean) Whether this peer is holding back the download window\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdownloadstate", "")
+            + HelpExampleRpc("getdownloadstate", "")
+       );
+
+    CDownloadStats stats;
+    GetDownloadStats(stats);
+
+    UniValue ret(UniValue::VOBJ);
+    {
+        LOCK(cs_main);
+        ret.push_back(Pair("initialblockdownload", IsInitialBlockDownload()));
+        ret.push_back(Pair("blocks", chainActive.Height()));
+        ret.push_back(Pair("headers", pindexBestHeader ? pindexBestHeader->GetHeight() : -1));
+    }
+    ret.push_back(Pair("window", stats.nWindow));
+    ret.push_back(Pair("inflight", stats.nBlocksInFlight));
+    ret.push_back(Pair("inflight_validated", stats.nBlocksInFlightValidHeaders));
+    ret.push_back(Pair("reassigned", stats.nBlocksReassigned));
+    ret.push_back(Pair("stalls", stats.nStalls));
+
+    vector<CNodeStats> vstats;
+    CopyNodeStats(vstats);
+
+    UniValue peers(UniValue::VARR);
+    BOOST_FOREACH(const CNodeStats& nodestats, vstats) {
+        CNodeStateStats statestats;
+        if (!GetNodeStateStats(nodestats.nodeid, statestats))
+            continue;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("id", nodestats.nodeid));
+        obj.push_back(Pair("inflight", (int)statestats.vHeightInFlight.size()));
+        obj.push_back(Pair("inflight_limit", statestats.nBlocksInFlightLimit));
+        obj.push_back(Pair("block_rtt", statestats.nBlockRttMicros / 1e6));
+        obj.push_back(Pair("block_interval", statestats.nBlockIntervalMicros / 1e6));
+        obj.push_back(Pair("blocks_received", statestats.nBlocksReceived));
+        obj.push_back(Pair("blocks_reassigned", statestats.nBlocksReassigned));
+        obj.push_back(Pair("stalling", statestats.fStalling));
+        peers.push_back(obj);
+    }
+    ret.push_back(Pair("peers", peers));
+    return ret;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -663,6 +788,8 @@ static const CRPCCommand commands[] =
     { "network",            "disconnectnode",         &disconnectnode,         true  },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
     { "network",            "getnettotals",           &getnettotals,           true  },
+    { "network",            "getmessagestats",        &getmessagestats,        true  },
+    { "network",            "getdownloadstate",       &getdownloadstate,       true  },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
     { "network",            "setban",                 &setban,                 true  },
     { "network",            "listbanned",             &listbanned,             true  },
@@ -21,6 +21,7 @@
 
 #include "rpc/server.h"
 
+#include "httpserver.h"
 #include "init.h"
 #include "key_io.h"
 #include "random.h"
@@ -306,6 +307,8 @@ static const CRPCCommand vRPCCommands[] =
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
     { "network",            "getconnectioncount",     &getconnectioncount,     true  },
     { "network",            "getnettotals",           &getnettotals,           true  },
+    { "network",            "getmessagestats",        &getmessagestats,        true  },
+    { "network",            "getdownloadstate",       &getdownloadstate,       true  },
     { "network",            "getpeerinfo",            &getpeerinfo,            true  },
     { "network",            "ping",                   &ping,                   true  },
     { "network",            "setban",                 &setban,                 true  },
@@ -478,6 +481,7 @@ static const CRPCCommand vRPCCommands[] =
     { "oracles",       "oraclesdata",      &oraclesdata,        true },
     { "oracles",       "oraclessample",   &oraclessample,     true },
     { "oracles",       "oraclessamples",   &oraclessamples,     true },
+    { "oracles",       "oraclessamplesrange", &oraclessamplesrange, true },
 
     // Prices
     { "prices",       "prices",      &prices,      true },
@@ -539,6 +543,7 @@ static const CRPCCommand vRPCCommands[] =
     { "gateways",       "gatewayspendingdeposits",   &gatewayspendingdeposits,      true },
     { "gateways",       "gatewayspendingwithdraws",   &gatewayspendingwithdraws,      true },
     { "gateways",       "gatewaysprocessed",   &gatewaysprocessed,  true },
+    { "gateways",       "gatewayswait",        &gatewayswait,       true },
 
     // dice
     { "dice",       "dicelist",      &dicelist,         true },
@@ -553,8 +558,10 @@ static const CRPCCommand vRPCCommands[] =
     // tokens & assets
 	{ "tokens",       "assetsaddress",     &assetsaddress,      true },
     { "tokens",       "tokeninfo",        &tokeninfo,         true },
+    { "tokens",       "tokenholders",     &tokenholders,      true },
     { "tokens",       "tokenlist",        &tokenlist,         true },
     { "tokens",       "tokenorders",      &tokenorders,       true },
+    { "tokens",       "tokenorderswait",  &tokenorderswait,   true },
     { "tokens",       "mytokenorders",    &mytokenorders,     true },
     { "tokens",       "tokenaddress",     &tokenaddress,      true },
     { "tokens",       "tokenbalance",     &tokenbalance,      true },
@@ -671,6 +678,7 @@ static const CRPCCommand vRPCCommands[] =
     { "wallet",             "z_getoperationstatus",   &z_getoperationstatus,   true  },
     { "wallet",             "z_getoperationresult",   &z_getoperationresult,   true  },
     { "wallet",             "z_listoperationids",     &z_listoperationids,     true  },
+    { "wallet",             "z_rescan",               &z_rescan,               true  },
     { "wallet",             "z_getnewaddress",        &z_getnewaddress,        true  },
     { "wallet",             "z_listaddresses",        &z_listaddresses,        true  },
     { "wallet",             "z_exportkey",            &z_exportkey,            true  },
@@ -767,6 +775,25 @@ bool IsRPCRunning()
     return fRPCRunning;
 }
 
+static CCriticalSection cs_rpcWaitSlots;
+static int nRPCWaitSlotsUsed = 0;
+
+CRPCWaitSlot::CRPCWaitSlot()
+{
+    LOCK(cs_rpcWaitSlots);
+    int nSlots = std::max((int)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1) / 2;
+    fHeld = nRPCWaitSlotsUsed < nSlots;
+    if (fHeld)
+        nRPCWaitSlotsUsed++;
+}
+
+CRPCWaitSlot::~CRPCWaitSlot()
+{
+    LOCK(cs_rpcWaitSlots);
+    if (fHeld)
+        nRPCWaitSlotsUsed--;
+}
+
 void SetRPCWarmupStatus(const std::string& newStatus)
 {
     LOCK(cs_rpcWarmup);
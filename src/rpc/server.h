@@ -65,6 +65,29 @@ public:
 /** Query whether RPC is running */
 bool IsRPCRunning();
 
+/** Longest time a call waiting for a change, such as tokenorderswait, holds an RPC thread, in seconds */
+static const int64_t MAX_RPC_WAIT_SECONDS = 20;
+
+/**
+ * Slot for a call that waits for a change, such as tokenorderswait. Waiting
+ * calls hold an RPC thread each, so at most half of the -rpcthreads may wait
+ * at once and the others are kept for the remaining calls. A call that gets
+ * no slot returns at once.
+ */
+class CRPCWaitSlot
+{
+public:
+    CRPCWaitSlot();
+    ~CRPCWaitSlot();
+    bool IsHeld() const { return fHeld; }
+
+private:
+    bool fHeld;
+
+    CRPCWaitSlot(const CRPCWaitSlot&);
+    CRPCWaitSlot& operator=(const CRPCWaitSlot&);
+};
+
 /** Get the async queue*/
 std::shared_ptr<AsyncRPCQueue> getAsyncRPCQueue();
 
@@ -225,6 +248,8 @@ extern UniValue addnode(const UniValue& params, bool fHelp, const CPubKey& mypk)
 extern UniValue disconnectnode(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getaddednodeinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getnettotals(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getmessagestats(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getdownloadstate(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue setban(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue listbanned(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue clearbanned(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -249,8 +274,10 @@ extern UniValue estimatefee(const UniValue& params, bool fHelp, const CPubKey& m
 extern UniValue estimatepriority(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue coinsupply(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokeninfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue tokenholders(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokenlist(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue tokenorderswait(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue mytokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue tokenbalance(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue assetsaddress(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -281,6 +308,7 @@ extern UniValue oraclessubscribe(const UniValue& params, bool fHelp, const CPubK
 extern UniValue oraclesdata(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue oraclessample(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue oraclessamples(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue oraclessamplesrange(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue pricesaddress(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue priceslist(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue mypriceslist(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -324,6 +352,7 @@ extern UniValue gatewaysmarkdone(const UniValue& params, bool fHelp, const CPubK
 extern UniValue gatewayspendingdeposits(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue gatewayspendingwithdraws(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue gatewaysprocessed(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue gatewayswait(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue channelslist(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue channelsinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue channelsopen(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -494,6 +523,7 @@ extern UniValue z_exportkey(const UniValue& params, bool fHelp, const CPubKey& m
 extern UniValue z_importkey(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcdump.cpp
 extern UniValue z_exportviewingkey(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcdump.cpp
 extern UniValue z_importviewingkey(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcdump.cpp
+extern UniValue z_rescan(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcdump.cpp
 extern UniValue z_getnewaddress(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcwallet.cpp
 extern UniValue z_listaddresses(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcwallet.cpp
 extern UniValue z_exportwallet(const UniValue& params, bool fHelp, const CPubKey& mypk); // in rpcdump.cpp
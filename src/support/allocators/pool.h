@@ -0,0 +1,144 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * Memory resource for the nodes of node-based containers.
+ *
+ * Single-object allocations of up to MAX_BLOCK_SIZE bytes are carved out of
+ * chunks and returned to a free list per size class on release, so inserting
+ * into and erasing from a map costs no malloc per entry. Larger or array
+ * allocations (such as bucket arrays) go to the heap, but are still counted.
+ * The first chunk is MIN_CHUNK_SIZE bytes and each further one twice the
+ * previous, up to CHUNK_SIZE, so a pool holding a few entries stays small.
+ * Full-size chunks of a pool that no longer hands out any block are returned
+ * to a small process-wide reserve, from which the next pool is served.
+ *
+ * Not thread-safe: like the containers using it, a pool must only be used by
+ * one thread at a time.
+ */
+class CNodePool
+{
+public:
+    static const size_t MIN_CHUNK_SIZE = 4 * 1024;
+    static const size_t CHUNK_SIZE = 256 * 1024;
+    static const size_t ALIGN = sizeof(void*) * 2;
+    static const size_t MAX_BLOCK_SIZE = 512;
+
+    CNodePool();
+    ~CNodePool();
+
+    void* Allocate(size_t nBytes, size_t nCount);
+    void Deallocate(void* p, size_t nBytes, size_t nCount);
+
+    //! Give all chunks back when no pooled block is in use.
+    void Release();
+
+    //! Memory held by the pool, including heap allocations made through it.
+    size_t DynamicMemoryUsage() const;
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    std::vector<void*> vChunks;
+    std::vector<FreeBlock*> vFreeLists;
+    char* pChunkCursor;
+    char* pChunkEnd;
+    size_t nBlocksInUse;
+    size_t nChunkUsage;
+    size_t nHeapUsage;
+
+    CNodePool(const CNodePool&);
+    CNodePool& operator=(const CNodePool&);
+
+    static size_t SizeClass(size_t nBytes) { return (nBytes + ALIGN - 1) / ALIGN; }
+    static size_t ChunkSize(size_t nIndex);
+    void NewChunk();
+};
+
+/**
+ * Allocator drawing from a CNodePool. A default-constructed allocator has no
+ * pool and behaves like std::allocator, so containers declared with it can
+ * still be used stand-alone.
+ */
+template <typename T>
+class pool_allocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef pool_allocator<U> other;
+    };
+
+    CNodePool* pool;
+
+    pool_allocator() : pool(NULL) {}
+    explicit pool_allocator(CNodePool* poolIn) : pool(poolIn) {}
+    template <typename U>
+    pool_allocator(const pool_allocator<U>& other) : pool(other.pool) {}
+
+    T* allocate(std::size_t n)
+    {
+        if (pool)
+            return static_cast<T*>(pool->Allocate(sizeof(T) * n, n));
+        return static_cast<T*>(::operator new(sizeof(T) * n));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (pool)
+            pool->Deallocate(p, sizeof(T) * n, n);
+        else
+            ::operator delete(p);
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        ::new ((void*)p) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U>
+    void destroy(U* p)
+    {
+        p->~U();
+    }
+
+    std::size_t max_size() const { return std::size_t(-1) / sizeof(T); }
+};
+
+template <typename T, typename U>
+bool operator==(const pool_allocator<T>& a, const pool_allocator<U>& b) { return a.pool == b.pool; }
+template <typename T, typename U>
+bool operator!=(const pool_allocator<T>& a, const pool_allocator<U>& b) { return a.pool != b.pool; }
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
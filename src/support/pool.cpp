@@ -0,0 +1,162 @@
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "support/allocators/pool.h"
+
+#include "prevector.h"
+#include "memusage.h"
+
+#include <assert.h>
+
+#include <boost/thread/mutex.hpp>
+
+namespace {
+
+/** Most chunks kept around between pools (16 MiB). */
+static const size_t MAX_RESERVE_CHUNKS = 64;
+
+struct CChunkReserve
+{
+    boost::mutex cs;
+    std::vector<void*> vChunks;
+
+    ~CChunkReserve()
+    {
+        for (size_t i = 0; i < vChunks.size(); i++)
+            ::operator delete(vChunks[i]);
+    }
+} chunkReserve;
+
+void* TakeChunk(size_t nSize)
+{
+    if (nSize == CNodePool::CHUNK_SIZE) {
+        boost::mutex::scoped_lock lock(chunkReserve.cs);
+        if (!chunkReserve.vChunks.empty()) {
+            void* p = chunkReserve.vChunks.back();
+            chunkReserve.vChunks.pop_back();
+            return p;
+        }
+    }
+    return ::operator new(nSize);
+}
+
+void ReturnChunk(void* p, size_t nSize)
+{
+    if (nSize == CNodePool::CHUNK_SIZE) {
+        boost::mutex::scoped_lock lock(chunkReserve.cs);
+        if (chunkReserve.vChunks.size() < MAX_RESERVE_CHUNKS) {
+            chunkReserve.vChunks.push_back(p);
+            return;
+        }
+    }
+    ::operator delete(p);
+}
+
+}
+
+CNodePool::CNodePool() : vFreeLists(SizeClass(MAX_BLOCK_SIZE) + 1, NULL), pChunkCursor(NULL), pChunkEnd(NULL), nBlocksInUse(0), nChunkUsage(0), nHeapUsage(0)
+{
+}
+
+CNodePool::~CNodePool()
+{
+    assert(nBlocksInUse == 0);
+    Release();
+}
+
+size_t CNodePool::ChunkSize(size_t nIndex)
+{
+    size_t nSize = MIN_CHUNK_SIZE;
+    while (nIndex-- > 0 && nSize < CHUNK_SIZE)
+        nSize *= 2;
+    return nSize;
+}
+
+void CNodePool::NewChunk()
+{
+    size_t nSize = ChunkSize(vChunks.size());
+    void* p = TakeChunk(nSize);
+    vChunks.push_back(p);
+    nChunkUsage += memusage::MallocUsage(nSize);
+    pChunkCursor = static_cast<char*>(p);
+    pChunkEnd = pChunkCursor + nSize;
+}
+
+void* CNodePool::Allocate(size_t nBytes, size_t nCount)
+{
+    if (nCount != 1 || nBytes > MAX_BLOCK_SIZE) {
+        nHeapUsage += memusage::MallocUsage(nBytes);
+        return ::operator new(nBytes);
+    }
+
+    size_t nClass = SizeClass(nBytes);
+    nBlocksInUse++;
+    if (FreeBlock* block = vFreeLists[nClass]) {
+        vFreeLists[nClass] = block->next;
+        return block;
+    }
+    size_t nBlockSize = nClass * ALIGN;
+    if (pChunkCursor == NULL || (size_t)(pChunkEnd - pChunkCursor) < nBlockSize) {
+        // The tail of the old chunk is too small for this class; hand it to
+        // the free lists of the classes it does fit.
+        while (pChunkCursor != NULL && (size_t)(pChunkEnd - pChunkCursor) >= ALIGN) {
+            size_t nTailClass = SizeClass(pChunkEnd - pChunkCursor);
+            if (nTailClass * ALIGN > (size_t)(pChunkEnd - pChunkCursor))
+                nTailClass--;
+            FreeBlock* tail = reinterpret_cast<FreeBlock*>(pChunkCursor);
+            tail->next = vFreeLists[nTailClass];
+            vFreeLists[nTailClass] = tail;
+            pChunkCursor += nTailClass * ALIGN;
+        }
+        NewChunk();
+    }
+    void* p = pChunkCursor;
+    pChunkCursor += nBlockSize;
+    return p;
+}
+
+void CNodePool::Deallocate(void* p, size_t nBytes, size_t nCount)
+{
+    if (nCount != 1 || nBytes > MAX_BLOCK_SIZE) {
+        nHeapUsage -= memusage::MallocUsage(nBytes);
+        ::operator delete(p);
+        return;
+    }
+
+    size_t nClass = SizeClass(nBytes);
+    FreeBlock* block = static_cast<FreeBlock*>(p);
+    block->next = vFreeLists[nClass];
+    vFreeLists[nClass] = block;
+    assert(nBlocksInUse > 0);
+    nBlocksInUse--;
+}
+
+void CNodePool::Release()
+{
+    if (nBlocksInUse != 0)
+        return;
+    for (size_t i = 0; i < vChunks.size(); i++)
+        ReturnChunk(vChunks[i], ChunkSize(i));
+    std::vector<void*>().swap(vChunks);
+    nChunkUsage = 0;
+    vFreeLists.assign(vFreeLists.size(), NULL);
+    pChunkCursor = pChunkEnd = NULL;
+}
+
+size_t CNodePool::DynamicMemoryUsage() const
+{
+    return nChunkUsage + nHeapUsage +
+           memusage::DynamicUsage(vChunks) + memusage::DynamicUsage(vFreeLists);
+}
@@ -0,0 +1,193 @@
+#include <gtest/gtest.h>
+
+#include "arith_uint256.h"
+#include "cc/CCassets.h"
+#include "cc/CCinclude.h"
+#include "testutils.h"
+
+
+namespace TestAssetsBook {
+
+    typedef std::set<std::pair<uint256, int64_t> > OrderSet;
+
+    /**
+     * The book is process-wide. Each test starts from an empty one: a
+     * disconnect of an unknown block drops it, and without the address index
+     * it is read again with no orders.
+     */
+    class TestAssetsBook : public ::testing::Test {
+    protected:
+        virtual void SetUp() {
+            CBlock unknown;
+            unknown.nNonce = ArithToUint256(arith_uint256(GetRand(1000000) + 1));
+            AssetsBookBlockDisconnected(unknown);
+        }
+    };
+
+    static uint256 tokenid1 = uint256S("11");
+    static uint256 tokenid2 = uint256S("22");
+    static int nTx = 0;
+
+    static CMutableTransaction NewTx()
+    {
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn(COutPoint(ArithToUint256(arith_uint256(++nTx)), 0), CScript()));
+        return mtx;
+    }
+
+    static CTransaction MakeBid(uint256 tokenid, int64_t amount)
+    {
+        struct CCcontract_info *cp, C;
+        cp = CCinit(&C, EVAL_ASSETS);
+        CMutableTransaction mtx = NewTx();
+        mtx.vout.push_back(MakeCC1vout(EVAL_ASSETS, amount, GetUnspendable(cp, NULL)));
+        std::vector<CPubKey> voutPubkeys;
+        std::vector<uint8_t> origpubkey(notaryKey.GetPubKey().begin(), notaryKey.GetPubKey().end());
+        mtx.vout.push_back(CTxOut(0, EncodeTokenOpRet(tokenid, voutPubkeys,
+            std::make_pair(OPRETID_ASSETSDATA, EncodeAssetOpRet('b', zeroid, amount * 2, origpubkey)))));
+        return CTransaction(mtx);
+    }
+
+    static CTransaction MakeAsk(uint256 tokenid, int64_t amount)
+    {
+        struct CCcontract_info *cp, C;
+        cp = CCinit(&C, EVAL_ASSETS);
+        CPubKey unspendable = GetUnspendable(cp, NULL);
+        CMutableTransaction mtx = NewTx();
+        mtx.vout.push_back(MakeTokensCC1vout(EVAL_ASSETS, 0, amount, unspendable));
+        std::vector<CPubKey> voutPubkeys;
+        voutPubkeys.push_back(unspendable);
+        std::vector<uint8_t> origpubkey(notaryKey.GetPubKey().begin(), notaryKey.GetPubKey().end());
+        mtx.vout.push_back(CTxOut(0, EncodeTokenOpRet(tokenid, voutPubkeys,
+            std::make_pair(OPRETID_ASSETSDATA, EncodeAssetOpRet('s', zeroid, amount * 3, origpubkey)))));
+        return CTransaction(mtx);
+    }
+
+    static CTransaction MakeSpend(const CTransaction &ordertx)
+    {
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn(COutPoint(ordertx.GetHash(), 0), CScript()));
+        mtx.vout.push_back(CTxOut(ordertx.vout[0].nValue, CScript() << OP_TRUE));
+        return CTransaction(mtx);
+    }
+
+    static CBlock MakeBlock(const std::vector<CTransaction> &txs)
+    {
+        static int nBlock = 0;
+        CBlock block;
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].scriptSig = CScript() << ++nBlock;
+        coinbase.vout.push_back(CTxOut(1, CScript() << OP_TRUE));
+        block.vtx.push_back(CTransaction(coinbase));
+        block.vtx.insert(block.vtx.end(), txs.begin(), txs.end());
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        return block;
+    }
+
+    static OrderSet Orders()
+    {
+        OrderSet orders;
+        UniValue result = AssetOrders(zeroid, CPubKey(), 0, 0);
+        for (int i = 0; i < result.size(); i++)
+            orders.insert(std::make_pair(uint256S(result[i]["txid"].get_str()), result[i]["vout"].get_int64()));
+        return orders;
+    }
+
+    static OrderSet Outputs(const CTransaction &tx1, const CTransaction &tx2 = CTransaction())
+    {
+        OrderSet orders;
+        orders.insert(std::make_pair(tx1.GetHash(), 0));
+        if (!tx2.vout.empty())
+            orders.insert(std::make_pair(tx2.GetHash(), 0));
+        return orders;
+    }
+
+    TEST_F(TestAssetsBook, ConnectAndDisconnect)
+    {
+        ASSERT_TRUE(Orders().empty());
+
+        CTransaction bid = MakeBid(tokenid1, 1000), ask = MakeAsk(tokenid1, 5);
+        CBlock block1 = MakeBlock({bid, ask});
+        AssetsBookBlockConnected(block1);
+        EXPECT_EQ(Outputs(bid, ask), Orders());
+
+        // the bid is filled and a new one placed
+        CTransaction bid2 = MakeBid(tokenid2, 2000);
+        CBlock block2 = MakeBlock({MakeSpend(bid), bid2});
+        AssetsBookBlockConnected(block2);
+        EXPECT_EQ(Outputs(ask, bid2), Orders());
+
+        AssetsBookBlockDisconnected(block2);
+        EXPECT_EQ(Outputs(bid, ask), Orders());
+        AssetsBookBlockDisconnected(block1);
+        EXPECT_TRUE(Orders().empty());
+    }
+
+    TEST_F(TestAssetsBook, OrderSpentInItsOwnBlock)
+    {
+        Orders();
+        CTransaction bid = MakeBid(tokenid1, 1000);
+        CBlock block = MakeBlock({bid, MakeSpend(bid)});
+        AssetsBookBlockConnected(block);
+        EXPECT_TRUE(Orders().empty());
+
+        // the undo must not bring back an order that did not exist before the block
+        AssetsBookBlockDisconnected(block);
+        EXPECT_TRUE(Orders().empty());
+    }
+
+    TEST_F(TestAssetsBook, ReorgToOtherBlock)
+    {
+        Orders();
+        CTransaction bid = MakeBid(tokenid1, 1000);
+        CBlock block1 = MakeBlock({bid});
+        AssetsBookBlockConnected(block1);
+
+        CTransaction ask = MakeAsk(tokenid1, 5);
+        CBlock blockA = MakeBlock({MakeSpend(bid), ask});
+        AssetsBookBlockConnected(blockA);
+        EXPECT_EQ(Outputs(ask), Orders());
+
+        // blockA is replaced by blockB, which spends nothing
+        CTransaction ask2 = MakeAsk(tokenid2, 7);
+        AssetsBookBlockDisconnected(blockA);
+        AssetsBookBlockConnected(MakeBlock({ask2}));
+        EXPECT_EQ(Outputs(bid, ask2), Orders());
+    }
+
+    TEST_F(TestAssetsBook, DisconnectBeyondUndoRereads)
+    {
+        Orders();
+        // more blocks than the book keeps undo data for
+        std::vector<CBlock> blocks;
+        for (int i = 0; i < 101; i++) {
+            blocks.push_back(MakeBlock({MakeBid(tokenid1, 1000 + i)}));
+            AssetsBookBlockConnected(blocks.back());
+        }
+        EXPECT_EQ(101u, Orders().size());
+        for (int i = 100; i > 0; i--)
+            AssetsBookBlockDisconnected(blocks[i]);
+        EXPECT_EQ(Outputs(blocks[0].vtx[1]), Orders());
+
+        // the undo of the first block is gone, the book is dropped and read
+        // again from the address index, which has no orders in this test
+        uint64_t sequence = AssetsBookWait(zeroid, 0, 0);
+        AssetsBookBlockDisconnected(blocks[0]);
+        EXPECT_GT(AssetsBookWait(zeroid, 0, 0), sequence);
+        EXPECT_TRUE(Orders().empty());
+    }
+
+    TEST_F(TestAssetsBook, WaitSequencePerToken)
+    {
+        Orders();
+        uint64_t sequence1 = AssetsBookWait(tokenid1, 0, 0);
+        uint64_t sequence2 = AssetsBookWait(tokenid2, 0, 0);
+
+        AssetsBookBlockConnected(MakeBlock({MakeBid(tokenid1, 1000)}));
+        uint64_t after1 = AssetsBookWait(tokenid1, sequence1, 0);
+        EXPECT_GT(after1, sequence1);
+        EXPECT_EQ(sequence2, AssetsBookWait(tokenid2, 0, 0));
+        EXPECT_GE(AssetsBookWait(zeroid, 0, 0), after1);
+    }
+}
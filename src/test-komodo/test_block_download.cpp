@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+
+#include "main.h"
+#include "testutils.h"
+
+
+namespace TestBlockDownload {
+
+    class TestBlockDownload : public ::testing::Test {};
+
+    static const int64_t MS = 1000;
+    static const int64_t SECOND = 1000000;
+
+    TEST(TestBlockDownload, UnmeasuredTakerNeverTakesOver)
+    {
+        EXPECT_FALSE(IsBlockRequestLate(60 * SECOND, 0, 100 * MS, 50 * MS, 100 * MS, 0, 0));
+    }
+
+    TEST(TestBlockDownload, NotBeforeTheMinimumTimeout)
+    {
+        // The owner predicts 150ms, but nothing is reassigned within BLOCK_REASSIGN_TIMEOUT
+        int64_t nElapsed = BLOCK_REASSIGN_TIMEOUT * SECOND - 1;
+        EXPECT_FALSE(IsBlockRequestLate(nElapsed, 0, 100 * MS, 50 * MS, 10 * MS, 10 * MS, 0));
+        EXPECT_TRUE(IsBlockRequestLate(BLOCK_REASSIGN_TIMEOUT * SECOND, 0, 100 * MS, 50 * MS, 10 * MS, 10 * MS, 0));
+    }
+
+    TEST(TestBlockDownload, LateAgainstTheOwnersSpeed)
+    {
+        // The owner should take 500ms + 4 * 500ms for the fourth block in its queue
+        int64_t nExpected = 500 * MS + 4 * 500 * MS;
+        EXPECT_FALSE(IsBlockRequestLate(BLOCK_REASSIGN_FACTOR * nExpected - 1, 3, 500 * MS, 500 * MS, 10 * MS, 10 * MS, 0));
+        EXPECT_TRUE(IsBlockRequestLate(BLOCK_REASSIGN_FACTOR * nExpected, 3, 500 * MS, 500 * MS, 10 * MS, 10 * MS, 0));
+    }
+
+    TEST(TestBlockDownload, UnmeasuredOwnerGetsTheStallingTimeout)
+    {
+        int64_t nExpected = BLOCK_STALLING_TIMEOUT * SECOND;
+        EXPECT_FALSE(IsBlockRequestLate(BLOCK_REASSIGN_FACTOR * nExpected - 1, 0, 0, 0, 10 * MS, 10 * MS, 0));
+        EXPECT_TRUE(IsBlockRequestLate(BLOCK_REASSIGN_FACTOR * nExpected, 0, 0, 0, 10 * MS, 10 * MS, 0));
+    }
+
+    TEST(TestBlockDownload, BusyTakerDoesNotTakeOver)
+    {
+        // Late for the owner, but the taker has so much queued that it would not be faster
+        int64_t nElapsed = 10 * SECOND;
+        EXPECT_TRUE(IsBlockRequestLate(nElapsed, 0, 100 * MS, 100 * MS, 200 * MS, 100 * MS, 10));
+        EXPECT_FALSE(IsBlockRequestLate(nElapsed, 0, 100 * MS, 100 * MS, 200 * MS, 100 * MS, 98));
+        EXPECT_FALSE(IsBlockRequestLate(nElapsed, 0, 100 * MS, 100 * MS, 200 * MS, 100 * MS, 200));
+    }
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include "chain.h"
+#include "main.h"
+#include "txdb.h"
+#include "testutils.h"
+
+
+namespace TestBlockIndexLoad {
+
+    class TestBlockIndexLoad : public ::testing::Test {
+    protected:
+        virtual void SetUp() {
+            setupChain();
+        }
+
+        virtual void TearDown() {
+            UnloadBlockIndex();
+        }
+    };
+
+    static CBlockHeader MakeHeader(uint256 hashPrev, unsigned int nTime)
+    {
+        CBlockHeader header;
+        header.nVersion = 4;
+        header.hashPrevBlock = hashPrev;
+        header.nTime = nTime;
+        header.nBits = 0x200f0f0f;
+        return header;
+    }
+
+    // writes a parent and a child entry to a fresh block tree and returns their hashes
+    static std::pair<uint256, uint256> WriteParentAndChild(CBlockTreeDB &db)
+    {
+        CBlockHeader parentHeader = MakeHeader(uint256(), 1000);
+        uint256 hashParent = parentHeader.GetHash();
+        CBlockIndex parent(parentHeader);
+        parent.phashBlock = &hashParent;
+        parent.SetHeight(7);
+        parent.nTx = 3;
+
+        CBlockHeader childHeader = MakeHeader(hashParent, 2000);
+        uint256 hashChild = childHeader.GetHash();
+        CBlockIndex child(childHeader);
+        child.phashBlock = &hashChild;
+        child.pprev = &parent;
+        child.SetHeight(8);
+
+        std::vector<const CBlockIndex*> vIndex;
+        vIndex.push_back(&parent);
+        vIndex.push_back(&child);
+        EXPECT_TRUE(db.WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, vIndex));
+        return std::make_pair(hashParent, hashChild);
+    }
+
+    TEST_F(TestBlockIndexLoad, FillsForwardReferencedEntry)
+    {
+        CBlockTreeDB db(1 << 20, true);
+        std::pair<uint256, uint256> hashes = WriteParentAndChild(db);
+        UnloadBlockIndex();
+
+        // an entry created before the load, e.g. as the parent of a block
+        CBlockIndex* pforward = InsertBlockIndex(hashes.first);
+        ASSERT_TRUE(pforward != NULL);
+
+        ASSERT_TRUE(db.LoadBlockIndexGuts());
+        ASSERT_EQ(2u, mapBlockIndex.size());
+        ASSERT_EQ(pforward, mapBlockIndex[hashes.first]);
+        EXPECT_EQ(hashes.first, pforward->GetBlockHash());
+        EXPECT_EQ(7, pforward->GetHeight());
+        EXPECT_EQ(1000u, pforward->nTime);
+        EXPECT_EQ(3u, pforward->nTx);
+        EXPECT_TRUE(pforward->pprev == NULL);
+
+        CBlockIndex* pchild = mapBlockIndex[hashes.second];
+        ASSERT_TRUE(pchild != NULL);
+        EXPECT_EQ(pforward, pchild->pprev);
+        EXPECT_EQ(8, pchild->GetHeight());
+        EXPECT_EQ(hashes.second, pchild->GetBlockHash());
+    }
+
+    TEST_F(TestBlockIndexLoad, FillsEmptyEntry)
+    {
+        CBlockTreeDB db(1 << 20, true);
+        std::pair<uint256, uint256> hashes = WriteParentAndChild(db);
+        UnloadBlockIndex();
+
+        mapBlockIndex.insert(std::make_pair(hashes.second, (CBlockIndex*)NULL));
+        ASSERT_TRUE(db.LoadBlockIndexGuts());
+        ASSERT_EQ(2u, mapBlockIndex.size());
+        CBlockIndex* pchild = mapBlockIndex[hashes.second];
+        ASSERT_TRUE(pchild != NULL);
+        EXPECT_EQ(hashes.second, pchild->GetBlockHash());
+        EXPECT_EQ(mapBlockIndex[hashes.first], pchild->pprev);
+        EXPECT_EQ(2000u, pchild->nTime);
+    }
+}
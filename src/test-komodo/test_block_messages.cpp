@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include "chainparams.h"
+#include "main.h"
+#include "net.h"
+#include "util.h"
+#include "testutils.h"
+
+
+namespace TestBlockMessages {
+
+    class TestBlockMessages : public ::testing::Test {
+    protected:
+        boost::filesystem::path pathTemp;
+        std::string strDataDirBefore;
+
+        virtual void SetUp() {
+            strDataDirBefore = mapArgs["-datadir"];
+            pathTemp = GetTempPath() / strprintf("test_block_messages_%li_%i", GetTime(), GetRand(100000));
+            boost::filesystem::create_directories(pathTemp / "blocks");
+            mapArgs["-datadir"] = pathTemp.string();
+            ClearDatadirCache();
+        }
+
+        virtual void TearDown() {
+            mapArgs["-datadir"] = strDataDirBefore;
+            ClearDatadirCache();
+            boost::filesystem::remove_all(pathTemp);
+        }
+    };
+
+    static CBlock MakeBlock(unsigned int nTime)
+    {
+        CBlock block;
+        for (int i = 0; i < 3; i++) {
+            CMutableTransaction mtx;
+            mtx.vin.resize(1);
+            mtx.vin[0].scriptSig = CScript() << OP_1 << i;
+            mtx.vout.push_back(CTxOut(1000 * (i + 1), CScript() << OP_TRUE));
+            block.vtx.push_back(CTransaction(mtx));
+        }
+        block.nVersion = 4;
+        block.nBits = 0x207fffff;
+        block.nTime = nTime;
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        return block;
+    }
+
+    static std::shared_ptr<const CSerializeData> MakeMessage(const std::string& strPayload)
+    {
+        std::shared_ptr<CSerializeData> pmsg = std::make_shared<CSerializeData>(CMessageHeader::HEADER_SIZE);
+        pmsg->insert(pmsg->end(), strPayload.begin(), strPayload.end());
+        FrameMessage("ping", *pmsg);
+        return pmsg;
+    }
+
+    // Check that vMsg is a valid "block" message and return the block in it
+    static CBlock ParseBlockMessage(const CSerializeData& vMsg)
+    {
+        CDataStream ss(vMsg.begin(), vMsg.end(), SER_NETWORK, PROTOCOL_VERSION);
+        CMessageHeader hdr(Params().MessageStart());
+        ss >> hdr;
+        EXPECT_TRUE(hdr.IsValid(Params().MessageStart()));
+        EXPECT_EQ("block", hdr.GetCommand());
+        EXPECT_EQ(vMsg.size() - CMessageHeader::HEADER_SIZE, hdr.nMessageSize);
+        uint256 hash = Hash(vMsg.begin() + CMessageHeader::HEADER_SIZE, vMsg.end());
+        unsigned int nChecksum = 0;
+        memcpy(&nChecksum, &hash, sizeof(nChecksum));
+        EXPECT_EQ(nChecksum, hdr.nChecksum);
+        CBlock block;
+        ss >> block;
+        EXPECT_TRUE(ss.empty());
+        return block;
+    }
+
+    TEST(TestBlockMessages, FrameMessageWritesHeader)
+    {
+        std::shared_ptr<const CSerializeData> pmsg = MakeMessage("payload");
+        ASSERT_EQ((size_t)CMessageHeader::HEADER_SIZE + 7, pmsg->size());
+
+        CDataStream ss(pmsg->begin(), pmsg->end(), SER_NETWORK, PROTOCOL_VERSION);
+        CMessageHeader hdr(Params().MessageStart());
+        ss >> hdr;
+        EXPECT_TRUE(hdr.IsValid(Params().MessageStart()));
+        EXPECT_EQ("ping", hdr.GetCommand());
+        EXPECT_EQ(7u, hdr.nMessageSize);
+        EXPECT_EQ("payload", std::string(ss.begin(), ss.end()));
+    }
+
+    TEST(TestBlockMessages, PushSerializedMessageSharesBuffer)
+    {
+        std::shared_ptr<const CSerializeData> pmsg = MakeMessage("shared");
+        // Without a socket nothing is sent, so the messages stay queued
+        CNode node1(INVALID_SOCKET, CAddress(), "", true);
+        CNode node2(INVALID_SOCKET, CAddress(), "", true);
+        node1.PushSerializedMessage(pmsg);
+        node2.PushSerializedMessage(pmsg);
+
+        ASSERT_EQ(1u, node1.vSendMsg.size());
+        ASSERT_EQ(1u, node2.vSendMsg.size());
+        EXPECT_EQ(pmsg.get(), node1.vSendMsg.front().get());
+        EXPECT_EQ(pmsg.get(), node2.vSendMsg.front().get());
+        EXPECT_EQ(pmsg->size(), node1.nSendSize);
+        EXPECT_EQ(pmsg->size(), node2.nSendSize);
+    }
+
+    TEST(TestBlockMessages, PushSerializedMessageSends)
+    {
+        int fds[2];
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        std::shared_ptr<const CSerializeData> pmsg = MakeMessage("sent as is");
+        {
+            CNode node(fds[0], CAddress(), "", true);
+            node.PushSerializedMessage(pmsg);
+            EXPECT_TRUE(node.vSendMsg.empty());
+            EXPECT_EQ(0u, node.nSendSize);
+            EXPECT_EQ(pmsg->size(), node.nSendBytes);
+            EXPECT_EQ(1, pmsg.use_count());
+        }
+
+        std::vector<char> vReceived(pmsg->size() + 1);
+        ASSERT_EQ((ssize_t)pmsg->size(), recv(fds[1], &vReceived[0], vReceived.size(), MSG_DONTWAIT));
+        vReceived.resize(pmsg->size());
+        EXPECT_TRUE(std::equal(vReceived.begin(), vReceived.end(), pmsg->begin()));
+        close(fds[1]);
+    }
+
+    TEST_F(TestBlockMessages, ReadBlockMessageMatchesBlock)
+    {
+        CBlock block = MakeBlock(1500000001);
+        CDiskBlockPos pos(0, 0);
+        ASSERT_TRUE(WriteBlockToDisk(block, pos, Params().MessageStart()));
+
+        std::shared_ptr<const CSerializeData> pmsg = ReadBlockMessage(pos, block.GetHash(), false);
+        ASSERT_TRUE(pmsg != nullptr);
+        CBlock read = ParseBlockMessage(*pmsg);
+        EXPECT_EQ(block.GetHash(), read.GetHash());
+        EXPECT_EQ(block.hashMerkleRoot, read.BuildMerkleTree());
+
+        // A block that is not the requested one is not served
+        EXPECT_TRUE(ReadBlockMessage(pos, MakeBlock(1500000002).GetHash(), false) == nullptr);
+    }
+
+    TEST_F(TestBlockMessages, HotBlocksShareOneMessage)
+    {
+        CBlock block = MakeBlock(1500000003);
+        CDiskBlockPos pos(0, 0);
+        ASSERT_TRUE(WriteBlockToDisk(block, pos, Params().MessageStart()));
+
+        std::shared_ptr<const CSerializeData> pmsg1 = ReadBlockMessage(pos, block.GetHash(), true);
+        std::shared_ptr<const CSerializeData> pmsg2 = ReadBlockMessage(pos, block.GetHash(), true);
+        ASSERT_TRUE(pmsg1 != nullptr);
+        EXPECT_EQ(pmsg1.get(), pmsg2.get());
+        EXPECT_EQ(block.GetHash(), ParseBlockMessage(*pmsg1).GetHash());
+
+        // Other reads go to the block file and get their own buffer
+        std::shared_ptr<const CSerializeData> pmsgCold = ReadBlockMessage(pos, block.GetHash(), false);
+        ASSERT_TRUE(pmsgCold != nullptr);
+        EXPECT_NE(pmsg1.get(), pmsgCold.get());
+        EXPECT_TRUE(*pmsg1 == *pmsgCold);
+
+        // Once cached, the block is served without its file
+        boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+        EXPECT_TRUE(ReadBlockMessage(pos, block.GetHash(), false) == nullptr);
+        EXPECT_EQ(pmsg1.get(), ReadBlockMessage(pos, block.GetHash(), true).get());
+    }
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include "arith_uint256.h"
+#include "blockencodings.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "testutils.h"
+
+
+namespace TestBlockEncodings {
+
+    class TestBlockEncodings : public ::testing::Test {};
+
+    static CBlock MakeBlock(int nTxs)
+    {
+        CBlock block;
+        for (int i = 0; i < nTxs; i++) {
+            CMutableTransaction mtx;
+            mtx.vin.resize(1);
+            if (i == 0)
+                mtx.vin[0].scriptSig = CScript() << OP_1 << OP_0;
+            else
+                mtx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(i)), 0);
+            mtx.vout.push_back(CTxOut(1000 * (i + 1), CScript() << OP_TRUE));
+            block.vtx.push_back(CTransaction(mtx));
+        }
+        block.nVersion = 4;
+        block.nBits = 0x207fffff;
+        block.nTime = 1500000000;
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        return block;
+    }
+
+    static CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+    {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << cmpctblock;
+        CBlockHeaderAndShortTxIDs decoded;
+        stream >> decoded;
+        return decoded;
+    }
+
+    TEST(TestBlockEncodings, ReconstructFromExtraTransactions)
+    {
+        CBlock block = MakeBlock(4);
+        CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+        ASSERT_EQ(4u, cmpctblock.BlockTxCount());
+
+        CTxMemPool pool(CFeeRate(0));
+        std::vector<std::pair<uint256, CTransactionRef> > extra;
+        for (int i = 1; i < 4; i++)
+            extra.push_back(std::make_pair(block.vtx[i].GetHash(), std::make_shared<const CTransaction>(block.vtx[i])));
+
+        PartiallyDownloadedBlock partial(&pool);
+        ASSERT_EQ(READ_STATUS_OK, partial.InitData(cmpctblock, extra));
+        for (size_t i = 0; i < 4; i++)
+            EXPECT_TRUE(partial.IsTxAvailable(i));
+
+        CBlock filled;
+        ASSERT_EQ(READ_STATUS_OK, partial.FillBlock(filled, std::vector<CTransactionRef>()));
+        EXPECT_EQ(block.GetHash(), filled.GetHash());
+        EXPECT_EQ(block.hashMerkleRoot, filled.BuildMerkleTree());
+    }
+
+    TEST(TestBlockEncodings, ReconstructWithMissingTransactions)
+    {
+        CBlock block = MakeBlock(4);
+        CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+
+        CTxMemPool pool(CFeeRate(0));
+        std::vector<std::pair<uint256, CTransactionRef> > extra;
+        extra.push_back(std::make_pair(block.vtx[2].GetHash(), std::make_shared<const CTransaction>(block.vtx[2])));
+
+        PartiallyDownloadedBlock partial(&pool);
+        ASSERT_EQ(READ_STATUS_OK, partial.InitData(cmpctblock, extra));
+        EXPECT_TRUE(partial.IsTxAvailable(0));  // the coinbase is prefilled
+        EXPECT_FALSE(partial.IsTxAvailable(1));
+        EXPECT_TRUE(partial.IsTxAvailable(2));
+        EXPECT_FALSE(partial.IsTxAvailable(3));
+
+        // The getblocktxn request for the gaps survives the differential index encoding.
+        BlockTransactionsRequest req;
+        req.blockhash = block.GetHash();
+        req.indexes.push_back(1);
+        req.indexes.push_back(3);
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << req;
+        BlockTransactionsRequest decoded;
+        stream >> decoded;
+        EXPECT_EQ(req.blockhash, decoded.blockhash);
+        EXPECT_EQ(req.indexes, decoded.indexes);
+
+        std::vector<CTransactionRef> missing;
+        missing.push_back(std::make_shared<const CTransaction>(block.vtx[1]));
+        missing.push_back(std::make_shared<const CTransaction>(block.vtx[3]));
+        CBlock filled;
+        ASSERT_EQ(READ_STATUS_OK, partial.FillBlock(filled, missing));
+        EXPECT_EQ(block.GetHash(), filled.GetHash());
+        EXPECT_EQ(block.hashMerkleRoot, filled.BuildMerkleTree());
+    }
+
+    TEST(TestBlockEncodings, WrongTransactionFailsMerkleCheck)
+    {
+        CBlock block = MakeBlock(3);
+        CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+
+        CTxMemPool pool(CFeeRate(0));
+        PartiallyDownloadedBlock partial(&pool);
+        ASSERT_EQ(READ_STATUS_OK, partial.InitData(cmpctblock, std::vector<std::pair<uint256, CTransactionRef> >()));
+
+        CBlock other = MakeBlock(5);
+        std::vector<CTransactionRef> missing;
+        missing.push_back(std::make_shared<const CTransaction>(block.vtx[1]));
+        missing.push_back(std::make_shared<const CTransaction>(other.vtx[4]));
+        CBlock filled;
+        EXPECT_EQ(READ_STATUS_FAILED, partial.FillBlock(filled, missing));
+    }
+
+    TEST(TestBlockEncodings, TooFewMissingTransactionsIsInvalid)
+    {
+        CBlock block = MakeBlock(3);
+        CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+
+        CTxMemPool pool(CFeeRate(0));
+        PartiallyDownloadedBlock partial(&pool);
+        ASSERT_EQ(READ_STATUS_OK, partial.InitData(cmpctblock, std::vector<std::pair<uint256, CTransactionRef> >()));
+
+        std::vector<CTransactionRef> missing;
+        missing.push_back(std::make_shared<const CTransaction>(block.vtx[1]));
+        CBlock filled;
+        EXPECT_EQ(READ_STATUS_INVALID, partial.FillBlock(filled, missing));
+    }
+
+    TEST(TestBlockEncodings, EmptyCompactBlockIsInvalid)
+    {
+        CTxMemPool pool(CFeeRate(0));
+        PartiallyDownloadedBlock partial(&pool);
+        CBlockHeaderAndShortTxIDs empty;
+        EXPECT_EQ(READ_STATUS_INVALID, partial.InitData(empty, std::vector<std::pair<uint256, CTransactionRef> >()));
+    }
+}
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include "blockfilewriter.h"
+#include "util.h"
+#include "testutils.h"
+
+
+namespace TestBlockFileWriter {
+
+    class TestBlockFileWriter : public ::testing::Test {
+    protected:
+        boost::filesystem::path pathTemp;
+        std::string strDataDirBefore;
+
+        virtual void SetUp() {
+            strDataDirBefore = mapArgs["-datadir"];
+            pathTemp = GetTempPath() / strprintf("test_blockfilewriter_%li_%i", GetTime(), GetRand(100000));
+            boost::filesystem::create_directories(pathTemp);
+            mapArgs["-datadir"] = pathTemp.string();
+            ClearDatadirCache();
+        }
+
+        virtual void TearDown() {
+            mapArgs["-datadir"] = strDataDirBefore;
+            ClearDatadirCache();
+            boost::filesystem::remove_all(pathTemp);
+        }
+    };
+
+    static const unsigned int RECORD_SIZE = CBlockFileWriter::RECORD_HEADER_SIZE + 100;
+
+    static CSerializeData MakeRecord(unsigned char fill)
+    {
+        return CSerializeData(RECORD_SIZE, fill);
+    }
+
+    static std::vector<unsigned char> ReadFile(bool fUndo, int nFile)
+    {
+        std::vector<unsigned char> vData;
+        boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), fUndo ? "rev" : "blk");
+        FILE* file = fopen(path.string().c_str(), "rb");
+        if (!file)
+            return vData;
+        unsigned char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+            vData.insert(vData.end(), buf, buf + n);
+        fclose(file);
+        return vData;
+    }
+
+    TEST_F(TestBlockFileWriter, WritesInQueueOrder)
+    {
+        CBlockFileWriter writer;
+        writer.Start();
+        for (int i = 0; i < 20; i++) {
+            CSerializeData vData = MakeRecord(i);
+            ASSERT_TRUE(writer.Write(false, CDiskBlockPos(0, i * RECORD_SIZE), vData));
+            EXPECT_TRUE(vData.empty());  // swapped out
+        }
+        // A later record at the same position wins
+        CSerializeData vData = MakeRecord(0xee);
+        ASSERT_TRUE(writer.Write(false, CDiskBlockPos(0, 0), vData));
+        CSerializeData vUndo = MakeRecord(0x77);
+        ASSERT_TRUE(writer.Write(true, CDiskBlockPos(0, 0), vUndo));
+        ASSERT_TRUE(writer.Sync(0, false, 0, 0));
+        writer.Stop();
+
+        std::vector<unsigned char> vBlk = ReadFile(false, 0);
+        ASSERT_EQ(20 * RECORD_SIZE, vBlk.size());
+        for (unsigned int i = 0; i < vBlk.size(); i++)
+            ASSERT_EQ(i < RECORD_SIZE ? 0xee : i / RECORD_SIZE, vBlk[i]);
+        std::vector<unsigned char> vRev = ReadFile(true, 0);
+        ASSERT_EQ(RECORD_SIZE, vRev.size());
+        EXPECT_EQ(0x77, vRev[0]);
+    }
+
+    TEST_F(TestBlockFileWriter, PendingUntilWritten)
+    {
+        CBlockFileWriter writer;
+        writer.Start();
+        CDiskBlockPos pos(1, RECORD_SIZE);
+        CDiskBlockPos posData(1, RECORD_SIZE + CBlockFileWriter::RECORD_HEADER_SIZE);
+        CSerializeData vData = MakeRecord(0x42);
+        ASSERT_TRUE(writer.Write(false, pos, vData));
+
+        // Either still queued and served from memory, or already on disk
+        std::shared_ptr<const CSerializeData> pending = writer.GetPending(false, posData);
+        if (pending) {
+            ASSERT_EQ(RECORD_SIZE, pending->size());
+            EXPECT_EQ(0x42, (*pending)[0]);
+        }
+        EXPECT_FALSE(writer.GetPending(false, pos));
+        EXPECT_FALSE(writer.GetPending(true, posData));
+
+        writer.WaitForFile(false, 1);
+        EXPECT_FALSE(writer.GetPending(false, posData));
+        // Written and flushed, though not synced yet
+        std::vector<unsigned char> vBlk = ReadFile(false, 1);
+        ASSERT_EQ(2 * RECORD_SIZE, vBlk.size());
+        EXPECT_EQ(0x42, vBlk[RECORD_SIZE]);
+        EXPECT_EQ(0x42, vBlk.back());
+
+        // Nothing queued for another file, so this returns at once
+        writer.WaitForFile(false, 2);
+        writer.Stop();
+    }
+
+    TEST_F(TestBlockFileWriter, SyncFinalizeTruncatesPreallocation)
+    {
+        CBlockFileWriter writer;
+        writer.Start();
+        ASSERT_TRUE(writer.Allocate(false, CDiskBlockPos(0, 0), 1 << 20));
+        ASSERT_TRUE(writer.Allocate(true, CDiskBlockPos(0, 0), 1 << 16));
+        for (int i = 0; i < 3; i++) {
+            CSerializeData vData = MakeRecord(i + 1);
+            ASSERT_TRUE(writer.Write(false, CDiskBlockPos(0, i * RECORD_SIZE), vData));
+        }
+        CSerializeData vUndo = MakeRecord(9);
+        ASSERT_TRUE(writer.Write(true, CDiskBlockPos(0, 0), vUndo));
+
+        ASSERT_TRUE(writer.Sync(0, true, 3 * RECORD_SIZE, RECORD_SIZE));
+        // Sync waits for everything queued before it
+        EXPECT_EQ(3 * RECORD_SIZE, ReadFile(false, 0).size());
+        EXPECT_EQ(RECORD_SIZE, ReadFile(true, 0).size());
+        EXPECT_EQ(3, ReadFile(false, 0).back());
+        writer.Stop();
+    }
+
+    TEST_F(TestBlockFileWriter, WritesDirectlyWithoutThread)
+    {
+        CBlockFileWriter writer;
+        CSerializeData vData = MakeRecord(0x11);
+        ASSERT_TRUE(writer.Write(false, CDiskBlockPos(3, 0), vData));
+        EXPECT_FALSE(writer.GetPending(false, CDiskBlockPos(3, CBlockFileWriter::RECORD_HEADER_SIZE)));
+        std::vector<unsigned char> vBlk = ReadFile(false, 3);
+        ASSERT_EQ(RECORD_SIZE, vBlk.size());
+        EXPECT_EQ(0x11, vBlk[0]);
+        ASSERT_TRUE(writer.Sync(3, false, 0, 0));
+    }
+}
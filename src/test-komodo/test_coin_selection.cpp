@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include "wallet/wallet.h"
+#include "testutils.h"
+
+
+namespace TestCoinSelection {
+
+    class TestCoinSelection : public ::testing::Test {};
+
+    typedef std::vector<std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > > CoinValues;
+
+    // coins sorted by descending value, as SelectCoinsMinConf passes them
+    static CoinValues MakeCoins(const std::vector<CAmount> &values)
+    {
+        CoinValues vValue;
+        for (unsigned int i = 0; i < values.size(); i++)
+            vValue.push_back(std::make_pair(values[i], std::make_pair((const CWalletTx*)NULL, i)));
+        return vValue;
+    }
+
+    static CAmount Selected(const CoinValues &vValue, const std::vector<char> &vfBest)
+    {
+        CAmount nTotal = 0;
+        for (unsigned int i = 0; i < vValue.size(); i++)
+            if (vfBest[i])
+                nTotal += vValue[i].first;
+        return nTotal;
+    }
+
+    TEST(TestCoinSelection, BnBFindsExactMatch)
+    {
+        CoinValues vValue = MakeCoins({ 8 * COIN, 5 * COIN, 4 * COIN, 3 * COIN, 1 * COIN });
+        std::vector<char> vfBest;
+        CAmount nBest = 0;
+
+        ASSERT_TRUE(SelectCoinsBnB(vValue, 10 * COIN, 0, vfBest, nBest));
+        EXPECT_EQ(10 * COIN, nBest);
+        EXPECT_EQ(10 * COIN, Selected(vValue, vfBest));
+
+        ASSERT_TRUE(SelectCoinsBnB(vValue, 21 * COIN, 0, vfBest, nBest));
+        EXPECT_EQ(21 * COIN, nBest);
+        for (unsigned int i = 0; i < vValue.size(); i++)
+            EXPECT_TRUE(vfBest[i]);
+    }
+
+    TEST(TestCoinSelection, BnBNoSolution)
+    {
+        CoinValues vValue = MakeCoins({ 4 * COIN, 4 * COIN, 4 * COIN });
+        std::vector<char> vfBest;
+        CAmount nBest = 0;
+
+        // Not enough in total
+        EXPECT_FALSE(SelectCoinsBnB(vValue, 13 * COIN, 0, vfBest, nBest));
+        // Enough, but every subset needs change
+        EXPECT_FALSE(SelectCoinsBnB(vValue, 5 * COIN, COIN / 2, vfBest, nBest));
+        EXPECT_FALSE(SelectCoinsBnB(MakeCoins({}), 1, 0, vfBest, nBest));
+    }
+
+    TEST(TestCoinSelection, BnBChangeWindow)
+    {
+        CoinValues vValue = MakeCoins({ 6 * COIN, 3 * COIN + 300, 3 * COIN + 100, 2 * COIN });
+        std::vector<char> vfBest;
+        CAmount nBest = 0;
+
+        // No exact match, the smallest sum within the window wins
+        ASSERT_TRUE(SelectCoinsBnB(vValue, 9 * COIN, 500, vfBest, nBest));
+        EXPECT_EQ(9 * COIN + 100, nBest);
+        EXPECT_EQ(nBest, Selected(vValue, vfBest));
+        EXPECT_TRUE(vfBest[0]);
+        EXPECT_FALSE(vfBest[1]);
+        EXPECT_TRUE(vfBest[2]);
+        EXPECT_FALSE(vfBest[3]);
+
+        // The window is inclusive of its upper bound, and nothing beyond it is taken
+        ASSERT_TRUE(SelectCoinsBnB(vValue, 9 * COIN, 100, vfBest, nBest));
+        EXPECT_EQ(9 * COIN + 100, nBest);
+        EXPECT_FALSE(SelectCoinsBnB(vValue, 9 * COIN, 99, vfBest, nBest));
+    }
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include "coins.h"
+#include "txdb.h"
+#include "testutils.h"
+
+
+namespace TestCoinsDB {
+
+    class TestCoinsDB : public ::testing::Test {};
+
+    static CCoins MakeCoins(int nOutputs, int nHeight)
+    {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(uint256S("01"), 0);
+        for (int i = 0; i < nOutputs; i++)
+            mtx.vout.push_back(CTxOut(1000 + i, CScript() << OP_TRUE));
+        return CCoins(CTransaction(mtx), nHeight);
+    }
+
+    TEST(TestCoinsDB, SpendOneOutputKeepsTheRest)
+    {
+        CCoinsViewDB db(1 << 20, true);
+        uint256 txid = uint256S("aa");
+        {
+            CCoinsViewCache cache(&db);
+            *cache.ModifyCoins(txid) = MakeCoins(5, 100);
+            ASSERT_TRUE(cache.Flush());
+        }
+        {
+            CCoinsViewCache cache(&db);
+            cache.ModifyCoins(txid)->Spend(2);
+            ASSERT_TRUE(cache.Sync());
+            // Still cached and clean after a sync.
+            ASSERT_EQ(1u, cache.GetCacheSize());
+            cache.ModifyCoins(txid)->Spend(4);
+            ASSERT_TRUE(cache.Flush());
+        }
+
+        CCoins coins;
+        ASSERT_TRUE(db.GetCoins(txid, coins));
+        EXPECT_EQ(100, coins.nHeight);
+        EXPECT_TRUE(coins.IsAvailable(0));
+        EXPECT_TRUE(coins.IsAvailable(1));
+        EXPECT_FALSE(coins.IsAvailable(2));
+        EXPECT_TRUE(coins.IsAvailable(3));
+        EXPECT_FALSE(coins.IsAvailable(4));
+        EXPECT_EQ(1003, coins.vout[3].nValue);
+
+        {
+            CCoinsViewCache cache(&db);
+            {
+                CCoinsModifier modifier = cache.ModifyCoins(txid);
+                modifier->Spend(0);
+                modifier->Spend(1);
+                modifier->Spend(3);
+            }
+            ASSERT_TRUE(cache.Flush());
+        }
+        EXPECT_FALSE(db.HaveCoins(txid));
+        EXPECT_FALSE(db.GetCoins(txid, coins));
+    }
+
+    TEST(TestCoinsDB, OutputsBeyondTheFirstByteRoundTrip)
+    {
+        CCoinsViewDB db(1 << 20, true);
+        uint256 txid = uint256S("bb");
+        {
+            CCoinsViewCache cache(&db);
+            *cache.ModifyCoins(txid) = MakeCoins(20, 7);
+            cache.ModifyCoins(txid)->Spend(0);
+            ASSERT_TRUE(cache.Flush());
+        }
+        {
+            CCoinsViewCache cache(&db);
+            {
+                CCoinsModifier modifier = cache.ModifyCoins(txid);
+                for (int i = 1; i < 19; i++)
+                    modifier->Spend(i);
+            }
+            ASSERT_TRUE(cache.Flush());
+        }
+
+        EXPECT_TRUE(db.HaveCoins(txid));
+        CCoins coins;
+        ASSERT_TRUE(db.GetCoins(txid, coins));
+        EXPECT_EQ(7, coins.nHeight);
+        ASSERT_EQ(20u, coins.vout.size());
+        for (int i = 0; i < 19; i++)
+            EXPECT_FALSE(coins.IsAvailable(i));
+        EXPECT_TRUE(coins.IsAvailable(19));
+        EXPECT_EQ(1019, coins.vout[19].nValue);
+        EXPECT_FALSE(db.HaveCoins(uint256S("cc")));
+    }
+
+    TEST(TestCoinsDB, ManyOutputsReadWithOneSeek)
+    {
+        CCoinsViewDB db(1 << 20, true);
+        uint256 txid = uint256S("dd"), next = uint256S("de");
+        {
+            CCoinsViewCache cache(&db);
+            *cache.ModifyCoins(txid) = MakeCoins(50, 12);
+            *cache.ModifyCoins(next) = MakeCoins(3, 13);
+            ASSERT_TRUE(cache.Flush());
+        }
+        {
+            // leave gaps, and the first and last outputs spent
+            CCoinsViewCache cache(&db);
+            {
+                CCoinsModifier modifier = cache.ModifyCoins(txid);
+                for (int i = 0; i < 50; i += 3)
+                    modifier->Spend(i);
+                modifier->Spend(49);
+            }
+            ASSERT_TRUE(cache.Flush());
+        }
+
+        CCoins coins;
+        ASSERT_TRUE(db.GetCoins(txid, coins));
+        EXPECT_EQ(12, coins.nHeight);
+        ASSERT_EQ(48u, coins.vout.size());
+        for (int i = 0; i < 48; i++)
+            EXPECT_EQ(i % 3 != 0, coins.IsAvailable(i)) << i;
+        EXPECT_EQ(1047, coins.vout[47].nValue);
+
+        // the records of the next transaction are not taken for its own
+        ASSERT_TRUE(db.GetCoins(next, coins));
+        EXPECT_EQ(13, coins.nHeight);
+        ASSERT_EQ(3u, coins.vout.size());
+        EXPECT_EQ(1000, coins.vout[0].nValue);
+    }
+
+    TEST(TestCoinsDB, NewDatabaseGetsVersioned)
+    {
+        CCoinsViewDB db(1 << 20, true);
+        ASSERT_TRUE(db.Upgrade());
+        // Once versioned, opening again is a no-op.
+        ASSERT_TRUE(db.Upgrade());
+    }
+}
@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+
+#include "arith_uint256.h"
+#include "cc/CCGateways.h"
+#include "cc/CCinclude.h"
+#include "testutils.h"
+
+
+#define CC_MARKER_VALUE 10000
+
+CScript EncodeGatewaysDepositOpRet(uint8_t funcid,uint256 bindtxid,std::string refcoin,std::vector<CPubKey> publishers,std::vector<uint256>txids,int32_t height,uint256 cointxid,int32_t claimvout,std::string deposithex,std::vector<uint8_t>proof,CPubKey destpub,int64_t amount);
+CScript EncodeGatewaysWithdrawOpRet(uint8_t funcid,uint256 tokenid,uint256 bindtxid,std::string refcoin,CPubKey withdrawpub,int64_t amount);
+CScript EncodeGatewaysPartialOpRet(uint8_t funcid, uint256 withdrawtxid,std::string refcoin,uint8_t K, CPubKey signerpk,std::string hex);
+CScript EncodeGatewaysCompleteSigningOpRet(uint8_t funcid,uint256 withdrawtxid,std::string refcoin,uint8_t K,std::string hex);
+
+namespace TestGatewaysQueue {
+
+    /**
+     * The queues are process-wide. Each test starts without any: a disconnect
+     * of an unknown block drops them, and without the address index an
+     * address is read again with no markers.
+     */
+    class TestGatewaysQueue : public ::testing::Test {
+    protected:
+        virtual void SetUp() {
+            CBlock unknown;
+            unknown.nNonce = ArithToUint256(arith_uint256(GetRand(1000000) + 1));
+            GatewaysQueueBlockDisconnected(unknown);
+        }
+    };
+
+    static uint256 bindtxid1 = uint256S("b1");
+    static uint256 bindtxid2 = uint256S("b2");
+    static uint256 tokenid = uint256S("70");
+    static int nTx = 0;
+
+    static CPubKey GatewaysPk()
+    {
+        struct CCcontract_info *cp, C;
+        cp = CCinit(&C, EVAL_GATEWAYS);
+        return GetUnspendable(cp, 0);
+    }
+
+    static std::string MarkerAddress(const CPubKey &pk)
+    {
+        char addr[64];
+        _GetCCaddress(addr, EVAL_GATEWAYS, pk);
+        return addr;
+    }
+
+    // a marker tx at the gateways address of pk, spending prevtxid's marker if set
+    static CTransaction MakeMarker(const CPubKey &pk, const CScript &opret, uint256 prevtxid = uint256())
+    {
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn(COutPoint(ArithToUint256(arith_uint256(++nTx)), 1), CScript()));
+        if (!prevtxid.IsNull())
+            mtx.vin.push_back(CTxIn(COutPoint(prevtxid, 0), CScript()));
+        mtx.vout.push_back(MakeCC1vout(EVAL_GATEWAYS, CC_MARKER_VALUE, pk));
+        mtx.vout.push_back(CTxOut(0, opret));
+        return CTransaction(mtx);
+    }
+
+    static CTransaction MakeWithdraw(uint256 bindtxid)
+    {
+        return MakeMarker(GatewaysPk(), EncodeGatewaysWithdrawOpRet('W', tokenid, bindtxid, "KMD", notaryKey.GetPubKey(), 1000));
+    }
+
+    static CTransaction MakePartial(uint256 withdrawtxid, uint256 prevtxid)
+    {
+        return MakeMarker(GatewaysPk(), EncodeGatewaysPartialOpRet('P', withdrawtxid, "KMD", 1, notaryKey.GetPubKey(), "00"), prevtxid);
+    }
+
+    static CTransaction MakeComplete(uint256 withdrawtxid, uint256 prevtxid)
+    {
+        return MakeMarker(GatewaysPk(), EncodeGatewaysCompleteSigningOpRet('S', withdrawtxid, "KMD", 2, "00"), prevtxid);
+    }
+
+    static CTransaction MakeDeposit(uint256 bindtxid, const CPubKey &pk)
+    {
+        return MakeMarker(pk, EncodeGatewaysDepositOpRet('D', bindtxid, "KMD", std::vector<CPubKey>(), std::vector<uint256>(),
+            100, uint256S("c0"), 0, "00", std::vector<uint8_t>(), pk, 1000));
+    }
+
+    static CBlock MakeBlock(const std::vector<CTransaction> &txs)
+    {
+        static int nBlock = 0;
+        CBlock block;
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].scriptSig = CScript() << ++nBlock;
+        coinbase.vout.push_back(CTxOut(1, CScript() << OP_TRUE));
+        block.vtx.push_back(CTransaction(coinbase));
+        block.vtx.insert(block.vtx.end(), txs.begin(), txs.end());
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        return block;
+    }
+
+    static std::set<uint256> Queue(uint256 bindtxid, const CPubKey &pk = GatewaysPk())
+    {
+        std::string addr = MarkerAddress(pk);
+        std::vector<uint256> txids;
+        EXPECT_TRUE(GatewaysQueueTxids(bindtxid, (char *)addr.c_str(), txids));
+        return std::set<uint256>(txids.begin(), txids.end());
+    }
+
+    static std::set<uint256> Txids(const CTransaction &tx)
+    {
+        std::set<uint256> txids;
+        txids.insert(tx.GetHash());
+        return txids;
+    }
+
+    TEST_F(TestGatewaysQueue, WithdrawAndSignings)
+    {
+        ASSERT_TRUE(Queue(bindtxid1).empty());
+
+        CTransaction withdraw = MakeWithdraw(bindtxid1);
+        CBlock block1 = MakeBlock({withdraw});
+        GatewaysQueueBlockConnected(block1);
+        EXPECT_EQ(Txids(withdraw), Queue(bindtxid1));
+
+        // the withdraw tx cannot be read here, the signings take its bindtxid from the queue
+        CTransaction partial = MakePartial(withdraw.GetHash(), withdraw.GetHash());
+        CBlock block2 = MakeBlock({partial});
+        GatewaysQueueBlockConnected(block2);
+        EXPECT_EQ(Txids(partial), Queue(bindtxid1));
+
+        CTransaction complete = MakeComplete(withdraw.GetHash(), partial.GetHash());
+        CBlock block3 = MakeBlock({complete});
+        GatewaysQueueBlockConnected(block3);
+        EXPECT_EQ(Txids(complete), Queue(bindtxid1));
+        EXPECT_TRUE(Queue(bindtxid2).empty());
+
+        GatewaysQueueBlockDisconnected(block3);
+        EXPECT_EQ(Txids(partial), Queue(bindtxid1));
+        GatewaysQueueBlockDisconnected(block2);
+        EXPECT_EQ(Txids(withdraw), Queue(bindtxid1));
+        GatewaysQueueBlockDisconnected(block1);
+        EXPECT_TRUE(Queue(bindtxid1).empty());
+    }
+
+    TEST_F(TestGatewaysQueue, SigningOfUnknownWithdraw)
+    {
+        Queue(bindtxid1);
+        uint64_t sequence = GatewaysQueueWait(notaryKey.GetPubKey(), bindtxid1, 0, 0);
+
+        // its withdraw is read at the next query, and there is none
+        CTransaction partial = MakePartial(uint256S("dead"), uint256S("beef"));
+        GatewaysQueueBlockConnected(MakeBlock({partial}));
+        EXPECT_GT(GatewaysQueueWait(notaryKey.GetPubKey(), bindtxid1, 0, 0), sequence);
+        EXPECT_TRUE(Queue(bindtxid1).empty());
+    }
+
+    TEST_F(TestGatewaysQueue, MarkerSpentInItsOwnBlock)
+    {
+        Queue(bindtxid1);
+        CTransaction withdraw = MakeWithdraw(bindtxid1);
+        CTransaction partial = MakePartial(withdraw.GetHash(), withdraw.GetHash());
+        CBlock block = MakeBlock({withdraw, partial});
+        GatewaysQueueBlockConnected(block);
+        EXPECT_EQ(Txids(partial), Queue(bindtxid1));
+
+        // the undo must not bring back a marker that did not exist before the block
+        GatewaysQueueBlockDisconnected(block);
+        EXPECT_TRUE(Queue(bindtxid1).empty());
+    }
+
+    TEST_F(TestGatewaysQueue, QueuesByBindtxidAndAddress)
+    {
+        CPubKey pk = notaryKey.GetPubKey();
+        Queue(bindtxid1);
+        Queue(bindtxid1, pk);
+        uint64_t sequence2 = GatewaysQueueWait(pk, bindtxid2, 0, 0);
+
+        CTransaction withdraw = MakeWithdraw(bindtxid1), deposit = MakeDeposit(bindtxid1, pk);
+        GatewaysQueueBlockConnected(MakeBlock({withdraw, deposit}));
+        EXPECT_EQ(Txids(withdraw), Queue(bindtxid1));
+        EXPECT_EQ(Txids(deposit), Queue(bindtxid1, pk));
+        EXPECT_TRUE(Queue(bindtxid2).empty());
+        EXPECT_GT(GatewaysQueueWait(pk, bindtxid1, sequence2, 0), sequence2);
+        EXPECT_EQ(sequence2, GatewaysQueueWait(pk, bindtxid2, 0, 0));
+    }
+
+    TEST_F(TestGatewaysQueue, DisconnectBeyondUndoRereads)
+    {
+        Queue(bindtxid1);
+        // more blocks than the queues keep undo data for
+        std::vector<CBlock> blocks;
+        for (int i = 0; i < 101; i++) {
+            blocks.push_back(MakeBlock({MakeWithdraw(bindtxid1)}));
+            GatewaysQueueBlockConnected(blocks.back());
+        }
+        EXPECT_EQ(101u, Queue(bindtxid1).size());
+        for (int i = 100; i > 0; i--)
+            GatewaysQueueBlockDisconnected(blocks[i]);
+        EXPECT_EQ(Txids(blocks[0].vtx[1]), Queue(bindtxid1));
+
+        // the undo of the first block is gone, the queues are dropped and read
+        // again from the address index, which has no markers in this test
+        uint64_t sequence = GatewaysQueueWait(notaryKey.GetPubKey(), bindtxid1, 0, 0);
+        GatewaysQueueBlockDisconnected(blocks[0]);
+        EXPECT_GT(GatewaysQueueWait(notaryKey.GetPubKey(), bindtxid1, 0, 0), sequence);
+        EXPECT_TRUE(Queue(bindtxid1).empty());
+    }
+}
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+
+#include "keystore.h"
+#include "random.h"
+#include "script/standard.h"
+
+
+namespace TestKeystore {
+
+    static std::vector<CKeyID> AddNewKeys(CBasicKeyStore &keyStore, int n)
+    {
+        std::vector<CKeyID> keyIDs;
+        for (int i = 0; i < n; i++) {
+            CKey key;
+            key.MakeNewKey(true);
+            EXPECT_TRUE(keyStore.AddKey(key));
+            keyIDs.push_back(key.GetPubKey().GetID());
+        }
+        return keyIDs;
+    }
+
+    static int CountFalsePositives(const CBasicKeyStore &keyStore, int n)
+    {
+        int nFalsePositives = 0;
+        for (int i = 0; i < n; i++) {
+            uint160 unknown;
+            GetRandBytes(unknown.begin(), unknown.size());
+            if (keyStore.MayHaveKey(CKeyID(unknown)))
+                nFalsePositives++;
+        }
+        return nFalsePositives;
+    }
+
+    TEST(TestKeystore, OwnedFilterCoversKeysScriptsAndWatchOnly)
+    {
+        CBasicKeyStore keyStore;
+        CKey key;
+        key.MakeNewKey(true);
+        CPubKey pubkey = key.GetPubKey();
+        CScript redeemScript = GetScriptForDestination(pubkey.GetID());
+        CScript watchScript = GetScriptForDestination(CScriptID(redeemScript));
+
+        // an empty keystore owns nothing
+        EXPECT_FALSE(keyStore.MayHaveKey(pubkey.GetID()));
+        EXPECT_FALSE(keyStore.MayHaveCScript(CScriptID(redeemScript)));
+        EXPECT_FALSE(keyStore.MayHaveWatchOnly(watchScript));
+
+        ASSERT_TRUE(keyStore.AddKeyPubKey(key, pubkey));
+        ASSERT_TRUE(keyStore.AddCScript(redeemScript));
+        ASSERT_TRUE(keyStore.AddWatchOnly(watchScript));
+        EXPECT_TRUE(keyStore.MayHaveKey(pubkey.GetID()));
+        EXPECT_TRUE(keyStore.MayHaveCScript(CScriptID(redeemScript)));
+        EXPECT_TRUE(keyStore.MayHaveWatchOnly(watchScript));
+
+        // growing past the initial capacity rebuilds the filter without losing entries
+        std::vector<CKeyID> keyIDs = AddNewKeys(keyStore, 2500);
+        for (const CKeyID& keyID : keyIDs)
+            EXPECT_TRUE(keyStore.MayHaveKey(keyID));
+        EXPECT_TRUE(keyStore.MayHaveKey(pubkey.GetID()));
+        EXPECT_TRUE(keyStore.MayHaveWatchOnly(watchScript));
+
+        // keys it does not hold are almost always rejected
+        EXPECT_LT(CountFalsePositives(keyStore, 1000), 10);
+    }
+
+    TEST(TestKeystore, OwnedFilterBeyondP2PSizeLimit)
+    {
+        // a CBloomFilter held to MAX_BLOOM_FILTER_SIZE at this rate saturates
+        // at about 15000 keys and then passes most unknown keys
+        CBasicKeyStore keyStore;
+        std::vector<CKeyID> keyIDs = AddNewKeys(keyStore, 40000);
+        for (const CKeyID& keyID : keyIDs)
+            ASSERT_TRUE(keyStore.MayHaveKey(keyID));
+        EXPECT_LT(CountFalsePositives(keyStore, 10000), 20);
+    }
+}
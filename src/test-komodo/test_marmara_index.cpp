@@ -0,0 +1,220 @@
+#include <gtest/gtest.h>
+
+#include "arith_uint256.h"
+#include "base58.h"
+#include "cc/CCinclude.h"
+#include "cc/CCMarmara.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "testutils.h"
+
+
+extern bool fAddressIndex;
+
+CScript Marmara_scriptPubKey(int32_t height,CPubKey pk);
+CScript MarmaraCoinbaseOpret(uint8_t funcid,int32_t height,CPubKey pk);
+
+namespace TestMarmaraIndex {
+
+    /**
+     * The index is process-wide. Each test starts from an empty one: a
+     * disconnect of an unknown block drops the activated addresses, and they
+     * are read again from the address index of a fresh chain. Txs that are in
+     * the address index are also put in the mempool, where myGetTransaction()
+     * finds them when the address is loaded.
+     */
+    class TestMarmaraIndex : public ::testing::Test {
+    protected:
+        bool fAddressIndexBefore;
+
+        virtual void SetUp() {
+            setupChain();
+            fAddressIndexBefore = fAddressIndex;
+            fAddressIndex = true;
+            CBlock unknown;
+            unknown.nNonce = ArithToUint256(arith_uint256(GetRand(1000000) + 1));
+            MarmaraBlockDisconnected(unknown);
+        }
+
+        virtual void TearDown() {
+            mempool.clear();
+            fAddressIndex = fAddressIndexBefore;
+        }
+    };
+
+    static const CAmount STAKE = 1000;
+    static int nTx = 0;
+
+    static std::string ActivatedAddress(const CPubKey &pk)
+    {
+        char addr[64];
+        Getscriptaddress(addr, Marmara_scriptPubKey(2, pk));
+        return addr;
+    }
+
+    static CPubKey OtherPk()
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        return key.GetPubKey();
+    }
+
+    // a tx paying STAKE to the activated address of pk, with the coinbase opret of opretpk
+    static CTransaction MakeStake(const CPubKey &pk, const CPubKey &opretpk, uint8_t funcid = 'C')
+    {
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn(COutPoint(ArithToUint256(arith_uint256(++nTx)), 0), CScript()));
+        mtx.vout.push_back(CTxOut(STAKE, Marmara_scriptPubKey(2, pk)));
+        mtx.vout.push_back(CTxOut(0, MarmaraCoinbaseOpret(funcid, 2, opretpk)));
+        return CTransaction(mtx);
+    }
+
+    static CTransaction MakeSpend(const COutPoint &prevout)
+    {
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn(prevout, CScript()));
+        mtx.vout.push_back(CTxOut(STAKE, CScript() << OP_TRUE));
+        return CTransaction(mtx);
+    }
+
+    static void AddToMempool(const CTransaction &tx)
+    {
+        mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 0, GetTime(), 0, 1, true, false, 0));
+    }
+
+    // put vout 0 of tx in the address index as confirmed at height
+    static void AddToAddressIndex(const CTransaction &tx, int height)
+    {
+        uint160 hashBytes;
+        int type = 0;
+        ASSERT_TRUE(CBitcoinAddress(ActivatedAddress(notaryKey.GetPubKey())).GetIndexKey(hashBytes, type, true));
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vect;
+        vect.push_back(std::make_pair(CAddressUnspentKey(type, hashBytes, tx.GetHash(), 0),
+                                      CAddressUnspentValue(tx.vout[0].nValue, tx.vout[0].scriptPubKey, height)));
+        ASSERT_TRUE(pblocktree->UpdateAddressUnspentIndex(vect));
+        AddToMempool(tx);
+    }
+
+    static CBlock MakeBlock(const std::vector<CTransaction> &txs)
+    {
+        static int nBlock = 0;
+        CBlock block;
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].scriptSig = CScript() << ++nBlock;
+        coinbase.vout.push_back(CTxOut(1, CScript() << OP_TRUE));
+        block.vtx.push_back(CTransaction(coinbase));
+        block.vtx.insert(block.vtx.end(), txs.begin(), txs.end());
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        return block;
+    }
+
+    // the txids of the stakes of pk the staker sees
+    static std::set<uint256> Stakes(const CPubKey &pk = notaryKey.GetPubKey())
+    {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+        std::string addr = ActivatedAddress(pk);
+        MarmaraActivatedUnspents(unspentOutputs, (char *)addr.c_str(), pk);
+        std::set<uint256> txids;
+        for (int i = 0; i < unspentOutputs.size(); i++) {
+            EXPECT_EQ(STAKE, unspentOutputs[i].second.satoshis);
+            txids.insert(unspentOutputs[i].first.txhash);
+        }
+        EXPECT_EQ(unspentOutputs.size(), txids.size());
+        return txids;
+    }
+
+    static std::set<uint256> Txids(const std::vector<CTransaction> &txs)
+    {
+        std::set<uint256> txids;
+        for (int i = 0; i < txs.size(); i++)
+            txids.insert(txs[i].GetHash());
+        return txids;
+    }
+
+    TEST_F(TestMarmaraIndex, LoadedThenConnected)
+    {
+        CPubKey pk = notaryKey.GetPubKey();
+        CTransaction indexed = MakeStake(pk, pk);
+        AddToAddressIndex(indexed, 2);
+        EXPECT_EQ(Txids({indexed}), Stakes());
+
+        // outputs at the address with the opret of another pk, or without a coinbase opret, are not stakes of pk
+        CTransaction stake = MakeStake(pk, pk), lock = MakeStake(pk, pk, 'L');
+        CTransaction other = MakeStake(pk, OtherPk()), plain = MakeStake(pk, pk, 'X');
+        MarmaraBlockConnected(4, MakeBlock({stake, lock, other, plain}));
+        EXPECT_EQ(Txids({indexed, stake, lock}), Stakes());
+
+        MarmaraBlockConnected(5, MakeBlock({MakeSpend(COutPoint(indexed.GetHash(), 0))}));
+        EXPECT_EQ(Txids({stake, lock}), Stakes());
+    }
+
+    TEST_F(TestMarmaraIndex, DisconnectUndoes)
+    {
+        CPubKey pk = notaryKey.GetPubKey();
+        CTransaction indexed = MakeStake(pk, pk);
+        AddToAddressIndex(indexed, 2);
+        Stakes();
+
+        CTransaction stake = MakeStake(pk, pk);
+        CBlock block1 = MakeBlock({stake});
+        CBlock block2 = MakeBlock({MakeSpend(COutPoint(indexed.GetHash(), 0)), MakeSpend(COutPoint(stake.GetHash(), 0))});
+        MarmaraBlockConnected(4, block1);
+        MarmaraBlockConnected(5, block2);
+        EXPECT_TRUE(Stakes().empty());
+
+        MarmaraBlockDisconnected(block2);
+        EXPECT_EQ(Txids({indexed, stake}), Stakes());
+        MarmaraBlockDisconnected(block1);
+        EXPECT_EQ(Txids({indexed}), Stakes());
+    }
+
+    TEST_F(TestMarmaraIndex, StakeSpentInItsOwnBlock)
+    {
+        CPubKey pk = notaryKey.GetPubKey();
+        Stakes();
+        CTransaction stake = MakeStake(pk, pk);
+        CBlock block = MakeBlock({stake, MakeSpend(COutPoint(stake.GetHash(), 0))});
+        MarmaraBlockConnected(4, block);
+        EXPECT_TRUE(Stakes().empty());
+
+        // the undo must not bring back an output that did not exist before the block
+        MarmaraBlockDisconnected(block);
+        EXPECT_TRUE(Stakes().empty());
+    }
+
+    TEST_F(TestMarmaraIndex, MempoolSpendsLeftOut)
+    {
+        CPubKey pk = notaryKey.GetPubKey();
+        CTransaction indexed = MakeStake(pk, pk);
+        AddToAddressIndex(indexed, 2);
+        EXPECT_EQ(Txids({indexed}), Stakes());
+
+        AddToMempool(MakeSpend(COutPoint(indexed.GetHash(), 0)));
+        EXPECT_TRUE(Stakes().empty());
+    }
+
+    TEST_F(TestMarmaraIndex, DisconnectBeyondUndoRereads)
+    {
+        CPubKey pk = notaryKey.GetPubKey();
+        CTransaction indexed = MakeStake(pk, pk);
+        AddToAddressIndex(indexed, 2);
+        Stakes();
+
+        // more blocks than the index keeps undo data for
+        std::vector<CBlock> blocks;
+        for (int i = 0; i < 101; i++) {
+            blocks.push_back(MakeBlock({MakeStake(pk, pk)}));
+            MarmaraBlockConnected(4 + i, blocks.back());
+        }
+        EXPECT_EQ(102u, Stakes().size());
+        for (int i = 100; i > 0; i--)
+            MarmaraBlockDisconnected(blocks[i]);
+        EXPECT_EQ(Txids({indexed, blocks[0].vtx[1]}), Stakes());
+
+        // the undo of the first block is gone, the address is dropped and read
+        // again from the address index, which only has the first stake
+        MarmaraBlockDisconnected(blocks[0]);
+        EXPECT_EQ(Txids({indexed}), Stakes());
+    }
+}
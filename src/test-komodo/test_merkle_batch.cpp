@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include "random.h"
+#include "zcash/IncrementalMerkleTree.hpp"
+#include "testutils.h"
+
+
+namespace TestMerkleBatch {
+
+    class TestMerkleBatch : public ::testing::Test {};
+
+    /**
+     * Append blocks of random sizes to a tree, and check that witnesses
+     * brought over each block with append_batch end up exactly as witnesses
+     * that appended every commitment, including witnesses of commitments of
+     * the block itself.
+     */
+    template<typename Tree, typename Witness>
+    void CheckBatchMatchesSerial(uint64_t nLeaves, int nMaxBlock)
+    {
+        Tree tree;
+        std::vector<Witness> witnesses;
+        uint64_t nAppended = 0;
+
+        while (nAppended < nLeaves) {
+            uint64_t nBlock = std::min<uint64_t>(GetRandInt(nMaxBlock + 1), nLeaves - nAppended);
+            std::vector<Witness> serial = witnesses;
+            std::vector<Witness> newSerial, newBatch;
+
+            auto batch = tree.batch();
+            for (uint64_t i = 0; i < nBlock; i++) {
+                uint256 commitment = GetRandHash();
+                tree.append(commitment);
+                batch.append(commitment);
+                for (Witness& witness : serial)
+                    witness.append(commitment);
+                for (Witness& witness : newSerial)
+                    witness.append(commitment);
+                if (GetRandInt(4) == 0) {
+                    newSerial.push_back(tree.witness());
+                    newBatch.push_back(tree.witness());
+                }
+            }
+            nAppended += nBlock;
+            ASSERT_EQ(tree.size(), batch.size());
+
+            for (size_t i = 0; i < witnesses.size(); i++) {
+                witnesses[i].append_batch(batch);
+                ASSERT_TRUE(witnesses[i] == serial[i]);
+                ASSERT_EQ(tree.root(), witnesses[i].root());
+            }
+            for (size_t i = 0; i < newBatch.size(); i++) {
+                newBatch[i].append_batch(batch);
+                ASSERT_TRUE(newBatch[i] == newSerial[i]);
+                ASSERT_EQ(tree.root(), newBatch[i].root());
+                witnesses.push_back(newBatch[i]);
+            }
+            if (witnesses.size() > 64)
+                witnesses.erase(witnesses.begin(), witnesses.begin() + 32);
+        }
+    }
+
+    TEST(TestMerkleBatch, SproutWitnessesMatchSerialAppend)
+    {
+        CheckBatchMatchesSerial<SproutMerkleTree, SproutWitness>(2000, 40);
+    }
+
+    TEST(TestMerkleBatch, WitnessesMatchSerialAppendUntilTheTreeIsFull)
+    {
+        for (int i = 0; i < 20; i++)
+            CheckBatchMatchesSerial<SproutTestingMerkleTree, SproutTestingWitness>(16, 5);
+    }
+
+    TEST(TestMerkleBatch, SaplingWitnessesMatchSerialAppend)
+    {
+        CheckBatchMatchesSerial<SaplingMerkleTree, SaplingWitness>(300, 20);
+    }
+
+    TEST(TestMerkleBatch, EmptyBatchLeavesTheWitnessAlone)
+    {
+        SproutMerkleTree tree;
+        tree.append(GetRandHash());
+        SproutWitness witness = tree.witness();
+        tree.append(GetRandHash());
+        witness.append(tree.last());
+
+        SproutWitness before = witness;
+        witness.append_batch(tree.batch());
+        EXPECT_TRUE(witness == before);
+        EXPECT_EQ(tree.root(), witness.root());
+    }
+}
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include <boost/thread.hpp>
+
+#include "cc/CCPayments.h"
+#include "testutils.h"
+
+
+namespace TestPaymentsSnapshot {
+
+    class TestPaymentsSnapshot : public ::testing::Test {
+    protected:
+        virtual void TearDown() {
+            std::vector <std::pair<CAmount, CTxDestination>> vEmpty;
+            komodo_setaddresssnapshot(0, vEmpty);
+        }
+    };
+
+    static std::vector<CTxDestination> MakeDestinations(int n)
+    {
+        std::vector<CTxDestination> vDest;
+        for (int i = 0; i < n; i++) {
+            CKey key;
+            key.MakeNewKey(true);
+            vDest.push_back(key.GetPubKey().GetID());
+        }
+        return vDest;
+    }
+
+    // a snapshot paying amounts[i] to vDest[i], highest first as komodo_dailysnapshot sorts it
+    static void SetSnapshot(int32_t height, const std::vector<CTxDestination> &vDest, const std::vector<CAmount> &amounts)
+    {
+        std::vector <std::pair<CAmount, CTxDestination>> vSnapshot;
+        for (int i = 0; i < vDest.size(); i++)
+            vSnapshot.push_back(std::make_pair(amounts[i], vDest[i]));
+        komodo_setaddresssnapshot(height, vSnapshot);
+    }
+
+    static int32_t Allocations(int32_t top, int32_t bottom, const std::vector<std::vector<uint8_t>> &excluded, std::vector<int64_t> &allocations, int64_t &total)
+    {
+        std::vector<CScript> scriptPubKeys;
+        mpz_t mpzTotal;
+        mpz_init(mpzTotal);
+        int32_t n = payments_getallocations(top, bottom, excluded, mpzTotal, scriptPubKeys, allocations);
+        total = mpz_get_si(mpzTotal);
+        mpz_clear(mpzTotal);
+        EXPECT_EQ(allocations.size(), scriptPubKeys.size());
+        return n;
+    }
+
+    TEST_F(TestPaymentsSnapshot, AllocationsFollowTheSnapshot)
+    {
+        std::vector<CTxDestination> vDest = MakeDestinations(5);
+        SetSnapshot(10, vDest, {500, 400, 300, 200, 100});
+        std::vector<std::vector<uint8_t>> excluded;
+        std::vector<int64_t> allocations;
+        int64_t total;
+        ASSERT_EQ(3, Allocations(3, 0, excluded, allocations, total));
+        EXPECT_EQ(std::vector<int64_t>({500, 400, 300}), allocations);
+        EXPECT_EQ(1200, total);
+
+        // an excluded address is skipped and the next one taken in its place
+        CScript script = GetScriptForDestination(vDest[1]);
+        excluded.push_back(std::vector<uint8_t>(script.begin(), script.end()));
+        allocations.clear();
+        ASSERT_EQ(3, Allocations(4, 1, excluded, allocations, total));
+        EXPECT_EQ(std::vector<int64_t>({300, 200, 100}), allocations);
+
+        // a new snapshot is not answered from the allocations cached for the old one
+        SetSnapshot(11, vDest, {50, 40, 30, 20, 10});
+        allocations.clear();
+        ASSERT_EQ(3, Allocations(3, 0, std::vector<std::vector<uint8_t>>(), allocations, total));
+        EXPECT_EQ(std::vector<int64_t>({50, 40, 30}), allocations);
+        EXPECT_EQ(120, total);
+    }
+
+    TEST_F(TestPaymentsSnapshot, ReplacedWhileRead)
+    {
+        std::vector<CTxDestination> vDest = MakeDestinations(100);
+        std::vector<CAmount> ones(vDest.size(), 1), twos(vDest.size(), 2);
+        SetSnapshot(20, vDest, ones);
+
+        // the snapshots alternate, each at its own height
+        boost::thread replacer([&]() {
+            for (int i = 0; i < 2000; i++)
+                SetSnapshot(21 + i, vDest, i % 2 ? ones : twos);
+        });
+        int nMixed = 0;
+        for (int i = 0; i < 2000; i++) {
+            std::vector<int64_t> allocations;
+            int64_t total;
+            if (Allocations(50, 0, std::vector<std::vector<uint8_t>>(), allocations, total) != 50 ||
+                std::count(allocations.begin(), allocations.end(), allocations[0]) != 50 ||
+                total != 50 * allocations[0])
+                nMixed++;
+        }
+        replacer.join();
+        EXPECT_EQ(0, nMixed);
+    }
+}
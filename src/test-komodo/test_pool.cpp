@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <set>
+
+#include "coins.h"
+#include "support/allocators/pool.h"
+#include "testutils.h"
+
+
+namespace TestPool {
+
+    class TestPool : public ::testing::Test {};
+
+    static const size_t CHUNK_SIZE = CNodePool::CHUNK_SIZE;
+    static const size_t MIN_CHUNK_SIZE = CNodePool::MIN_CHUNK_SIZE;
+
+    TEST(TestPool, FreedBlocksAreReused)
+    {
+        CNodePool pool;
+        void* p1 = pool.Allocate(40, 1);
+        void* p2 = pool.Allocate(40, 1);
+        EXPECT_NE(p1, p2);
+        size_t nUsage = pool.DynamicMemoryUsage();
+
+        pool.Deallocate(p1, 40, 1);
+        // A block of the same size class comes back from the free list
+        void* p3 = pool.Allocate(33, 1);
+        EXPECT_EQ(p1, p3);
+        EXPECT_EQ(nUsage, pool.DynamicMemoryUsage());
+
+        pool.Deallocate(p2, 40, 1);
+        pool.Deallocate(p3, 33, 1);
+    }
+
+    TEST(TestPool, ChunksGrowUpToChunkSize)
+    {
+        CNodePool pool;
+        size_t nEmpty = pool.DynamicMemoryUsage();
+        EXPECT_LT(nEmpty, MIN_CHUNK_SIZE);
+
+        std::vector<void*> vBlocks;
+        vBlocks.push_back(pool.Allocate(64, 1));
+        size_t nOne = pool.DynamicMemoryUsage();
+        EXPECT_GE(nOne, nEmpty + MIN_CHUNK_SIZE);
+        EXPECT_LT(nOne, nEmpty + 2 * MIN_CHUNK_SIZE);
+
+        // Enough blocks for several chunks, the last ones of full size
+        while (vBlocks.size() * 64 < 4 * CHUNK_SIZE)
+            vBlocks.push_back(pool.Allocate(64, 1));
+        size_t nMany = pool.DynamicMemoryUsage();
+        EXPECT_GE(nMany, vBlocks.size() * 64);
+        EXPECT_LT(nMany, vBlocks.size() * 64 + 2 * CHUNK_SIZE);
+
+        for (size_t i = 0; i < vBlocks.size(); i++)
+            pool.Deallocate(vBlocks[i], 64, 1);
+        EXPECT_EQ(nMany, pool.DynamicMemoryUsage());
+        pool.Release();
+        EXPECT_EQ(nEmpty, pool.DynamicMemoryUsage());
+    }
+
+    TEST(TestPool, HeapAllocationsAreCounted)
+    {
+        CNodePool pool;
+        size_t nEmpty = pool.DynamicMemoryUsage();
+        void* p = pool.Allocate(4 * CNodePool::MAX_BLOCK_SIZE, 1);
+        EXPECT_GE(pool.DynamicMemoryUsage(), nEmpty + 4 * CNodePool::MAX_BLOCK_SIZE);
+        EXPECT_LT(pool.DynamicMemoryUsage(), nEmpty + MIN_CHUNK_SIZE);
+        void* pArray = pool.Allocate(8 * 16, 16);
+        pool.Deallocate(p, 4 * CNodePool::MAX_BLOCK_SIZE, 1);
+        pool.Deallocate(pArray, 8 * 16, 16);
+        EXPECT_EQ(nEmpty, pool.DynamicMemoryUsage());
+    }
+
+    TEST(TestPool, ReleaseWaitsForBlocksInUse)
+    {
+        CNodePool pool;
+        void* p = pool.Allocate(16, 1);
+        size_t nUsage = pool.DynamicMemoryUsage();
+        pool.Release();
+        EXPECT_EQ(nUsage, pool.DynamicMemoryUsage());
+        pool.Deallocate(p, 16, 1);
+    }
+
+    TEST(TestPool, ContainerNodesAreReused)
+    {
+        CNodePool pool;
+        {
+            typedef std::map<int, int, std::less<int>, pool_allocator<std::pair<const int, int> > > PoolMap;
+            PoolMap map((std::less<int>()), PoolMap::allocator_type(&pool));
+            for (int i = 0; i < 1000; i++)
+                map[i] = i;
+            size_t nUsage = pool.DynamicMemoryUsage();
+            for (int round = 0; round < 10; round++) {
+                for (int i = 0; i < 1000; i++)
+                    map.erase(i);
+                for (int i = 0; i < 1000; i++)
+                    map[i + round] = i;
+            }
+            EXPECT_EQ(nUsage, pool.DynamicMemoryUsage());
+            EXPECT_EQ(1000u, map.size());
+        }
+        pool.Release();
+    }
+
+    TEST(TestPool, SmallCoinsViewStaysSmall)
+    {
+        CCoinsView base;
+        CCoinsViewCache cache(&base);
+        EXPECT_LT(cache.DynamicMemoryUsage(), MIN_CHUNK_SIZE);
+
+        CMutableTransaction mtx;
+        mtx.vout.push_back(CTxOut(1000, CScript() << OP_TRUE));
+        *cache.ModifyCoins(uint256S("aa")) = CCoins(CTransaction(mtx), 100);
+        EXPECT_EQ(1u, cache.GetCacheSize());
+        EXPECT_LT(cache.DynamicMemoryUsage(), CHUNK_SIZE / 8);
+    }
+}
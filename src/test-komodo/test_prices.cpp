@@ -0,0 +1,320 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <limits>
+
+#include "arith_uint256.h"
+#include "cc/CCPrices.h"
+#include "random.h"
+#include "testutils.h"
+
+
+CScript prices_addopret(uint256 bettxid,CPubKey mypk,int64_t amount);
+
+namespace TestPrices {
+
+    class TestPrices : public ::testing::Test {};
+
+    static uint16_t RandomIndex()
+    {
+        return GetRandInt(KOMODO_MAXPRICES);
+    }
+
+    // A term of a synthetic: one to three prices combined into one, then weighted
+    static void AppendTerm(std::vector<uint16_t> &vec)
+    {
+        static const uint16_t ops3[] = { PRICES_MDD, PRICES_MMD, PRICES_MMM, PRICES_DDD };
+        switch (GetRandInt(4)) {
+        case 0:
+            vec.push_back(RandomIndex());
+            break;
+        case 1:
+            vec.push_back(RandomIndex());
+            vec.push_back(PRICES_INV);
+            break;
+        case 2:
+            vec.push_back(RandomIndex());
+            vec.push_back(RandomIndex());
+            vec.push_back(GetRandInt(2) ? PRICES_MULT : PRICES_DIV);
+            break;
+        default:
+            vec.push_back(RandomIndex());
+            vec.push_back(RandomIndex());
+            vec.push_back(RandomIndex());
+            vec.push_back(ops3[GetRandInt(4)]);
+            break;
+        }
+        if (GetRandInt(4) == 0)
+            vec.push_back(PRICES_INV);
+        vec.push_back(PRICES_WEIGHT | (1 + GetRandInt(KOMODO_MAXPRICES - 1)));
+    }
+
+    // A random synthetic, sometimes with one opcode replaced so that it is malformed.
+    // The stack never holds more than the interpreter's four prices.
+    static std::vector<uint16_t> RandomSynthetic()
+    {
+        static const uint16_t ops[] = { PRICES_WEIGHT | 1, PRICES_MULT, PRICES_DIV, PRICES_INV, PRICES_MDD, PRICES_MMD, PRICES_MMM, PRICES_DDD };
+        std::vector<uint16_t> vec;
+        int nTerms = 1 + GetRandInt(3);
+        for (int i = 0; i < nTerms; i++)
+            AppendTerm(vec);
+        if (GetRandInt(4) == 0) {
+            std::vector<uint16_t> mutated = vec;
+            size_t pos = GetRandInt(mutated.size());
+            mutated[pos] = GetRandInt(3) ? ops[GetRandInt(8)] : RandomIndex();
+            int depth = 0;
+            for (size_t i = 0; i < mutated.size() && depth <= 4; i++)
+                if ((mutated[i] & KOMODO_PRICEMASK) == 0)
+                    depth++;
+                else if (depth > 0 && mutated[i] != PRICES_INV)
+                    depth--;
+            if (depth <= 4)
+                vec = mutated;
+        }
+        return vec;
+    }
+
+    static int64_t RandomPrice()
+    {
+        switch (GetRandInt(16)) {
+        case 0:
+            return 0;
+        case 1:
+            return 1 + GetRand(std::numeric_limits<int64_t>::max() - 1);
+        default:
+            // mostly around the scale of real prices, 1e-4 to 1e4 coins
+            uint64_t nScale = 10000;
+            for (int e = GetRandInt(9); e > 0; e--)
+                nScale *= 10;
+            return 1 + GetRand(nScale);
+        }
+    }
+
+    static bool HasOpcode(const std::vector<uint16_t> &vec, uint16_t opcode)
+    {
+        return std::find(vec.begin(), vec.end(), opcode) != vec.end();
+    }
+
+    TEST(TestPrices, PlanMatchesInterpreter)
+    {
+        int nTests = 0, nPlanned = 0;
+        for (int n = 0; n < 500; n++) {
+            std::vector<uint16_t> vec = RandomSynthetic();
+            int32_t numinds = 0;
+            for (size_t i = 0; i < vec.size(); i++)
+                if ((vec[i] & KOMODO_PRICEMASK) == 0)
+                    numinds++;
+
+            // numblocks heights of prices laid out as komodo_pricegetbatch returns them
+            int32_t numblocks = 1 + GetRandInt(16);
+            std::vector<int64_t> prices(numinds * numblocks * PRICES_MAXDATAPOINTS);
+            std::vector<int32_t> retvals(numinds, 0);
+            for (int32_t ind = 0; ind < numinds; ind++)
+                for (int32_t j = 0; j < numblocks; j++)
+                    prices[((size_t)ind * numblocks + j) * PRICES_MAXDATAPOINTS + 2] = RandomPrice();
+
+            for (int32_t j = 0; j < numblocks; j++) {
+                int64_t interpreted = prices_interpretpricedata(vec, &prices[0], &retvals[0], numblocks, j);
+                int64_t price = -1;
+                bool fPlanned = prices_evalsynthetic(vec, &prices[0], numblocks, j, price);
+                nTests++;
+                if (fPlanned) {
+                    nPlanned++;
+                    EXPECT_EQ(interpreted, price);
+                    EXPECT_GE(price, 0);
+                } else if (!HasOpcode(vec, PRICES_MMM)) {
+                    // Only the range check of "***" declines what the interpreter can compute
+                    EXPECT_LT(interpreted, 0);
+                }
+            }
+        }
+#ifdef __SIZEOF_INT128__
+        EXPECT_GT(nPlanned, nTests / 4);
+#else
+        EXPECT_EQ(0, nPlanned);
+#endif
+    }
+
+    TEST(TestPrices, ZeroPriceFailsBothWays)
+    {
+        std::vector<uint16_t> vec;
+        vec.push_back(1);
+        vec.push_back(2);
+        vec.push_back(PRICES_DIV);
+        vec.push_back(PRICES_WEIGHT | 1);
+
+        std::vector<int64_t> prices(2 * PRICES_MAXDATAPOINTS);
+        std::vector<int32_t> retvals(2, 0);
+        prices[2] = 3 * SATOSHIDEN;
+        prices[PRICES_MAXDATAPOINTS + 2] = 2 * SATOSHIDEN;
+        int64_t price = 0;
+        EXPECT_EQ(3 * SATOSHIDEN / 2, prices_interpretpricedata(vec, &prices[0], &retvals[0], 1, 0));
+#ifdef __SIZEOF_INT128__
+        ASSERT_TRUE(prices_evalsynthetic(vec, &prices[0], 1, 0, price));
+        EXPECT_EQ(3 * SATOSHIDEN / 2, price);
+#endif
+
+        prices[PRICES_MAXDATAPOINTS + 2] = 0;
+        EXPECT_FALSE(prices_evalsynthetic(vec, &prices[0], 1, 0, price));
+        EXPECT_LT(prices_interpretpricedata(vec, &prices[0], &retvals[0], 1, 0), 0);
+    }
+
+    TEST(TestPrices, DivisionByZeroFailsBothWays)
+    {
+        // The product of two tiny prices truncates to zero before it is inverted
+        std::vector<uint16_t> vec;
+        vec.push_back(1);
+        vec.push_back(2);
+        vec.push_back(PRICES_MULT);
+        vec.push_back(PRICES_INV);
+        vec.push_back(PRICES_WEIGHT | 1);
+
+        std::vector<int64_t> prices(2 * PRICES_MAXDATAPOINTS);
+        std::vector<int32_t> retvals(2, 0);
+        prices[2] = 1;
+        prices[PRICES_MAXDATAPOINTS + 2] = 1;
+        int64_t price = 0;
+        EXPECT_FALSE(prices_evalsynthetic(vec, &prices[0], 1, 0, price));
+        EXPECT_LT(prices_interpretpricedata(vec, &prices[0], &retvals[0], 1, 0), 0);
+    }
+
+    /**
+     * The bet scans are process-wide. Each test starts without any: a
+     * disconnect at height 0 drops them all. The bets open far above the tip,
+     * so no prices are read and a scan stays at its first height.
+     */
+    class TestPricesScans : public ::testing::Test {
+    protected:
+        virtual void SetUp() {
+            PricesBlockDisconnected(0);
+        }
+    };
+
+    static const int32_t FIRSTHEIGHT = 1000000;
+
+    static BetInfo MakeBet(int32_t firstheight)
+    {
+        BetInfo betinfo;
+        betinfo.leverage = 10;
+        betinfo.vecparsed.push_back(1);
+        betinfo.vecparsed.push_back(PRICES_WEIGHT | 1);
+        betinfo.isOpen = true;
+        OneBetData bet;
+        bet.positionsize = 1000;
+        bet.firstheight = firstheight;
+        betinfo.bets.push_back(bet);
+        return betinfo;
+    }
+
+    static uint256 BetTxid(int n)
+    {
+        return ArithToUint256(arith_uint256(n + 1));
+    }
+
+    static void Scan(uint256 bettxid, BetInfo betinfo)
+    {
+        ASSERT_EQ(0, prices_scanchain(bettxid, betinfo));
+    }
+
+    static int32_t NumPositions(uint256 bettxid)
+    {
+        int32_t height, numpositions;
+        return PricesBetScanInfo(bettxid, height, numpositions) ? numpositions : -1;
+    }
+
+    // a block adding a position to each of bettxids
+    static CBlock MakeAddFundingBlock(const std::vector<uint256> &bettxids)
+    {
+        CBlock block;
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vout.push_back(CTxOut(1, CScript() << OP_TRUE));
+        block.vtx.push_back(CTransaction(coinbase));
+        for (int i = 0; i < bettxids.size(); i++) {
+            CMutableTransaction mtx;
+            mtx.vin.push_back(CTxIn(COutPoint(bettxids[i], 0), CScript()));
+            mtx.vout.push_back(CTxOut(0, prices_addopret(bettxids[i], notaryKey.GetPubKey(), 500)));
+            block.vtx.push_back(CTransaction(mtx));
+        }
+        return block;
+    }
+
+    TEST_F(TestPricesScans, KeptAndResumed)
+    {
+        uint256 bettxid = BetTxid(0);
+        int32_t height, numpositions;
+        ASSERT_FALSE(PricesBetScanInfo(bettxid, height, numpositions));
+
+        Scan(bettxid, MakeBet(FIRSTHEIGHT));
+        ASSERT_TRUE(PricesBetScanInfo(bettxid, height, numpositions));
+        EXPECT_EQ(FIRSTHEIGHT, height);
+        EXPECT_EQ(1, numpositions);
+
+        // a position opened after the scanned height is added to the kept scan
+        BetInfo betinfo = MakeBet(FIRSTHEIGHT);
+        OneBetData added;
+        added.positionsize = 500;
+        added.firstheight = FIRSTHEIGHT + 5;
+        betinfo.bets.push_back(added);
+        Scan(bettxid, betinfo);
+        EXPECT_EQ(2, NumPositions(bettxid));
+
+        // a bet it does not match replaces it
+        BetInfo other = MakeBet(FIRSTHEIGHT);
+        other.leverage = 20;
+        Scan(bettxid, other);
+        EXPECT_EQ(1, NumPositions(bettxid));
+    }
+
+    TEST_F(TestPricesScans, LeastRecentlyUsedTrimmed)
+    {
+        for (int n = 0; n < PRICES_MAXSCANS; n++)
+            Scan(BetTxid(n), MakeBet(FIRSTHEIGHT));
+        for (int n = 0; n < PRICES_MAXSCANS; n++)
+            ASSERT_EQ(1, NumPositions(BetTxid(n)));
+
+        // use the first again, so the second is now the least recently used
+        Scan(BetTxid(0), MakeBet(FIRSTHEIGHT));
+        Scan(BetTxid(PRICES_MAXSCANS), MakeBet(FIRSTHEIGHT));
+        EXPECT_EQ(1, NumPositions(BetTxid(0)));
+        EXPECT_EQ(-1, NumPositions(BetTxid(1)));
+        EXPECT_EQ(1, NumPositions(BetTxid(2)));
+        EXPECT_EQ(1, NumPositions(BetTxid(PRICES_MAXSCANS)));
+    }
+
+    TEST_F(TestPricesScans, ConnectedBlocksAddPositions)
+    {
+        uint256 bettxid = BetTxid(0), unknown = BetTxid(1);
+        Scan(bettxid, MakeBet(FIRSTHEIGHT));
+
+        std::vector<uint256> bettxids;
+        bettxids.push_back(bettxid);
+        bettxids.push_back(unknown);
+        PricesBlockConnected(FIRSTHEIGHT + 2, MakeAddFundingBlock(bettxids));
+        EXPECT_EQ(2, NumPositions(bettxid));
+        EXPECT_EQ(-1, NumPositions(unknown));
+
+        // a block below the scanned height is not taken
+        PricesBlockConnected(FIRSTHEIGHT - 1, MakeAddFundingBlock(bettxids));
+        EXPECT_EQ(2, NumPositions(bettxid));
+    }
+
+    TEST_F(TestPricesScans, DisconnectDropsLaterPositionsAndBets)
+    {
+        uint256 bettxid = BetTxid(0), later = BetTxid(1);
+        Scan(bettxid, MakeBet(FIRSTHEIGHT));
+        Scan(later, MakeBet(FIRSTHEIGHT + 5));
+        PricesBlockConnected(FIRSTHEIGHT + 2, MakeAddFundingBlock(std::vector<uint256>(1, bettxid)));
+        ASSERT_EQ(2, NumPositions(bettxid));
+
+        PricesBlockDisconnected(FIRSTHEIGHT + 2);
+        int32_t height, numpositions;
+        ASSERT_TRUE(PricesBetScanInfo(bettxid, height, numpositions));
+        EXPECT_EQ(1, numpositions);
+        EXPECT_EQ(FIRSTHEIGHT, height);
+        EXPECT_EQ(-1, NumPositions(later));
+
+        PricesBlockDisconnected(FIRSTHEIGHT);
+        EXPECT_EQ(-1, NumPositions(bettxid));
+    }
+}
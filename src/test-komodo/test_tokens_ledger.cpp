@@ -0,0 +1,230 @@
+#include <gtest/gtest.h>
+
+#include "arith_uint256.h"
+#include "cc/CCinclude.h"
+#include "cc/CCtokens.h"
+#include "txmempool.h"
+#include "testutils.h"
+
+
+extern bool fAddressIndex;
+
+namespace TestTokensLedger {
+
+    /**
+     * The ledger is process-wide. Each test starts from an empty one: a
+     * disconnect of an unknown block drops it, and it is read again from an
+     * empty address index. The token txs and the txs they spend are put in
+     * the mempool, where myGetTransaction() finds them when they are checked.
+     */
+    class TestTokensLedger : public ::testing::Test {
+    protected:
+        bool fAddressIndexBefore;
+
+        virtual void SetUp() {
+            setupChain();
+            fAddressIndexBefore = fAddressIndex;
+            fAddressIndex = true;
+            CBlock unknown;
+            unknown.nNonce = ArithToUint256(arith_uint256(GetRand(1000000) + 1));
+            Disconnect(unknown);
+        }
+
+        virtual void TearDown() {
+            mempool.clear();
+            fAddressIndex = fAddressIndexBefore;
+        }
+
+    public:
+        static void Connect(const CBlock &block) {
+            LOCK(cs_main);
+            TokensLedgerBlockConnected(block);
+        }
+
+        static void Disconnect(const CBlock &block) {
+            LOCK(cs_main);
+            TokensLedgerBlockDisconnected(block);
+        }
+    };
+
+    static const int64_t SUPPLY = 1000;
+    static int nTx = 0;
+
+    static CPubKey OtherPk()
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        return key.GetPubKey();
+    }
+
+    static std::string TokensAddress(const CPubKey &pk)
+    {
+        char addr[64];
+        Getscriptaddress(addr, MakeTokensCC1vout(EVAL_TOKENS, 0, pk).scriptPubKey);
+        return addr;
+    }
+
+    static void AddToMempool(const CTransaction &tx)
+    {
+        mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 0, GetTime(), 0, 1, true, false, 0));
+    }
+
+    // a token creation by notaryKey, funded from the mempool
+    static CTransaction MakeCreate()
+    {
+        struct CCcontract_info *cp, C;
+        cp = CCinit(&C, EVAL_TOKENS);
+        CPubKey pk = notaryKey.GetPubKey();
+
+        CMutableTransaction funding;
+        funding.vin.push_back(CTxIn(COutPoint(ArithToUint256(arith_uint256(++nTx)), 0), CScript()));
+        funding.vout.push_back(CTxOut(SUPPLY + 20000, CScript() << ToByteVector(pk) << OP_CHECKSIG));
+        AddToMempool(CTransaction(funding));
+
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn(COutPoint(funding.GetHash(), 0), CScript()));
+        mtx.vout.push_back(MakeCC1vout(EVAL_TOKENS, 10000, GetUnspendable(cp, NULL)));
+        mtx.vout.push_back(MakeTokensCC1vout(EVAL_TOKENS, SUPPLY, pk));
+        mtx.vout.push_back(CTxOut(0, EncodeTokenCreateOpRet('c', std::vector<uint8_t>(pk.begin(), pk.end()), "T", "test", vscript_t())));
+        AddToMempool(CTransaction(mtx));
+        return CTransaction(mtx);
+    }
+
+    // a transfer of tokenid to pk that the token checks reject, spending prevout if set
+    static CTransaction MakeFakeTransfer(uint256 tokenid, const CPubKey &pk, COutPoint prevout = COutPoint())
+    {
+        CMutableTransaction mtx;
+        mtx.vin.push_back(prevout.IsNull() ? CTxIn(COutPoint(ArithToUint256(arith_uint256(++nTx)), 0), CScript()) : CTxIn(prevout, CScript()));
+        mtx.vout.push_back(MakeTokensCC1vout(EVAL_TOKENS, SUPPLY, pk));
+        std::vector<CPubKey> voutPubkeys;
+        voutPubkeys.push_back(pk);
+        mtx.vout.push_back(CTxOut(0, EncodeTokenOpRet(tokenid, voutPubkeys, std::vector<std::pair<uint8_t, vscript_t> >())));
+        AddToMempool(CTransaction(mtx));
+        return CTransaction(mtx);
+    }
+
+    static CBlock MakeBlock(const std::vector<CTransaction> &txs)
+    {
+        static int nBlock = 0;
+        CBlock block;
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].scriptSig = CScript() << ++nBlock;
+        coinbase.vout.push_back(CTxOut(1, CScript() << OP_TRUE));
+        block.vtx.push_back(CTransaction(coinbase));
+        block.vtx.insert(block.vtx.end(), txs.begin(), txs.end());
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        return block;
+    }
+
+    static int64_t Balance(uint256 tokenid, const CPubKey &pk)
+    {
+        int64_t balance = -1;
+        EXPECT_TRUE(TokensLedgerBalance(tokenid, TokensAddress(pk), balance, NULL));
+        return balance;
+    }
+
+    TEST_F(TestTokensLedger, CreationCheckedAtQuery)
+    {
+        CTransaction create = MakeCreate();
+        uint256 tokenid = create.GetHash();
+        ASSERT_EQ(0, Balance(tokenid, notaryKey.GetPubKey()));
+
+        Connect(MakeBlock({create}));
+        EXPECT_EQ(SUPPLY, Balance(tokenid, notaryKey.GetPubKey()));
+
+        // the marker at the tokens global address is not a token output
+        int64_t burned = -1;
+        int32_t holders = -1;
+        ASSERT_TRUE(TokensLedgerInfo(tokenid, burned, holders));
+        EXPECT_EQ(0, burned);
+        EXPECT_EQ(1, holders);
+    }
+
+    TEST_F(TestTokensLedger, InvalidOutputsAreDropped)
+    {
+        CTransaction create = MakeCreate();
+        uint256 tokenid = create.GetHash();
+        CPubKey pk2 = OtherPk();
+        Balance(tokenid, pk2);
+
+        Connect(MakeBlock({create}));
+        Connect(MakeBlock({MakeFakeTransfer(tokenid, pk2)}));
+        EXPECT_EQ(0, Balance(tokenid, pk2));
+        EXPECT_EQ(SUPPLY, Balance(tokenid, notaryKey.GetPubKey()));
+        int64_t burned;
+        int32_t holders;
+        ASSERT_TRUE(TokensLedgerInfo(tokenid, burned, holders));
+        EXPECT_EQ(1, holders);
+    }
+
+    TEST_F(TestTokensLedger, SpentBeforeCheckedAndDisconnected)
+    {
+        CTransaction create = MakeCreate();
+        uint256 tokenid = create.GetHash();
+        CPubKey pk2 = OtherPk();
+        Balance(tokenid, pk2);
+
+        // nothing is checked until the first query of the token
+        CBlock block1 = MakeBlock({create});
+        CBlock block2 = MakeBlock({MakeFakeTransfer(tokenid, pk2, COutPoint(tokenid, 1))});
+        Connect(block1);
+        Connect(block2);
+        EXPECT_EQ(0, Balance(tokenid, notaryKey.GetPubKey()));
+        EXPECT_EQ(0, Balance(tokenid, pk2));
+
+        Disconnect(block2);
+        EXPECT_EQ(SUPPLY, Balance(tokenid, notaryKey.GetPubKey()));
+        Disconnect(block1);
+        EXPECT_EQ(0, Balance(tokenid, notaryKey.GetPubKey()));
+    }
+
+    TEST_F(TestTokensLedger, OutputSpentInItsOwnBlock)
+    {
+        CTransaction create = MakeCreate();
+        uint256 tokenid = create.GetHash();
+        Balance(tokenid, notaryKey.GetPubKey());
+
+        CBlock block = MakeBlock({create, MakeFakeTransfer(tokenid, OtherPk(), COutPoint(tokenid, 1))});
+        Connect(block);
+        EXPECT_EQ(0, Balance(tokenid, notaryKey.GetPubKey()));
+
+        // the undo must not bring back an output that did not exist before the block
+        Disconnect(block);
+        EXPECT_EQ(0, Balance(tokenid, notaryKey.GetPubKey()));
+    }
+
+    TEST_F(TestTokensLedger, DisconnectBeyondUndoRereads)
+    {
+        CTransaction create = MakeCreate();
+        uint256 tokenid = create.GetHash();
+        Balance(tokenid, notaryKey.GetPubKey());
+        Connect(MakeBlock({create}));
+        EXPECT_EQ(SUPPLY, Balance(tokenid, notaryKey.GetPubKey()));
+
+        // the ledger is dropped and read again from the address index, which is empty here
+        CBlock unknown = MakeBlock({});
+        Disconnect(unknown);
+        EXPECT_EQ(0, Balance(tokenid, notaryKey.GetPubKey()));
+    }
+
+    TEST_F(TestTokensLedger, WrittenAndReadAtSameTip)
+    {
+        CTransaction create = MakeCreate();
+        uint256 tokenid = create.GetHash();
+        Balance(tokenid, notaryKey.GetPubKey());
+        CBlock block = MakeBlock({create});
+        Connect(block);
+        EXPECT_EQ(SUPPLY, Balance(tokenid, notaryKey.GetPubKey()));
+        TokensLedgerWrite();
+
+        // dropped, then read back instead of from the empty address index
+        Disconnect(MakeBlock({}));
+        TokensLedgerRead();
+        EXPECT_EQ(SUPPLY, Balance(tokenid, notaryKey.GetPubKey()));
+
+        // the undo is read as well
+        Disconnect(block);
+        EXPECT_EQ(0, Balance(tokenid, notaryKey.GetPubKey()));
+    }
+}
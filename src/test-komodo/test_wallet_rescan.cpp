@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+
+#include "asyncrpcqueue.h"
+#include "rpc/server.h"
+#include "wallet/asyncrpcoperation_rescan.h"
+#include "wallet/wallet.h"
+#include "wallet/walletdb.h"
+#include "testutils.h"
+
+
+extern std::atomic<bool> fRequestShutdown;
+
+namespace TestWalletRescan {
+
+    /**
+     * Each test runs on a fresh chain of a few blocks paying notaryKey and a
+     * wallet in a mock database. The operations are taken off the async RPC
+     * queue and run on the test thread.
+     */
+    class TestWalletRescan : public ::testing::Test {
+    protected:
+        CWallet *pwallet;
+
+        virtual void SetUp() {
+            setupChain();
+            for (int i = 0; i < 5; i++)
+                generateBlock(NULL);
+            bitdb.MakeMock();
+            pwallet = new CWallet("wallet_rescan_test.dat");
+            bool fFirstRun;
+            ASSERT_EQ(DB_LOAD_OK, pwallet->LoadWallet(fFirstRun));
+        }
+
+        virtual void TearDown() {
+            fRequestShutdown = false;
+            delete pwallet;
+            bitdb.Flush(true);
+            bitdb.Reset();
+        }
+
+    public:
+        std::shared_ptr<AsyncRPCOperation> Queue(int nHeight) {
+            return getAsyncRPCQueue()->popOperationForId(QueueWalletRescan(pwallet, nHeight));
+        }
+
+        int PendingHeight() {
+            LOCK(pwallet->cs_wallet);
+            CWalletDB walletdb(pwallet->strWalletFile);
+            int nHeight = -1;
+            return walletdb.ReadRescanHeight(nHeight) ? nHeight : -1;
+        }
+
+        void SetPendingHeight(int nHeight) {
+            LOCK(pwallet->cs_wallet);
+            CWalletDB walletdb(pwallet->strWalletFile);
+            ASSERT_TRUE(walletdb.WriteRescanHeight(nHeight));
+        }
+    };
+
+    static int ProgressStartHeight(const std::shared_ptr<AsyncRPCOperation> &op)
+    {
+        return find_value(find_value(op->getStatus(), "progress"), "startheight").get_int();
+    }
+
+    TEST_F(TestWalletRescan, FindsCoinbasesThroughOwnedFilter)
+    {
+        ASSERT_TRUE(pwallet->AddKey(notaryKey));
+        std::shared_ptr<AsyncRPCOperation> op = Queue(1);
+        ASSERT_TRUE(pwallet->fAsyncRescanInProgress);
+        EXPECT_EQ(1, PendingHeight());
+
+        op->main();
+        ASSERT_TRUE(op->isSuccess()) << op->getErrorMessage();
+        UniValue result = op->getResult();
+        EXPECT_EQ(5, find_value(result, "endheight").get_int());
+        EXPECT_EQ(5, find_value(result, "txs").get_int());
+        EXPECT_EQ(5u, pwallet->mapWallet.size());
+        EXPECT_FALSE(pwallet->fAsyncRescanInProgress);
+        EXPECT_EQ(-1, PendingHeight());
+    }
+
+    TEST_F(TestWalletRescan, UnrelatedWalletFindsNothing)
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        ASSERT_TRUE(pwallet->AddKey(key));
+        std::shared_ptr<AsyncRPCOperation> op = Queue(1);
+        op->main();
+        ASSERT_TRUE(op->isSuccess()) << op->getErrorMessage();
+        EXPECT_EQ(5, find_value(op->getResult(), "blocks").get_int());
+        EXPECT_EQ(0, find_value(op->getResult(), "txs").get_int());
+        EXPECT_TRUE(pwallet->mapWallet.empty());
+    }
+
+    TEST_F(TestWalletRescan, CancelledBeforeStartKeepsResumeHeight)
+    {
+        std::shared_ptr<AsyncRPCOperation> op = Queue(2);
+        EXPECT_THROW(QueueWalletRescan(pwallet, 1), UniValue);
+
+        op->cancel();
+        op->main();
+        EXPECT_TRUE(op->isCancelled());
+        EXPECT_FALSE(pwallet->fAsyncRescanInProgress);
+        EXPECT_EQ(2, PendingHeight());
+
+        // another rescan may be queued, and does not skip the pending blocks
+        std::shared_ptr<AsyncRPCOperation> next = Queue(4);
+        EXPECT_EQ(2, ProgressStartHeight(next));
+        next->main();
+        EXPECT_TRUE(next->isSuccess()) << next->getErrorMessage();
+        EXPECT_EQ(-1, PendingHeight());
+    }
+
+    TEST_F(TestWalletRescan, InterruptedByShutdownResumes)
+    {
+        ASSERT_TRUE(pwallet->AddKey(notaryKey));
+        std::shared_ptr<AsyncRPCOperation> op = Queue(3);
+        fRequestShutdown = true;
+        op->main();
+        EXPECT_TRUE(op->isFailed());
+        EXPECT_NE(std::string::npos, op->getErrorMessage().find("resume from height 3"));
+        EXPECT_FALSE(pwallet->fAsyncRescanInProgress);
+        EXPECT_EQ(3, PendingHeight());
+        EXPECT_TRUE(pwallet->mapWallet.empty());
+
+        // on the next start the rescan picks up where it stopped
+        fRequestShutdown = false;
+        std::shared_ptr<AsyncRPCOperation> resumed = Queue(5);
+        EXPECT_EQ(3, ProgressStartHeight(resumed));
+        resumed->main();
+        ASSERT_TRUE(resumed->isSuccess()) << resumed->getErrorMessage();
+        EXPECT_EQ(3, find_value(resumed->getResult(), "txs").get_int());
+        EXPECT_EQ(-1, PendingHeight());
+    }
+
+    TEST_F(TestWalletRescan, ResumesFromPendingHeight)
+    {
+        ASSERT_TRUE(pwallet->AddKey(notaryKey));
+        SetPendingHeight(2);
+
+        // a later start height does not skip over the pending blocks
+        std::shared_ptr<AsyncRPCOperation> op = Queue(4);
+        EXPECT_EQ(2, ProgressStartHeight(op));
+        op->main();
+        ASSERT_TRUE(op->isSuccess()) << op->getErrorMessage();
+        EXPECT_EQ(4, find_value(op->getResult(), "txs").get_int());
+
+        // an earlier one is taken as is
+        SetPendingHeight(4);
+        std::shared_ptr<AsyncRPCOperation> earlier = Queue(1);
+        EXPECT_EQ(1, ProgressStartHeight(earlier));
+        earlier->main();
+        EXPECT_TRUE(earlier->isSuccess()) << earlier->getErrorMessage();
+    }
+}
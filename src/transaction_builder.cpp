@@ -5,12 +5,121 @@
 #include "transaction_builder.h"
 
 #include "main.h"
+#include "metrics.h"
 #include "pubkey.h"
 #include "script/sign.h"
 
 #include <boost/variant.hpp>
 #include <librustzcash.h>
 
+namespace {
+
+struct PreparedSpend {
+    bool fValid = false;
+    uint256 nf;
+    std::vector<unsigned char> witness;
+};
+
+struct PreparedOutput {
+    uint256 cm;
+    libzcash::SaplingEncCiphertext encCiphertext;
+    boost::optional<libzcash::SaplingNoteEncryption> encryptor;
+};
+
+std::shared_ptr<void> NewProvingContext()
+{
+    return std::shared_ptr<void>(librustzcash_sapling_proving_ctx_init(), librustzcash_sapling_proving_ctx_free);
+}
+
+// Everything about a spend that does not need the proving context.
+PreparedSpend PrepareSaplingSpend(const SpendDescriptionInfo& spend)
+{
+    PreparedSpend prepared;
+    auto cm = spend.note.cm();
+    auto nf = spend.note.nullifier(
+        spend.expsk.full_viewing_key(), spend.witness.position());
+    if (!(cm && nf)) {
+        return prepared;
+    }
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << spend.witness.path();
+    prepared.witness.assign(ss.begin(), ss.end());
+    prepared.nf = *nf;
+    prepared.fValid = true;
+    return prepared;
+}
+
+// Everything about an output that does not need the proving context.
+PreparedOutput PrepareSaplingOutput(const OutputDescriptionInfo& output)
+{
+    PreparedOutput prepared;
+    auto cm = output.note.cm();
+    if (!cm) {
+        return prepared;
+    }
+
+    libzcash::SaplingNotePlaintext notePlaintext(output.note, output.memo);
+    auto res = notePlaintext.encrypt(output.note.pk_d);
+    if (!res) {
+        return prepared;
+    }
+    prepared.cm = *cm;
+    prepared.encCiphertext = res->first;
+    prepared.encryptor = res->second;
+    return prepared;
+}
+
+bool ProveSaplingOutput(void* ctx, const OutputDescriptionInfo& output, const PreparedOutput& prepared, OutputDescription& odesc)
+{
+    if (!prepared.encryptor) {
+        return false;
+    }
+    auto encryptor = *prepared.encryptor;
+
+    provingTimer.start();
+    bool fProved = librustzcash_sapling_output_proof(
+            ctx,
+            encryptor.get_esk().begin(),
+            output.note.d.data(),
+            output.note.pk_d.begin(),
+            output.note.r.begin(),
+            output.note.value(),
+            odesc.cv.begin(),
+            (unsigned char*)&(*odesc.zkproof.begin()));
+    provingTimer.stop();
+    if (!fProved) {
+        return false;
+    }
+    saplingProofsCreated.increment();
+
+    odesc.cm = prepared.cm;
+    odesc.ephemeralKey = encryptor.get_epk();
+    odesc.encCiphertext = prepared.encCiphertext;
+
+    libzcash::SaplingOutgoingPlaintext outPlaintext(output.note.pk_d, encryptor.get_esk());
+    odesc.outCiphertext = outPlaintext.encrypt(
+        output.ovk,
+        odesc.cv,
+        odesc.cm,
+        encryptor);
+    return true;
+}
+
+// Proves outputs in order against ctx.
+boost::optional<std::vector<OutputDescription>> ProveSaplingOutputs(void* ctx, const std::vector<OutputDescriptionInfo>& outputs)
+{
+    std::vector<OutputDescription> odescs(outputs.size());
+    for (size_t i = 0; i < outputs.size(); i++) {
+        if (!ProveSaplingOutput(ctx, outputs[i], PrepareSaplingOutput(outputs[i]), odescs[i])) {
+            return boost::none;
+        }
+    }
+    return odescs;
+}
+
+}
+
 SpendDescriptionInfo::SpendDescriptionInfo(
     libzcash::SaplingExpandedSpendingKey expsk,
     libzcash::SaplingNote note,
@@ -100,6 +209,21 @@ void TransactionBuilder::AddOpRet(CScript &s)
     opReturn.emplace(CScript(s));
 }
 
+void TransactionBuilder::PrebuildOutputProofs()
+{
+    if (prebuiltOutputs.valid()) {
+        return;
+    }
+    if (!provingCtx) {
+        provingCtx = NewProvingContext();
+    }
+    auto ctx = provingCtx;
+    auto toProve = outputs;
+    prebuiltOutputs = std::async(std::launch::async, [ctx, toProve]() {
+        return ProveSaplingOutputs(ctx.get(), toProve);
+    }).share();
+}
+
 void TransactionBuilder::SetFee(CAmount fee)
 {
     this->fee = fee;
@@ -167,24 +291,38 @@ boost::optional<CTransaction> TransactionBuilder::Build()
     // Sapling spends and outputs
     //
 
-    auto ctx = librustzcash_sapling_proving_ctx_init();
+    // A proving context only serves a single transaction
+    if (!provingCtx) {
+        provingCtx = NewProvingContext();
+    }
+    std::shared_ptr<void> ctxHolder;
+    ctxHolder.swap(provingCtx);
+    auto ctx = ctxHolder.get();
+
+    // Outputs proven ahead by PrebuildOutputProofs() come first; the proving
+    // context must not be shared with that job until it has finished.
+    std::vector<OutputDescription> odescs;
+    if (prebuiltOutputs.valid()) {
+        auto prebuilt = prebuiltOutputs.get();
+        prebuiltOutputs = decltype(prebuiltOutputs)();
+        if (!prebuilt) {
+            return boost::none;
+        }
+        odescs = *prebuilt;
+    }
+    size_t nPrebuilt = odescs.size();
 
     // Create Sapling SpendDescriptions
-    for (auto spend : spends) {
-        auto cm = spend.note.cm();
-        auto nf = spend.note.nullifier(
-            spend.expsk.full_viewing_key(), spend.witness.position());
-        if (!(cm && nf)) {
-            librustzcash_sapling_proving_ctx_free(ctx);
+    for (size_t i = 0; i < spends.size(); i++) {
+        const auto& spend = spends[i];
+        auto prepared = PrepareSaplingSpend(spend);
+        if (!prepared.fValid) {
             return boost::none;
         }
 
-        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-        ss << spend.witness.path();
-        std::vector<unsigned char> witness(ss.begin(), ss.end());
-
         SpendDescription sdesc;
-        if (!librustzcash_sapling_spend_proof(
+        provingTimer.start();
+        bool fProved = librustzcash_sapling_spend_proof(
                 ctx,
                 spend.expsk.full_viewing_key().ak.begin(),
                 spend.expsk.nsk.begin(),
@@ -193,63 +331,30 @@ boost::optional<CTransaction> TransactionBuilder::Build()
                 spend.alpha.begin(),
                 spend.note.value(),
                 spend.anchor.begin(),
-                witness.data(),
+                prepared.witness.data(),
                 sdesc.cv.begin(),
                 sdesc.rk.begin(),
-                sdesc.zkproof.data())) {
-            librustzcash_sapling_proving_ctx_free(ctx);
+                sdesc.zkproof.data());
+        provingTimer.stop();
+        if (!fProved) {
             return boost::none;
         }
+        saplingProofsCreated.increment();
 
         sdesc.anchor = spend.anchor;
-        sdesc.nullifier = *nf;
+        sdesc.nullifier = prepared.nf;
         mtx.vShieldedSpend.push_back(sdesc);
     }
 
     // Create Sapling OutputDescriptions
-    for (auto output : outputs) {
-        auto cm = output.note.cm();
-        if (!cm) {
-            librustzcash_sapling_proving_ctx_free(ctx);
-            return boost::none;
-        }
-
-        libzcash::SaplingNotePlaintext notePlaintext(output.note, output.memo);
-
-        auto res = notePlaintext.encrypt(output.note.pk_d);
-        if (!res) {
-            librustzcash_sapling_proving_ctx_free(ctx);
-            return boost::none;
-        }
-        auto enc = res.get();
-        auto encryptor = enc.second;
-
+    for (size_t i = nPrebuilt; i < outputs.size(); i++) {
         OutputDescription odesc;
-        if (!librustzcash_sapling_output_proof(
-                ctx,
-                encryptor.get_esk().begin(),
-                output.note.d.data(),
-                output.note.pk_d.begin(),
-                output.note.r.begin(),
-                output.note.value(),
-                odesc.cv.begin(),
-                (unsigned char*)&(*odesc.zkproof.begin()))) {
-            librustzcash_sapling_proving_ctx_free(ctx);
+        if (!ProveSaplingOutput(ctx, outputs[i], PrepareSaplingOutput(outputs[i]), odesc)) {
             return boost::none;
         }
-
-        odesc.cm = *cm;
-        odesc.ephemeralKey = encryptor.get_epk();
-        odesc.encCiphertext = enc.first;
-
-        libzcash::SaplingOutgoingPlaintext outPlaintext(output.note.pk_d, encryptor.get_esk());
-        odesc.outCiphertext = outPlaintext.encrypt(
-            output.ovk,
-            odesc.cv,
-            odesc.cm,
-            encryptor);
-        mtx.vShieldedOutput.push_back(odesc);
+        odescs.push_back(odesc);
     }
+    mtx.vShieldedOutput.insert(mtx.vShieldedOutput.end(), odescs.begin(), odescs.end());
 
     // add op_return if there is one to add
     AddOpRetLast();
@@ -266,7 +371,6 @@ boost::optional<CTransaction> TransactionBuilder::Build()
     try {
         dataToBeSigned = SignatureHash(scriptCode, mtx, NOT_AN_INPUT, SIGHASH_ALL, 0, consensusBranchId);
     } catch (std::logic_error ex) {
-        librustzcash_sapling_proving_ctx_free(ctx);
         return boost::none;
     }
 
@@ -284,8 +388,6 @@ boost::optional<CTransaction> TransactionBuilder::Build()
         dataToBeSigned.begin(),
         mtx.bindingSig.data());
 
-    librustzcash_sapling_proving_ctx_free(ctx);
-
     // Transparent signatures
     CTransaction txNewConst(mtx);
     for (int nIn = 0; nIn < mtx.vin.size(); nIn++) {
@@ -18,6 +18,9 @@
 
 #include <boost/optional.hpp>
 
+#include <future>
+#include <memory>
+
 struct SpendDescriptionInfo {
     libzcash::SaplingExpandedSpendingKey expsk;
     libzcash::SaplingNote note;
@@ -69,6 +72,15 @@ private:
     boost::optional<CTxDestination> tChangeAddr;
     boost::optional<CScript> opReturn;
 
+    // Every Sapling proof of a transaction must be created against the same
+    // librustzcash proving context, which accumulates the value commitment
+    // randomness for the binding signature. Proofs are therefore created one
+    // at a time.
+    std::shared_ptr<void> provingCtx;
+
+    // Proofs for outputs[0..n) started by PrebuildOutputProofs()
+    std::shared_future<boost::optional<std::vector<OutputDescription>>> prebuiltOutputs;
+
     bool AddOpRetLast(CScript &s);
 
 public:
@@ -106,6 +118,11 @@ public:
 
     void SetLockTime(uint32_t time) { this->mtx.nLockTime = time; }
 
+    // Starts proving the Sapling outputs added so far in the background, so
+    // that the proofs overlap with selecting and witnessing the inputs.
+    // Outputs added afterwards, including change, are proven by Build().
+    void PrebuildOutputProofs();
+
     boost::optional<CTransaction> Build();
 };
 
@@ -33,6 +33,8 @@
 
 #include <stdint.h>
 
+#include <atomic>
+
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -43,7 +45,9 @@ static const char DB_SPROUT_ANCHOR = 'A';
 static const char DB_SAPLING_ANCHOR = 'Z';
 static const char DB_NULLIFIER = 's';
 static const char DB_SAPLING_NULLIFIER = 'S';
-static const char DB_COINS = 'c';
+static const char DB_COINS = 'c'; // Legacy one-record-per-transaction layout, see CCoinsViewDB::Upgrade.
+static const char DB_COIN = 'C';
+static const char DB_COIN_HEADER = 'h';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_ADDRESSINDEX = 'd';
@@ -59,7 +63,110 @@ static const char DB_BEST_SAPLING_ANCHOR = 'z';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_VERSION = 'V';
+
+//! Layout of the chainstate: per-output records, each transaction indexed by a DB_COIN_HEADER record.
+static const int CHAINSTATE_VERSION = 1;
+
+//! Transactions with more unspent outputs than this are read with one seek instead of a point read per output.
+static const uint32_t MAX_COIN_POINT_READS = 4;
+
+namespace {
+
+/**
+ * Key of one unspent output in the chainstate. The output index is stored
+ * big-endian so that all outputs of a transaction are adjacent and ordered,
+ * and can be read back with a single seek.
+ */
+struct CoinKey
+{
+    char prefix;
+    uint256 txid;
+    uint32_t n;
+
+    CoinKey() : prefix(0), n(0) {}
+    CoinKey(const uint256 &txidIn, uint32_t nIn) : prefix(DB_COIN), txid(txidIn), n(nIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        ::Serialize(s, prefix);
+        ::Serialize(s, txid);
+        ser_writedata32be(s, n);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        ::Unserialize(s, prefix);
+        ::Unserialize(s, txid);
+        n = ser_readdata32be(s);
+    }
+};
+
+/** Value of one unspent output: the output itself plus the transaction fields CCoins carries. */
+struct CoinValue
+{
+    CTxOut out;
+    int nHeight;
+    int nVersion;
+    bool fCoinBase;
+
+    CoinValue() : nHeight(0), nVersion(0), fCoinBase(false) {}
+    CoinValue(const CCoins &coins, uint32_t n) : out(coins.vout[n]), nHeight(coins.nHeight), nVersion(coins.nVersion), fCoinBase(coins.fCoinBase) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        uint32_t nCode = nHeight * 2 + (fCoinBase ? 1 : 0);
+        ::Serialize(s, VARINT(nCode));
+        ::Serialize(s, VARINT(this->nVersion));
+        ::Serialize(s, CTxOutCompressor(REF(out)));
+    }
 
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        uint32_t nCode = 0;
+        ::Unserialize(s, VARINT(nCode));
+        nHeight = nCode >> 1;
+        fCoinBase = nCode & 1;
+        ::Unserialize(s, VARINT(this->nVersion));
+        ::Unserialize(s, REF(CTxOutCompressor(out)));
+    }
+};
+
+/**
+ * Which outputs of a transaction are unspent, as a bitmask. Kept under its
+ * own key so a lookup by txid is a point read instead of an iterator seek.
+ */
+struct CoinHeader
+{
+    std::vector<unsigned char> vAvail;
+
+    CoinHeader() {}
+    explicit CoinHeader(const CCoins &coins) {
+        for (uint32_t i = 0; i < coins.vout.size(); i++) {
+            if (coins.IsAvailable(i)) {
+                if (vAvail.size() <= i / 8)
+                    vAvail.resize(i / 8 + 1);
+                vAvail[i / 8] |= 1 << (i % 8);
+            }
+        }
+    }
+
+    bool IsEmpty() const { return vAvail.empty(); }
+    uint32_t Size() const { return vAvail.size() * 8; }
+    bool IsAvailable(uint32_t n) const { return n / 8 < vAvail.size() && (vAvail[n / 8] & (1 << (n % 8))); }
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        ::Serialize(s, vAvail);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        ::Unserialize(s, vAvail);
+    }
+};
+
+}
 
 CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe) {
 }
@@ -109,12 +216,64 @@ bool CCoinsViewDB::GetNullifier(const uint256 &nf, ShieldedType type) const {
     return db.Read(make_pair(dbChar, nf), spent);
 }
 
+/**
+ * CCoins holds a whole transaction, so every unspent output of txid is read
+ * even if the caller needs one of them; the cache above keeps it for the
+ * other spends of the transaction until the next flush. A few outputs are
+ * fetched with point reads. More than that are adjacent in the key order
+ * and read with a single seek, so a lookup costs two LevelDB accesses
+ * however many outputs are left.
+ */
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(make_pair(DB_COINS, txid), coins);
+    CoinHeader header;
+    coins.Clear();
+    if (!db.Read(make_pair(DB_COIN_HEADER, txid), header))
+        return false;
+
+    std::vector<uint32_t> vAvail;
+    for (uint32_t i = 0; i < header.Size(); i++) {
+        if (header.IsAvailable(i))
+            vAvail.push_back(i);
+    }
+    if (vAvail.empty())
+        return false;
+
+    coins.vout.resize(vAvail.back() + 1);
+    if (vAvail.size() <= MAX_COIN_POINT_READS) {
+        for (uint32_t n : vAvail) {
+            CoinValue value;
+            if (!db.Read(CoinKey(txid, n), value))
+                return error("%s: unable to read output %s:%u", __func__, txid.ToString(), n);
+            coins.vout[n] = value.out;
+            coins.nHeight = value.nHeight;
+            coins.nVersion = value.nVersion;
+            coins.fCoinBase = value.fCoinBase;
+        }
+        return true;
+    }
+
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    size_t nRead = 0;
+    for (pcursor->Seek(CoinKey(txid, vAvail.front())); pcursor->Valid() && nRead < vAvail.size(); pcursor->Next()) {
+        CoinKey key;
+        CoinValue value;
+        if (!pcursor->GetKey(key) || key.prefix != DB_COIN || key.txid != txid || key.n != vAvail[nRead])
+            break;
+        if (!pcursor->GetValue(value))
+            return error("%s: unable to read output %s:%u", __func__, txid.ToString(), key.n);
+        coins.vout[key.n] = value.out;
+        coins.nHeight = value.nHeight;
+        coins.nVersion = value.nVersion;
+        coins.fCoinBase = value.fCoinBase;
+        nRead++;
+    }
+    if (nRead != vAvail.size())
+        return error("%s: unable to read output %s:%u", __func__, txid.ToString(), vAvail[nRead]);
+    return true;
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(make_pair(DB_COINS, txid));
+    return db.Exists(make_pair(DB_COIN_HEADER, txid));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -188,12 +347,36 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
+    size_t outputs = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(make_pair(DB_COINS, it->first));
-            else
-                batch.Write(make_pair(DB_COINS, it->first), it->second.coins);
+            // Only write the outputs that differ from what is on disk, so
+            // spending one output of a large transaction is a single erase.
+            const CCoins &coins = it->second.coins;
+            const std::vector<bool> &vBaseAvail = it->second.vBaseAvail;
+            bool fRewrite = coins.nHeight != it->second.nBaseHeight;
+            bool fHeaderChanged = false;
+            uint32_t nOutputs = std::max(coins.vout.size(), vBaseAvail.size());
+            for (uint32_t i = 0; i < nOutputs; i++) {
+                bool fAvail = coins.IsAvailable(i);
+                bool fBaseAvail = i < vBaseAvail.size() && vBaseAvail[i];
+                if (fAvail && (!fBaseAvail || fRewrite)) {
+                    batch.Write(CoinKey(it->first, i), CoinValue(coins, i));
+                    fHeaderChanged = true;
+                    outputs++;
+                } else if (!fAvail && fBaseAvail) {
+                    batch.Erase(CoinKey(it->first, i));
+                    fHeaderChanged = true;
+                    outputs++;
+                }
+            }
+            if (fHeaderChanged) {
+                CoinHeader header(coins);
+                if (header.IsEmpty())
+                    batch.Erase(make_pair(DB_COIN_HEADER, it->first));
+                else
+                    batch.Write(make_pair(DB_COIN_HEADER, it->first), header);
+            }
             changed++;
         }
         count++;
@@ -214,7 +397,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     if (!hashSaplingAnchor.IsNull())
         batch.Write(DB_BEST_SAPLING_ANCHOR, hashSaplingAnchor);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint("coindb", "Committing %u changed outputs of %u changed transactions (out of %u) to coin database...\n", (unsigned int)outputs, (unsigned int)changed, (unsigned int)count);
     return db.WriteBatch(batch);
 }
 
@@ -246,30 +429,34 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
-    pcursor->Seek(DB_COINS);
+    pcursor->Seek(DB_COIN);
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
     CAmount nTotalAmount = 0;
+    uint256 prevTxid;
+    bool fFirst = true;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        CCoins coins;
-        if (pcursor->GetKey(key) && key.first == DB_COINS) {
-            if (pcursor->GetValue(coins)) {
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
+        CoinKey key;
+        CoinValue value;
+        if (pcursor->GetKey(key) && key.prefix == DB_COIN) {
+            if (pcursor->GetValue(value)) {
+                // Outputs of a transaction are adjacent; hash them as one group.
+                if (fFirst || key.txid != prevTxid) {
+                    if (!fFirst)
+                        ss << VARINT(0);
+                    stats.nTransactions++;
+                    stats.nSerializedSize += 32;
+                    prevTxid = key.txid;
+                    fFirst = false;
                 }
-                stats.nSerializedSize += 32 + pcursor->GetValueSize();
-                ss << VARINT(0);
+                stats.nTransactionOutputs++;
+                ss << VARINT(key.n+1);
+                ss << value.out;
+                nTotalAmount += value.out.nValue;
+                stats.nSerializedSize += pcursor->GetValueSize();
             } else {
                 return error("CCoinsViewDB::GetStats() : unable to read value");
             }
@@ -278,6 +465,8 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
         }
         pcursor->Next();
     }
+    if (!fFirst)
+        ss << VARINT(0);
     {
         LOCK(cs_main);
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->GetHeight();
@@ -287,6 +476,72 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
     return true;
 }
 
+bool CCoinsViewDB::Upgrade() {
+    int nVersion = 0;
+    if (db.Read(DB_VERSION, nVersion)) {
+        if (nVersion != CHAINSTATE_VERSION)
+            return error("%s: chainstate database version %d is not supported, rebuild it with -reindex", __func__, nVersion);
+        return true;
+    }
+
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(make_pair(DB_COINS, uint256()));
+    std::pair<char, uint256> key;
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_COINS) {
+        // No legacy records and no version: either a new database, or
+        // per-output records written before headers existed, which cannot
+        // be read back and need a rebuild.
+        CoinKey coinKey;
+        pcursor->Seek(DB_COIN);
+        if (pcursor->Valid() && pcursor->GetKey(coinKey) && coinKey.prefix == DB_COIN)
+            return error("%s: chainstate database has an unversioned layout, rebuild it with -reindex", __func__);
+        return db.Write(DB_VERSION, CHAINSTATE_VERSION);
+    }
+
+    LogPrintf("Upgrading chainstate database to per-output records...\n");
+    uiInterface.InitMessage(_("Upgrading chainstate database..."));
+
+    // Each batch converts whole transactions and erases their old record in
+    // the same write, so an interrupted upgrade simply resumes on next start.
+    CDBBatch batch(db);
+    size_t count = 0;
+    size_t batched = 0;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            break;
+        if (!pcursor->GetKey(key) || key.first != DB_COINS)
+            break;
+        CCoins coins;
+        if (!pcursor->GetValue(coins))
+            return error("%s: unable to read transaction %s", __func__, key.second.ToString());
+        for (uint32_t i = 0; i < coins.vout.size(); i++) {
+            if (!coins.vout[i].IsNull())
+                batch.Write(CoinKey(key.second, i), CoinValue(coins, i));
+        }
+        CoinHeader header(coins);
+        if (!header.IsEmpty())
+            batch.Write(make_pair(DB_COIN_HEADER, key.second), header);
+        batch.Erase(key);
+        count++;
+        if (++batched >= 10000) {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+            batched = 0;
+        }
+        pcursor->Next();
+    }
+    if (!ShutdownRequested()) {
+        batch.Write(DB_VERSION, CHAINSTATE_VERSION);
+        batched++;
+    }
+    if (batched > 0 && !db.WriteBatch(batch))
+        return false;
+    LogPrintf("Upgraded %u transactions in chainstate database%s\n", (unsigned int)count, ShutdownRequested() ? " (interrupted)" : "");
+    return true;
+}
+
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
@@ -346,12 +601,14 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
     return WriteBatch(batch);
 }
 
+// fAllAddresses reads the unspent outputs of all addresses of type, addressHash is then not used
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                                           bool fAllAddresses) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, fAllAddresses ? uint160() : addressHash)));
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
@@ -362,7 +619,7 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
             char chType = keyObj.first;
             CAddressUnspentKey indexKey = keyObj.second;
 
-            if (chType == DB_ADDRESSUNSPENTINDEX && indexKey.hashBytes == addressHash) {
+            if (chType == DB_ADDRESSUNSPENTINDEX && indexKey.type == type && (fAllAddresses || indexKey.hashBytes == addressHash)) {
                 try {
                     CAddressUnspentValue nValue;
                     pcursor->GetValue(nValue);
@@ -563,6 +820,7 @@ bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, Un
     return true;
 }
 
+extern CCriticalSection cs_addresssnapshot;
 extern std::vector <std::pair<CAmount, CTxDestination>> vAddressSnapshot;
 
 UniValue CBlockTreeDB::Snapshot(int top)
@@ -574,7 +832,13 @@ UniValue CBlockTreeDB::Snapshot(int top)
     UniValue result(UniValue::VOBJ);
     UniValue addressesSorted(UniValue::VARR);
     result.push_back(Pair("start_time", (int) time(NULL)));
-    if ( (vAddressSnapshot.size() > 0 && top < 0) || (Snapshot2(addressAmounts,&result) && top >= 0) )
+    std::vector <std::pair<CAmount, CTxDestination>> vSnapshot;
+    if ( top < 0 )
+    {
+        LOCK(cs_addresssnapshot);
+        vSnapshot = vAddressSnapshot;
+    }
+    if ( (vSnapshot.size() > 0 && top < 0) || (Snapshot2(addressAmounts,&result) && top >= 0) )
     {
         if ( top > -1 )
         {
@@ -584,9 +848,9 @@ UniValue CBlockTreeDB::Snapshot(int top)
         }
         else 
         {
-            for ( auto address : vAddressSnapshot )
+            for ( auto address : vSnapshot )
                 vaddr.push_back(make_pair(address.first, CBitcoinAddress(address.second).ToString()));
-            top = vAddressSnapshot.size();
+            top = vSnapshot.size();
         }
         int topN = 0;
         for (std::vector<std::pair<CAmount, std::string>>::iterator it = vaddr.begin(); it!=vaddr.end(); ++it)
@@ -691,82 +955,202 @@ bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+namespace {
+
+/** Block index entries are allocated in arrays of this many per loading thread. */
+static const size_t BLOCK_INDEX_ARENA_SIZE = 1024;
+
+/** The block index records of one range of the key space, read by one thread. */
+struct CBlockIndexShard
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    unsigned int nBegin, nEnd; // range of the first byte of the block hash
+    std::vector<std::pair<CBlockIndex*, size_t> > vArenas;
+    std::vector<CBlockIndex*> vIndexes;
+    std::vector<uint256> vHashes;
+    std::vector<uint256> vHashPrev;
+    std::string strError;
+    std::atomic<unsigned int> nCursor; // first hash byte reached so far
+    std::atomic<bool> fDone;
+
+    CBlockIndexShard() : nBegin(0), nEnd(0), nCursor(0), fDone(false) {}
+};
 
-    pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
-    int64_t count = 0; int reportDone = 0;
-    uiInterface.ShowProgress(_("Loading guts..."), 0, false);
+void ReadBlockIndexShard(CDBWrapper* db, CBlockIndexShard* shard)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(db->NewIterator());
+    uint256 start;
+    *start.begin() = shard->nBegin;
+    pcursor->Seek(make_pair(DB_BLOCK_INDEX, start));
 
-    // Load mapBlockIndex
+    CBlockIndex* pArena = NULL;
+    size_t nArenaUsed = BLOCK_INDEX_ARENA_SIZE;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        if (ShutdownRequested()) return false;
+        if (ShutdownRequested())
+            return;
 
         std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= shard->nEnd)
+            break;
 
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
+        CDiskBlockIndex diskindex;
+        if (!pcursor->GetValue(diskindex)) {
+            shard->strError = "LoadBlockIndex() : failed to read value";
+            return;
+        }
+        // Hashing the header is most of the cost of loading an entry.
+        uint256 hash = diskindex.GetBlockHash();
+        if (hash != key.second) {
+            shard->strError = strprintf("LoadBlockIndex(): block header inconsistency detected: on-disk = %s, key = %s",
+                                        diskindex.ToString(), key.second.ToString());
+            return;
+        }
 
-            if (count++ % 256 == 0) {
-                uint32_t high = 0x100 * *key.second.begin() + *(key.second.begin() + 1);
-                int percentageDone = (int)(high * 100.0 / 65536.0 + 0.5);
-                uiInterface.ShowProgress(_("Loading guts..."), percentageDone, false);
-                if (reportDone < percentageDone/10) {
-                    // report max. every 10% step
-                    LogPrintf("[%d%%]...", percentageDone); /* Continued */
-                    reportDone = percentageDone/10;
-                }
-            }
+        if (nArenaUsed == BLOCK_INDEX_ARENA_SIZE) {
+            pArena = new CBlockIndex[BLOCK_INDEX_ARENA_SIZE];
+            shard->vArenas.push_back(std::make_pair(pArena, BLOCK_INDEX_ARENA_SIZE));
+            nArenaUsed = 0;
+        }
+        CBlockIndex* pindexNew = &pArena[nArenaUsed++];
+        pindexNew->SetHeight(diskindex.GetHeight());
+        pindexNew->nFile          = diskindex.nFile;
+        pindexNew->nDataPos       = diskindex.nDataPos;
+        pindexNew->nUndoPos       = diskindex.nUndoPos;
+        pindexNew->hashSproutAnchor     = diskindex.hashSproutAnchor;
+        pindexNew->nVersion       = diskindex.nVersion;
+        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+        pindexNew->hashFinalSaplingRoot   = diskindex.hashFinalSaplingRoot;
+        pindexNew->nTime          = diskindex.nTime;
+        pindexNew->nBits          = diskindex.nBits;
+        pindexNew->nNonce         = diskindex.nNonce;
+        pindexNew->nSolution.swap(diskindex.nSolution);
+        pindexNew->nStatus        = diskindex.nStatus;
+        pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
+        pindexNew->nTx            = diskindex.nTx;
+        pindexNew->nSproutValue   = diskindex.nSproutValue;
+        pindexNew->nSaplingValue  = diskindex.nSaplingValue;
+        pindexNew->segid          = diskindex.segid;
+        pindexNew->nNotaryPay     = diskindex.nNotaryPay;
+
+        shard->vIndexes.push_back(pindexNew);
+        shard->vHashes.push_back(hash);
+        shard->vHashPrev.push_back(diskindex.hashPrev);
+        shard->nCursor = *key.second.begin();
+        pcursor->Next();
+    }
+}
 
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->SetHeight(diskindex.GetHeight());
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->hashSproutAnchor     = diskindex.hashSproutAnchor;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->hashFinalSaplingRoot   = diskindex.hashFinalSaplingRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nSolution      = diskindex.nSolution;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
-                pindexNew->nTx            = diskindex.nTx;
-                pindexNew->nSproutValue   = diskindex.nSproutValue;
-                pindexNew->nSaplingValue  = diskindex.nSaplingValue;
-                pindexNew->segid          = diskindex.segid;
-                pindexNew->nNotaryPay     = diskindex.nNotaryPay;
-//LogPrintf("loadguts ht.%d\n",pindexNew->GetHeight());
-                // Consistency checks
-                auto header = pindexNew->GetBlockHeader();
-                if (header.GetHash() != pindexNew->GetBlockHash())
-                    return error("LoadBlockIndex(): block header inconsistency detected: on-disk = %s, in-memory = %s",
-                                 diskindex.ToString(),  pindexNew->ToString());
-                if ( 0 ) // POW will be checked before any block is connected
-                {
-                    uint8_t pubkey33[33];
-                    komodo_index2pubkey33(pubkey33,pindexNew,pindexNew->GetHeight());
-                    if (!CheckProofOfWork(header,pubkey33,pindexNew->GetHeight(),Params().GetConsensus()))
-                        return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
+void LoadBlockIndexShard(CDBWrapper* db, CBlockIndexShard* shard)
+{
+    try {
+        ReadBlockIndexShard(db, shard);
+    } catch (const boost::thread_interrupted&) {
+    } catch (const std::exception& e) {
+        shard->strError = strprintf("LoadBlockIndex(): %s", e.what());
+    }
+    shard->fDone = true;
+}
+
+/** Show the loading progress until all shards are done. */
+void ReportShardProgress(const std::vector<CBlockIndexShard>& vShards)
+{
+    int reportDone = 0;
+    while (true) {
+        size_t nDone = 0;
+        unsigned int nPos = 0;
+        for (size_t i = 0; i < vShards.size(); i++) {
+            nDone += vShards[i].fDone;
+            nPos += vShards[i].nCursor - vShards[i].nBegin;
+        }
+        if (nDone == vShards.size())
+            break;
+        int percentageDone = (int)(nPos * 100.0 / 256 + 0.5);
+        uiInterface.ShowProgress(_("Loading guts..."), percentageDone, false);
+        if (reportDone < percentageDone/10) {
+            // report max. every 10% step
+            LogPrintf("[%d%%]...", percentageDone); /* Continued */
+            reportDone = percentageDone/10;
+        }
+        MilliSleep(100);
+    }
+}
+
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts()
+{
+    int64_t nStart = GetTimeMillis();
+    uiInterface.ShowProgress(_("Loading guts..."), 0, false);
+
+    // Entries are keyed by block hash, so splitting the key space by its
+    // first byte gives shards of about the same size. Each shard is read
+    // through its own iterator, and its entries deserialized and their
+    // headers hashed, on its own thread.
+    int nShards = std::max(1, std::min(256, (int)boost::thread::hardware_concurrency()));
+    std::vector<CBlockIndexShard> vShards(nShards);
+    {
+        boost::thread_group threadGroup;
+        for (int i = 0; i < nShards; i++) {
+            vShards[i].nBegin = 256 * i / nShards;
+            vShards[i].nEnd = 256 * (i + 1) / nShards;
+            vShards[i].nCursor = vShards[i].nBegin;
+            threadGroup.create_thread(boost::bind(&LoadBlockIndexShard, this, &vShards[i]));
+        }
+        try {
+            ReportShardProgress(vShards);
+        } catch (const boost::thread_interrupted&) {
+            // The shards point into vShards; never leave them running.
+            threadGroup.interrupt_all();
+            threadGroup.join_all();
+            throw;
+        }
+        threadGroup.join_all();
+    }
+
+    // Hand the arenas to main, then put the entries in mapBlockIndex and link
+    // them to their parents. This is the only part that has to be serial.
+    size_t nTotal = 0;
+    for (int i = 0; i < nShards; i++) {
+        for (size_t j = 0; j < vShards[i].vArenas.size(); j++)
+            AddBlockIndexArena(vShards[i].vArenas[j].first, vShards[i].vArenas[j].second);
+        nTotal += vShards[i].vIndexes.size();
+    }
+    for (int i = 0; i < nShards; i++) {
+        if (!vShards[i].strError.empty())
+            return error("%s", vShards[i].strError);
+    }
+    if (ShutdownRequested())
+        return false;
+    int64_t nRead = GetTimeMillis();
+
+    mapBlockIndex.reserve(mapBlockIndex.size() + nTotal);
+    for (int i = 0; i < nShards; i++) {
+        CBlockIndexShard& shard = vShards[i];
+        for (size_t j = 0; j < shard.vIndexes.size(); j++) {
+            std::pair<BlockMap::iterator, bool> ret = mapBlockIndex.insert(make_pair(shard.vHashes[j], shard.vIndexes[j]));
+            if (!ret.second) {
+                // Already referenced, e.g. by InsertBlockIndex as the parent
+                // of a block: fill in that entry, as pointers to it may be held.
+                if (ret.first->second != NULL) {
+                    *ret.first->second = *shard.vIndexes[j];
+                    shard.vIndexes[j] = ret.first->second;
+                } else {
+                    ret.first->second = shard.vIndexes[j];
                 }
-                pcursor->Next();
-            } else {
-                return error("LoadBlockIndex() : failed to read value");
             }
-        } else {
-            break;
+            shard.vIndexes[j]->phashBlock = &((*ret.first).first);
         }
     }
+    for (int i = 0; i < nShards; i++) {
+        const CBlockIndexShard& shard = vShards[i];
+        for (size_t j = 0; j < shard.vIndexes.size(); j++)
+            shard.vIndexes[j]->pprev = InsertBlockIndex(shard.vHashPrev[j]);
+    }
 
     uiInterface.ShowProgress("", 100, false);
-    LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
+    LogPrintf("[DONE].\n");
+    LogPrintf("%s: read %u entries with %d threads in %dms, linked in %dms\n", __func__,
+              (unsigned int)nTotal, nShards, (int)(nRead - nStart), (int)(GetTimeMillis() - nRead));
 
     return true;
 }
@@ -908,6 +908,17 @@ void AllocateFileRange(FILE *file, unsigned int offset, unsigned int length) {
 #endif
 }
 
+/**
+ * this function tells the OS that a file is about to be read from start to end, so it can read ahead
+ * it is advisory, and does nothing where not supported
+ */
+void AdviseSequentialRead(FILE *file) {
+#if defined(__linux__)
+    posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fileno(file), 0, 0, POSIX_FADV_WILLNEED);
+#endif
+}
+
 void ShrinkDebugFile()
 {
     // Scroll debug.log if it's getting too big
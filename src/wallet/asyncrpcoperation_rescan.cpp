@@ -0,0 +1,376 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "asyncrpcqueue.h"
+#include "consensus/upgrades.h"
+#include "init.h"
+#include "main.h"
+#include "rpc/protocol.h"
+#include "rpc/server.h"
+#include "util.h"
+#include "utiltime.h"
+#include "wallet.h"
+#include "walletdb.h"
+
+#include <boost/thread.hpp>
+
+#include "asyncrpcoperation_rescan.h"
+
+// Only one rescan may be queued or running at a time.
+static std::atomic<bool> fRescanQueued(false);
+
+// Wall clock time the current rescan started committing blocks
+static std::atomic<int64_t> nRescanStartMillis(0);
+
+AsyncRPCOperation_rescan::AsyncRPCOperation_rescan(CWallet* pwallet, int startHeight, bool fReaccept, UniValue contextInfo) :
+        contextinfo_(contextInfo), pwallet_(pwallet), startHeight_(startHeight), fReaccept_(fReaccept),
+        nextHeight_(startHeight), tipHeight_(0), blocksScanned_(0), txsFound_(0)
+{
+    assert(pwallet_ != NULL);
+
+    batchSize_ = GetArg("-rescanbatchsize", RESCAN_DEFAULT_BATCH_SIZE);
+    if (batchSize_ < 1) {
+        batchSize_ = 1;
+    }
+
+    {
+        // Block connects must leave the witnesses of notes this rescan
+        // discovers alone until it has caught up with the tip.
+        LOCK(pwallet_->cs_wallet);
+        pwallet_->fAsyncRescanInProgress = true;
+        CWalletDB walletdb(pwallet_->strWalletFile);
+        walletdb.WriteRescanHeight(startHeight_);
+    }
+
+    LogPrint("zrpc", "%s: rescan initialized (start height=%d)\n", getId(), startHeight_);
+}
+
+AsyncRPCOperation_rescan::~AsyncRPCOperation_rescan() {
+}
+
+void AsyncRPCOperation_rescan::main() {
+    // However the operation ends, block connects must go back to updating
+    // all witnesses; an unfinished rescan resumes on the next start.
+    struct ClearInProgress {
+        CWallet* pwallet;
+        ~ClearInProgress() {
+            LOCK(pwallet->cs_wallet);
+            pwallet->fAsyncRescanInProgress = false;
+        }
+    } clearInProgress = {pwallet_};
+
+    if (isCancelled()) {
+        fRescanQueued = false;
+        return;
+    }
+
+    set_state(OperationStatus::EXECUTING);
+    start_execution_clock();
+
+    bool success = false;
+
+    try {
+        success = main_impl();
+    } catch (const UniValue& objError) {
+        int code = find_value(objError, "code").get_int();
+        std::string message = find_value(objError, "message").get_str();
+        set_error_code(code);
+        set_error_message(message);
+    } catch (const runtime_error& e) {
+        set_error_code(-1);
+        set_error_message("runtime error: " + string(e.what()));
+    } catch (const logic_error& e) {
+        set_error_code(-1);
+        set_error_message("logic error: " + string(e.what()));
+    } catch (const exception& e) {
+        set_error_code(-1);
+        set_error_message("general exception: " + string(e.what()));
+    } catch (...) {
+        set_error_code(-2);
+        set_error_message("unknown error");
+    }
+
+    stop_execution_clock();
+
+    if (success) {
+        set_state(OperationStatus::SUCCESS);
+    } else {
+        set_state(OperationStatus::FAILED);
+    }
+
+    std::string s = strprintf("%s: rescan finished (status=%s", getId(), getStateAsString());
+    if (success) {
+        s += strprintf(", blocks=%d, txs=%d)\n", blocksScanned_.load(), txsFound_.load());
+    } else {
+        s += strprintf(", error=%s, resume height=%d)\n", getErrorMessage(), nextHeight_.load());
+    }
+    LogPrintf("%s",s);
+
+    if (success && fReaccept_) {
+        pwallet_->ReacceptWalletTransactions();
+    }
+
+    fRescanQueued = false;
+}
+
+bool AsyncRPCOperation_rescan::main_impl() {
+    {
+        // no need to read and scan block, if block was created before
+        // our wallet birthday (as adjusted for block time variability)
+        LOCK2(cs_main, pwallet_->cs_wallet);
+        CBlockIndex* pindex = chainActive[startHeight_];
+        while (pindex && pwallet_->nTimeFirstKey && (pindex->GetBlockTime() < (pwallet_->nTimeFirstKey - 7200)))
+            pindex = chainActive.Next(pindex);
+        if (pindex) {
+            nextHeight_ = pindex->GetHeight();
+        }
+    }
+
+    nRescanStartMillis = GetTimeMillis();
+    int64_t nNow = GetTime();
+
+    // The reader stage always runs one batch ahead of the commit stage.
+    auto launch = [this](int nHeight) {
+        return std::async(std::launch::async, &AsyncRPCOperation_rescan::read_batch, this, select_batch(nHeight));
+    };
+    std::future<std::vector<ScannedBlock>> pending = launch(nextHeight_);
+
+    while (true) {
+        if (ShutdownRequested()) {
+            pending.wait();
+            throw JSONRPCError(RPC_WALLET_ERROR, strprintf("Rescan interrupted by shutdown, it will resume from height %d on the next start", nextHeight_.load()));
+        }
+
+        std::vector<ScannedBlock> vBlocks = pending.get();
+        int nFollowing = vBlocks.empty() ? nextHeight_.load() : vBlocks.back().pindex->GetHeight() + 1;
+        pending = launch(nFollowing);
+
+        bool fReorg = false;
+        if (commit_batch(vBlocks, fReorg)) {
+            pending.wait();
+            break;
+        }
+        if (fReorg) {
+            // Whatever the reader fetched ahead belongs to the stale branch
+            pending.wait();
+            pending = launch(nextHeight_);
+        }
+
+        if (GetTime() >= nNow + 60) {
+            nNow = GetTime();
+            LogPrintf("Still rescanning. At block %d of %d.\n", nextHeight_.load(), tipHeight_.load());
+        }
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("startheight", startHeight_));
+    obj.push_back(Pair("endheight", nextHeight_.load() - 1));
+    obj.push_back(Pair("blocks", blocksScanned_.load()));
+    obj.push_back(Pair("txs", txsFound_.load()));
+    set_result(obj);
+    return true;
+}
+
+/**
+ * Pick the next run of active chain blocks starting at nHeight.
+ */
+std::vector<CBlockIndex*> AsyncRPCOperation_rescan::select_batch(int nHeight) {
+    std::vector<CBlockIndex*> vIndex;
+    LOCK(cs_main);
+    tipHeight_ = chainActive.Height();
+    for (int h = nHeight; h <= chainActive.Height() && (int)vIndex.size() < batchSize_; h++) {
+        vIndex.push_back(chainActive[h]);
+    }
+    return vIndex;
+}
+
+/**
+ * Reader and decoder stages: load the blocks of a batch from disk on a
+ * pool of threads and flag the transactions with shielded data, which are
+ * always passed on because trial decryption is serialized on
+ * cs_SpendingKeyStore anyway, and those with a transparent output that may
+ * be ours. Outputs are probed against the keystore's owned filter, which
+ * only takes cs_KeyStore, so the commit stage is left with the filter's
+ * false positives and the spends of wallet transactions.
+ */
+std::vector<AsyncRPCOperation_rescan::ScannedBlock> AsyncRPCOperation_rescan::read_batch(const std::vector<CBlockIndex*>& vIndex) {
+    std::vector<ScannedBlock> vBlocks(vIndex.size());
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        vBlocks[i].pindex = vIndex[i];
+        vBlocks[i].fRead = false;
+    }
+
+    auto decode = [this, &vBlocks](size_t nOffset, size_t nStride) {
+        for (size_t i = nOffset; i < vBlocks.size(); i += nStride) {
+            ScannedBlock& sb = vBlocks[i];
+            sb.fRead = ReadBlockFromDisk(sb.block, sb.pindex, 1);
+            if (!sb.fRead) {
+                continue;
+            }
+            sb.vCandidate.resize(sb.block.vtx.size());
+            for (size_t j = 0; j < sb.block.vtx.size(); j++) {
+                const CTransaction& tx = sb.block.vtx[j];
+                bool fCandidate = tx.vjoinsplit.size() > 0 || tx.vShieldedOutput.size() > 0 ||
+                                  tx.vShieldedSpend.size() > 0;
+                for (uint32_t k = 0; !fCandidate && k < tx.vout.size(); k++) {
+                    fCandidate = pwallet_->MayBeMine(tx, k);
+                }
+                sb.vCandidate[j] = fCandidate;
+            }
+        }
+    };
+
+    size_t nThreads = std::min<size_t>(std::max(1u, boost::thread::hardware_concurrency()), vBlocks.size());
+    boost::thread_group threadGroup;
+    for (size_t n = 1; n < nThreads; n++) {
+        threadGroup.create_thread(boost::bind<void>(decode, n, nThreads));
+    }
+    decode(0, std::max<size_t>(nThreads, 1));
+    threadGroup.join_all();
+    return vBlocks;
+}
+
+/**
+ * Commit stage: add the flagged transactions to the wallet and advance the
+ * note witnesses, in chain order. Returns true once the rescan has reached
+ * the tip; fReorg is set if the batch was cut short by a reorg.
+ */
+bool AsyncRPCOperation_rescan::commit_batch(std::vector<ScannedBlock>& vBlocks, bool& fReorg) {
+    LOCK2(cs_main, pwallet_->cs_wallet);
+
+    std::vector<uint256> myTxHashes;
+    for (ScannedBlock& sb : vBlocks) {
+        if (!chainActive.Contains(sb.pindex)) {
+            const CBlockIndex* pfork = chainActive.FindFork(sb.pindex);
+            nextHeight_ = std::min(nextHeight_.load(), pfork->GetHeight() + 1);
+            fReorg = true;
+            break;
+        }
+        if (sb.pindex->GetHeight() != nextHeight_) {
+            // An earlier reorg moved us back; this block will be read again
+            fReorg = true;
+            break;
+        }
+        if (!sb.fRead) {
+            throw JSONRPCError(RPC_WALLET_ERROR, strprintf("Failed to read block %s at height %d", sb.pindex->GetBlockHash().ToString(), sb.pindex->GetHeight()));
+        }
+
+        for (size_t i = 0; i < sb.block.vtx.size(); i++) {
+            const CTransaction& tx = sb.block.vtx[i];
+            bool fInvolved = sb.vCandidate[i] || pwallet_->mapWallet.count(tx.GetHash());
+            for (size_t j = 0; !fInvolved && j < tx.vin.size(); j++) {
+                fInvolved = pwallet_->mapWallet.count(tx.vin[j].prevout.hash);
+            }
+            if (fInvolved && pwallet_->AddToWalletIfInvolvingMe(tx, &sb.block, true)) {
+                myTxHashes.push_back(tx.GetHash());
+                txsFound_++;
+            }
+        }
+
+        SproutMerkleTree sproutTree;
+        SaplingMerkleTree saplingTree;
+        // This should never fail: we should always be able to get the tree
+        // state on the path to the tip of our chain
+        assert(pcoinsTip->GetSproutAnchorAt(sb.pindex->hashSproutAnchor, sproutTree));
+        if (sb.pindex->pprev) {
+            if (NetworkUpgradeActive(sb.pindex->pprev->GetHeight(), Params().GetConsensus(), Consensus::UPGRADE_SAPLING)) {
+                assert(pcoinsTip->GetSaplingAnchorAt(sb.pindex->pprev->hashFinalSaplingRoot, saplingTree));
+            }
+        }
+        // Increment note witness caches
+        pwallet_->ChainTip(sb.pindex, &sb.block, sproutTree, saplingTree, true);
+
+        nextHeight_ = sb.pindex->GetHeight() + 1;
+        blocksScanned_++;
+    }
+
+    // Persist Sapling note data that might have changed, e.g. nullifiers.
+    // Do not flush the wallet here for performance reasons.
+    CWalletDB walletdb(pwallet_->strWalletFile, "r+", false);
+    for (auto hash : myTxHashes) {
+        CWalletTx wtx = pwallet_->mapWallet[hash];
+        if (!wtx.mapSaplingNoteData.empty()) {
+            if (!wtx.WriteToDisk(&walletdb)) {
+                LogPrintf("Rescanning... WriteToDisk failed to update Sapling note data for: %s\n", hash.ToString());
+            }
+        }
+    }
+
+    tipHeight_ = chainActive.Height();
+    if (nextHeight_ > chainActive.Height()) {
+        // Caught up: from here on ordinary block connects take over.
+        walletdb.EraseRescanHeight();
+        pwallet_->fAsyncRescanInProgress = false;
+        pwallet_->SetBestChain(chainActive.GetLocator());
+        return true;
+    }
+    walletdb.WriteRescanHeight(nextHeight_);
+    return false;
+}
+
+UniValue AsyncRPCOperation_rescan::getStatus() const {
+    UniValue v = AsyncRPCOperation::getStatus();
+    UniValue obj = v.get_obj();
+    obj.push_back(Pair("method", "z_rescan"));
+    if (!contextinfo_.isNull()) {
+        obj.push_back(Pair("params", contextinfo_));
+    }
+
+    int nHeight = nextHeight_.load();
+    int nTip = tipHeight_.load();
+    int64_t nBlocks = blocksScanned_.load();
+    int64_t nElapsed = isExecuting() ? GetTimeMillis() - nRescanStartMillis.load() : 0;
+
+    UniValue progress(UniValue::VOBJ);
+    progress.push_back(Pair("startheight", startHeight_));
+    progress.push_back(Pair("height", nHeight - 1));
+    progress.push_back(Pair("tipheight", nTip));
+    progress.push_back(Pair("blocks", nBlocks));
+    progress.push_back(Pair("txs", txsFound_.load()));
+    if (nElapsed > 0) {
+        progress.push_back(Pair("blockspersecond", (double)nBlocks * 1000 / nElapsed));
+    }
+    if (nTip >= startHeight_) {
+        progress.push_back(Pair("percent", std::min(100.0, 100.0 * (nHeight - startHeight_) / (nTip - startHeight_ + 1))));
+    }
+    obj.push_back(Pair("progress", progress));
+    return obj;
+}
+
+AsyncRPCOperationId QueueWalletRescan(CWallet* pwallet, int nHeight, bool fReaccept, UniValue contextInfo)
+{
+    if (fRescanQueued.exchange(true)) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "A wallet rescan is already in progress");
+    }
+
+    {
+        // Never skip over blocks an interrupted rescan has not reached yet
+        LOCK(pwallet->cs_wallet);
+        CWalletDB walletdb(pwallet->strWalletFile);
+        int nPending;
+        if (walletdb.ReadRescanHeight(nPending) && nPending < nHeight) {
+            nHeight = nPending;
+        }
+    }
+
+    std::shared_ptr<AsyncRPCQueue> q = getAsyncRPCQueue();
+    std::shared_ptr<AsyncRPCOperation> operation(new AsyncRPCOperation_rescan(pwallet, nHeight, fReaccept, contextInfo));
+    q->addOperation(operation);
+    return operation->getId();
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2017 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/******************************************************************************
+ * Copyright © 2014-2019 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef ASYNCRPCOPERATION_RESCAN_H
+#define ASYNCRPCOPERATION_RESCAN_H
+
+#include "asyncrpcoperation.h"
+#include "primitives/block.h"
+
+#include <vector>
+
+#include <univalue.h>
+
+class CBlockIndex;
+class CWallet;
+
+// Number of blocks read, filtered and committed per step of the pipeline.
+#define RESCAN_DEFAULT_BATCH_SIZE   100
+
+/**
+ * Wallet rescan run on the async RPC queue.
+ *
+ * Blocks flow through three stages: a reader that loads the next batch from
+ * disk while the previous one is being committed, a pool of decoder threads
+ * that deserialize blocks and flag shielded transactions and transparent
+ * outputs that may be ours, and a single commit stage that feeds candidate
+ * transactions to AddToWalletIfInvolvingMe and advances the note witnesses.
+ * cs_main and cs_wallet are only held while a batch is committed. The next
+ * height to scan is persisted after every batch so an interrupted rescan
+ * resumes on the next start.
+ */
+class AsyncRPCOperation_rescan : public AsyncRPCOperation {
+public:
+    AsyncRPCOperation_rescan(CWallet* pwallet, int startHeight, bool fReaccept = false, UniValue contextInfo = NullUniValue);
+    virtual ~AsyncRPCOperation_rescan();
+
+    // We don't want to be copied or moved around
+    AsyncRPCOperation_rescan(AsyncRPCOperation_rescan const&) = delete;             // Copy construct
+    AsyncRPCOperation_rescan(AsyncRPCOperation_rescan&&) = delete;                  // Move construct
+    AsyncRPCOperation_rescan& operator=(AsyncRPCOperation_rescan const&) = delete;  // Copy assign
+    AsyncRPCOperation_rescan& operator=(AsyncRPCOperation_rescan &&) = delete;      // Move assign
+
+    virtual void main();
+
+    virtual UniValue getStatus() const;
+
+private:
+    // A block read from disk together with the decoder's verdict for each
+    // of its transactions.
+    struct ScannedBlock {
+        CBlockIndex* pindex;
+        CBlock block;
+        std::vector<bool> vCandidate;
+        bool fRead;
+    };
+
+    UniValue contextinfo_;     // optional data to include in return value from getStatus()
+
+    CWallet* pwallet_;
+    int startHeight_;
+    bool fReaccept_;           // resubmit unconfirmed wallet transactions once the rescan succeeds
+    int batchSize_;
+
+    // Progress counters, read by getStatus() from other threads
+    std::atomic<int> nextHeight_;
+    std::atomic<int> tipHeight_;
+    std::atomic<int64_t> blocksScanned_;
+    std::atomic<int64_t> txsFound_;
+
+    bool main_impl();
+
+    std::vector<CBlockIndex*> select_batch(int nHeight);
+    std::vector<ScannedBlock> read_batch(const std::vector<CBlockIndex*>& vIndex);
+    bool commit_batch(std::vector<ScannedBlock>& vBlocks, bool& fReorg);
+};
+
+/**
+ * Queue an asynchronous rescan of the active chain from nHeight and return its
+ * operation id. With fReaccept the unconfirmed wallet transactions are offered
+ * to the mempool again once it has succeeded.
+ */
+AsyncRPCOperationId QueueWalletRescan(CWallet* pwallet, int nHeight, bool fReaccept = false, UniValue contextInfo = NullUniValue);
+
+#endif /* ASYNCRPCOPERATION_RESCAN_H */
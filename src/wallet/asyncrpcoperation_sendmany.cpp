@@ -442,6 +442,25 @@ bool AsyncRPCOperation_sendmany::main_impl() {
             ovk = ovkForShieldingFromTaddr(seed);
         }
 
+        // Add Sapling outputs
+        for (auto r : z_outputs_) {
+            auto address = std::get<0>(r);
+            auto value = std::get<1>(r);
+            auto hexMemo = std::get<2>(r);
+
+            auto addr = DecodePaymentAddress(address);
+            assert(boost::get<libzcash::SaplingPaymentAddress>(&addr) != nullptr);
+            auto to = boost::get<libzcash::SaplingPaymentAddress>(addr);
+
+            auto memo = get_memo_from_hex_string(hexMemo);
+
+            builder_.AddSaplingOutput(ovk, to, value, memo);
+        }
+
+        // Recipient amounts are fixed, so their proofs can be created while
+        // the inputs below are selected and witnessed.
+        builder_.PrebuildOutputProofs();
+
         // Set change address if we are using transparent funds
         // TODO: Should we just use fromtaddr_ as the change address?
         if (isfromtaddr_) {
@@ -491,21 +510,6 @@ bool AsyncRPCOperation_sendmany::main_impl() {
             assert(builder_.AddSaplingSpend(expsk, notes[i], anchor, witnesses[i].get()));
         }
 
-        // Add Sapling outputs
-        for (auto r : z_outputs_) {
-            auto address = std::get<0>(r);
-            auto value = std::get<1>(r);
-            auto hexMemo = std::get<2>(r);
-
-            auto addr = DecodePaymentAddress(address);
-            assert(boost::get<libzcash::SaplingPaymentAddress>(&addr) != nullptr);
-            auto to = boost::get<libzcash::SaplingPaymentAddress>(addr);
-
-            auto memo = get_memo_from_hex_string(hexMemo);
-
-            builder_.AddSaplingOutput(ovk, to, value, memo);
-        }
-
         // Add transparent outputs
         for (auto r : t_outputs_) {
             auto outputAddress = std::get<0>(r);
@@ -400,11 +400,22 @@ bool CCryptoKeyStore::AddCryptedKey(const CPubKey &vchPubKey, const std::vector<
         if (!SetCrypted())
             return false;
 
-        mapCryptedKeys[vchPubKey.GetID()] = make_pair(vchPubKey, vchCryptedSecret);
+        CKeyID keyID = vchPubKey.GetID();
+        mapCryptedKeys[keyID] = make_pair(vchPubKey, vchCryptedSecret);
+        AddToOwnedFilter(std::vector<unsigned char>(keyID.begin(), keyID.end()));
     }
     return true;
 }
 
+void CCryptoKeyStore::FillOwnedFilter()
+{
+    CBasicKeyStore::FillOwnedFilter();
+    for (const CryptedKeyMap::value_type& item : mapCryptedKeys) {
+        filterOwned.insert(std::vector<unsigned char>(item.first.begin(), item.first.end()));
+        nOwnedElements++;
+    }
+}
+
 bool CCryptoKeyStore::GetKey(const CKeyID &address, CKey& keyOut) const
 {
     {
@@ -160,6 +160,8 @@ private:
 protected:
     bool SetCrypted();
 
+    void FillOwnedFilter();
+
     //! will encrypt previously unencrypted keys
     bool EncryptKeys(CKeyingMaterial& vMasterKeyIn);
 
@@ -28,6 +28,7 @@
 #include "util.h"
 #include "utiltime.h"
 #include "wallet.h"
+#include "wallet/asyncrpcoperation_rescan.h"
 
 #include <fstream>
 #include <stdint.h>
@@ -148,6 +149,30 @@ UniValue convertpassphrase(const UniValue& params, bool fHelp, const CPubKey& my
     return ret;
 }
 
+/**
+ * Rescan the active chain from pindex after a key import. With -asyncrescan
+ * the rescan is queued as an AsyncRPCOperation and the RPC returns at once.
+ */
+static void RescanAfterImport(CBlockIndex* pindex, const std::string& strMethod, bool fReaccept = false)
+{
+    if (!GetBoolArg("-asyncrescan", false)) {
+        pwalletMain->ScanForWalletTransactions(pindex, true);
+        if (fReaccept)
+            pwalletMain->ReacceptWalletTransactions();
+        return;
+    }
+
+    UniValue contextInfo(UniValue::VOBJ);
+    contextInfo.push_back(Pair("import", strMethod));
+    contextInfo.push_back(Pair("startheight", pindex->GetHeight()));
+    try {
+        AsyncRPCOperationId opid = QueueWalletRescan(pwalletMain, pindex->GetHeight(), fReaccept, contextInfo);
+        LogPrintf("%s: queued rescan from height %d as operation %s\n", strMethod, pindex->GetHeight(), opid);
+    } catch (const UniValue& objError) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "Key imported, but a wallet rescan is already in progress; call z_rescan once it has finished");
+    }
+}
+
 UniValue importprivkey(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (!EnsureWalletIsAvailable(fHelp))
@@ -237,7 +262,7 @@ UniValue importprivkey(const UniValue& params, bool fHelp, const CPubKey& mypk)
         pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
 
         if (fRescan) {
-            pwalletMain->ScanForWalletTransactions(chainActive[height], true);
+            RescanAfterImport(chainActive[height], "importprivkey");
         }
     }
 
@@ -309,8 +334,7 @@ UniValue importaddress(const UniValue& params, bool fHelp, const CPubKey& mypk)
 
         if (fRescan)
         {
-            pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
-            pwalletMain->ReacceptWalletTransactions();
+            RescanAfterImport(chainActive.Genesis(), "importaddress", true);
         }
     }
 
@@ -757,7 +781,7 @@ UniValue z_importkey(const UniValue& params, bool fHelp, const CPubKey& mypk)
     
     // We want to scan for transactions and notes
     if (fRescan) {
-        pwalletMain->ScanForWalletTransactions(chainActive[nRescanHeight], true);
+        RescanAfterImport(chainActive[nRescanHeight], "z_importkey");
     }
 
     return NullUniValue;
@@ -876,11 +900,45 @@ UniValue z_importviewingkey(const UniValue& params, bool fHelp, const CPubKey& m
 
     // We want to scan for transactions and notes
     if (fRescan) {
-        pwalletMain->ScanForWalletTransactions(chainActive[nRescanHeight], true);
+        RescanAfterImport(chainActive[nRescanHeight], "z_importviewingkey");
     }
     return NullUniValue;
 }
 
+UniValue z_rescan(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "z_rescan ( startheight )\n"
+            "\nRescan the block chain for wallet transactions and notes as an asynchronous operation.\n"
+            "The node keeps serving RPC requests while the rescan runs. If the node is stopped before\n"
+            "the rescan completes, it resumes from the last committed height on the next start.\n"
+            "\nArguments:\n"
+            "1. startheight    (numeric, optional, default=0) Block height to start rescanning from\n"
+            "\nResult:\n"
+            "\"operationid\"    (string) An operationid to pass to z_getoperationstatus to follow the progress of the rescan.\n"
+            "\nExamples:\n"
+            + HelpExampleCli("z_rescan", "")
+            + HelpExampleCli("z_rescan", "1000000")
+            + HelpExampleRpc("z_rescan", "1000000")
+        );
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    int nStartHeight = 0;
+    if (params.size() > 0)
+        nStartHeight = params[0].get_int();
+    if (nStartHeight < 0 || nStartHeight > chainActive.Height())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Start height is out of range");
+
+    UniValue contextInfo(UniValue::VOBJ);
+    contextInfo.push_back(Pair("startheight", nStartHeight));
+    return QueueWalletRescan(pwalletMain, nStartHeight, false, contextInfo);
+}
+
 UniValue z_exportkey(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (!EnsureWalletIsAvailable(fHelp))
@@ -28,6 +28,7 @@
 #include "netbase.h"
 #include "rpc/server.h"
 #include "timedata.h"
+#include "metrics.h"
 #include "transaction_builder.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -2811,6 +2812,8 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "  \"unlocked_until\": ttt,      (numeric) the timestamp in seconds since epoch (midnight Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
             "  \"paytxfee\": x.xxxx,         (numeric) the transaction fee configuration, set in " + CURRENCY_UNIT + "/kB\n"
             "  \"seedfp\": \"uint256\",        (string) the BLAKE2b-256 hash of the HD seed\n"
+            "  \"saplingproofs\": xxxx,      (numeric) Sapling spend and output proofs created since startup\n"
+            "  \"saplingproofspersecond\": x.xx, (numeric) Sapling proving throughput while proofs were being created\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getwalletinfo", "")
@@ -2833,6 +2836,8 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     uint256 seedFp = pwalletMain->GetHDChain().seedFp;
     if (!seedFp.IsNull())
          obj.push_back(Pair("seedfp", seedFp.GetHex()));
+    obj.push_back(Pair("saplingproofs", (uint64_t)saplingProofsCreated.get()));
+    obj.push_back(Pair("saplingproofspersecond", provingTimer.rate(saplingProofsCreated)));
     return obj;
 }
 
@@ -3414,6 +3419,19 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
             sample_times.push_back(benchmark_verify_sapling_spend());
         } else if (benchmarktype == "verifysaplingoutput") {
             sample_times.push_back(benchmark_verify_sapling_output());
+#ifndef _WIN32
+        } else if (benchmarktype == "peerload") {
+            if (Params().NetworkIDString() != "regtest") {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Benchmark must be run in regtest mode");
+            }
+            // Number of simulated inbound peers, and bytes each of them sends
+            int nPeers = params.size() >= 3 ? params[2].get_int() : 100;
+            int nBytesPerPeer = params.size() >= 4 ? params[3].get_int() : 64 * 1024;
+            if (nPeers <= 0 || nBytesPerPeer <= 0 || nBytesPerPeer >= (int)MAX_PROTOCOL_MESSAGE_LENGTH) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid peer count or size");
+            }
+            sample_times.push_back(benchmark_peer_load(nPeers, nBytesPerPeer));
+#endif
         } else {
             throw JSONRPCError(RPC_TYPE_ERROR, "Invalid benchmarktype");
         }
@@ -7036,6 +7054,37 @@ UniValue gatewaysprocessed(const UniValue& params, bool fHelp, const CPubKey& my
     return(GatewaysProcessedWithdraws(mypk,bindtxid,coin));
 }
 
+UniValue gatewayswait(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    uint256 bindtxid; uint64_t sequence = 0; int64_t timeout = MAX_RPC_WAIT_SECONDS;
+    if ( fHelp || params.size() < 1 || params.size() > 3 )
+        throw runtime_error(strprintf("gatewayswait bindtxid [sequence [timeout]]\n"
+                            "waits until the pending deposits of mypubkey, the pending withdraws or the processed withdraws of bindtxid\n"
+                            "change after sequence, or timeout seconds (default and at most %d) have passed, then returns the sequence\n"
+                            "of their last change to be passed in the next call\n"
+                            "a waiting call holds an RPC thread, so at most half of the -rpcthreads wait at once; further calls return at once\n" "\n",
+                            MAX_RPC_WAIT_SECONDS));
+    if ( ensure_CCrequirements(EVAL_GATEWAYS) < 0 )
+        throw runtime_error(CC_REQUIREMENTS_MSG);
+    bindtxid = Parseuint256((char *)params[0].get_str().c_str());
+    if ( params.size() >= 2 )
+        sequence = strtoull(params[1].get_str().c_str(), NULL, 10);
+    if ( params.size() == 3 && ((timeout = atoi(params[2].get_str().c_str())) < 0 || timeout > MAX_RPC_WAIT_SECONDS) )
+        throw runtime_error("incorrect timeout\n");
+
+    // wait in steps, so that a shutdown is not held up
+    CPubKey pk = mypk.IsValid() ? mypk : pubkey2pk(Mypubkey());
+    CRPCWaitSlot slot;
+    uint64_t last = GatewaysQueueWait(pk, bindtxid, sequence, 0);
+    for (int64_t i = 0; slot.IsHeld() && last <= sequence && i < timeout && IsRPCRunning(); i++)
+        last = GatewaysQueueWait(pk, bindtxid, sequence, 1000);
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("result", "success"));
+    result.push_back(Pair("sequence", (int64_t)last));
+    return result;
+}
+
 UniValue oracleslist(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if ( fHelp || params.size() > 0 )
@@ -7139,6 +7188,22 @@ UniValue oraclessamples(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return(OracleDataSamples(txid,batonaddr,num));
 }
 
+UniValue oraclessamplesrange(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    uint256 txid; int32_t fromheight,toheight = std::numeric_limits<int32_t>::max(); char *batonaddr;
+    if ( fHelp || params.size() < 3 || params.size() > 4 )
+        throw runtime_error("oraclessamplesrange oracletxid batonaddress fromheight [toheight]\n"
+                            "returns the confirmed samples of the batonaddress in blocks fromheight to toheight, oldest first\n");
+    if ( ensure_CCrequirements(EVAL_ORACLES) < 0 )
+        throw runtime_error(CC_REQUIREMENTS_MSG);
+    txid = Parseuint256((char *)params[0].get_str().c_str());
+    batonaddr = (char *)params[1].get_str().c_str();
+    fromheight = atoi((char *)params[2].get_str().c_str());
+    if ( params.size() == 4 )
+        toheight = atoi((char *)params[3].get_str().c_str());
+    return(OracleDataSamplesRange(txid,batonaddr,fromheight,toheight));
+}
+
 UniValue oraclesdata(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     UniValue result(UniValue::VOBJ); uint256 txid; std::vector<unsigned char> data;
@@ -7588,27 +7653,77 @@ UniValue tokeninfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return(TokenInfo(tokenid));
 }
 
+UniValue tokenholders(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    uint256 tokenid; int32_t count = 0;
+    if ( fHelp || params.size() < 1 || params.size() > 2 )
+        throw runtime_error("tokenholders tokenid [count]\n"
+                            "returns the token CC addresses holding the tokenid with their balances, largest first, upto count of them if count is set\n"
+                            "burned tokens are only counted in the burned total\n");
+    if ( ensure_CCrequirements(EVAL_TOKENS) < 0 )
+        throw runtime_error(CC_REQUIREMENTS_MSG);
+    tokenid = Parseuint256((char *)params[0].get_str().c_str());
+    if ( params.size() == 2 && (count = atoi(params[1].get_str().c_str())) <= 0 )
+        throw runtime_error("incorrect count\n");
+    return(TokenHolders(tokenid, count));
+}
+
 UniValue tokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     uint256 tokenid;
-    if ( fHelp || params.size() > 1 )
-        throw runtime_error("tokenorders [tokenid]\n"
+    if ( fHelp || params.size() > 2 )
+        throw runtime_error("tokenorders [tokenid [depth]]\n"
                             "returns token orders for the tokenid or all available token orders if tokenid is not set\n"
+                            "with depth, returns only the depth best bids and the depth best asks for the tokenid, best prices first\n"
                             "(this rpc supports only fungible tokens)\n" "\n");
     if (ensure_CCrequirements(EVAL_ASSETS) < 0 || ensure_CCrequirements(EVAL_TOKENS) < 0)
         throw runtime_error(CC_REQUIREMENTS_MSG);
-	if (params.size() == 1) {
+	if (params.size() >= 1) {
 		tokenid = Parseuint256((char *)params[0].get_str().c_str());
 		if (tokenid == zeroid) 
 			throw runtime_error("incorrect tokenid\n");
-        return AssetOrders(tokenid, CPubKey(), 0);
+        int32_t depth = 0;
+        if (params.size() == 2 && (depth = atoi(params[1].get_str().c_str())) <= 0)
+            throw runtime_error("incorrect depth\n");
+        return AssetOrders(tokenid, CPubKey(), 0, depth);
 	}
     else {
         // throw runtime_error("no tokenid\n");
-        return AssetOrders(zeroid, CPubKey(), 0);
+        return AssetOrders(zeroid, CPubKey(), 0, 0);
     }
 }
 
+UniValue tokenorderswait(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    uint256 tokenid; uint64_t sequence = 0; int64_t timeout = MAX_RPC_WAIT_SECONDS;
+    if ( fHelp || params.size() > 3 )
+        throw runtime_error(strprintf("tokenorderswait [tokenid [sequence [timeout]]]\n"
+                            "waits until the token orders for the tokenid (or for any token, if tokenid is not set or 0) change after sequence,\n"
+                            "or timeout seconds (default and at most %d) have passed, then returns the sequence of their last change\n"
+                            "to be passed in the next call\n"
+                            "a waiting call holds an RPC thread, so at most half of the -rpcthreads wait at once; further calls return at once\n" "\n",
+                            MAX_RPC_WAIT_SECONDS));
+    if (ensure_CCrequirements(EVAL_ASSETS) < 0 || ensure_CCrequirements(EVAL_TOKENS) < 0)
+        throw runtime_error(CC_REQUIREMENTS_MSG);
+    if (params.size() >= 1)
+        tokenid = Parseuint256((char *)params[0].get_str().c_str());
+    if (params.size() >= 2)
+        sequence = strtoull(params[1].get_str().c_str(), NULL, 10);
+    if (params.size() == 3 && ((timeout = atoi(params[2].get_str().c_str())) < 0 || timeout > MAX_RPC_WAIT_SECONDS))
+        throw runtime_error("incorrect timeout\n");
+
+    // wait in steps, so that a shutdown is not held up
+    CRPCWaitSlot slot;
+    uint64_t last = AssetsBookWait(tokenid, sequence, 0);
+    for (int64_t i = 0; slot.IsHeld() && last <= sequence && i < timeout && IsRPCRunning(); i++)
+        last = AssetsBookWait(tokenid, sequence, 1000);
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("result", "success"));
+    result.push_back(Pair("sequence", (int64_t)last));
+    return result;
+}
+
 
 UniValue mytokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
@@ -7623,7 +7738,7 @@ UniValue mytokenorders(const UniValue& params, bool fHelp, const CPubKey& mypk)
     if (params.size() == 1)
         additionalEvalCode = strtol(params[0].get_str().c_str(), NULL, 0);  // supports also 0xEE-like values
 
-    return AssetOrders(zeroid, Mypubkey(), additionalEvalCode);
+    return AssetOrders(zeroid, Mypubkey(), additionalEvalCode, 0);
 }
 
 UniValue tokenbalance(const UniValue& params, bool fHelp, const CPubKey& mypk)
@@ -8501,6 +8616,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "z_getoperationstatus",     &z_getoperationstatus,     true  },
     { "wallet",             "z_getoperationresult",     &z_getoperationresult,     true  },
     { "wallet",             "z_listoperationids",       &z_listoperationids,       true  },
+    { "wallet",             "z_rescan",                 &z_rescan,                 true  },
     { "wallet",             "z_getnewaddress",          &z_getnewaddress,          true  },
     { "wallet",             "z_listaddresses",          &z_listaddresses,          true  },
     { "wallet",             "z_exportkey",              &z_exportkey,              true  },
@@ -289,6 +289,7 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey &pubkey)
     AssertLockHeld(cs_wallet); // mapKeyMetadata
     if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
         return false;
+    MarkCoinPoolDirty();
 
     // check if we need to remove from watch-only
     CScript script;
@@ -312,6 +313,7 @@ bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
 
     if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
         return false;
+    MarkCoinPoolDirty();
     if (!fFileBacked)
         return true;
     {
@@ -472,6 +474,7 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    MarkCoinPoolDirty();
     if (!fFileBacked)
         return true;
     return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
@@ -497,6 +500,7 @@ bool CWallet::AddWatchOnly(const CScript &dest)
 {
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    MarkCoinPoolDirty();
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
     NotifyWatchonlyChanged(true);
     if (!fFileBacked)
@@ -509,6 +513,7 @@ bool CWallet::RemoveWatchOnly(const CScript &dest)
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
+    MarkCoinPoolDirty();
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
     if (fFileBacked)
@@ -989,13 +994,24 @@ void CWallet::ClearNoteWitnessCache()
     //LogPrintf("Clear witness cache\n");
 }
 
+/**
+ * While an asynchronous rescan is catching up, the notes it has discovered
+ * are witnessed below the block being connected at the tip. Those (and notes
+ * not witnessed yet) are left for the rescan to bring forward.
+ */
+template<typename NoteData>
+bool IsLaggingWitness(const NoteData* nd, int indexHeight, bool fRescanning)
+{
+    return fRescanning && nd->witnessHeight < indexHeight - 1;
+}
+
 template<typename NoteDataMap>
-void CopyPreviousWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize)
+void CopyPreviousWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, bool fRescanning)
 {
     for (auto& item : noteDataMap) {
         auto* nd = &(item.second);
         // Only increment witnesses that are behind the current height
-        if (nd->witnessHeight < indexHeight) {
+        if (nd->witnessHeight < indexHeight && !IsLaggingWitness(nd, indexHeight, fRescanning)) {
             // Check the validity of the cache
             // The only time a note witnessed above the current height
             // would be invalid here is during a reindex when blocks
@@ -1016,22 +1032,27 @@ void CopyPreviousWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nW
     }
 }
 
-template<typename NoteDataMap>
-void AppendNoteCommitment(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const uint256& note_commitment)
+/**
+ * Register every note in noteDataMap whose newest witness must absorb the
+ * commitments of the block at indexHeight.
+ */
+template<typename NoteDataMap, typename NoteData>
+void CollectPendingWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, bool fRescanning, std::set<NoteData*>& pending)
 {
     for (auto& item : noteDataMap) {
         auto* nd = &(item.second);
-        if (nd->witnessHeight < indexHeight && nd->witnesses.size() > 0) {
+        if (nd->witnessHeight < indexHeight && nd->witnesses.size() > 0 && !IsLaggingWitness(nd, indexHeight, fRescanning)) {
             // Check the validity of the cache
             // See comment in CopyPreviousWitnesses about validity.
             assert(nWitnessCacheSize >= nd->witnesses.size());
-            nd->witnesses.front().append(note_commitment);
+            pending.insert(nd);
         }
     }
 }
 
 template<typename OutPoint, typename NoteData, typename Witness>
-void WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const OutPoint& key, const Witness& witness)
+void WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const OutPoint& key, const Witness& witness,
+                       std::set<NoteData*>& pending)
 {
     if (noteDataMap.count(key) && noteDataMap[key].witnessHeight < indexHeight) {
         auto* nd = &(noteDataMap[key]);
@@ -1055,18 +1076,36 @@ void WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeigh
         nd->witnesses.push_front(witness);
         // Set height to one less than pindex so it gets incremented
         nd->witnessHeight = indexHeight - 1;
+        pending.insert(nd);
         // Check the validity of the cache
         assert(nWitnessCacheSize >= nd->witnesses.size());
     }
 }
 
+/**
+ * Bring every pending witness up to the end of the block. The subtrees the
+ * block completes are hashed once in a batch started from the tree before
+ * the block, and each witness takes the ones on its path from there.
+ */
+template<typename NoteData, typename Tree>
+void AppendBlockCommitments(const std::set<NoteData*>& pending, const Tree& treeBefore, const std::vector<uint256>& commitments)
+{
+    if (pending.empty() || commitments.empty())
+        return;
+
+    auto batch = treeBefore.batch();
+    for (const uint256& commitment : commitments)
+        batch.append(commitment);
+    for (NoteData* nd : pending)
+        nd->witnesses.front().append_batch(batch);
+}
 
 template<typename NoteDataMap>
-void UpdateWitnessHeights(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize)
+void UpdateWitnessHeights(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, bool fRescanning)
 {
     for (auto& item : noteDataMap) {
         auto* nd = &(item.second);
-        if (nd->witnessHeight < indexHeight) {
+        if (nd->witnessHeight < indexHeight && !IsLaggingWitness(nd, indexHeight, fRescanning)) {
             nd->witnessHeight = indexHeight;
             // Check the validity of the cache
             // See comment in CopyPreviousWitnesses about validity.
@@ -1081,9 +1120,13 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
                                      SaplingMerkleTree& saplingTree)
 {
     LOCK(cs_wallet);
+    std::set<SproutNoteData*> pendingSprout;
+    std::set<SaplingNoteData*> pendingSapling;
     for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-       ::CopyPreviousWitnesses(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize);
-       ::CopyPreviousWitnesses(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize);
+       ::CopyPreviousWitnesses(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, fAsyncRescanInProgress);
+       ::CopyPreviousWitnesses(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, fAsyncRescanInProgress);
+       ::CollectPendingWitnesses(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, fAsyncRescanInProgress, pendingSprout);
+       ::CollectPendingWitnesses(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, fAsyncRescanInProgress, pendingSapling);
     }
 
     if (nWitnessCacheSize < WITNESS_CACHE_SIZE) {
@@ -1097,6 +1140,13 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
         pblock = &block;
     }
 
+    // Record the block's commitments once; existing witnesses are brought
+    // forward over them in bulk below instead of one append per commitment
+    // per wallet note.
+    SproutMerkleTree sproutTreeBefore = sproutTree;
+    SaplingMerkleTree saplingTreeBefore = saplingTree;
+    std::vector<uint256> sproutCommitments;
+    std::vector<uint256> saplingCommitments;
     for (const CTransaction& tx : pblock->vtx) {
         auto hash = tx.GetHash();
         bool txIsOurs = mapWallet.count(hash);
@@ -1106,16 +1156,13 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
             for (uint8_t j = 0; j < jsdesc.commitments.size(); j++) {
                 const uint256& note_commitment = jsdesc.commitments[j];
                 sproutTree.append(note_commitment);
-
-                // Increment existing witnesses
-                for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-                    ::AppendNoteCommitment(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, note_commitment);
-                }
+                sproutCommitments.push_back(note_commitment);
 
                 // If this is our note, witness it
                 if (txIsOurs) {
                     JSOutPoint jsoutpt {hash, i, j};
-                    ::WitnessNoteIfMine(mapWallet[hash].mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, jsoutpt, sproutTree.witness());
+                    ::WitnessNoteIfMine(mapWallet[hash].mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, jsoutpt, sproutTree.witness(),
+                                        pendingSprout);
                 }
             }
         }
@@ -1123,24 +1170,25 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
         for (uint32_t i = 0; i < tx.vShieldedOutput.size(); i++) {
             const uint256& note_commitment = tx.vShieldedOutput[i].cm;
             saplingTree.append(note_commitment);
-
-            // Increment existing witnesses
-            for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-                ::AppendNoteCommitment(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, note_commitment);
-            }
+            saplingCommitments.push_back(note_commitment);
 
             // If this is our note, witness it
             if (txIsOurs) {
                 SaplingOutPoint outPoint {hash, i};
-                ::WitnessNoteIfMine(mapWallet[hash].mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, outPoint, saplingTree.witness());
+                ::WitnessNoteIfMine(mapWallet[hash].mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, outPoint, saplingTree.witness(),
+                                    pendingSapling);
             }
         }
     }
 
+    // Increment existing witnesses
+    ::AppendBlockCommitments(pendingSprout, sproutTreeBefore, sproutCommitments);
+    ::AppendBlockCommitments(pendingSapling, saplingTreeBefore, saplingCommitments);
+
     // Update witness heights
     for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-        ::UpdateWitnessHeights(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize);
-        ::UpdateWitnessHeights(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize);
+        ::UpdateWitnessHeights(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, fAsyncRescanInProgress);
+        ::UpdateWitnessHeights(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, fAsyncRescanInProgress);
     }
 
     // For performance reasons, we write out the witness cache in
@@ -1149,12 +1197,17 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
 }
 
 template<typename NoteDataMap>
-bool DecrementNoteWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize)
+bool DecrementNoteWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, bool fRescanning)
 {
     extern int32_t KOMODO_REWIND;
 
     for (auto& item : noteDataMap) {
         auto* nd = &(item.second);
+        // Notes an asynchronous rescan has not brought forward yet are
+        // behind the block being removed; the rescan rewinds on its own.
+        if (fRescanning && nd->witnessHeight < indexHeight) {
+            continue;
+        }
         // Only decrement witnesses that are not above the current height
         if (nd->witnessHeight <= indexHeight) {
             // Check the validity of the cache
@@ -1200,9 +1253,9 @@ void CWallet::DecrementNoteWitnesses(const CBlockIndex* pindex)
 {
     LOCK(cs_wallet);
     for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-        if (!::DecrementNoteWitnesses(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize))
+        if (!::DecrementNoteWitnesses(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, fAsyncRescanInProgress))
             needsRescan = true;
-        if (!::DecrementNoteWitnesses(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize))
+        if (!::DecrementNoteWitnesses(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, fAsyncRescanInProgress))
             needsRescan = true;
     }
     if ( WITNESS_CACHE_SIZE == _COINBASE_MATURITY+10 )
@@ -1469,6 +1522,7 @@ void CWallet::MarkDirty()
 {
     {
         LOCK(cs_wallet);
+        MarkCoinPoolDirty();
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
     }
@@ -1600,6 +1654,7 @@ void CWallet::UpdateSaplingNullifierNoteMapForBlock(const CBlock *pblock) {
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb)
 {
     uint256 hash = wtxIn.GetHash();
+    MarkCoinPoolDirty();
 
     if (fFromLoadWallet)
     {
@@ -1893,7 +1948,10 @@ void CWallet::EraseFromWallet(const uint256 &hash)
     {
         LOCK(cs_wallet);
         if (mapWallet.erase(hash))
+        {
+            MarkCoinPoolDirty();
             CWalletDB(strWalletFile).EraseTx(hash);
+        }
     }
     return;
 }
@@ -2208,10 +2266,55 @@ bool CWallet::IsMine(const CTransaction& tx)
     return false;
 }
 
+/**
+ * Cheap pre-check for IsMine(tx, voutNum). The common output templates are
+ * decoded by hand and probed against the keystore's owned filter, so that
+ * outputs paying other wallets are rejected before Solver or any keystore
+ * map lookup runs. Templates not recognised here take the full path.
+ */
+bool CWallet::MayBeMine(const CTransaction& tx, uint32_t voutNum) const
+{
+    const CScript& scriptPubKey = tx.vout[voutNum].scriptPubKey;
+    if (MayHaveWatchOnly(scriptPubKey))
+        return true;
+
+    if (scriptPubKey.IsPayToPublicKeyHash())
+        return MayHaveKey(CKeyID(uint160(valtype(scriptPubKey.begin() + 3, scriptPubKey.begin() + 23))));
+
+    if (scriptPubKey.IsPayToPublicKey())
+        return MayHaveKey(CPubKey(scriptPubKey.begin() + 1, scriptPubKey.begin() + 34).GetID());
+
+    if (scriptPubKey.IsPayToScriptHash())
+    {
+        // a timelocked P2SH can be recognised from the opret that follows it
+        int voutNext = voutNum + 1;
+        if (tx.vout.size() > voutNext &&
+            tx.vout[voutNext].scriptPubKey.size() > 7 &&
+            tx.vout[voutNext].scriptPubKey[0] == OP_RETURN)
+            return true;
+        return MayHaveCScript(CScriptID(uint160(valtype(scriptPubKey.begin() + 2, scriptPubKey.begin() + 22))));
+    }
+
+    std::vector<valtype> vParams;
+    if (scriptPubKey.IsPayToCryptoCondition(NULL, vParams))
+    {
+        // only the first key of the optional CC params can make the output ours
+        if (vParams.empty())
+            return false;
+        COptCCParams p(vParams[0]);
+        return p.IsValid() && p.vKeys.size() > 0 && MayHaveKey(p.vKeys[0].GetID());
+    }
+
+    return true;
+}
+
 // special case handling for non-standard/Verus OP_RETURN script outputs, which need the transaction
 // to determine ownership
 isminetype CWallet::IsMine(const CTransaction& tx, uint32_t voutNum)
 {
+    if (!MayBeMine(tx, voutNum))
+        return ISMINE_NO;
+
     vector<valtype> vSolutions;
     txnouttype whichType;
     const CScriptExt scriptPubKey = CScriptExt(tx.vout[voutNum].scriptPubKey);
@@ -3557,7 +3660,7 @@ const CTxOut& CWallet::FindNonChangeParentOutput(const CWalletTx& tx, int output
     return ptx->vout[n];
 }
 
-static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
+static void ApproximateBestSubset(const vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >& vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
 {
     vector<char> vfIncluded;
 
@@ -3602,11 +3705,84 @@ static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,uns
     }
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, vector<COutput> vCoins,set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+static const int BNB_MAX_TRIES = 100000;
+
+bool SelectCoinsBnB(const vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >& vValue, const CAmount& nTargetValue, const CAmount& nWindow, vector<char>& vfBest, CAmount& nBest)
+{
+    vector<CAmount> vRemaining(vValue.size() + 1, 0);
+    for (int i = (int)vValue.size() - 1; i >= 0; i--)
+        vRemaining[i] = vRemaining[i + 1] + vValue[i].first;
+    if (vRemaining[0] < nTargetValue)
+        return false;
+
+    vector<char> vfIncluded(vValue.size(), false);
+    bool fFound = false;
+    CAmount nTotal = 0;
+    size_t i = 0;
+    for (int nTries = 0; nTries < BNB_MAX_TRIES; nTries++)
+    {
+        bool fBacktrack = false;
+        if (nTotal > nTargetValue + nWindow || nTotal + vRemaining[i] < nTargetValue)
+            fBacktrack = true;
+        else if (nTotal >= nTargetValue)
+        {
+            if (!fFound || nTotal < nBest)
+            {
+                fFound = true;
+                nBest = nTotal;
+                vfBest = vfIncluded;
+                if (nBest == nTargetValue)
+                    break;
+            }
+            fBacktrack = true;
+        }
+        else if (i == vValue.size())
+            fBacktrack = true;
+
+        if (fBacktrack)
+        {
+            // Step back to the last included coin and try omitting it instead
+            while (i > 0 && !vfIncluded[i - 1])
+                i--;
+            if (i == 0)
+                break;
+            i--;
+            vfIncluded[i] = false;
+            nTotal -= vValue[i].first;
+            i++;
+        }
+        else
+        {
+            vfIncluded[i] = true;
+            nTotal += vValue[i].first;
+            i++;
+        }
+    }
+    return fFound;
+}
+
+const std::vector<COutput>& CWallet::GetCoinPool() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    uint256 hashTip = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256();
+    uint64_t nGeneration = nCoinPoolGeneration;
+    if (nCoinPoolBuiltGeneration != nGeneration || hashCoinPoolTip != hashTip)
+    {
+        AvailableCoins(vCoinPool, true, NULL, false, true);
+        sort(vCoinPool.begin(), vCoinPool.end(), [](const COutput& a, const COutput& b) {
+            return a.tx->vout[a.i].nValue > b.tx->vout[b.i].nValue;
+        });
+        nCoinPoolBuiltGeneration = nGeneration;
+        hashCoinPoolTip = hashTip;
+        LogPrint("selectcoins", "GetCoinPool(): rebuilt with %u outputs\n", vCoinPool.size());
+    }
+    return vCoinPool;
+}
+
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const vector<COutput>& vCoins,set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const
 {
-    int32_t count = 0; //uint64_t lowest_interest = 0;
     setCoinsRet.clear();
-    //memset(interests,0,sizeof(interests));
     nValueRet = 0;
     // List of values less than target
     pair<CAmount, pair<const CWalletTx*,unsigned int> > coinLowestLarger;
@@ -3615,8 +3791,6 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
     vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > > vValue;
     CAmount nTotalLower = 0;
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
-
     BOOST_FOREACH(const COutput &output, vCoins)
     {
         if (!output.fSpendable)
@@ -3636,30 +3810,16 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
         {
             setCoinsRet.insert(coin.second);
             nValueRet += coin.first;
-            //if ( KOMODO_EXCHANGEWALLET == 0 )
-            //    *interestp += pcoin->vout[i].interest;
             return true;
         }
         else if (n < nTargetValue + CENT)
         {
             vValue.push_back(coin);
             nTotalLower += n;
-            //if ( KOMODO_EXCHANGEWALLET == 0 && count < sizeof(interests)/sizeof(*interests) )
-            //{
-                //LogPrintf("count.%d %.8f\n",count,(double)pcoin->vout[i].interest/COIN);
-                //interests[count++] = pcoin->vout[i].interest;
-            //}
-            if ( nTotalLower > 4*nTargetValue + CENT )
-            {
-                //LogPrintf("why bother with all the utxo if we have double what is needed?\n");
-                break;
-            }
         }
         else if (n < coinLowestLarger.first)
         {
             coinLowestLarger = coin;
-            //if ( KOMODO_EXCHANGEWALLET == 0 )
-            //    lowest_interest = pcoin->vout[i].interest;
         }
     }
 
@@ -3669,8 +3829,6 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
         {
             setCoinsRet.insert(vValue[i].second);
             nValueRet += vValue[i].first;
-            //if ( KOMODO_EXCHANGEWALLET == 0 && i < count )
-            //    *interestp += interests[i];
         }
         return true;
     }
@@ -3681,47 +3839,62 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
             return false;
         setCoinsRet.insert(coinLowestLarger.second);
         nValueRet += coinLowestLarger.first;
-        //if ( KOMODO_EXCHANGEWALLET == 0 )
-        //    *interestp += lowest_interest;
         return true;
     }
 
-    // Solve subset sum by stochastic approximation
-    sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
+    if (!is_sorted(vValue.rbegin(), vValue.rend(), CompareValueOnly()))
+        sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
     vector<char> vfBest;
     CAmount nBest;
 
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
-    if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
-
-    // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
-    //                                   or the next bigger coin is closer), return the bigger coin
-    if (coinLowestLarger.second.first &&
-        ((nBest != nTargetValue && nBest < nTargetValue + CENT) || coinLowestLarger.first <= nBest))
+    // Look for a changeless solution first: any excess below the dust threshold
+    // of a change output is added to the fee by CreateTransaction anyway.
+    CScript scriptDummyChange = GetScriptForDestination(CKeyID());
+    CAmount nChangeWindow = CTxOut(0, scriptDummyChange).GetDustThreshold(::minRelayTxFee);
+    if (SelectCoinsBnB(vValue, nTargetValue, nChangeWindow, vfBest, nBest))
     {
-        setCoinsRet.insert(coinLowestLarger.second);
-        nValueRet += coinLowestLarger.first;
-        //if ( KOMODO_EXCHANGEWALLET == 0 )
-        //    *interestp += lowest_interest;
+        LogPrint("selectcoins", "SelectCoins() branch and bound: total %s\n", FormatMoney(nBest));
     }
-    else {
-        for (unsigned int i = 0; i < vValue.size(); i++)
-            if (vfBest[i])
-            {
-                setCoinsRet.insert(vValue[i].second);
-                nValueRet += vValue[i].first;
-                //if ( KOMODO_EXCHANGEWALLET == 0 && i < count )
-                //    *interestp += interests[i];
-            }
-
-        LogPrint("selectcoins", "SelectCoins() best subset: ");
-        for (unsigned int i = 0; i < vValue.size(); i++)
-            if (vfBest[i])
-                LogPrint("selectcoins", "%s", FormatMoney(vValue[i].first));
-        LogPrint("selectcoins", "total %s\n", FormatMoney(nBest));
+    else
+    {
+        // Use a random subset of the small coins, at most about four times the target
+        random_shuffle(vValue.begin(), vValue.end(), GetRandInt);
+        size_t nUsed = 0;
+        nTotalLower = 0;
+        while (nUsed < vValue.size() && nTotalLower <= 4*nTargetValue + CENT)
+            nTotalLower += vValue[nUsed++].first;
+        vValue.resize(nUsed);
+        sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
+
+        // Solve subset sum by stochastic approximation
+        ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
+        if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
+            ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
+
+        // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
+        //                                   or the next bigger coin is closer), return the bigger coin
+        if (coinLowestLarger.second.first &&
+            ((nBest != nTargetValue && nBest < nTargetValue + CENT) || coinLowestLarger.first <= nBest))
+        {
+            setCoinsRet.insert(coinLowestLarger.second);
+            nValueRet += coinLowestLarger.first;
+            return true;
+        }
     }
 
+    for (unsigned int i = 0; i < vValue.size(); i++)
+        if (vfBest[i])
+        {
+            setCoinsRet.insert(vValue[i].second);
+            nValueRet += vValue[i].first;
+        }
+
+    LogPrint("selectcoins", "SelectCoins() best subset: ");
+    for (unsigned int i = 0; i < vValue.size(); i++)
+        if (vfBest[i])
+            LogPrint("selectcoins", "%s", FormatMoney(vValue[i].first));
+    LogPrint("selectcoins", "total %s\n", FormatMoney(nBest));
+
     return true;
 }
 
@@ -3734,9 +3907,16 @@ bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*
     //    interestp = &tmp;
     //    *interestp = 0;
     //}
+    // Both views are filtered from the cached pool rather than by walking mapWallet twice
     vector<COutput> vCoinsNoCoinbase, vCoinsWithCoinbase;
-    AvailableCoins(vCoinsNoCoinbase, true, coinControl, false, false);
-    AvailableCoins(vCoinsWithCoinbase, true, coinControl, false, true);
+    BOOST_FOREACH(const COutput& out, GetCoinPool())
+    {
+        if (coinControl && coinControl->HasSelected() && !coinControl->IsSelected(out.tx->GetHash(), out.i))
+            continue;
+        vCoinsWithCoinbase.push_back(out);
+        if (!out.tx->IsCoinBase())
+            vCoinsNoCoinbase.push_back(out);
+    }
     fOnlyCoinbaseCoinsRet = vCoinsNoCoinbase.size() == 0 && vCoinsWithCoinbase.size() > 0;
 
     // If coinbase utxos can only be sent to zaddrs, exclude any coinbase utxos from coin selection.
@@ -3947,6 +4127,9 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
         LOCK2(cs_main, cs_wallet);
         {
             nFeeRet = 0;
+            // Inputs chosen on an earlier fee iteration, kept while they still cover the higher fee
+            set<pair<const CWalletTx*,unsigned int> > setCoinsPrev;
+            CAmount nValueInPrev = 0;
             while (true)
             {
                 //interest = 0;
@@ -3998,7 +4181,12 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                 bool fOnlyCoinbaseCoins = false;
                 bool fNeedCoinbaseCoins = false;
                 interest2 = 0;
-                if (!SelectCoins(nTotalValue, setCoins, nValueIn, fOnlyCoinbaseCoins, fNeedCoinbaseCoins, coinControl))
+                if (!setCoinsPrev.empty() && nValueInPrev >= nTotalValue)
+                {
+                    setCoins = setCoinsPrev;
+                    nValueIn = nValueInPrev;
+                }
+                else if (!SelectCoins(nTotalValue, setCoins, nValueIn, fOnlyCoinbaseCoins, fNeedCoinbaseCoins, coinControl))
                 {
                     if (fOnlyCoinbaseCoins && Params().GetConsensus().fCoinbaseMustBeProtected) {
                         strFailReason = _("Coinbase funds can only be sent to a zaddr");
@@ -4009,6 +4197,8 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                     }
                     return false;
                 }
+                setCoinsPrev = setCoins;
+                nValueInPrev = nValueIn;
                 BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
                 {
                     CAmount nCredit = pcoin.first->vout[pcoin.second].nValue;
@@ -4838,18 +5028,21 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    MarkCoinPoolDirty();
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    MarkCoinPoolDirty();
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    MarkCoinPoolDirty();
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
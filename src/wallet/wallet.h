@@ -42,6 +42,7 @@
 #include "base58.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -758,6 +759,14 @@ private:
 };
 
 
+/**
+ * Depth-first branch and bound search for a subset of vValue (sorted by
+ * descending value) whose sum lies in [nTargetValue, nTargetValue + nWindow].
+ * Such a subset needs no change output. Returns the one wasting the least
+ * over the target, or false if none is found within a bounded number of steps.
+ */
+bool SelectCoinsBnB(const std::vector<std::pair<CAmount, std::pair<const CWalletTx*,unsigned int> > >& vValue, const CAmount& nTargetValue, const CAmount& nWindow, std::vector<char>& vfBest, CAmount& nBest);
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -788,6 +797,18 @@ private:
      */
     typedef TxSpendMap<COutPoint> TxSpends;
     TxSpends mapTxSpends;
+    /**
+     * Spendable transparent outputs in descending value order, shared by coin
+     * selection across calls. GetCoinPool() rebuilds it once the wallet has
+     * changed (see MarkCoinPoolDirty) or the chain tip has moved. Mempool
+     * changes that touch the wallet reach it through SyncTransaction.
+     */
+    mutable std::vector<COutput> vCoinPool;
+    mutable uint64_t nCoinPoolBuiltGeneration = 0;
+    mutable uint256 hashCoinPoolTip;
+    std::atomic<uint64_t> nCoinPoolGeneration{1};
+
+    const std::vector<COutput>& GetCoinPool() const;
     /**
      * Used to keep track of spent Notes, and
      * detect and report conflicts (double-spends).
@@ -809,6 +830,12 @@ public:
      */
     int64_t nWitnessCacheSize;
     bool needsRescan = false;
+    /*
+     * Set while an AsyncRPCOperation_rescan is catching up with the tip.
+     * Notes it has discovered are witnessed below the tip and are left for
+     * the rescan to bring forward.
+     */
+    bool fAsyncRescanInProgress = false;
 
     void ClearNoteWitnessCache();
 
@@ -1033,7 +1060,7 @@ public:
      */
     const CTxOut& FindNonChangeParentOutput(const CWalletTx& tx, int output) const;
 
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
     bool IsSproutSpent(const uint256& nullifier) const;
@@ -1172,6 +1199,8 @@ public:
     TxItems OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount = "");
 
     void MarkDirty();
+    //! Invalidate the cached coin selection pool; cheap, call on any change to spendable outputs
+    void MarkCoinPoolDirty() { nCoinPoolGeneration++; }
     bool UpdateNullifierNoteMap();
     void UpdateNullifierNoteMapWithTx(const CWalletTx& wtx);
     void UpdateSaplingNullifierNoteMapWithTx(CWalletTx& wtx);
@@ -1244,6 +1273,7 @@ public:
     isminetype IsMine(const CTxIn& txin) const;
     CAmount GetDebit(const CTxIn& txin, const isminefilter& filter) const;
     isminetype IsMine(const CTxOut& txout) const;
+    bool MayBeMine(const CTransaction& tx, uint32_t voutNum) const;
     isminetype IsMine(const CTransaction& tx, uint32_t voutNum);
     CAmount GetCredit(const CTxOut& txout, const isminefilter& filter) const;
     bool IsChange(const CTxOut& txout) const;
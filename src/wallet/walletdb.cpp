@@ -261,6 +261,23 @@ bool CWalletDB::WriteWitnessCacheSize(int64_t nWitnessCacheSize)
     return Write(std::string("witnesscachesize"), nWitnessCacheSize);
 }
 
+bool CWalletDB::WriteRescanHeight(int nHeight)
+{
+    nWalletDBUpdated++;
+    return Write(std::string("rescanheight"), nHeight);
+}
+
+bool CWalletDB::ReadRescanHeight(int& nHeight)
+{
+    return Read(std::string("rescanheight"), nHeight);
+}
+
+bool CWalletDB::EraseRescanHeight()
+{
+    nWalletDBUpdated++;
+    return Erase(std::string("rescanheight"));
+}
+
 bool CWalletDB::ReadPool(int64_t nPool, CKeyPool& keypool)
 {
     return Read(std::make_pair(std::string("pool"), nPool), keypool);
@@ -167,6 +167,10 @@ public:
 
     bool WriteWitnessCacheSize(int64_t nWitnessCacheSize);
 
+    bool WriteRescanHeight(int nHeight);
+    bool ReadRescanHeight(int& nHeight);
+    bool EraseRescanHeight();
+
     bool ReadPool(int64_t nPool, CKeyPool& keypool);
     bool WritePool(int64_t nPool, const CKeyPool& keypool);
     bool ErasePool(int64_t nPool);
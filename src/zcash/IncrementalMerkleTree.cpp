@@ -348,6 +348,110 @@ void IncrementalWitness<Depth, Hash>::append(Hash obj) {
     }
 }
 
+template<size_t Depth, typename Hash>
+void IncrementalWitness<Depth, Hash>::append_batch(const IncrementalMerkleBatch<Depth, Hash>& batch) {
+    if (batch.empty()) {
+        return;
+    }
+
+    uint64_t position = tree.size() - 1;
+    uint64_t size = batch.size();
+
+    // The uncle subtrees to the right of our path, lowest first: those the
+    // batch completes go to filled, the first one it only starts becomes
+    // the cursor.
+    while (true) {
+        size_t depth = tree.next_depth(filled.size());
+        if (depth >= Depth) {
+            break;
+        }
+        uint64_t begin = ((position >> depth) + 1) << depth;
+        uint64_t end = begin + ((uint64_t)1 << depth);
+
+        if (end <= size) {
+            filled.push_back(batch.node(depth, begin >> depth));
+            cursor = boost::none;
+            cursor_depth = depth;
+            continue;
+        }
+
+        if (begin < size) {
+            // Lay out the partial subtree the way appending its leaves would.
+            uint64_t last = size - 1;
+            uint64_t offset = last - begin;
+            IncrementalMerkleTree<Depth, Hash> partial;
+            if (offset & 1) {
+                partial.left = batch.node(0, last - 1);
+                partial.right = batch.node(0, last);
+            } else {
+                partial.left = batch.node(0, last);
+            }
+            for (size_t d = 1; (offset >> d) != 0; d++) {
+                if ((offset >> d) & 1) {
+                    partial.parents.push_back(batch.node(d, (last >> d) - 1));
+                } else {
+                    partial.parents.push_back(boost::none);
+                }
+            }
+            cursor = partial;
+            cursor_depth = depth;
+        }
+        break;
+    }
+}
+
+template<size_t Depth, typename Hash>
+IncrementalMerkleBatch<Depth, Hash>::IncrementalMerkleBatch(const IncrementalMerkleTree<Depth, Hash>& tree) {
+    start_size = tree_size = tree.size();
+
+    // Keep the complete subtrees the next commitments get combined with:
+    // the left siblings on the path of the next position.
+    for (size_t d = 0; d < Depth; d++) {
+        if (((tree_size >> d) & 1) == 0) {
+            continue;
+        }
+        std::pair<size_t, uint64_t> key(d, (tree_size >> d) - 1);
+        if (d == 0) {
+            nodes[key] = *tree.left;
+        } else if (tree_size & (((uint64_t)1 << d) - 1)) {
+            nodes[key] = *tree.parents[d - 1];
+        } else {
+            // The subtree ending with the last commitment, which the tree
+            // only combines on its next append.
+            Hash root = Hash::combine(*tree.left, *tree.right, 0);
+            for (size_t i = 0; i + 1 < d; i++) {
+                root = Hash::combine(*tree.parents[i], root, i + 1);
+            }
+            nodes[key] = root;
+        }
+    }
+}
+
+template<size_t Depth, typename Hash>
+void IncrementalMerkleBatch<Depth, Hash>::append(Hash obj) {
+    if (tree_size >= ((uint64_t)1 << Depth)) {
+        throw std::runtime_error("tree is full");
+    }
+
+    uint64_t position = tree_size++;
+    nodes[std::make_pair((size_t)0, position)] = obj;
+
+    Hash combined = obj;
+    for (size_t d = 0; d < Depth && ((position >> d) & 1); d++) {
+        combined = Hash::combine(node(d, (position >> d) - 1), combined, d);
+        nodes[std::make_pair(d + 1, position >> (d + 1))] = combined;
+    }
+}
+
+template<size_t Depth, typename Hash>
+Hash IncrementalMerkleBatch<Depth, Hash>::node(size_t depth, uint64_t index) const {
+    typename std::map<std::pair<size_t, uint64_t>, Hash>::const_iterator it = nodes.find(std::make_pair(depth, index));
+    if (it == nodes.end()) {
+        throw std::runtime_error("subtree is not part of the batch");
+    }
+    return it->second;
+}
+
 template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH, SHA256Compress>;
 template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, SHA256Compress>;
 
@@ -360,4 +464,9 @@ template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, Pede
 template class IncrementalWitness<SAPLING_INCREMENTAL_MERKLE_TREE_DEPTH, PedersenHash>;
 template class IncrementalWitness<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, PedersenHash>;
 
+template class IncrementalMerkleBatch<INCREMENTAL_MERKLE_TREE_DEPTH, SHA256Compress>;
+template class IncrementalMerkleBatch<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, SHA256Compress>;
+template class IncrementalMerkleBatch<SAPLING_INCREMENTAL_MERKLE_TREE_DEPTH, PedersenHash>;
+template class IncrementalMerkleBatch<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, PedersenHash>;
+
 } // end namespace `libzcash`
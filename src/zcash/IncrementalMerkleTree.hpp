@@ -3,6 +3,7 @@
 
 #include <array>
 #include <deque>
+#include <map>
 #include <boost/optional.hpp>
 #include <boost/static_assert.hpp>
 
@@ -82,10 +83,14 @@ bool operator==(const EmptyMerkleRoots<Depth, Hash>& a,
 template<size_t Depth, typename Hash>
 class IncrementalWitness;
 
+template<size_t Depth, typename Hash>
+class IncrementalMerkleBatch;
+
 template<size_t Depth, typename Hash>
 class IncrementalMerkleTree {
 
 friend class IncrementalWitness<Depth, Hash>;
+friend class IncrementalMerkleBatch<Depth, Hash>;
 
 public:
     BOOST_STATIC_ASSERT(Depth >= 1);
@@ -110,6 +115,10 @@ public:
         return IncrementalWitness<Depth, Hash>(*this);
     }
 
+    IncrementalMerkleBatch<Depth, Hash> batch() const {
+        return IncrementalMerkleBatch<Depth, Hash>(*this);
+    }
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -180,6 +189,11 @@ public:
 
     void append(Hash obj);
 
+    // Same as appending every commitment of the batch in turn, but reuses the
+    // subtree roots the batch has already computed. The witness must be up to
+    // date with the tree the batch was started from.
+    void append_batch(const IncrementalMerkleBatch<Depth, Hash>& batch);
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -213,6 +227,36 @@ bool operator==(const IncrementalWitness<Depth, Hash>& a,
             a.cursor_depth == b.cursor_depth);
 }
 
+// Commitments appended to a tree, together with the root of every subtree
+// they complete, so that any number of witnesses of that tree can be brought
+// forward over them without each hashing them again.
+template<size_t Depth, typename Hash>
+class IncrementalMerkleBatch {
+public:
+    // Starts after the last commitment of tree.
+    IncrementalMerkleBatch(const IncrementalMerkleTree<Depth, Hash>& tree);
+
+    void append(Hash obj);
+
+    // Size of the tree including the batch.
+    uint64_t size() const {
+        return tree_size;
+    }
+
+    bool empty() const {
+        return tree_size == start_size;
+    }
+
+    // Root of the complete subtree at the given depth (0 for a leaf) and
+    // index, if the batch completed it or appends next to it.
+    Hash node(size_t depth, uint64_t index) const;
+
+private:
+    uint64_t start_size;
+    uint64_t tree_size;
+    std::map<std::pair<size_t, uint64_t>, Hash> nodes;
+};
+
 class SHA256Compress : public uint256 {
 public:
     SHA256Compress() : uint256() {}
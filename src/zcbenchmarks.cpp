@@ -3,6 +3,9 @@
 #include <map>
 #include <thread>
 #include <unistd.h>
+#ifndef _WIN32
+#include <poll.h>
+#endif
 #include <boost/filesystem.hpp>
 
 #include "coins.h"
@@ -17,7 +20,10 @@
 #include "consensus/validation.h"
 #include "main.h"
 #include "miner.h"
+#include "net.h"
+#include "netbase.h"
 #include "pow.h"
+#include "protocol.h"
 #include "rpc/server.h"
 #include "script/sign.h"
 #include "sodium.h"
@@ -634,3 +640,99 @@ double benchmark_verify_sapling_output()
     }
     return timer_stop(tv_start);
 }
+
+#ifndef _WIN32
+/**
+ * Open nPeers loopback connections to our own listening port and have each
+ * send nBytesPerPeer bytes of a message that never completes, so nothing
+ * reaches the message handler. Measures how long the socket handler takes to
+ * accept all of them and read everything.
+ */
+double benchmark_peer_load(size_t nPeers, size_t nBytesPerPeer)
+{
+    CService addrLocal(CNetAddr("127.0.0.1"), GetListenPort());
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!addrLocal.GetSockAddr((struct sockaddr*)&sockaddr, &len))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Could not build listening address");
+
+    // The header promises one byte more than is ever sent.
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << CMessageHeader(Params().MessageStart(), "benchmark", nBytesPerPeer + 1);
+    std::vector<char> vData(ssHeader.begin(), ssHeader.end());
+    vData.resize(vData.size() + nBytesPerPeer, 'b');
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+
+    std::vector<struct pollfd> vPoll;
+    std::vector<size_t> vSent;
+    std::set<unsigned short> setPorts;
+    for (size_t i = 0; i < nPeers; i++) {
+        SOCKET hSocket = socket(((struct sockaddr*)&sockaddr)->sa_family, SOCK_STREAM, IPPROTO_TCP);
+        if (hSocket == INVALID_SOCKET)
+            break;
+        SetSocketNonBlocking(hSocket, true);
+        if (connect(hSocket, (struct sockaddr*)&sockaddr, len) == SOCKET_ERROR && WSAGetLastError() != WSAEINPROGRESS) {
+            CloseSocket(hSocket);
+            break;
+        }
+        struct sockaddr_storage sockaddrBound;
+        socklen_t lenBound = sizeof(sockaddrBound);
+        CService addrBound;
+        if (getsockname(hSocket, (struct sockaddr*)&sockaddrBound, &lenBound) == 0 && addrBound.SetSockAddr((struct sockaddr*)&sockaddrBound))
+            setPorts.insert(addrBound.GetPort());
+        struct pollfd pfd;
+        pfd.fd = hSocket;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        vPoll.push_back(pfd);
+        vSent.push_back(0);
+    }
+
+    // Push everything out, then wait for the node to have read it all.
+    uint64_t nExpected = (uint64_t)vData.size() * vPoll.size();
+    int64_t nDeadline = GetTimeMillis() + 60 * 1000;
+    size_t nPending = vPoll.size();
+    while (nPending > 0 && GetTimeMillis() < nDeadline) {
+        if (poll(&vPoll[0], vPoll.size(), 100) < 0)
+            break;
+        for (size_t i = 0; i < vPoll.size(); i++) {
+            if (vPoll[i].fd < 0 || !(vPoll[i].revents & (POLLOUT | POLLERR | POLLHUP)))
+                continue;
+            int nBytes = send(vPoll[i].fd, &vData[vSent[i]], vData.size() - vSent[i], MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (nBytes > 0)
+                vSent[i] += nBytes;
+            if ((nBytes < 0 && WSAGetLastError() != WSAEWOULDBLOCK) || vSent[i] == vData.size()) {
+                vPoll[i].events = 0;
+                vPoll[i].fd = ~vPoll[i].fd; // negative: poll() skips it
+                nPending--;
+            }
+        }
+    }
+
+    uint64_t nReceived = 0;
+    while (GetTimeMillis() < nDeadline) {
+        nReceived = 0;
+        {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodes)
+                if (pnode->fInbound && setPorts.count(pnode->addr.GetPort()))
+                    nReceived += pnode->nRecvBytes;
+        }
+        if (nReceived >= nExpected)
+            break;
+        MilliSleep(1);
+    }
+    double elapsed = timer_stop(tv_start);
+
+    for (size_t i = 0; i < vPoll.size(); i++) {
+        SOCKET hSocket = vPoll[i].fd < 0 ? ~vPoll[i].fd : vPoll[i].fd;
+        CloseSocket(hSocket);
+    }
+    if (vPoll.size() < nPeers || nReceived < nExpected)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("Only %u of %u peers connected, %u of %u bytes received",
+                                                         vPoll.size(), nPeers, nReceived, nExpected));
+    return elapsed;
+}
+#endif
@@ -23,5 +23,6 @@ extern double benchmark_create_sapling_spend();
 extern double benchmark_create_sapling_output();
 extern double benchmark_verify_sapling_spend();
 extern double benchmark_verify_sapling_output();
+extern double benchmark_peer_load(size_t nPeers, size_t nBytesPerPeer);
 
 #endif